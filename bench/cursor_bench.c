@@ -0,0 +1,241 @@
+#include "cursor_set.h"
+#include "text_buffer.h"
+#include "undo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_EDITS 20000
+#define BENCH_CURSORS 32
+#define BENCH_TEXT 4096
+
+static const char *bench_names[] = {"split buffer", "piece table", "rope"};
+static long bench_mismatches;
+
+/*
+the slow way round: the text as a plain string and the cursors as a sorted
+array, edited one cursor at a time the way a single cursor would be
+*/
+typedef struct bench_model_t {
+	char text[BENCH_TEXT * 2];
+	long length;
+	long offsets[BENCH_CURSORS * 2];
+	long count;
+} bench_model_t;
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static void bench_merge(bench_model_t *model) {
+	long count = 0;
+	for (long i = 0; i < model->count; i++) {
+		if (!count || model->offsets[i] != model->offsets[count - 1]) {
+			model->offsets[count++] = model->offsets[i];
+		}
+	}
+	model->count = count;
+}
+
+static void bench_add(bench_model_t *model, long offset) {
+	long i = model->count;
+	while (i > 0 && model->offsets[i - 1] > offset) {
+		model->offsets[i] = model->offsets[i - 1];
+		i--;
+	}
+	model->offsets[i] = offset;
+	model->count++;
+	bench_merge(model);
+}
+
+// from the last cursor back, so the cursors before it don't move
+static void bench_insert(bench_model_t *model, const char *data, long length) {
+	for (long i = model->count - 1; i >= 0; i--) {
+		long offset = model->offsets[i];
+		memmove(&model->text[offset + length], &model->text[offset],
+		    model->length - offset);
+		memcpy(&model->text[offset], data, length);
+		model->length += length;
+		for (long j = i; j < model->count; j++) {
+			model->offsets[j] += length;
+		}
+	}
+}
+
+// removes the byte at offset, pulling back every cursor after it
+static void bench_cut(bench_model_t *model, long offset) {
+	memmove(&model->text[offset], &model->text[offset + 1],
+	    model->length - offset - 1);
+	model->length--;
+	for (long j = 0; j < model->count; j++) {
+		if (model->offsets[j] > offset) {
+			model->offsets[j]--;
+		}
+	}
+}
+
+static void bench_remove(bench_model_t *model) {
+	for (long i = model->count - 1; i >= 0; i--) {
+		if (model->offsets[i] > 0) {
+			bench_cut(model, model->offsets[i] - 1);
+		}
+	}
+	bench_merge(model);
+}
+
+static void bench_delete(bench_model_t *model) {
+	for (long i = model->count - 1; i >= 0; i--) {
+		if (model->offsets[i] < model->length) {
+			bench_cut(model, model->offsets[i]);
+		}
+	}
+	bench_merge(model);
+}
+
+static void bench_move(bench_model_t *model, long distance) {
+	for (long i = 0; i < model->count; i++) {
+		long offset = model->offsets[i] + distance;
+		model->offsets[i] = offset < 0              ? 0
+		                    : offset > model->length ? model->length
+		                                             : offset;
+	}
+	bench_merge(model);
+}
+
+static int bench_same(text_buffer_t *buffer, const cursor_set_t *set,
+    const bench_model_t *model) {
+	char *string = text_buffer_to_string(buffer);
+	int same = string != NULL && text_buffer_size(buffer) == model->length &&
+	           memcmp(string, model->text, model->length) == 0 &&
+	           set->count == model->count &&
+	           memcmp(set->offsets, model->offsets,
+	               model->count * sizeof(long)) == 0 &&
+	           (!set->count ||
+	               text_buffer_cursor(buffer) == set->offsets[set->count - 1]);
+	free(string);
+	return same;
+}
+
+/*
+cursors a few bytes apart are backspaced and deleted into each other until
+they land on the same spot and merge, then typed at. the edits are made as one
+batch on the buffer and one cursor at a time on the model, and the text,
+cursors and buffer cursor have to agree after each.
+*/
+static void bench_backend(text_buffer_backend_t backend) {
+	static const char *text = "the quick brown fox jumps over the lazy dog\n";
+	const char *name = bench_names[backend];
+	text_buffer_t buffer;
+	undo_journal_t journal;
+	cursor_set_t set;
+	bench_model_t model = {.length = 0, .count = 0};
+	while (model.length + 44 <= BENCH_TEXT / 2) {
+		memcpy(&model.text[model.length], text, 44);
+		model.length += 44;
+	}
+	model.text[model.length] = '\0';
+	if (text_buffer_create(&buffer, backend, model.text) != NO_ERROR ||
+	    undo_journal_create(&journal, 0) != NO_ERROR ||
+	    cursor_set_create(&set) != NO_ERROR) {
+		printf("%s: failed to create the buffer\n", name);
+		bench_mismatches++;
+		return;
+	}
+
+	srand(42);
+	long merged = 0;
+	double elapsed = 0.0;
+	for (long i = 0; i < BENCH_EDITS; i++) {
+		long before = model.count;
+		double start = bench_time();
+		int action = rand() % 8;
+		if (!model.count || (action == 0 && model.count < BENCH_CURSORS)) {
+			long offset = rand() % (model.length + 1);
+			cursor_set_add(&set, offset);
+			bench_add(&model, offset);
+			cursor_set_move(&set, &buffer, 0);
+		} else if (action == 1 && model.length < BENCH_TEXT) {
+			long length = rand() % 4 + 1;
+			cursor_set_insert(&set, &journal, &buffer, text, length);
+			bench_insert(&model, text, length);
+		} else if (action == 2 || action == 3) {
+			cursor_set_remove(&set, &journal, &buffer);
+			bench_remove(&model);
+		} else if (action == 4) {
+			cursor_set_delete(&set, &journal, &buffer);
+			bench_delete(&model);
+		} else if (action == 5) {
+			long distance = rand() % 9 - 4;
+			cursor_set_move(&set, &buffer, distance);
+			bench_move(&model, distance);
+		} else if (action == 6 && model.length < BENCH_TEXT) {
+			cursor_set_insert(&set, &journal, &buffer, "x", 1);
+			bench_insert(&model, "x", 1);
+		} else if (rand() % 64 == 0) {
+			cursor_set_clear(&set);
+			model.count = 0;
+		}
+		elapsed += bench_time() - start;
+		merged += before - model.count > 0 ? before - model.count : 0;
+
+		if (!bench_same(&buffer, &set, &model)) {
+			if (bench_mismatches++ < 10) {
+				printf("%s: text or cursors wrong after edit %ld\n", name, i);
+			}
+		}
+	}
+
+	printf("%-12s %d edits in %.2f ms, %ld cursors merged, %ld bytes left\n",
+	    name, BENCH_EDITS, elapsed * 1000.0, merged, model.length);
+
+	cursor_set_destroy(&set);
+	undo_journal_destroy(&journal);
+	text_buffer_destroy(&buffer);
+}
+
+// three cursors backspaced onto the same spot become one and type once
+static void bench_overlap(text_buffer_backend_t backend) {
+	const char *name = bench_names[backend];
+	text_buffer_t buffer;
+	undo_journal_t journal;
+	cursor_set_t set;
+	text_buffer_create(&buffer, backend, "abcdef");
+	undo_journal_create(&journal, 0);
+	cursor_set_create(&set);
+	cursor_set_add(&set, 2);
+	cursor_set_add(&set, 3);
+	cursor_set_add(&set, 4);
+	cursor_set_move(&set, &buffer, 0);
+
+	cursor_set_remove(&set, &journal, &buffer);
+	cursor_set_remove(&set, &journal, &buffer);
+	cursor_set_insert(&set, &journal, &buffer, "X", 1);
+
+	char *string = text_buffer_to_string(&buffer);
+	if (string == NULL || strcmp(string, "Xef") != 0 || set.count != 1 ||
+	    set.offsets[0] != 1 || text_buffer_cursor(&buffer) != 1) {
+		printf("%s: overlapping cursors left \"%s\" with %ld cursors\n", name,
+		    string, set.count);
+		bench_mismatches++;
+	}
+	free(string);
+
+	cursor_set_destroy(&set);
+	undo_journal_destroy(&journal);
+	text_buffer_destroy(&buffer);
+}
+
+int main(void) {
+	for (int backend = SPLIT_BUFFER_BACKEND; backend <= ROPE_BACKEND;
+	    backend++) {
+		bench_overlap(backend);
+		bench_backend(backend);
+	}
+
+	printf("%ld mismatches\n", bench_mismatches);
+	return bench_mismatches > 0;
+}
@@ -0,0 +1,118 @@
+#include "edit_log.h"
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BYTES (10L * 1024L * 1024L)
+#define BENCH_KEYSTROKES 20000
+// roughly a fast typist, so group commits have something to group
+#define BENCH_PAUSE_NS 1000000
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// types into the middle of the file, timing only the edit itself, which is
+// all the render loop waits on
+static void bench_typing(
+    text_buffer_backend_t backend, const char *name, const char *path, int log) {
+	file_io_t io;
+	file_io_create(&io, FILE_IO_POSIX);
+	int fd = open(path, O_RDONLY);
+	text_buffer_t buffer;
+	text_buffer_load(&buffer, backend, &io, fd, BENCH_BYTES);
+	file_io_destroy(&io);
+	text_buffer_move(&buffer, BENCH_BYTES / 2 - text_buffer_cursor(&buffer));
+	char log_path[] = "/tmp/edit_log_benchXXXXXX";
+	close(mkstemp(log_path));
+	unlink(log_path);
+	edit_log_t edits;
+	if (log) {
+		edit_log_start(&edits, log_path, fd, &buffer);
+	}
+
+	static double times[BENCH_KEYSTROKES];
+	struct timespec pause = {0, BENCH_PAUSE_NS};
+	for (int i = 0; i < BENCH_KEYSTROKES; i++) {
+		double start = bench_time();
+		if (i % 8 == 7) {
+			text_buffer_remove(&buffer);
+		} else {
+			text_buffer_append(&buffer, 'a' + i % 26);
+		}
+		times[i] = bench_time() - start;
+		nanosleep(&pause, NULL);
+	}
+	long commits = log ? edits.commits : 0;
+	if (log) {
+		edit_log_stop(&edits);
+	}
+	qsort(times, BENCH_KEYSTROKES, sizeof(double), bench_compare);
+	double total = 0.0;
+	for (int i = 0; i < BENCH_KEYSTROKES; i++) {
+		total += times[i];
+	}
+	printf("  %-14s %-8s %8.2f %8.2f %8.2f %8ld\n", name, log ? "logged" : "none",
+	    total / BENCH_KEYSTROKES * 1e6, times[BENCH_KEYSTROKES * 99 / 100] * 1e6,
+	    times[BENCH_KEYSTROKES - 1] * 1e6, commits);
+	text_buffer_destroy(&buffer);
+	close(fd);
+}
+
+// what logging would cost if every keystroke were synced on its own
+static void bench_sync_each(void) {
+	char path[] = "/tmp/edit_log_benchXXXXXX";
+	int fd = mkstemp(path);
+	double times[200];
+	char record[33] = {0};
+	for (int i = 0; i < 200; i++) {
+		double start = bench_time();
+		pwrite(fd, record, sizeof(record), i * sizeof(record));
+		fdatasync(fd);
+		times[i] = bench_time() - start;
+	}
+	qsort(times, 200, sizeof(double), bench_compare);
+	printf("  %-23s %8.2f %8.2f %8.2f %8d\n", "sync per keystroke",
+	    times[100] * 1e6, times[198] * 1e6, times[199] * 1e6, 200);
+	close(fd);
+	unlink(path);
+}
+
+int main(void) {
+	char path[] = "/tmp/edit_log_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *text = malloc(BENCH_BYTES);
+	for (long i = 0; i < BENCH_BYTES; i++) {
+		text[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+	}
+	write(fd, text, BENCH_BYTES);
+	close(fd);
+	free(text);
+
+	printf("%d keystrokes %d ms apart, us per keystroke on the editing thread\n",
+	    BENCH_KEYSTROKES, BENCH_PAUSE_NS / 1000000);
+	printf("  %-23s %8s %8s %8s %8s\n", "", "mean", "p99", "worst", "syncs");
+	bench_typing(SPLIT_BUFFER_BACKEND, "split buffer", path, 0);
+	bench_typing(SPLIT_BUFFER_BACKEND, "split buffer", path, 1);
+	bench_typing(ROPE_BACKEND, "rope", path, 0);
+	bench_typing(ROPE_BACKEND, "rope", path, 1);
+	bench_typing(PIECE_TABLE_BACKEND, "piece table", path, 0);
+	bench_typing(PIECE_TABLE_BACKEND, "piece table", path, 1);
+	bench_sync_each();
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include "encoding.h"
+#include "file_manager.h"
+#include "text_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BYTES (64L * 1024L * 1024L)
+#define BENCH_CHUNK (1024L * 1024L)
+#define BENCH_ROUNDS 4
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+// plain ascii lines, or every fourth character two or three bytes long. both
+// fit latin-1 except the euro signs, which come back as ?
+static long bench_fill(char *text, int mixed) {
+	static const char *wide[] = {"\xc3\xa9", "\xe2\x82\xac"};
+	long i = 0;
+	for (long k = 0; i < BENCH_BYTES - 4; k++) {
+		if (mixed && k % 4 == 3) {
+			const char *c = wide[k / 4 % 2];
+			long length = strlen(c);
+			memcpy(&text[i], c, length);
+			i += length;
+		} else {
+			text[i++] = k % 80 == 79 ? '\n' : 'a' + k % 26;
+		}
+	}
+	return i;
+}
+
+static long bench_encode(encoding_t encoding, const char *in, long length,
+    char *out) {
+	encoding_state_t state;
+	encoding_begin(&state, encoding, 0);
+	long written = 0;
+	for (long i = 0; i < length; i += BENCH_CHUNK) {
+		long chunk = length - i < BENCH_CHUNK ? length - i : BENCH_CHUNK;
+		written += encoding_encode(&state, &in[i], chunk, &out[written]);
+	}
+	return written + encoding_encode_end(&state, &out[written]);
+}
+
+static long bench_decode(encoding_t encoding, const char *in, long length,
+    char *out) {
+	encoding_state_t state;
+	encoding_begin(&state, encoding, 0);
+	long written = 0;
+	for (long i = 0; i < length; i += BENCH_CHUNK) {
+		long chunk = length - i < BENCH_CHUNK ? length - i : BENCH_CHUNK;
+		written += encoding_decode(&state, &in[i], chunk, &out[written]);
+	}
+	return written + encoding_decode_end(&state, &out[written]);
+}
+
+// GB/s of the utf-8 side, the text as it is in the buffer
+static void report(const char *name, long length, double elapsed, double copy) {
+	double bytes = (double)length * BENCH_ROUNDS;
+	printf("  %-18s %6.2f GB/s  (%.2fx memcpy)\n", name, bytes / elapsed / 1e9,
+	    copy / elapsed);
+}
+
+// a whole file opened through the decoder and saved back through the encoder
+static void bench_file(encoding_t encoding, const char *raw, long length) {
+	char path[] = "/tmp/encoding_benchXXXXXX";
+	close(mkstemp(path));
+	FILE *file = fopen(path, "wb");
+	fwrite(raw, 1, length, file);
+	fclose(file);
+
+	int handle;
+	double start = bench_time();
+	file_manager_open(path, ROPE_BACKEND, &handle);
+	double opened = bench_time() - start;
+	text_buffer_t *buffer = file_manager_buffer(handle);
+	text_buffer_insert(buffer, "saved\n", 6);
+	start = bench_time();
+	file_manager_save(handle);
+	double saved = bench_time() - start;
+	printf("  %-18s open %7.2f ms, save %7.2f ms, %ld MB\n",
+	    encoding_name(encoding), opened * 1e3, saved * 1e3, length >> 20);
+	file_manager_close(handle);
+	unlink(path);
+}
+
+// what reading and writing a file that isn't utf-8 costs next to copying it
+int main(void) {
+	const encoding_t encodings[] = {
+	    ENCODING_UTF16LE, ENCODING_UTF16BE, ENCODING_LATIN1};
+	char *text = malloc(BENCH_BYTES);
+	char *raw = malloc(ENCODING_ROOM(BENCH_BYTES));
+	char *copy = malloc(ENCODING_ROOM(BENCH_BYTES));
+	long sink = 0;
+	file_manager_startup();
+	for (int mixed = 0; mixed < 2; mixed++) {
+		long length = bench_fill(text, mixed);
+		printf("%s\n", mixed ? "a quarter non-ascii" : "ascii");
+		// once untimed, so the copy isn't paying for faulting its pages in
+		memcpy(copy, text, length);
+		memcpy(raw, text, length);
+
+		double start = bench_time();
+		for (int i = 0; i < BENCH_ROUNDS; i++) {
+			memcpy(copy, text, length);
+			sink += copy[i];
+		}
+		double copied = bench_time() - start;
+		report("memcpy", length, copied, copied);
+
+		for (int e = 0; e < 3; e++) {
+			char name[32];
+			long encoded = 0;
+			start = bench_time();
+			for (int i = 0; i < BENCH_ROUNDS; i++) {
+				encoded = bench_encode(encodings[e], text, length, raw);
+			}
+			snprintf(name, sizeof(name), "%s encode",
+			    encoding_name(encodings[e]));
+			report(name, length, bench_time() - start, copied);
+
+			start = bench_time();
+			for (int i = 0; i < BENCH_ROUNDS; i++) {
+				sink += bench_decode(encodings[e], raw, encoded, copy);
+			}
+			snprintf(name, sizeof(name), "%s decode",
+			    encoding_name(encodings[e]));
+			report(name, length, bench_time() - start, copied);
+		}
+		for (int e = 0; e < 3; e++) {
+			long encoded = bench_encode(encodings[e], text, length, raw);
+			bench_file(encodings[e], raw, encoded);
+		}
+	}
+
+	printf("  checksum %ld\n", sink);
+	file_manager_shutdown();
+	free(copy);
+	free(raw);
+	free(text);
+	return 0;
+}
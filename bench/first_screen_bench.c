@@ -0,0 +1,109 @@
+#include "file_manager.h"
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BLOCK (1024L * 1024L)
+#define BENCH_RUNS 3
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench_drop(const char *path) {
+	int fd = open(path, O_RDONLY);
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static void bench_write(const char *path, long length) {
+	char *block = malloc(BENCH_BLOCK);
+	for (long i = 0; i < BENCH_BLOCK; i++) {
+		block[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+	}
+	FILE *file = fopen(path, "wb");
+	for (long written = 0; written < length; written += BENCH_BLOCK) {
+		fwrite(block, 1, BENCH_BLOCK, file);
+	}
+	fclose(file);
+	free(block);
+}
+
+/*
+median ms until the first screen is in the buffer, and until all of it is.
+opened all at once both are the same, opened in the background the first is
+the open returning and the rest is polled for like a frame would.
+*/
+static void bench_open(const char *path, text_buffer_backend_t backend,
+    int background, int cold, double *first, double *all) {
+	double firsts[BENCH_RUNS];
+	double alls[BENCH_RUNS];
+	struct timespec pause = {0, 1000000};
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		if (cold) {
+			bench_drop(path);
+		}
+		int handle;
+		result_t res;
+		double start = bench_time();
+		if (background) {
+			file_manager_open_background(path, backend, &handle);
+			firsts[i] = bench_time() - start;
+			while (!file_manager_loaded(handle, &res)) {
+				nanosleep(&pause, NULL);
+			}
+		} else {
+			file_manager_open(path, backend, &handle);
+			firsts[i] = bench_time() - start;
+		}
+		alls[i] = bench_time() - start;
+		file_manager_close(handle);
+	}
+	qsort(firsts, BENCH_RUNS, sizeof(double), bench_compare);
+	qsort(alls, BENCH_RUNS, sizeof(double), bench_compare);
+	*first = firsts[BENCH_RUNS / 2] * 1e3;
+	*all = alls[BENCH_RUNS / 2] * 1e3;
+}
+
+int main(void) {
+	// the backends the app picks for files of these sizes
+	const long sizes[] = {2L << 20, 32L << 20};
+	const text_buffer_backend_t backends[] = {
+	    SPLIT_BUFFER_BACKEND, ROPE_BACKEND};
+	const char *names[] = {"split buffer", "rope"};
+	file_manager_startup();
+
+	printf("%-14s %6s %6s %14s %14s %14s\n", "backend", "MB", "cache",
+	    "all at once", "first screen", "streamed");
+	for (int i = 0; i < 2; i++) {
+		char path[] = "/tmp/first_screen_benchXXXXXX";
+		close(mkstemp(path));
+		bench_write(path, sizes[i]);
+		for (int cold = 0; cold < 2; cold++) {
+			double first;
+			double all;
+			double whole;
+			bench_open(path, backends[i], 0, cold, &first, &whole);
+			bench_open(path, backends[i], 1, cold, &first, &all);
+			printf("%-14s %6ld %6s %11.2f ms %11.3f ms %11.2f ms\n", names[i],
+			    sizes[i] >> 20, cold ? "cold" : "warm", whole, first, all);
+		}
+		unlink(path);
+	}
+
+	file_manager_shutdown();
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "file_manager.h"
+#include "text_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FILES 500
+#define BENCH_BYTES (64L * 1024L)
+#define BENCH_LOOKUPS 100000
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static void bench_write(const char *path, long length) {
+	FILE *file = fopen(path, "wb");
+	for (long i = 0; i < length; i++) {
+		fputc(i % 64 == 63 ? '\n' : 'a' + i % 26, file);
+	}
+	fclose(file);
+}
+
+static void bench_wait_saves(const int *handles, int count) {
+	struct timespec pause = {0, 100000};
+	long written;
+	long length;
+	for (int i = 0; i < count; i++) {
+		while (file_manager_saving(handles[i], &written, &length)) {
+			nanosleep(&pause, NULL);
+		}
+	}
+}
+
+// every file stays open, so each open, lookup and switch is against all of
+// them at once
+int main(void) {
+	char directory[] = "/tmp/handle_benchXXXXXX";
+	mkdtemp(directory);
+	static char paths[BENCH_FILES][64];
+	static int handles[BENCH_FILES];
+	for (int i = 0; i < BENCH_FILES; i++) {
+		sprintf(paths[i], "%s/file%d.txt", directory, i);
+		bench_write(paths[i], BENCH_BYTES);
+	}
+	file_manager_startup();
+
+	double start = bench_time();
+	for (int i = 0; i < BENCH_FILES; i++) {
+		file_manager_open(paths[i], SPLIT_BUFFER_BACKEND, &handles[i]);
+	}
+	double opened = bench_time() - start;
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_FILES; i++) {
+		file_manager_close(handles[i]);
+	}
+	for (int i = 0; i < BENCH_FILES; i++) {
+		file_manager_open_background(
+		    paths[i], SPLIT_BUFFER_BACKEND, &handles[i]);
+	}
+	double handed = bench_time() - start;
+	struct timespec pause = {0, 100000};
+	for (int i = 0; i < BENCH_FILES; i++) {
+		result_t res;
+		while (!file_manager_loaded(handles[i], &res)) {
+			nanosleep(&pause, NULL);
+		}
+	}
+	double loaded = bench_time() - start;
+
+	// opening an open file again is a lookup, not a read
+	start = bench_time();
+	long found = 0;
+	for (int i = 0; i < BENCH_LOOKUPS; i++) {
+		int handle;
+		file_manager_open(
+		    paths[i % BENCH_FILES], SPLIT_BUFFER_BACKEND, &handle);
+		found += handle == handles[i % BENCH_FILES];
+	}
+	double lookup = (bench_time() - start) / BENCH_LOOKUPS;
+
+	// switching is picking another buffer, its text is already there
+	start = bench_time();
+	long size = 0;
+	for (int i = 0; i < BENCH_LOOKUPS; i++) {
+		size += text_buffer_size(file_manager_buffer(handles[i % BENCH_FILES]));
+	}
+	double swap = (bench_time() - start) / BENCH_LOOKUPS;
+
+	// every file saved at once, queued on the one writer thread
+	for (int i = 0; i < BENCH_FILES; i++) {
+		text_buffer_insert(file_manager_buffer(handles[i]), "saved\n", 6);
+	}
+	start = bench_time();
+	for (int i = 0; i < BENCH_FILES; i++) {
+		file_manager_save_background(handles[i]);
+	}
+	double queued = bench_time() - start;
+	bench_wait_saves(handles, BENCH_FILES);
+	double saved = bench_time() - start;
+
+	printf("%d files of %ld KB open at once\n", BENCH_FILES, BENCH_BYTES >> 10);
+	printf("  open, one after another   %10.2f ms\n", opened * 1e3);
+	printf("  open in the background    %10.2f ms handed off, %.2f ms loaded\n",
+	    handed * 1e3, loaded * 1e3);
+	printf("  open of an open file      %10.2f us, %ld of %d found\n",
+	    lookup * 1e6, found, BENCH_LOOKUPS);
+	printf("  switch                    %10.3f us, %ld bytes\n", swap * 1e6,
+	    size / BENCH_LOOKUPS);
+	printf("  save all in the background %9.2f ms handed off, "
+	    "%.2f ms written\n", queued * 1e3, saved * 1e3);
+
+	for (int i = 0; i < BENCH_FILES; i++) {
+		file_manager_close(handles[i]);
+		unlink(paths[i]);
+	}
+	file_manager_shutdown();
+	rmdir(directory);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "file_manager.h"
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BYTES (256L * 1024L * 1024L)
+#define BENCH_BLOCK (4L * 1024L * 1024L)
+#define BENCH_RUNS 3
+#define BENCH_STATS 4096
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench_drop(const char *path) {
+	int fd = open(path, O_RDONLY);
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+// median ms to open path into a backend, from the page cache or the disk
+static double bench_open(
+    const char *path, text_buffer_backend_t backend, int cold) {
+	double times[BENCH_RUNS];
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		if (cold) {
+			bench_drop(path);
+		}
+		int handle;
+		double start = bench_time();
+		file_manager_open(path, backend, &handle);
+		times[i] = bench_time() - start;
+		file_manager_close(handle);
+	}
+	qsort(times, BENCH_RUNS, sizeof(double), bench_compare);
+	return times[BENCH_RUNS / 2] * 1e3;
+}
+
+static double bench_save(const text_buffer_t *buffer, int durable) {
+	char path[] = "/tmp/io_bench_saveXXXXXX";
+	close(mkstemp(path));
+	double times[BENCH_RUNS];
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		double start = bench_time();
+		file_manager_write(buffer, path, durable);
+		times[i] = bench_time() - start;
+		bench_drop(path);
+	}
+	unlink(path);
+	qsort(times, BENCH_RUNS, sizeof(double), bench_compare);
+	return times[BENCH_RUNS / 2] * 1e3;
+}
+
+// what a keystroke at the prompt costs the main thread, the lookup it starts
+// is waited on outside the timing like frames would
+static double bench_stats(const char *path) {
+	double spent = 0.0;
+	long size;
+	int directory;
+	for (int i = 0; i < BENCH_STATS; i++) {
+		double start = bench_time();
+		file_manager_prefetch(i % 2 ? path : "/tmp/io_bench_missing");
+		spent += bench_time() - start;
+		while (!file_manager_prefetched(&size, &directory)) {
+		}
+	}
+	return spent / BENCH_STATS * 1e6;
+}
+
+int main(void) {
+	char path[] = "/tmp/io_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *block = malloc(BENCH_BLOCK);
+	srand(42);
+	long length = 0;
+	while (length < BENCH_BLOCK - 128) {
+		length += sprintf(&block[length], "line %d of some log output\n", rand());
+	}
+	memset(&block[length], '\n', BENCH_BLOCK - length);
+	for (long i = 0; i < BENCH_BYTES / BENCH_BLOCK; i++) {
+		if (write(fd, block, BENCH_BLOCK) != BENCH_BLOCK) {
+			printf("failed to write %s\n", path);
+			unlink(path);
+			return 1;
+		}
+	}
+	close(fd);
+	free(block);
+
+	file_manager_startup();
+	printf("%ld MB file, ms\n", BENCH_BYTES >> 20);
+	printf("  %-9s %9s %9s %9s %9s %9s %9s %9s\n", "", "split", "cold",
+	    "rope", "cold", "save", "durable", "prompt us");
+	file_io_engine_t engines[] = {FILE_IO_POSIX, FILE_IO_URING};
+	for (int e = 0; e < 2; e++) {
+		if (file_manager_use_engine(engines[e]) != NO_ERROR) {
+			printf("  %-9s unavailable\n", e ? "io_uring" : "posix");
+			continue;
+		}
+		double split = bench_open(path, SPLIT_BUFFER_BACKEND, 0);
+		double split_cold = bench_open(path, SPLIT_BUFFER_BACKEND, 1);
+		double rope = bench_open(path, ROPE_BACKEND, 0);
+		double rope_cold = bench_open(path, ROPE_BACKEND, 1);
+
+		int handle;
+		file_manager_open(path, ROPE_BACKEND, &handle);
+		double save = bench_save(file_manager_buffer(handle), 0);
+		double durable = bench_save(file_manager_buffer(handle), 1);
+		file_manager_close(handle);
+
+		printf("  %-9s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.2f\n",
+		    file_manager_engine(), split, split_cold, rope, rope_cold, save,
+		    durable, bench_stats(path));
+	}
+	file_manager_shutdown();
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,196 @@
+#include "line_index.h"
+#include "text_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LINES 100000
+#define BENCH_ROUNDS 4
+// edits made between one index and the next
+#define BENCH_EDITS 500
+#define BENCH_SAMPLES 2000
+
+static const char *bench_names[] = {"split buffer", "piece table", "rope"};
+static long bench_mismatches;
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static void bench_mismatch(const char *name, long round, const char *what,
+    long at, long got, long expected) {
+	if (bench_mismatches++ < 10) {
+		printf("%s: round %ld %s %ld gave %ld, not %ld\n", name, round, what,
+		    at, got, expected);
+	}
+}
+
+// lines of 0 to 80 bytes, so some are empty and some newlines are back to back
+static char *bench_text(long *length) {
+	char *text = malloc(BENCH_LINES * 81L + 1);
+	long written = 0;
+	for (long i = 0; i < BENCH_LINES; i++) {
+		long width = rand() % 81;
+		for (long j = 0; j < width; j++) {
+			text[written++] = 'a' + (i + j) % 26;
+		}
+		text[written++] = '\n';
+	}
+	text[written] = '\0';
+	*length = written;
+	return text;
+}
+
+// a mix of pastes with and without newlines and deletes across lines
+static void bench_edit(text_buffer_t *buffer) {
+	static const char *pastes[] = {"x", "\n", "two\nlines\n", "\n\n\n", "tail"};
+	for (long i = 0; i < BENCH_EDITS; i++) {
+		long size = text_buffer_size(buffer);
+		long start = rand() % (size + 1);
+		if (rand() % 2) {
+			long distance = start - text_buffer_cursor(buffer);
+			if (distance) {
+				text_buffer_move(buffer, distance);
+			}
+			const char *paste = pastes[rand() % 5];
+			text_buffer_insert(buffer, paste, strlen(paste));
+		} else {
+			long end = start + rand() % 200;
+			text_buffer_delete_range(buffer, start, end > size ? size : end);
+		}
+	}
+}
+
+// the last line start at or before offset, from every line start found naively
+static long bench_line_of(const long *starts, long count, long offset) {
+	long low = 0;
+	long high = count - 1;
+	while (low < high) {
+		long middle = (low + high + 1) / 2;
+		if (starts[middle] <= offset) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+
+static void bench_check(text_buffer_t *buffer, line_index_t *index,
+    const char *name, long round) {
+	long size = text_buffer_size(buffer);
+	char *text = text_buffer_to_string(buffer);
+	long *starts = malloc((size + 1) * sizeof(long));
+	long count = 0;
+	starts[count++] = 0;
+	for (long i = 0; i < size; i++) {
+		if (text[i] == '\n') {
+			starts[count++] = i + 1;
+		}
+	}
+
+	int done;
+	long lines = line_index_line_count(index, &done);
+	long buffer_lines = text_buffer_line_count(buffer);
+	if (!done || lines != count || buffer_lines != count) {
+		printf("%s: round %ld counted %ld lines in the index and %ld in the "
+		       "buffer, not %ld\n",
+		    name, round, lines, buffer_lines, count);
+		bench_mismatches++;
+	}
+
+	// every line near the start and either side of each mark, then a sample
+	for (long line = 0; line < count; line++) {
+		long stride = line % LINE_INDEX_STRIDE;
+		if (line >= 3 * LINE_INDEX_STRIDE && stride > 1 &&
+		    stride < LINE_INDEX_STRIDE - 1 && rand() % (count / 1000 + 1)) {
+			continue;
+		}
+		long start = line_index_line_start(index, line);
+		if (start != starts[line]) {
+			bench_mismatch(
+			    name, round, "line start", line, start, starts[line]);
+		}
+	}
+	long past = line_index_line_start(index, count + 5);
+	if (past != starts[count - 1]) {
+		bench_mismatch(name, round, "line start", count + 5, past,
+		    starts[count - 1]);
+	}
+
+	for (long i = 0; i < BENCH_SAMPLES; i++) {
+		long offset = i == 0 ? size : rand() % (size + 1);
+		long line = line_index_line_of(index, offset);
+		long expected = bench_line_of(starts, count, offset);
+		if (line != expected) {
+			bench_mismatch(
+			    name, round, "line of offset", offset, line, expected);
+		}
+	}
+
+	free(starts);
+	free(text);
+}
+
+/*
+edits the buffer between rounds and indexes it again each time, the way the
+viewer does after a reload, then checks the index against every line start
+found by scanning the text one byte at a time
+*/
+static void bench_backend(text_buffer_backend_t backend) {
+	const char *name = bench_names[backend];
+	srand(42);
+	long length;
+	char *text = bench_text(&length);
+	text_buffer_t buffer;
+	if (text_buffer_create(&buffer, backend, text) != NO_ERROR) {
+		printf("%s: failed to create the buffer\n", name);
+		bench_mismatches++;
+		free(text);
+		return;
+	}
+	free(text);
+
+	for (long round = 0; round < BENCH_ROUNDS; round++) {
+		if (round) {
+			bench_edit(&buffer);
+		}
+
+		line_index_t index;
+		double start = bench_time();
+		if (line_index_create(&index, &buffer) != NO_ERROR) {
+			printf("%s: failed to create the line index\n", name);
+			bench_mismatches++;
+			break;
+		}
+		int done = 0;
+		while (!done) {
+			line_index_line_count(&index, &done);
+			if (!done) {
+				nanosleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+			}
+		}
+		double elapsed = bench_time() - start;
+
+		bench_check(&buffer, &index, name, round);
+		printf("%-12s round %ld: indexed %ld lines in %.2f ms\n", name, round,
+		    line_index_line_count(&index, &done), elapsed * 1000.0);
+		line_index_destroy(&index);
+	}
+
+	text_buffer_destroy(&buffer);
+}
+
+int main(void) {
+	for (int backend = SPLIT_BUFFER_BACKEND; backend <= ROPE_BACKEND;
+	    backend++) {
+		bench_backend(backend);
+	}
+
+	printf("%ld mismatches\n", bench_mismatches);
+	return bench_mismatches > 0;
+}
@@ -0,0 +1,115 @@
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BYTES (1024L * 1024L * 1024L)
+#define BENCH_BLOCK (4L * 1024L * 1024L)
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_open(const char *path, int cold) {
+	int fd = open(path, O_RDONLY);
+	// drops the file from the page cache so the disk has to be read again
+	if (cold) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return fd;
+}
+
+// what the disk or page cache can deliver, nothing done with the bytes
+static double bench_read(const char *path, int cold) {
+	char *block = malloc(BENCH_BLOCK);
+	int fd = bench_open(path, cold);
+	double start = bench_time();
+	long total = 0;
+	long bytes;
+	while ((bytes = read(fd, block, BENCH_BLOCK)) > 0) {
+		total += bytes;
+	}
+	double elapsed = bench_time() - start;
+	close(fd);
+	free(block);
+	return total / elapsed / 1e6;
+}
+
+// the old way, the whole file read into one string and copied again
+static double bench_copy(const char *path, int cold) {
+	int fd = bench_open(path, cold);
+	double start = bench_time();
+	FILE *file = fdopen(fd, "r");
+	char *string = malloc(BENCH_BYTES + 1);
+	long length = fread(string, 1, BENCH_BYTES, file);
+	string[length] = '\0';
+	text_buffer_t buffer;
+	text_buffer_create(&buffer, SPLIT_BUFFER_BACKEND, string);
+	free(string);
+	double elapsed = bench_time() - start;
+	fclose(file);
+	text_buffer_destroy(&buffer);
+	return length / elapsed / 1e6;
+}
+
+static double bench_load(
+    const char *path, text_buffer_backend_t backend, int cold) {
+	file_io_t io;
+	file_io_create(&io, FILE_IO_POSIX);
+	int fd = bench_open(path, cold);
+	double start = bench_time();
+	text_buffer_t buffer;
+	text_buffer_load(&buffer, backend, &io, fd, BENCH_BYTES);
+	double elapsed = bench_time() - start;
+	close(fd);
+	file_io_destroy(&io);
+	long size = text_buffer_size(&buffer);
+	text_buffer_destroy(&buffer);
+	return size / elapsed / 1e6;
+}
+
+int main(void) {
+	char path[] = "/tmp/load_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *block = malloc(BENCH_BLOCK);
+	srand(42);
+	long length = 0;
+	while (length < BENCH_BLOCK - 128) {
+		length += sprintf(&block[length], "line %d of some log output\n", rand());
+	}
+	memset(&block[length], '\n', BENCH_BLOCK - length);
+	for (long i = 0; i < BENCH_BYTES / BENCH_BLOCK; i++) {
+		if (write(fd, block, BENCH_BLOCK) != BENCH_BLOCK) {
+			printf("failed to write %s\n", path);
+			unlink(path);
+			return 1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	free(block);
+
+	printf("%ld MB file, MB/s\n", BENCH_BYTES >> 20);
+	printf("  %-24s %10s %10s\n", "", "cached", "cold");
+	// the first pass only warms the cache
+	bench_read(path, 0);
+	printf("  %-24s %10.0f %10.0f\n", "read only", bench_read(path, 0),
+	    bench_read(path, 1));
+	printf("  %-24s %10.0f %10.0f\n", "read and copy", bench_copy(path, 0),
+	    bench_copy(path, 1));
+	printf("  %-24s %10.0f %10.0f\n", "split buffer load",
+	    bench_load(path, SPLIT_BUFFER_BACKEND, 0),
+	    bench_load(path, SPLIT_BUFFER_BACKEND, 1));
+	printf("  %-24s %10.0f %10.0f\n", "rope load",
+	    bench_load(path, ROPE_BACKEND, 0), bench_load(path, ROPE_BACKEND, 1));
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "regex.h"
+#include "text_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (64L * 1024L * 1024L)
+// edits spread over the buffer so matches have to cross span boundaries
+#define BENCH_EDITS 256
+
+static const char *patterns[] = {
+    "ERROR request 1",
+    "ERROR request \\d+ served in 9\\d\\dms",
+    "^2024-05-1\\d 12:00:\\d\\d WARN",
+    "(?i)error request 7",
+    // backtracks forever in a backtracking engine
+    "(x+x+)+y",
+    // a full dfa for this is 2^14 states, the cache has to keep flushing
+    "[0-4][^\\n]{13}x",
+};
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static char *bench_log(void) {
+	static const char *levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+	char *text = malloc(BENCH_BYTES + 1);
+	long length = 0;
+	srand(42);
+	while (length < BENCH_BYTES - 128) {
+		length += sprintf(&text[length],
+		    "2024-05-%02d 12:%02d:%02d %s request %d served in %dms\n",
+		    rand() % 28 + 1, rand() % 60, rand() % 60, levels[rand() % 4],
+		    rand(), rand() % 1000);
+	}
+	// a run of x's for the pathological pattern to chew on
+	memset(&text[length], 'x', BENCH_BYTES - length);
+	text[BENCH_BYTES] = '\0';
+	return text;
+}
+
+static void bench_backend(text_buffer_backend_t backend, const char *name,
+    const char *text) {
+	text_buffer_t buffer;
+	text_buffer_create(&buffer, backend, text);
+	for (long i = 0; i < BENCH_EDITS; i++) {
+		long offset = BENCH_BYTES / BENCH_EDITS * i + 7;
+		text_buffer_delete_range(&buffer, offset, offset + 1);
+		text_buffer_insert(&buffer, &text[offset], 1);
+	}
+	printf("%s\n", name);
+
+	long size = text_buffer_size(&buffer);
+	for (unsigned i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		regex_t regex;
+		if (regex_compile(&regex, patterns[i], strlen(patterns[i])) !=
+		    NO_ERROR) {
+			printf("  failed to compile %s\n", patterns[i]);
+			continue;
+		}
+
+		long count = 0;
+		long offset = 0;
+		long start;
+		long end;
+		double begin = bench_time();
+		while (regex_search_next(&regex, &buffer, offset, &start, &end)) {
+			count++;
+			offset = end > start ? end : end + 1;
+		}
+		double elapsed = bench_time() - begin;
+		printf("  %-40s %8ld matches %7.2f GB/s %5ld flushes\n", patterns[i],
+		    count, size / elapsed / 1e9,
+		    regex.forward.flushes + regex.reverse.flushes);
+		regex_destroy(&regex);
+	}
+
+	// walking backwards through every WARN line start
+	regex_t regex;
+	regex_compile(&regex, "^\\S+ \\S+ WARN", 13);
+	long count = 0;
+	long offset = size;
+	long start;
+	long end;
+	double begin = bench_time();
+	while (regex_search_previous(&regex, &buffer, offset, &start, &end)) {
+		count++;
+		offset = start;
+		if (start == 0) {
+			break;
+		}
+	}
+	double elapsed = bench_time() - begin;
+	printf("  %-40s %8ld matches %7.2f GB/s (previous)\n", "^\\S+ \\S+ WARN",
+	    count, size / elapsed / 1e9);
+	regex_destroy(&regex);
+	text_buffer_destroy(&buffer);
+}
+
+int main(void) {
+	char *text = bench_log();
+	printf("%ld MB of log lines, %d edits\n", BENCH_BYTES >> 20, BENCH_EDITS);
+	bench_backend(SPLIT_BUFFER_BACKEND, "split buffer", text);
+	bench_backend(PIECE_TABLE_BACKEND, "piece table", text);
+	bench_backend(ROPE_BACKEND, "rope", text);
+	free(text);
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include "file_manager.h"
+#include "undo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BYTES (512L * 1024L * 1024L)
+#define BENCH_BLOCK (1024L * 1024L)
+#define BENCH_APPEND 4096L
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+// text with lines of varying length, so chunks don't all look alike
+static void bench_fill(char *block, long length, unsigned long *seed) {
+	for (long i = 0; i < length; i++) {
+		*seed = *seed * 6364136223846793005ul + 1442695040888963407ul;
+		unsigned char value = *seed >> 58;
+		block[i] = value < 3 ? '\n' : 'a' + value % 26;
+	}
+}
+
+static void bench_write(const char *path, long length, unsigned long seed) {
+	FILE *file = fopen(path, "wb");
+	char *block = malloc(BENCH_BLOCK);
+	for (long written = 0; written < length; written += BENCH_BLOCK) {
+		bench_fill(block, BENCH_BLOCK, &seed);
+		fwrite(block, 1, BENCH_BLOCK, file);
+	}
+	free(block);
+	fclose(file);
+}
+
+// the file as another program changes it, then reloaded once that's noticed
+static void bench_reload(
+    const char *name, int handle, undo_journal_t *journal) {
+	struct timespec frame = {0, 1000000};
+	double start = bench_time();
+	while (!file_manager_changed(handle)) {
+		nanosleep(&frame, NULL);
+		if (bench_time() - start > 5.0) {
+			printf("  %-28s not noticed\n", name);
+			return;
+		}
+	}
+	double noticed = bench_time();
+	result_t res = file_manager_reload(handle, journal);
+	double done = bench_time();
+	printf("  %-28s %10.2f %10.2f %s\n", name, (noticed - start) * 1e3,
+	    (done - noticed) * 1e3, res == NO_ERROR ? "" : "failed");
+}
+
+int main(void) {
+	char path[] = "/tmp/reload_benchXXXXXX";
+	close(mkstemp(path));
+	bench_write(path, BENCH_BYTES, 1);
+
+	file_manager_startup();
+	undo_journal_t journal;
+	undo_journal_create(&journal, 0);
+	double start = bench_time();
+	int handle;
+	file_manager_open(path, PIECE_TABLE_BACKEND, &handle);
+	text_buffer_t *buffer = file_manager_buffer(handle);
+	printf("%ld MB piece table, opened in %.2f ms\n", BENCH_BYTES >> 20,
+	    (bench_time() - start) * 1e3);
+	printf("  %-28s %10s %10s\n", "change", "notice ms", "reload ms");
+
+	// another program appending, as a log does
+	char append[BENCH_APPEND];
+	unsigned long seed = 2;
+	bench_fill(append, BENCH_APPEND, &seed);
+	FILE *file = fopen(path, "ab");
+	fwrite(append, 1, BENCH_APPEND, file);
+	fclose(file);
+	bench_reload("append 4 KB", handle, &journal);
+
+	// rewritten through a temp file with a line changed in the middle, which
+	// has to be found by comparing all of it
+	char *text = text_buffer_to_string(buffer);
+	long length = text_buffer_size(buffer);
+	memcpy(&text[length / 2], "changed", 7);
+	char temp[64];
+	sprintf(temp, "%s.new", path);
+	file = fopen(temp, "wb");
+	fwrite(text, 1, length, file);
+	fclose(file);
+	rename(temp, path);
+	free(text);
+	bench_reload("replaced, 7 bytes changed", handle, &journal);
+
+	file_manager_close(handle);
+	file_manager_shutdown();
+	undo_journal_destroy(&journal);
+	unlink(path);
+	return 0;
+}
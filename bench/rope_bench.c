@@ -0,0 +1,71 @@
+#include "rope.h"
+#include "split_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (100L * 1024L * 1024L)
+#define BENCH_EDITS 1000
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+int main(void) {
+	char *text = malloc(BENCH_BYTES + 1);
+	for (long i = 0; i < BENCH_BYTES; i++) {
+		text[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+	}
+	text[BENCH_BYTES] = '\0';
+
+	long offsets[BENCH_EDITS];
+	srand(42);
+	for (int i = 0; i < BENCH_EDITS; i++) {
+		offsets[i] = ((long)rand() * RAND_MAX + rand()) % BENCH_BYTES;
+	}
+
+	split_buffer_t split_buffer;
+	split_buffer_create(&split_buffer, text);
+	double start = bench_time();
+	for (int i = 0; i < BENCH_EDITS; i++) {
+		long distance = offsets[i] - split_buffer.pre_cursor_index;
+		if (distance) {
+			split_buffer_move(&split_buffer, distance);
+		}
+		split_buffer_append(&split_buffer, 'x');
+	}
+	double split_elapsed = bench_time() - start;
+	split_buffer_destroy(&split_buffer);
+
+	rope_t rope;
+	rope_create(&rope, text, BENCH_BYTES);
+	start = bench_time();
+	for (int i = 0; i < BENCH_EDITS; i++) {
+		rope.cursor = offsets[i];
+		rope_append(&rope, 'x');
+	}
+	double rope_elapsed = bench_time() - start;
+
+	long lines = rope_line_count(&rope);
+	start = bench_time();
+	long checksum = 0;
+	for (int i = 0; i < BENCH_EDITS; i++) {
+		long line = offsets[i] % lines;
+		checksum += rope_line_of(&rope, rope_line_start(&rope, line));
+	}
+	double line_elapsed = bench_time() - start;
+	rope_destroy(&rope);
+	free(text);
+
+	printf("%d random edits in %ld MB\n", BENCH_EDITS, BENCH_BYTES >> 20);
+	printf("  gap buffer: %10.2f us/edit\n", split_elapsed / BENCH_EDITS * 1e6);
+	printf("  rope:       %10.2f us/edit\n", rope_elapsed / BENCH_EDITS * 1e6);
+	printf("  rope line <-> offset: %.2f us/lookup (checksum %ld)\n",
+	    line_elapsed / BENCH_EDITS * 1e6, checksum);
+
+	return 0;
+}
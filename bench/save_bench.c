@@ -0,0 +1,362 @@
+#include "file_manager.h"
+#include "snapshot.h"
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS 5
+#define BENCH_BACKGROUND_BYTES (500L * 1024L * 1024L)
+#define BENCH_FRAMES 100000
+// a block of a file the way a save in place writes it
+#define BENCH_PATCH_BLOCK 4096L
+
+// keeps the text gathered for a frame from being optimised away
+static volatile long bench_sink;
+// saves that didn't leave the file holding what was saved
+static long bench_mismatches;
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int bench_same(FILE *file, const char *data, long length) {
+	static char block[65536];
+	while (length > 0) {
+		long chunk = length < (long)sizeof(block) ? length : (long)sizeof(block);
+		if ((long)fread(block, 1, chunk, file) != chunk ||
+		    memcmp(block, data, chunk)) {
+			return 0;
+		}
+		data += chunk;
+		length -= chunk;
+	}
+	return 1;
+}
+
+// reads path back and checks it's exactly the snapshot, or the buffer when
+// there isn't one
+static void bench_verify(const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, const char *path) {
+	FILE *file = fopen(path, "rb");
+	int same = file != NULL;
+	if (snapshot != NULL) {
+		for (long i = 0; i < snapshot->span_count && same; i++) {
+			same = bench_same(
+			    file, snapshot->spans[i].data, snapshot->spans[i].length);
+		}
+	} else {
+		text_buffer_iterator_t iterator;
+		text_span_t span;
+		text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+		while (same && text_buffer_iterator_next(&iterator, &span)) {
+			same = bench_same(file, span.data, span.length);
+		}
+	}
+	if (file != NULL) {
+		same = same && fgetc(file) == EOF;
+		fclose(file);
+	}
+	if (!same) {
+		printf("  %s doesn't hold what was saved\n", path);
+		bench_mismatches++;
+	}
+}
+
+// the old way, truncating the file and writing it back through stdio
+static void bench_truncate(const text_buffer_t *buffer, const char *path) {
+	FILE *file = fopen(path, "w");
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		fwrite(span.data, 1, span.length, file);
+	}
+	fclose(file);
+}
+
+// median ms of a few saves, mode 0 truncates, 1 and 2 write atomically
+// without and with syncing
+static double bench_save(
+    const text_buffer_t *buffer, const char *path, int mode, int runs) {
+	double times[BENCH_RUNS];
+	for (int i = 0; i < runs; i++) {
+		double start = bench_time();
+		if (mode == 0) {
+			bench_truncate(buffer, path);
+		} else {
+			file_manager_write(buffer, path, mode == 2);
+		}
+		times[i] = bench_time() - start;
+		bench_verify(buffer, NULL, path);
+		// the next save shouldn't wait on this one's writeback
+		int fd = open(path, O_RDONLY);
+		fsync(fd);
+		close(fd);
+	}
+	qsort(times, runs, sizeof(double), bench_compare);
+	return times[runs / 2] * 1e3;
+}
+
+static char *bench_text(long size) {
+	char *text = malloc(size + 1);
+	srand(42);
+	long length = 0;
+	while (length < size - 128) {
+		length += sprintf(&text[length], "line %d of some saved text\n", rand());
+	}
+	memset(&text[length], '\n', size - length);
+	text[size] = '\0';
+	return text;
+}
+
+static void bench_size(text_buffer_backend_t backend, long size) {
+	char *text = bench_text(size);
+	text_buffer_t buffer;
+	text_buffer_create(&buffer, backend, text);
+	free(text);
+	// the gap in the middle, so a split buffer saves as two spans
+	text_buffer_move(&buffer, -size / 2);
+	text_buffer_insert(&buffer, "edited", 6);
+
+	char path[] = "/tmp/save_benchXXXXXX";
+	close(mkstemp(path));
+	int runs = size > (256L << 20) ? 1 : BENCH_RUNS;
+	printf("  %6ld MB %12.1f %12.1f %12.1f\n", size >> 20,
+	    bench_save(&buffer, path, 0, runs), bench_save(&buffer, path, 1, runs),
+	    bench_save(&buffer, path, 2, runs));
+	unlink(path);
+	text_buffer_destroy(&buffer);
+}
+
+// one line of a file changed without changing its length, saved in place
+// and then the whole file written out again for comparison
+static void bench_patch(
+    text_buffer_backend_t backend, const char *name, long size) {
+	char path[] = "/tmp/save_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *text = bench_text(size);
+	write(fd, text, size);
+	fsync(fd);
+	close(fd);
+	free(text);
+	int handle;
+	file_manager_open(path, backend, &handle);
+	text_buffer_t *buffer = file_manager_buffer(handle);
+
+	double times[BENCH_RUNS];
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		long offset = size / (BENCH_RUNS + 1) * (i + 1);
+		text_buffer_delete_range(buffer, offset, offset + 6);
+		text_buffer_insert(buffer, "edited", 6);
+		double start = bench_time();
+		file_manager_save(handle);
+		times[i] = bench_time() - start;
+		bench_verify(buffer, NULL, path);
+	}
+	qsort(times, BENCH_RUNS, sizeof(double), bench_compare);
+
+	// the same kind of change saved in place by the writer thread, with an
+	// edit straight after that mustn't make it into the file
+	text_buffer_delete_range(buffer, size / 2, size / 2 + 6);
+	text_buffer_insert(buffer, "thread", 6);
+	text_snapshot_t *snapshot;
+	text_snapshot_create(buffer, &snapshot);
+	text_snapshot_list(snapshot);
+	file_manager_save_background(handle);
+	text_buffer_insert(buffer, "x", 1);
+	long written;
+	long length;
+	struct timespec pause = {0, 1000000};
+	while (file_manager_saving(handle, &written, &length)) {
+		nanosleep(&pause, NULL);
+	}
+	if (file_manager_save_result(handle) != NO_ERROR) {
+		bench_mismatches++;
+	}
+	bench_verify(NULL, snapshot, path);
+	text_snapshot_release(snapshot);
+
+	double whole = bench_save(buffer, path, 2, 1);
+	printf("  %-14s %6ld MB %12.2f %12.1f\n", name, size >> 20,
+	    times[BENCH_RUNS / 2] * 1e3, whole);
+
+	file_manager_close(handle);
+	unlink(path);
+}
+
+// keeps typing while a big file saves in the background, a frame being a
+// keystroke, the text on screen gathered and the save polled
+static void bench_background(text_buffer_backend_t backend, const char *name) {
+	char path[] = "/tmp/save_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *text = bench_text(BENCH_BACKGROUND_BYTES);
+	write(fd, text, BENCH_BACKGROUND_BYTES);
+	close(fd);
+	free(text);
+	int handle;
+	file_manager_open(path, backend, &handle);
+	text_buffer_t *buffer = file_manager_buffer(handle);
+	text_buffer_move(buffer, -text_buffer_cursor(buffer) + 1000);
+	// a change in length, so the whole file is written and not just patched
+	text_buffer_insert(buffer, "x", 1);
+	// what the file has to hold once the thread is done, whatever's typed
+	text_snapshot_t *snapshot;
+	text_snapshot_create(buffer, &snapshot);
+
+	static double frames[BENCH_FRAMES];
+	struct timespec pause = {0, 100000};
+	double start = bench_time();
+	file_manager_save_background(handle);
+	double handoff = bench_time() - start;
+	long count = 0;
+	long written;
+	long length;
+	while (count < BENCH_FRAMES &&
+	       file_manager_saving(handle, &written, &length)) {
+		double frame = bench_time();
+		text_buffer_insert(buffer, "x", 1);
+		const char *visible;
+		for (long offset = 0; offset < 4096;) {
+			long span = text_buffer_span_at(buffer, offset, &visible);
+			if (span <= 0) {
+				break;
+			}
+			bench_sink += visible[0];
+			offset += span;
+		}
+		file_manager_saving(handle, &written, &length);
+		frames[count++] = bench_time() - frame;
+		nanosleep(&pause, NULL);
+	}
+	double elapsed = bench_time() - start;
+	qsort(frames, count, sizeof(double), bench_compare);
+	printf("  %-14s %8.1f ms save, %6.2f ms handoff, %ld frames, "
+	       "%.3f ms p99, %.2f ms worst\n",
+	    name, elapsed * 1e3, handoff * 1e3, count,
+	    frames[count * 99 / 100] * 1e3, frames[count - 1] * 1e3);
+	while (file_manager_saving(handle, &written, &length)) {
+		nanosleep(&pause, NULL);
+	}
+	if (file_manager_save_result(handle) != NO_ERROR) {
+		bench_mismatches++;
+	}
+	bench_verify(NULL, snapshot, path);
+	text_snapshot_release(snapshot);
+
+	file_manager_close(handle);
+	file_manager_shutdown();
+	unlink(path);
+}
+
+static unsigned long bench_hash(
+    unsigned long hash, const void *data, long length) {
+	const unsigned char *bytes = data;
+	for (long i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ul;
+	}
+	return hash;
+}
+
+/*
+a save in place cut short half way through copying its one block over the
+file, with the journal it synced first left next to it. opening the file has
+to finish the save from the journal. the journal is laid out the way
+file_manager.c writes it.
+*/
+static void bench_recover(void) {
+	long size = 1L << 20;
+	long offset = size / 2;
+	long record[2] = {offset, BENCH_PATCH_BLOCK};
+	char path[] = "/tmp/save_benchXXXXXX";
+	int fd = mkstemp(path);
+	char *text = bench_text(size);
+	write(fd, text, size);
+	memset(&text[offset], '#', record[1]);
+	pwrite(fd, &text[offset], record[1] / 2, offset);
+	fsync(fd);
+	struct stat file_stat;
+	fstat(fd, &file_stat);
+	close(fd);
+
+	struct {
+		char magic[8];
+		long device;
+		long inode;
+		long length;
+		long count;
+	} header = {"tedsave1", file_stat.st_dev, file_stat.st_ino, size, 1};
+	unsigned long checksum = 14695981039346656037ul;
+	checksum = bench_hash(checksum, &header, sizeof(header));
+	checksum = bench_hash(checksum, record, sizeof(record));
+	checksum = bench_hash(checksum, &text[offset], record[1]);
+	char journal[64];
+	sprintf(journal, "/tmp/.%s.text-editor-save", &path[5]);
+	FILE *file = fopen(journal, "wb");
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(record, sizeof(record), 1, file);
+	fwrite(&text[offset], 1, record[1], file);
+	fwrite(&checksum, sizeof(checksum), 1, file);
+	fclose(file);
+
+	int handle;
+	file_manager_open(path, SPLIT_BUFFER_BACKEND, &handle);
+	text_buffer_t *buffer = file_manager_buffer(handle);
+	char *loaded = text_buffer_to_string(buffer);
+	long mismatches = bench_mismatches;
+	if (text_buffer_size(buffer) != size || memcmp(loaded, text, size) ||
+	    access(journal, F_OK) == 0) {
+		bench_mismatches++;
+	}
+	bench_verify(buffer, NULL, path);
+	printf("  interrupted save %s on open\n",
+	    bench_mismatches == mismatches ? "finished" : "not finished");
+
+	free(loaded);
+	free(text);
+	file_manager_close(handle);
+	unlink(journal);
+	unlink(path);
+}
+
+int main(void) {
+	long sizes[] = {1L << 20, 100L << 20, 1024L << 20};
+	const char *names[] = {"split buffer", "rope"};
+	text_buffer_backend_t backends[] = {SPLIT_BUFFER_BACKEND, ROPE_BACKEND};
+	for (int b = 0; b < 2; b++) {
+		printf("%s save, ms\n", names[b]);
+		printf("  %9s %12s %12s %12s\n", "", "truncate", "atomic", "durable");
+		for (int s = 0; s < 3; s++) {
+			bench_size(backends[b], sizes[s]);
+		}
+	}
+	printf("one line changed, durable save, ms\n");
+	printf("  %-14s %9s %12s %12s\n", "", "", "in place", "whole file");
+	for (int s = 1; s < 3; s++) {
+		bench_patch(SPLIT_BUFFER_BACKEND, "split buffer", sizes[s]);
+		bench_patch(PIECE_TABLE_BACKEND, "piece table", sizes[s]);
+		bench_patch(ROPE_BACKEND, "rope", sizes[s]);
+	}
+	printf("typing through a %ld MB background save\n",
+	    BENCH_BACKGROUND_BYTES >> 20);
+	bench_background(ROPE_BACKEND, "rope");
+	bench_background(PIECE_TABLE_BACKEND, "piece table");
+	printf("crash recovery\n");
+	bench_recover();
+
+	printf("%ld saves didn't match\n", bench_mismatches);
+	return bench_mismatches > 0;
+}
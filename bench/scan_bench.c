@@ -0,0 +1,119 @@
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_BYTES (256L * 1024L * 1024L)
+#define BENCH_ROUNDS 4
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static const char *scalar_memchr(const char *text, char c, long length) {
+	for (long i = 0; i < length; i++) {
+		if (text[i] == c) {
+			return &text[i];
+		}
+	}
+	return NULL;
+}
+
+static const char *scalar_memrchr(const char *text, char c, long length) {
+	for (long i = length - 1; i >= 0; i--) {
+		if (text[i] == c) {
+			return &text[i];
+		}
+	}
+	return NULL;
+}
+
+static long scalar_count(const char *text, char c, long length) {
+	long count = 0;
+	for (long i = 0; i < length; i++) {
+		count += text[i] == c;
+	}
+	return count;
+}
+
+static const char *scalar_find_any(
+    const char *text, long length, const char *set, int set_size) {
+	for (long i = 0; i < length; i++) {
+		for (int j = 0; j < set_size; j++) {
+			if (text[i] == set[j]) {
+				return &text[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+static void report(const char *name, double scalar, double vector) {
+	double bytes = (double)BENCH_BYTES * BENCH_ROUNDS;
+	printf("  %-9s scalar %6.2f GB/s  %s %6.2f GB/s  (%.1fx)\n", name,
+	    bytes / scalar / 1e9, scan_implementation(), bytes / vector / 1e9,
+	    scalar / vector);
+}
+
+int main(void) {
+	char *text = malloc(BENCH_BYTES);
+	for (long i = 0; i < BENCH_BYTES; i++) {
+		text[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+	}
+	// one needle at each end so the searches cross the whole buffer
+	text[BENCH_BYTES - 1] = '#';
+	text[0] = '@';
+
+	long sink = 0;
+	double start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scalar_memchr(text, '#', BENCH_BYTES) - text;
+	}
+	double scalar = bench_time() - start;
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scan_memchr(text, '#', BENCH_BYTES) - text;
+	}
+	report("memchr", scalar, bench_time() - start);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scalar_memrchr(text, '@', BENCH_BYTES) - text;
+	}
+	scalar = bench_time() - start;
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scan_memrchr(text, '@', BENCH_BYTES) - text;
+	}
+	report("memrchr", scalar, bench_time() - start);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scalar_count(text, '\n', BENCH_BYTES);
+	}
+	scalar = bench_time() - start;
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scan_count(text, '\n', BENCH_BYTES);
+	}
+	report("count", scalar, bench_time() - start);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scalar_find_any(text, BENCH_BYTES, "#\t\r", 3) - text;
+	}
+	scalar = bench_time() - start;
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scan_find_any(text, BENCH_BYTES, "#\t\r", 3) - text;
+	}
+	report("find_any", scalar, bench_time() - start);
+
+	printf("  checksum %ld\n", sink);
+	free(text);
+
+	return 0;
+}
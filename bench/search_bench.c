@@ -0,0 +1,124 @@
+// memmem is only there as a baseline
+#define _GNU_SOURCE
+#include "scan.h"
+#include "split_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (512L * 1024L * 1024L)
+#define BENCH_ROUNDS 4
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static const char *naive_find(
+    const char *text, long length, const char *needle, long needle_length) {
+	for (long i = 0; i + needle_length <= length; i++) {
+		if (!memcmp(&text[i], needle, needle_length)) {
+			return &text[i];
+		}
+	}
+	return NULL;
+}
+
+static void report(const char *name, double elapsed, double bytes) {
+	printf("  %-22s %7.2f GB/s\n", name, bytes / elapsed / 1e9);
+}
+
+// log lines where the needle's first bytes are common but it never matches
+static char *bench_log(void) {
+	static const char *levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+	char *text = malloc(BENCH_BYTES + 1);
+	long length = 0;
+	srand(42);
+	while (length < BENCH_BYTES - 128) {
+		length += sprintf(&text[length],
+		    "2024-05-%02d 12:%02d:%02d %s request %d served in %dms\n",
+		    rand() % 28 + 1, rand() % 60, rand() % 60, levels[rand() % 4],
+		    rand(), rand() % 1000);
+	}
+	memset(&text[length], '.', BENCH_BYTES - length);
+	text[BENCH_BYTES] = '\0';
+	return text;
+}
+
+int main(void) {
+	const char *needle = "ERROR request 0 served";
+	long needle_length = strlen(needle);
+	char *text = bench_log();
+	// one match at each end so the searches cross the whole buffer
+	memcpy(&text[BENCH_BYTES - needle_length - 1], needle, needle_length);
+	memcpy(text, needle, needle_length);
+
+	split_buffer_t buffer;
+	split_buffer_create(&buffer, text);
+	// the gap sits in the middle so every search has to cross it
+	split_buffer_move(&buffer, -BENCH_BYTES / 2);
+	double bytes = (double)BENCH_BYTES * BENCH_ROUNDS;
+	printf("%ld MB, gap in the middle, %s kernels\n", BENCH_BYTES >> 20,
+	    scan_implementation());
+
+	long sink = 0;
+	double start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += scan_count(text, '\n', BENCH_BYTES);
+	}
+	report("count (bandwidth)", bench_time() - start, bytes);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += naive_find(&text[1], BENCH_BYTES - 1, needle, needle_length) -
+		        text;
+	}
+	report("naive memcmp", bench_time() - start, bytes);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += (const char *)memmem(
+		            &text[1], BENCH_BYTES - 1, needle, needle_length) -
+		        text;
+	}
+	report("libc memmem", bench_time() - start, bytes);
+	free(text);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += split_buffer_search_next(&buffer, 1, needle, needle_length);
+	}
+	report("search next", bench_time() - start, bytes);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += split_buffer_search_previous(
+		    &buffer, BENCH_BYTES - needle_length - 1, needle, needle_length);
+	}
+	report("search previous", bench_time() - start, bytes);
+
+	start = bench_time();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		sink += split_buffer_search_all(&buffer, "WARN", 4, NULL, 0);
+	}
+	report("search all (WARN)", bench_time() - start, bytes);
+
+	// found and then replaced, the way the replace prompt does it
+	start = bench_time();
+	long count = split_buffer_search_all(&buffer, "WARN", 4, NULL, 0);
+	long *offsets = malloc(count * sizeof(long));
+	split_buffer_search_all(&buffer, "WARN", 4, offsets, count);
+	split_buffer_replace_at_each(&buffer, offsets, count, 4, "WARNING", 7);
+	double elapsed = bench_time() - start;
+	free(offsets);
+	report("replace all (WARN)", elapsed, BENCH_BYTES);
+	printf("  replaced %ld in %.2f s\n", count, elapsed);
+
+	printf("  checksum %ld\n", sink + count);
+	split_buffer_destroy(&buffer);
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "snapshot.h"
+#include "text_buffer.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (8L * 1024L * 1024L)
+#define BENCH_EDITS 20000
+// a new snapshot is handed to the readers every this many edits
+#define BENCH_PUBLISH 100
+
+typedef struct published_t {
+	text_snapshot_t *snapshot;
+	unsigned long checksum;
+} published_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static published_t published;
+static atomic_int stop;
+static atomic_long bytes_read;
+static atomic_long mismatches;
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static unsigned long bench_checksum(
+    unsigned long hash, const char *text, long length) {
+	for (long i = 0; i < length; i++) {
+		hash = hash * 31 + (unsigned char)text[i];
+	}
+	return hash;
+}
+
+// the lock only covers picking up a reference, the text is read without it
+static void *bench_reader(void *argument) {
+	(void)argument;
+	while (!atomic_load(&stop)) {
+		pthread_mutex_lock(&lock);
+		published_t current = published;
+		text_snapshot_retain(current.snapshot);
+		pthread_mutex_unlock(&lock);
+
+		unsigned long hash = 0;
+		for (long i = 0; i < current.snapshot->span_count; i++) {
+			hash = bench_checksum(hash, current.snapshot->spans[i].data,
+			    current.snapshot->spans[i].length);
+		}
+		if (hash != current.checksum) {
+			atomic_fetch_add(&mismatches, 1);
+		}
+		atomic_fetch_add(&bytes_read, current.snapshot->length);
+		text_snapshot_release(current.snapshot);
+	}
+	return NULL;
+}
+
+static void bench_publish(text_buffer_t *buffer, double *snapshot_time) {
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	unsigned long hash = 0;
+	text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		hash = bench_checksum(hash, span.data, span.length);
+	}
+
+	double start = bench_time();
+	text_snapshot_t *snapshot;
+	if (text_snapshot_create(buffer, &snapshot) != NO_ERROR) {
+		exit(1);
+	}
+	*snapshot_time += bench_time() - start;
+
+	pthread_mutex_lock(&lock);
+	published_t old = published;
+	published = (published_t){snapshot, hash};
+	pthread_mutex_unlock(&lock);
+	if (old.snapshot != NULL) {
+		text_snapshot_release(old.snapshot);
+	}
+}
+
+static void bench_backend(const char *name, text_buffer_backend_t backend,
+    const char *text, int readers) {
+	text_buffer_t buffer;
+	text_buffer_create(&buffer, backend, text);
+	double snapshot_time = 0.0;
+	bench_publish(&buffer, &snapshot_time);
+
+	atomic_store(&stop, 0);
+	atomic_store(&bytes_read, 0);
+	atomic_store(&mismatches, 0);
+	pthread_t *threads = malloc(readers * sizeof(pthread_t));
+	for (int i = 0; i < readers; i++) {
+		pthread_create(&threads[i], NULL, bench_reader, NULL);
+	}
+
+	srand(42);
+	double start = bench_time();
+	for (int i = 0; i < BENCH_EDITS; i++) {
+		long size = text_buffer_size(&buffer);
+		long offset = ((long)rand() * RAND_MAX + rand()) % size;
+		if (rand() % 2) {
+			text_buffer_delete_range(&buffer, offset,
+			    offset + 16 < size ? offset + 16 : size);
+		} else {
+			text_buffer_delete_range(&buffer, offset, offset);
+			text_buffer_insert(&buffer, "snapshot\n", 9);
+		}
+		if (i % BENCH_PUBLISH == BENCH_PUBLISH - 1) {
+			bench_publish(&buffer, &snapshot_time);
+		}
+	}
+	double elapsed = bench_time() - start;
+
+	atomic_store(&stop, 1);
+	for (int i = 0; i < readers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	text_snapshot_release(published.snapshot);
+	published.snapshot = NULL;
+	text_buffer_destroy(&buffer);
+
+	printf("  %-12s %8.0f edits/s, %8.1f us/snapshot, readers %6.2f GB/s, "
+	       "%ld mismatches\n",
+	    name, BENCH_EDITS / elapsed,
+	    snapshot_time / (BENCH_EDITS / BENCH_PUBLISH + 1) * 1e6,
+	    atomic_load(&bytes_read) / elapsed / 1e9, atomic_load(&mismatches));
+}
+
+int main(int argc, char **argv) {
+	int readers = argc > 1 ? atoi(argv[1]) : 4;
+	char *text = malloc(BENCH_BYTES + 1);
+	for (long i = 0; i < BENCH_BYTES; i++) {
+		text[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+	}
+	text[BENCH_BYTES] = '\0';
+
+	printf("%d edits on %ld MB with %d reader threads\n", BENCH_EDITS,
+	    BENCH_BYTES >> 20, readers);
+	bench_backend("gap buffer", SPLIT_BUFFER_BACKEND, text, readers);
+	bench_backend("piece table", PIECE_TABLE_BACKEND, text, readers);
+	bench_backend("rope", ROPE_BACKEND, text, readers);
+	free(text);
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include "split_buffer.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_BYTES (10L * 1024L * 1024L)
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+int main(void) {
+	split_buffer_t buffer;
+	split_buffer_create(&buffer, "");
+
+	const char *text = "the quick brown fox jumps over the lazy dog\n";
+	double start = bench_time();
+	for (long i = 0; i < BENCH_BYTES; i++) {
+		if (split_buffer_append(&buffer, text[i % 44]) != NO_ERROR) {
+			printf("append failed at byte %ld\n", i);
+			return 1;
+		}
+	}
+	double elapsed = bench_time() - start;
+
+	printf("typed %ld bytes in %.3f s: %.1f M inserts/s (capacity %ld)\n",
+	    buffer.current_size, elapsed, BENCH_BYTES / elapsed / 1000000.0,
+	    buffer.capacity);
+	split_buffer_destroy(&buffer);
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "scan.h"
+#include "text_buffer.h"
+#include "trigram_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (256L * 1024L * 1024L)
+#define BENCH_LIMIT (512L * 1024L * 1024L)
+#define BENCH_SEARCHES 32
+#define BENCH_KEYSTROKES 20000
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench_wait(trigram_index_t *index) {
+	struct timespec pause = {0, 1000000};
+	while (trigram_index_busy(index)) {
+		nanosleep(&pause, NULL);
+	}
+}
+
+// made up user names, rare enough that the index can rule out most chunks
+static void bench_name(char *name, unsigned seed) {
+	for (int i = 0; i < 6; i++) {
+		name[i] = 'a' + seed % 26;
+		seed = seed * 1103515245u + 12345u;
+		seed ^= seed >> 16;
+	}
+	name[6] = '\0';
+}
+
+static char *bench_log(void) {
+	static const char *levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+	char *text = malloc(BENCH_BYTES + 1);
+	long length = 0;
+	unsigned id = 0;
+	srand(42);
+	while (length < BENCH_BYTES - 128) {
+		char name[7];
+		bench_name(name, id++);
+		length += sprintf(&text[length],
+		    "2024-05-%02d 12:%02d:%02d %s request %d for %s served in %dms\n",
+		    rand() % 28 + 1, rand() % 60, rand() % 60, levels[rand() % 4],
+		    rand(), name, rand() % 1000);
+	}
+	memset(&text[length], '\n', BENCH_BYTES - length);
+	text[BENCH_BYTES] = '\0';
+	return text;
+}
+
+// what searching costs without an index, one scan over every span
+static long bench_scan(
+    const text_buffer_t *buffer, const char *needle, long length) {
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	long offset = 0;
+	text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		const char *found = scan_find(span.data, span.length, needle, length);
+		if (found != NULL) {
+			return offset + (found - span.data);
+		}
+		offset += span.length;
+	}
+	return -1;
+}
+
+static void bench_backend(
+    text_buffer_backend_t backend, const char *name, const char *text) {
+	text_buffer_t buffer;
+	text_buffer_create(&buffer, backend, text);
+	printf("%s\n", name);
+
+	trigram_index_t index;
+	double start = bench_time();
+	trigram_index_create(&index, &buffer, BENCH_LIMIT);
+	bench_wait(&index);
+	printf("  build                %8.2f s, %ld MB\n", bench_time() - start,
+	    trigram_index_memory(&index) >> 20);
+
+	// users near the end of the file, and one that never shows up
+	char needles[BENCH_SEARCHES][16];
+	for (int i = 0; i < BENCH_SEARCHES; i++) {
+		char name[7];
+		bench_name(name, BENCH_BYTES / 80 - i * 997);
+		sprintf(needles[i], "for %s", i ? name : "zzzzzz");
+	}
+	long sink = 0;
+	start = bench_time();
+	for (int i = 0; i < BENCH_SEARCHES; i++) {
+		sink += bench_scan(&buffer, needles[i], strlen(needles[i]));
+	}
+	double scan = (bench_time() - start) / BENCH_SEARCHES;
+	start = bench_time();
+	for (int i = 0; i < BENCH_SEARCHES; i++) {
+		sink -= trigram_index_find(&index, 0, needles[i], strlen(needles[i]));
+	}
+	double indexed = (bench_time() - start) / BENCH_SEARCHES;
+	printf("  search scan          %8.2f ms\n", scan * 1e3);
+	printf("  search indexed       %8.2f ms\n", indexed * 1e3);
+
+	// scattered edits so the thread has plenty to redo, then type while it
+	// works through them
+	for (long i = 0; i < 2048; i++) {
+		long offset = BENCH_BYTES / 2048 * i;
+		text_buffer_delete_range(&buffer, offset, offset);
+		text_buffer_append(&buffer, '#');
+	}
+	trigram_index_refresh(&index);
+	text_buffer_delete_range(&buffer, BENCH_BYTES / 3, BENCH_BYTES / 3);
+	static double keys[BENCH_KEYSTROKES];
+	long busy = 0;
+	for (long i = 0; i < BENCH_KEYSTROKES; i++) {
+		busy += trigram_index_busy(&index);
+		double key = bench_time();
+		text_buffer_append(&buffer, 'a' + i % 26);
+		trigram_index_refresh(&index);
+		keys[i] = bench_time() - key;
+	}
+	// on one core the worst case is mostly the scheduler handing the thread
+	// its slice, the percentiles are what typing feels like
+	qsort(keys, BENCH_KEYSTROKES, sizeof(double), bench_compare);
+	printf("  keystroke            %8.2f us median, %.2f us p99, %.2f us worst, "
+	       "%ld%% while indexing\n",
+	    keys[BENCH_KEYSTROKES / 2] * 1e6, keys[BENCH_KEYSTROKES * 99 / 100] * 1e6,
+	    keys[BENCH_KEYSTROKES - 1] * 1e6, busy * 100 / BENCH_KEYSTROKES);
+	bench_wait(&index);
+	printf("  checksum %ld\n", sink);
+
+	trigram_index_destroy(&index);
+	text_buffer_destroy(&buffer);
+}
+
+int main(void) {
+	char *text = bench_log();
+	printf("%ld MB of log lines\n", BENCH_BYTES >> 20);
+	bench_backend(PIECE_TABLE_BACKEND, "piece table", text);
+	bench_backend(ROPE_BACKEND, "rope", text);
+	free(text);
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include "text_buffer.h"
+#include "undo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_STEPS 2000
+// small enough that the limited journal forgets most of the steps
+#define BENCH_LIMIT (16L * 1024L)
+
+static const char *bench_names[] = {"split buffer", "piece table", "rope"};
+static long bench_mismatches;
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static void bench_goto(text_buffer_t *buffer, long offset) {
+	long distance = offset - text_buffer_cursor(buffer);
+	if (distance) {
+		text_buffer_move(buffer, distance);
+	}
+}
+
+// ascending offsets at least spacing apart with room for spacing bytes after
+// the last, fewer than asked for when the buffer is short
+static long bench_offsets(
+    text_buffer_t *buffer, long *offsets, long count, long spacing) {
+	long size = text_buffer_size(buffer);
+	long offset = rand() % 64;
+	long found = 0;
+	while (found < count && offset + spacing <= size) {
+		offsets[found++] = offset;
+		offset += spacing + rand() % (size / count + 1);
+	}
+	return found;
+}
+
+/*
+one undoable step, sealed off from the last. typing, backspacing and forward
+deleting are a run of single byte edits that should coalesce into one record,
+the rest are one call. returns 0 when the buffer was too short for the step.
+*/
+static int bench_step(undo_journal_t *journal, text_buffer_t *buffer) {
+	static const char *text = "the quick brown fox jumps over the lazy dog\n";
+	long size = text_buffer_size(buffer);
+	long offsets[4];
+	long count;
+	long start = size ? rand() % size : 0;
+	long length = rand() % 16 + 1;
+	if (start + length > size) {
+		length = size - start;
+	}
+
+	undo_journal_seal(journal);
+	bench_goto(buffer, start);
+	switch (rand() % 8) {
+	case 0: {
+		long typed = rand() % 16 + 2;
+		for (long i = 0; i < typed; i++) {
+			undo_journal_append(journal, buffer, text[(start + i) % 44]);
+		}
+		// backspacing over some of it stays in the same record
+		for (long i = rand() % (typed - 1); i > 0; i--) {
+			undo_journal_remove(journal, buffer);
+		}
+		return 1;
+	}
+	case 1:
+		if (!length) {
+			return 0;
+		}
+		bench_goto(buffer, start + length);
+		for (long i = 0; i < length; i++) {
+			undo_journal_remove(journal, buffer);
+		}
+		return 1;
+	case 2:
+		if (!length) {
+			return 0;
+		}
+		for (long i = 0; i < length; i++) {
+			undo_journal_delete(journal, buffer);
+		}
+		return 1;
+	case 3:
+		return undo_journal_insert(journal, buffer, text, rand() % 44 + 1) ==
+		       NO_ERROR;
+	case 4:
+		return length && undo_journal_delete_range(journal, buffer, start,
+		                     start + length) == NO_ERROR;
+	case 5:
+		return undo_journal_replace(journal, buffer, start, start + length,
+		           text + length, rand() % 8 + 1) == NO_ERROR;
+	case 6:
+		count = bench_offsets(buffer, offsets, rand() % 4 + 1, 1);
+		return count && undo_journal_insert_at_each(journal, buffer, offsets,
+		                    count, text, rand() % 6 + 1) == NO_ERROR;
+	default:
+		count = bench_offsets(buffer, offsets, rand() % 4 + 1, 4);
+		return count && undo_journal_delete_at_each(journal, buffer, offsets,
+		                    count, rand() % 4 + 1) == NO_ERROR;
+	}
+}
+
+static void bench_expect(text_buffer_t *buffer, const char *expected,
+    const char *backend, const char *what, long step) {
+	char *string = text_buffer_to_string(buffer);
+	if (string == NULL || strcmp(string, expected) != 0) {
+		if (bench_mismatches++ < 10) {
+			printf("%s: wrong text after %s to step %ld\n", backend, what,
+			    step);
+		}
+	}
+	free(string);
+}
+
+/*
+makes the same steps on every backend, keeping the text after each, then undoes
+them all and redoes them all, checking the text at every step on the way. a
+limited journal has to forget the oldest steps and stay under its limit while
+the steps it kept still undo to the right text.
+*/
+static void bench_backend(text_buffer_backend_t backend, long limit) {
+	const char *name = bench_names[backend];
+	text_buffer_t buffer;
+	undo_journal_t journal;
+	if (text_buffer_create(&buffer, backend,
+	        "a line to start from\nand another one after it\n") != NO_ERROR ||
+	    undo_journal_create(&journal, limit) != NO_ERROR) {
+		printf("%s: failed to create the buffer\n", name);
+		bench_mismatches++;
+		return;
+	}
+
+	char **states = malloc((BENCH_STEPS + 1) * sizeof(char *));
+	states[0] = text_buffer_to_string(&buffer);
+	srand(42);
+	long steps = 0;
+	while (steps < BENCH_STEPS) {
+		if (bench_step(&journal, &buffer)) {
+			states[++steps] = text_buffer_to_string(&buffer);
+		}
+	}
+
+	double start = bench_time();
+	long undone = 0;
+	while (journal.current > journal.first) {
+		undo_journal_undo(&journal, &buffer);
+		undone++;
+		bench_expect(&buffer, states[steps - undone], name, "undo",
+		    steps - undone);
+	}
+	double undo_time = bench_time() - start;
+
+	start = bench_time();
+	for (long i = steps - undone + 1; i <= steps; i++) {
+		undo_journal_redo(&journal, &buffer);
+		bench_expect(&buffer, states[i], name, "redo", i);
+	}
+	double redo_time = bench_time() - start;
+	if (journal.current != journal.count) {
+		printf("%s: redo stopped early\n", name);
+		bench_mismatches++;
+	}
+
+	if (!limit && undone != steps) {
+		printf("%s: undid %ld of %ld steps\n", name, undone, steps);
+		bench_mismatches++;
+	}
+	if (limit &&
+	    (undone == steps || undo_journal_memory(&journal) > limit)) {
+		printf("%s: kept %ld steps in %ld bytes over a %ld byte limit\n",
+		    name, undone, undo_journal_memory(&journal), limit);
+		bench_mismatches++;
+	}
+
+	// a new edit after undoing drops what could have been redone
+	if (undone) {
+		undo_journal_undo(&journal, &buffer);
+		bench_goto(&buffer, 0);
+		undo_journal_insert(&journal, &buffer, "new", 3);
+		if (journal.current != journal.count) {
+			printf("%s: redo survived a new edit\n", name);
+			bench_mismatches++;
+		}
+		undo_journal_undo(&journal, &buffer);
+		bench_expect(&buffer, states[steps - 1], name, "undo", steps - 1);
+	}
+
+	printf("%-12s %s: undid %ld steps in %.2f ms, redid them in %.2f ms "
+	       "(%ld bytes kept)\n",
+	    name, limit ? "limited" : "unlimited", undone, undo_time * 1000.0,
+	    redo_time * 1000.0, undo_journal_memory(&journal));
+
+	for (long i = 0; i <= steps; i++) {
+		free(states[i]);
+	}
+	free(states);
+	undo_journal_destroy(&journal);
+	text_buffer_destroy(&buffer);
+}
+
+int main(void) {
+	for (int backend = SPLIT_BUFFER_BACKEND; backend <= ROPE_BACKEND;
+	    backend++) {
+		bench_backend(backend, 0);
+		bench_backend(backend, BENCH_LIMIT);
+	}
+
+	printf("%ld mismatches\n", bench_mismatches);
+	return bench_mismatches > 0;
+}
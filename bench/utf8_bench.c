@@ -0,0 +1,87 @@
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES (256L * 1024L * 1024L)
+#define BENCH_ROUNDS 4
+
+static double bench_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+// plain ascii lines, or every fourth character two, three or four bytes long
+static void bench_fill(char *text, int mixed) {
+	static const char *wide[] = {
+	    "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+	long i = 0;
+	for (long k = 0; i < BENCH_BYTES - 4; k++) {
+		if (mixed && k % 4 == 3) {
+			const char *c = wide[k / 4 % 3];
+			long length = strlen(c);
+			memcpy(&text[i], c, length);
+			i += length;
+		} else {
+			text[i++] = k % 80 == 79 ? '\n' : 'a' + k % 26;
+		}
+	}
+	memset(&text[i], '\n', BENCH_BYTES - i);
+}
+
+static void report(const char *name, double elapsed, double copy) {
+	double bytes = (double)BENCH_BYTES * BENCH_ROUNDS;
+	printf("  %-12s %6.2f GB/s  (%.2fx memcpy)\n", name,
+	    bytes / elapsed / 1e9, copy / elapsed);
+}
+
+// what checking a file as it loads costs next to copying it into the buffer
+int main(void) {
+	char *text = malloc(BENCH_BYTES);
+	char *copy = malloc(BENCH_BYTES);
+	long sink = 0;
+	printf("%s\n", scan_implementation());
+	for (int mixed = 0; mixed < 2; mixed++) {
+		bench_fill(text, mixed);
+		printf("%s\n", mixed ? "a quarter multibyte" : "ascii");
+		// once untimed, so the copy isn't paying for faulting its pages in
+		memcpy(copy, text, BENCH_BYTES);
+
+		double start = bench_time();
+		for (int i = 0; i < BENCH_ROUNDS; i++) {
+			memcpy(copy, text, BENCH_BYTES);
+			sink += copy[i];
+		}
+		double copied = bench_time() - start;
+		report("memcpy", copied, copied);
+
+		start = bench_time();
+		for (int i = 0; i < BENCH_ROUNDS; i++) {
+			sink += scan_utf8_valid(text, BENCH_BYTES);
+		}
+		report("utf8_valid", bench_time() - start, copied);
+
+		start = bench_time();
+		for (int i = 0; i < BENCH_ROUNDS; i++) {
+			sink += scan_codepoints(text, BENCH_BYTES);
+		}
+		report("codepoints", bench_time() - start, copied);
+
+		// a column looked up in every line, as moving up and down does
+		start = bench_time();
+		for (int i = 0; i < BENCH_ROUNDS; i++) {
+			for (long line = 0; line + 80 < BENCH_BYTES; line += 80) {
+				sink += scan_codepoint_offset(&text[line], 80, 40);
+			}
+		}
+		report("column", bench_time() - start, copied);
+	}
+
+	printf("  checksum %ld\n", sink);
+	free(copy);
+	free(text);
+	return 0;
+}
@@ -1,47 +1,145 @@
 #include "app.h"
 #define NDEBUG
+#include "cursor_set.h"
 #include "file_manager.h"
+#include "line_index.h"
 #include "logger.h"
 #include "math/matrix.h"
 #include "primitives/font.h"
 #include "primitives/quad.h"
 #include "primitives/texture.h"
-#include "split_buffer.h"
+#include "regex.h"
+#include "scan.h"
+#include "text_buffer.h"
+#include "trigram_index.h"
+#include "undo.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define _POSIX_C_SOURCE 199309L
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
 #define CLOCK_MONOTONIC 1
 
+// files at least this big are mapped into a piece table instead of copied
+#define PIECE_TABLE_THRESHOLD (64L * 1024L * 1024L)
+// past this the gap buffer spends more time moving its gap than editing
+#define ROPE_THRESHOLD (4L * 1024L * 1024L)
+// undo history past this is forgotten, oldest first
+#define UNDO_LIMIT (64L * 1024L * 1024L)
+// files at least this big get a trigram index to search through
+#define TRIGRAM_INDEX_THRESHOLD (32L * 1024L * 1024L)
+#define TRIGRAM_INDEX_LIMIT (256L * 1024L * 1024L)
+// files at least this big are only mapped for viewing, never edited
+#define VIEWER_THRESHOLD (1024L * 1024L * 1024L)
+// what's laid out of any document, rows that fit on screen and the bytes of
+// each line that could possibly be seen
+#define VIEW_ROWS 23
+#define VIEW_COLUMNS 160
+// how far a row looks for a newline, longer lines are shown in pieces
+#define VIEW_LINE_LIMIT (1L << 20)
+
 enum input_context_t {
 	NO_CONTEXT = 0,
 	CONTROL_INPUT_CONTEXT,
 	TEXT_INPUT_CONTEXT,
 	FILE_INPUT_CONTEXT,
+	SEARCH_INPUT_CONTEXT,
+	LINE_INPUT_CONTEXT,
+	REPLACE_INPUT_CONTEXT,
 };
 
 int old_input_context;
 
 typedef struct app_state_t {
-	split_buffer_t buffer;
+	// the buffer on screen, and what it looked like when the state was taken
+	text_buffer_t *buffer;
+	long buffer_version;
+	long buffer_size;
 	char file_manager_text[256];
 	char filename[256];
 	int input_context;
 	long cursor_position;
-	float vertical_offset;
+	long cursor_count;
+	// where the first row on screen starts
+	long view_top;
 } app_state_t;
 
+/*
+an open file and everything kept for it besides its text, so switching to
+another and back loses and rereads nothing. the open ones are in a ring in
+the order they were opened.
+*/
+typedef struct app_document_t {
+	int handle;
+	char filename[256];
+	// streaming in, what's arrived can be read and searched but not edited
+	int loading;
+	long loaded;
+	// when it was asked for until its first screen is drawn, then how long
+	// that took in ms
+	double opened;
+	double first_screen;
+	undo_journal_t journal;
+	// only used while there is more than one cursor
+	cursor_set_t cursors;
+	trigram_index_t index;
+	int indexed;
+	// the first pass over a newly opened file hasn't been reported yet
+	int indexing;
+	// a file opened read only, drawn a screen at a time
+	int viewing;
+	line_index_t lines;
+	int counting;
+	// the cursor the screen last followed, scrolling leaves it behind, and
+	// the text the top of the screen was last put on a row start in
+	long view_cursor;
+	unsigned long view_version;
+	// a line jumped to before it was counted or loaded, retried every frame,
+	// and the end jumped to before it was loaded
+	long pending_line;
+	int pending_end;
+	// a save is being written in the background, reported when it's done
+	int saving;
+	// where the screen was when another document was switched to
+	long view_top;
+	struct app_document_t *next;
+	struct app_document_t *previous;
+} app_document_t;
+
 typedef struct app_t {
 	GLFWwindow *window;
 	app_state_t state;
+	// reused between frames, only grow when a screen has more spans or
+	// cursors than ever
+	text_span_t *spans;
+	long span_capacity;
+	long *cursors;
+	long cursor_capacity;
+	// the document on screen, scratch while nothing is open
+	app_document_t *document;
+	app_document_t scratch;
+	text_buffer_t scratch_buffer;
+	// open documents by file manager handle
+	app_document_t **documents;
+	int document_capacity;
+	// what's typed at the search prompt, compiled on the first search. one
+	// without any special characters is searched for as it is.
+	char search_text[256];
+	char search_pattern[256];
+	int search_compiled;
+	int search_literal;
+	regex_t search;
+	// what every match is replaced with
+	char replace_text[256];
+	// where the cursor was when the prompt opened, typing searches from here
+	long search_origin;
+	char line_text[32];
 } app_t;
 
 static app_t app;
@@ -56,6 +154,22 @@ void key_callback(
 void file_input_callback(int key, int scancode, int action, int mods);
 void control_input_callback(int key, int scancode, int action, int mods);
 void text_input_callback(int key, int scancode, int action, int mods);
+void search_input_callback(int key, int scancode, int action, int mods);
+void line_input_callback(int key, int scancode, int action, int mods);
+void replace_input_callback(int key, int scancode, int action, int mods);
+void app_close_index(void);
+void app_close_view(void);
+void app_view_settle(void);
+void app_view_follow(void);
+long app_gather_view(const long *cursors, long cursor_count, long *shown);
+void app_goto_line(long line);
+void app_reload(void);
+void app_close(void);
+void app_first_screen(void);
+void app_loading(void);
+void app_loaded(result_t res);
+void app_open(int view);
+long app_codepoint_step(int forward);
 
 result_t app_startup(void) {
 	trace("app starting...");
@@ -107,8 +221,15 @@ result_t app_startup(void) {
 	app.state.filename[0] = '\0';
 	app.state.file_manager_text[0] = '\0';
 	app.state.cursor_position = 0;
-	split_buffer_create(&app.state.buffer, "");
-	app.state.vertical_offset = 0.0f;
+	text_buffer_create(&app.scratch_buffer, SPLIT_BUFFER_BACKEND, "");
+	app.scratch.handle = FILE_MANAGER_NO_HANDLE;
+	app.scratch.view_cursor = -1;
+	undo_journal_create(&app.scratch.journal, UNDO_LIMIT);
+	cursor_set_create(&app.scratch.cursors);
+	app.document = &app.scratch;
+	app.state.buffer = &app.scratch_buffer;
+	app.state.cursor_count = 0;
+	app.state.view_top = 0;
 	app.state.input_context = NO_CONTEXT;
 
 	return NO_ERROR;
@@ -116,6 +237,28 @@ result_t app_startup(void) {
 
 void app_shutdown(void) {
 	info("app shutting.");
+	free(app.spans);
+	app.spans = NULL;
+	app.span_capacity = 0;
+	free(app.cursors);
+	app.cursors = NULL;
+	app.cursor_capacity = 0;
+	if (app.document != NULL) {
+		while (app.document != &app.scratch) {
+			app_close();
+		}
+		undo_journal_destroy(&app.scratch.journal);
+		cursor_set_destroy(&app.scratch.cursors);
+		text_buffer_destroy(&app.scratch_buffer);
+		app.document = NULL;
+	}
+	free(app.documents);
+	app.documents = NULL;
+	app.document_capacity = 0;
+	if (app.search_compiled) {
+		regex_destroy(&app.search);
+		app.search_compiled = 0;
+	}
 	glfwTerminate();
 	file_manager_shutdown();
 	logger_shutdown();
@@ -134,6 +277,36 @@ void app_sleep(int64_t ms) {
 	nanosleep(&ts, 0);
 }
 
+int app_push_span(long count, text_span_t span) {
+	if (count == app.span_capacity) {
+		long capacity = app.span_capacity ? app.span_capacity * 2 : 16;
+		text_span_t *spans = realloc(app.spans, capacity * sizeof(text_span_t));
+		if (spans == NULL) {
+			error("failed to grow span list!");
+			return 0;
+		}
+		app.spans = spans;
+		app.span_capacity = capacity;
+	}
+	app.spans[count] = span;
+	return 1;
+}
+
+int app_push_cursor(long count, long cursor) {
+	if (count == app.cursor_capacity) {
+		long capacity = app.cursor_capacity ? app.cursor_capacity * 2 : 16;
+		long *cursors = realloc(app.cursors, capacity * sizeof(long));
+		if (cursors == NULL) {
+			error("failed to grow cursor list!");
+			return 0;
+		}
+		app.cursors = cursors;
+		app.cursor_capacity = capacity;
+	}
+	app.cursors[count] = cursor;
+	return 1;
+}
+
 result_t app_run(void) {
 	info("app running");
 
@@ -189,17 +362,102 @@ result_t app_run(void) {
 		render_object_draw(&file_manager_hint.object);
 
 		glfwSwapBuffers(app.window);
+		// the first frame with a newly opened file's text in it
+		if (app.document->opened > 0.0) {
+			app_first_screen();
+		}
 		glfwPollEvents();
+		if (app.document->loading) {
+			result_t res;
+			if (file_manager_loaded(app.document->handle, &res)) {
+				app_loaded(res);
+			} else {
+				app_loading();
+			}
+		}
+		// the ones not on screen keep streaming in too
+		file_manager_stream();
+		app_document_t *document = app.document;
+		if (document->indexed) {
+			trigram_index_refresh(&document->index);
+			if (document->indexing && !trigram_index_busy(&document->index)) {
+				sprintf(app.state.file_manager_text, "indexed in %ld MB",
+				    trigram_index_memory(&document->index) >> 20);
+				document->indexing = 0;
+			}
+		}
+		if (app.state.input_context == FILE_INPUT_CONTEXT) {
+			long size;
+			int directory;
+			if (file_manager_prefetched(&size, &directory)) {
+				if (size < 0) {
+					strcpy(app.state.file_manager_text, "new file");
+				} else if (directory) {
+					strcpy(app.state.file_manager_text, "directory");
+				} else {
+					sprintf(app.state.file_manager_text, "%.1f MB",
+					    size / 1048576.0);
+				}
+			}
+		}
+		// only the document on screen is asked about, the others are once
+		// they're switched to
+		if (document->saving) {
+			long written;
+			long length;
+			if (file_manager_saving(document->handle, &written, &length)) {
+				sprintf(app.state.file_manager_text, "saving %ld%%",
+				    length ? written * 100 / length : 0);
+			} else if (file_manager_save_result(document->handle) == NO_ERROR) {
+				sprintf(app.state.file_manager_text, "saved %s",
+				    document->filename);
+				document->saving = 0;
+			} else {
+				sprintf(app.state.file_manager_text, "failed to save %s",
+				    document->filename);
+				document->saving = 0;
+			}
+		}
+		if (file_manager_changed(document->handle)) {
+			app_reload();
+		}
+		if (document->pending_line) {
+			app_goto_line(document->pending_line);
+		}
+		if (document->viewing) {
+			int done;
+			long lines = line_index_line_count(&document->lines, &done);
+			if (document->counting && done) {
+				sprintf(app.state.file_manager_text, "%ld lines", lines);
+				document->counting = 0;
+			}
+		}
+		app_view_settle();
+		app_view_follow();
+		app.state.buffer_version = app.state.buffer->version;
+		app.state.buffer_size = text_buffer_size(app.state.buffer);
+		app.state.cursor_position = text_buffer_cursor(app.state.buffer);
 
 		// update application state if the two states dont match
 		if (memcmp(&previous_state, &app.state, sizeof(app_state_t))) {
 			trace("changed state");
-			// update file content display
-			if (app.state.buffer.current_size != previous_state.buffer.current_size) {
-				char *string = split_buffer_to_string(&app.state.buffer);
-				font_update(&font, app.state.buffer.pre_cursor_index, string,
-				    app.state.vertical_offset);
-				free(string);
+			// update file content display, cursor position and projection matrix
+			if (app.state.buffer != previous_state.buffer ||
+			    app.state.buffer_version != previous_state.buffer_version ||
+			    app.state.buffer_size != previous_state.buffer_size ||
+			    app.state.cursor_position != previous_state.cursor_position ||
+			    app.state.cursor_count != previous_state.cursor_count ||
+			    app.state.view_top != previous_state.view_top) {
+				// only the rows on screen are laid out, however big the
+				// buffer is
+				long cursor = text_buffer_cursor(app.state.buffer);
+				long shown;
+				long span_count = document->cursors.count > 1
+				                      ? app_gather_view(document->cursors.offsets,
+				                            document->cursors.count, &shown)
+				                      : app_gather_view(&cursor, 1, &shown);
+				font_update_cursors(
+				    &font, app.cursors, shown, app.spans, span_count, 0.0f);
 			}
 			// update filename display
 			if (strcmp(app.state.filename, previous_state.filename)) {
@@ -210,21 +468,6 @@ result_t app_run(void) {
 			        app.state.file_manager_text, previous_state.file_manager_text)) {
 				font_update(&file_manager_hint, -1, app.state.file_manager_text, 0.0f);
 			}
-			// update cursor position
-			if (app.state.buffer.pre_cursor_index !=
-			    previous_state.buffer.pre_cursor_index) {
-				char *string = split_buffer_to_string(&app.state.buffer);
-				font_update(&font, app.state.buffer.pre_cursor_index, string,
-				    app.state.vertical_offset);
-				free(string);
-			}
-			// update projection matrix
-			if (app.state.vertical_offset != previous_state.vertical_offset) {
-				char *string = split_buffer_to_string(&app.state.buffer);
-				font_update(&font, app.state.buffer.pre_cursor_index, string,
-				    app.state.vertical_offset);
-				free(string);
-			}
 			previous_state = app.state;
 		}
 		double current = app_get_time();
@@ -245,6 +488,711 @@ void check_for_state_change(app_t previous_state) {
 		return;
 }
 
+text_buffer_backend_t app_pick_backend(const char *filepath) {
+	struct stat file_stat;
+	if (stat(filepath, &file_stat)) {
+		return SPLIT_BUFFER_BACKEND;
+	}
+	if (file_stat.st_size >= PIECE_TABLE_THRESHOLD) {
+		return PIECE_TABLE_BACKEND;
+	}
+	if (file_stat.st_size >= ROPE_THRESHOLD) {
+		return ROPE_BACKEND;
+	}
+	return SPLIT_BUFFER_BACKEND;
+}
+
+void app_close_index(void) {
+	if (app.document->indexed) {
+		trigram_index_destroy(&app.document->index);
+		app.document->indexed = 0;
+		app.document->indexing = 0;
+	}
+}
+
+// big files are indexed in the background, searching works without it
+void app_open_index(void) {
+	app_close_index();
+	if (text_buffer_size(app.state.buffer) < TRIGRAM_INDEX_THRESHOLD) {
+		return;
+	}
+	if (trigram_index_create(&app.document->index, app.state.buffer,
+	        TRIGRAM_INDEX_LIMIT) == NO_ERROR) {
+		app.document->indexed = 1;
+		app.document->indexing = 1;
+	}
+}
+
+void app_close_view(void) {
+	if (app.document->viewing) {
+		line_index_destroy(&app.document->lines);
+		app.document->viewing = 0;
+		app.document->counting = 0;
+	}
+	app.document->pending_line = 0;
+	app.document->pending_end = 0;
+	app.document->view_cursor = -1;
+	app.state.view_top = 0;
+}
+
+// files too big to edit, or that can't be written to, are opened for viewing
+int app_should_view(const char *filepath) {
+	struct stat file_stat;
+	if (stat(filepath, &file_stat)) {
+		return 0;
+	}
+	return file_stat.st_size >= VIEWER_THRESHOLD || access(filepath, W_OK);
+}
+
+// nothing here reads the file, lines are counted in the background and only
+// the rows on screen are ever laid out
+result_t app_open_view(void) {
+	result_t res = line_index_create(&app.document->lines, app.state.buffer);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	app.document->viewing = 1;
+	app.document->counting = 1;
+	return NO_ERROR;
+}
+
+// what's on screen of a document, as much as has arrived while it loads
+text_buffer_t *app_document_buffer(app_document_t *document) {
+	if (document == &app.scratch) {
+		return &app.scratch_buffer;
+	}
+	return file_manager_buffer(document->handle);
+}
+
+// switching keeps where the screen was in the one left
+void app_show(app_document_t *document) {
+	app.document->view_top = app.state.view_top;
+	app.document = document;
+	app.state.buffer = app_document_buffer(document);
+	app.state.view_top = document->view_top;
+	app.state.cursor_count = document->cursors.count;
+	strcpy(app.state.filename, document->filename);
+}
+
+// a document for a file just opened, after the one on screen in the ring
+app_document_t *app_document_create(int handle) {
+	if (handle >= app.document_capacity) {
+		int capacity = app.document_capacity ? app.document_capacity : 16;
+		while (capacity <= handle) {
+			capacity *= 2;
+		}
+		app_document_t **documents =
+		    realloc(app.documents, capacity * sizeof(app_document_t *));
+		if (documents == NULL) {
+			error("failed to grow document list!");
+			return NULL;
+		}
+		memset(&documents[app.document_capacity], 0,
+		    (capacity - app.document_capacity) * sizeof(app_document_t *));
+		app.documents = documents;
+		app.document_capacity = capacity;
+	}
+	app_document_t *document = calloc(1, sizeof(app_document_t));
+	if (document == NULL) {
+		error("failed to allocate document!");
+		return NULL;
+	}
+	document->handle = handle;
+	document->view_cursor = -1;
+	undo_journal_create(&document->journal, UNDO_LIMIT);
+	cursor_set_create(&document->cursors);
+	if (app.document == &app.scratch) {
+		document->next = document;
+		document->previous = document;
+	} else {
+		document->next = app.document->next;
+		document->previous = app.document;
+		document->next->previous = document;
+		app.document->next = document;
+	}
+	app.documents[handle] = document;
+	return document;
+}
+
+// closes the document on screen, the one after it takes its place
+void app_close(void) {
+	app_document_t *document = app.document;
+	app_close_index();
+	app_close_view();
+	app_show(document->next == document ? &app.scratch : document->next);
+	document->previous->next = document->next;
+	document->next->previous = document->previous;
+	app.documents[document->handle] = NULL;
+	file_manager_close(document->handle);
+	undo_journal_destroy(&document->journal);
+	cursor_set_destroy(&document->cursors);
+	free(document);
+}
+
+// how long the first screen of the document took to be drawn from when it was
+// asked for, time to first glyph
+void app_first_screen(void) {
+	app_document_t *document = app.document;
+	document->first_screen = (app_get_time() - document->opened) * 1000.0;
+	document->opened = 0.0;
+	debug("first screen of %s in %.1f ms", document->filename,
+	    document->first_screen);
+	// shown with the next bit of it that arrives
+	document->loaded = -1;
+}
+
+// how far along the document on screen is, and what's in it so far
+void app_loading(void) {
+	app_document_t *document = app.document;
+	long loaded;
+	long length;
+	if (!file_manager_loading(document->handle, &loaded, &length) ||
+	    loaded == document->loaded) {
+		return;
+	}
+	document->loaded = loaded;
+	int share = (int)(loaded * 100 / length);
+	long lines = text_buffer_line_count(app.state.buffer);
+	if (document->first_screen > 0.0) {
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text),
+		    "loading %d%%, %ld lines so far, first screen in %.1f ms", share,
+		    lines, document->first_screen);
+	} else {
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text),
+		    "loading %d%%, %ld lines so far", share, lines);
+	}
+}
+
+// a file opened in the background has all arrived, or couldn't be read
+void app_loaded(result_t res) {
+	app_document_t *document = app.document;
+	document->loading = 0;
+	if (res != NO_ERROR) {
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "failed to open %s",
+		    document->filename);
+		app_close();
+		return;
+	}
+	// an end jumped to while it loaded is there now
+	if (document->pending_end) {
+		document->pending_end = 0;
+		text_buffer_goto_line(
+		    app.state.buffer, text_buffer_line_count(app.state.buffer) - 1);
+	}
+	long recovered = file_manager_recovered(document->handle);
+	int bom;
+	encoding_t encoding = file_manager_encoding(document->handle, &bom);
+	if (recovered) {
+		sprintf(app.state.file_manager_text, "recovered %ld unsaved edits",
+		    recovered);
+	} else if (encoding != ENCODING_UTF8) {
+		// saving writes it back the way it was
+		sprintf(app.state.file_manager_text, "%ld lines, read as %s",
+		    text_buffer_line_count(app.state.buffer), encoding_name(encoding));
+	} else if (app.state.buffer->backend == PIECE_TABLE_BACKEND) {
+		// counting its lines would read all of it, they're counted once one
+		// is asked for
+		sprintf(app.state.file_manager_text, "%.1f MB, mapped",
+		    text_buffer_size(app.state.buffer) / 1048576.0);
+	} else {
+		// bytes that aren't utf-8 are drawn as replacement glyphs, say where
+		// they start
+		long invalid;
+		long codepoints = file_manager_codepoints(document->handle, &invalid);
+		if (invalid >= 0) {
+			sprintf(app.state.file_manager_text,
+			    "%ld lines, not utf-8 from byte %ld",
+			    text_buffer_line_count(app.state.buffer), invalid);
+		} else {
+			sprintf(app.state.file_manager_text,
+			    "%ld lines, %ld characters, %.0f MB/s",
+			    text_buffer_line_count(app.state.buffer), codepoints,
+			    file_manager_load_rate(document->handle));
+		}
+	}
+	app_open_index();
+}
+
+// opens the file named at the prompt, or switches to it if it's open already
+void app_open(int view) {
+	int handle = file_manager_find(app.state.filename);
+	if (handle != FILE_MANAGER_NO_HANDLE && handle < app.document_capacity &&
+	    app.documents[handle] != NULL) {
+		app_show(app.documents[handle]);
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "switched to %s",
+		    app.state.filename);
+		change_input_context(TEXT_INPUT_CONTEXT);
+		return;
+	}
+	view = view || app_should_view(app.state.filename);
+	result_t res = view ? file_manager_view(app.state.filename, &handle)
+	                    : file_manager_open_background(app.state.filename,
+	                          app_pick_backend(app.state.filename), &handle);
+	if (res != NO_ERROR) {
+		error("error opening file!");
+		return;
+	}
+	app_document_t *document = app_document_create(handle);
+	if (document == NULL) {
+		file_manager_close(handle);
+		return;
+	}
+	strcpy(document->filename, app.state.filename);
+	document->loading = !view;
+	document->opened = app_get_time();
+	app_show(document);
+	if (view && app_open_view() != NO_ERROR) {
+		app_close();
+		return;
+	}
+	if (view) {
+		strcpy(app.state.file_manager_text, "counting lines");
+	} else {
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "loading %s",
+		    document->filename);
+	}
+	change_input_context(TEXT_INPUT_CONTEXT);
+}
+
+// first newline in the limit bytes from offset, -1 if there isn't one
+long app_find_newline(long offset, long limit) {
+	const text_buffer_t *buffer = app.state.buffer;
+	long size = text_buffer_size(buffer);
+	long end = limit < size - offset ? offset + limit : size;
+	while (offset < end) {
+		const char *text;
+		long length = text_buffer_span_at(buffer, offset, &text);
+		length = length < end - offset ? length : end - offset;
+		const char *found = scan_memchr(text, '\n', length);
+		if (found != NULL) {
+			return offset + (found - text);
+		}
+		offset += length;
+	}
+	return -1;
+}
+
+// last newline in the limit bytes before offset, -1 if there isn't one
+long app_find_newline_before(long offset, long limit) {
+	const text_buffer_t *buffer = app.state.buffer;
+	long start = offset > limit ? offset - limit : 0;
+	while (offset > start) {
+		const char *text;
+		long length = text_buffer_span_before(buffer, offset, &text);
+		if (length > offset - start) {
+			text += length - (offset - start);
+			length = offset - start;
+		}
+		const char *found = scan_memrchr(text, '\n', length);
+		if (found != NULL) {
+			return offset - length + (found - text);
+		}
+		offset -= length;
+	}
+	return -1;
+}
+
+/*
+rows are lines, except that the viewer never looks further than
+VIEW_LINE_LIMIT for a newline so a file without any still scrolls in bounded
+time. such a line is cut into rows wherever the search gave up.
+*/
+long app_view_row_start(long offset) {
+	long newline = app_find_newline_before(offset, VIEW_LINE_LIMIT);
+	if (newline >= 0) {
+		return newline + 1;
+	}
+	return offset > VIEW_LINE_LIMIT ? offset - VIEW_LINE_LIMIT : 0;
+}
+
+// where the row after the one starting at offset starts, -1 on the last row
+long app_view_next_row(long offset) {
+	long newline = app_find_newline(offset, VIEW_LINE_LIMIT);
+	if (newline >= 0) {
+		return newline + 1;
+	}
+	long size = text_buffer_size(app.state.buffer);
+	return size - offset > VIEW_LINE_LIMIT ? offset + VIEW_LINE_LIMIT : -1;
+}
+
+long app_view_previous_row(long offset) {
+	return offset > 0 ? app_view_row_start(offset - 1) : 0;
+}
+
+// edits shift the text under the top of the screen, it's put back on the
+// start of a row and the cursor is followed again however it moved
+void app_view_settle(void) {
+	app_document_t *document = app.document;
+	long size = text_buffer_size(app.state.buffer);
+	if (document->view_version == app.state.buffer->version &&
+	    app.state.view_top <= size) {
+		return;
+	}
+	document->view_version = app.state.buffer->version;
+	document->view_cursor = -1;
+	long top = app.state.view_top < size ? app.state.view_top : size;
+	app.state.view_top = app_view_row_start(top);
+}
+
+// scrolls just enough to bring the cursor on screen after it moves
+void app_view_follow(void) {
+	long cursor = text_buffer_cursor(app.state.buffer);
+	if (cursor == app.document->view_cursor) {
+		return;
+	}
+	app.document->view_cursor = cursor;
+
+	long row = app_view_row_start(cursor);
+	long top = app.state.view_top;
+	if (row < top) {
+		app.state.view_top = row;
+		return;
+	}
+	for (int i = 0; i < VIEW_ROWS && top >= 0; i++) {
+		if (top == row) {
+			return;
+		}
+		top = app_view_next_row(top);
+	}
+	for (int i = 1; i < VIEW_ROWS; i++) {
+		row = app_view_previous_row(row);
+	}
+	app.state.view_top = row;
+}
+
+/*
+points app.spans at the rows on screen, each cut to VIEW_COLUMNS bytes and
+ended with a newline of its own when it's cut, without copying any text.
+cursors must be ascending, app.cursors gets where each of the shown ones lands
+among the gathered text.
+*/
+long app_gather_view(const long *cursors, long cursor_count, long *shown) {
+	static const char newline = '\n';
+	const text_buffer_t *buffer = app.state.buffer;
+	long size = text_buffer_size(buffer);
+	long count = 0;
+	long gathered = 0;
+	long top = app.state.view_top;
+	long cursor = 0;
+	*shown = 0;
+	while (cursor < cursor_count && cursors[cursor] < top) {
+		cursor++;
+	}
+	for (int row = 0; row < VIEW_ROWS && top >= 0; row++) {
+		long next = app_view_next_row(top);
+		long end = next < 0 ? size : next;
+		long width = end - top < VIEW_COLUMNS ? end - top : VIEW_COLUMNS;
+		while (cursor < cursor_count && (cursors[cursor] < end || next < 0)) {
+			long at = cursors[cursor++] - top;
+			if (app_push_cursor(*shown, gathered + (at < width ? at : width))) {
+				(*shown)++;
+			}
+		}
+
+		text_buffer_iterator_t iterator;
+		text_span_t span;
+		text_buffer_iterator_begin(buffer, &iterator, top, top + width);
+		while (text_buffer_iterator_next(&iterator, &span)) {
+			if (!app_push_span(count, span)) {
+				return count;
+			}
+			count++;
+		}
+		gathered += width;
+		if (width < end - top) {
+			if (!app_push_span(count, (text_span_t){&newline, 1})) {
+				return count;
+			}
+			count++;
+			gathered++;
+		}
+		top = next;
+	}
+	return count;
+}
+
+// another program wrote the open file, what it changed comes in as one edit
+// that can be undone like any other
+void app_reload(void) {
+	app_document_t *document = app.document;
+	cursor_set_clear(&document->cursors);
+	if (file_manager_reload(document->handle, &document->journal) !=
+	    NO_ERROR) {
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "%s changed on disk",
+		    document->filename);
+		return;
+	}
+	// the line index only knows text that doesn't change, so it starts over
+	if (document->viewing) {
+		line_index_destroy(&document->lines);
+		document->viewing = 0;
+		if (line_index_create(&document->lines, app.state.buffer) == NO_ERROR) {
+			document->viewing = 1;
+			document->counting = 1;
+		}
+	}
+	snprintf(app.state.file_manager_text, sizeof(app.state.file_manager_text),
+	    "reloaded %s", document->filename);
+}
+
+// the buffers refuse a move of no distance, so the cursor only moves when
+// it's going somewhere
+void app_move_to(long offset) {
+	long distance = offset - text_buffer_cursor(app.state.buffer);
+	if (distance) {
+		text_buffer_move(app.state.buffer, distance);
+	}
+}
+
+// jumps to a line typed at the prompt, counting from one. a viewed file may
+// not be counted that far yet, or a loading one not loaded that far, then the
+// jump waits for it
+void app_goto_line(long line) {
+	text_buffer_t *buffer = app.state.buffer;
+	if (line < 1) {
+		line = 1;
+	}
+	if (app.document->viewing) {
+		int done;
+		long lines = line_index_line_count(&app.document->lines, &done);
+		if (done && line > lines) {
+			line = lines;
+		}
+		long offset = line_index_line_start(&app.document->lines, line - 1);
+		if (offset < 0) {
+			if (app.document->pending_line != line) {
+				sprintf(app.state.file_manager_text, "counting to %ld", line);
+			}
+			app.document->pending_line = line;
+			return;
+		}
+		app.document->pending_line = 0;
+		app_move_to(offset);
+	} else if (app.document->loading &&
+	           line > text_buffer_line_count(buffer)) {
+		if (app.document->pending_line != line) {
+			sprintf(app.state.file_manager_text, "waiting for line %ld", line);
+		}
+		app.document->pending_line = line;
+		return;
+	} else if (text_buffer_goto_line(buffer, line - 1) != NO_ERROR) {
+		app.document->pending_line = 0;
+		sprintf(app.state.file_manager_text, "no line %ld", line);
+		return;
+	}
+	app.document->pending_line = 0;
+	app.document->pending_end = 0;
+	cursor_set_clear(&app.document->cursors);
+	sprintf(app.state.file_manager_text, "line %ld", line);
+}
+
+// viewed files can't be edited, nor ones still loading, says so instead
+int app_readonly(void) {
+	if (app.document->loading) {
+		strcpy(app.state.file_manager_text, "still loading");
+	} else if (app.document->viewing) {
+		strcpy(app.state.file_manager_text, "read only");
+	}
+	return app.document->loading || app.document->viewing;
+}
+
+// bytes in the codepoint after the cursor, or before it, so left and right
+// never stop part way through one
+long app_codepoint_step(int forward) {
+	text_buffer_t *buffer = app.state.buffer;
+	long cursor = text_buffer_cursor(buffer);
+	const char *text;
+	long length = forward ? text_buffer_span_at(buffer, cursor, &text)
+	                      : text_buffer_span_before(buffer, cursor, &text);
+	long step = 1;
+	if (forward) {
+		while (step < length && step < 4 && (text[step] & 0xC0) == 0x80) {
+			step++;
+		}
+	} else {
+		while (step < length && step < 4 &&
+		       (text[length - step] & 0xC0) == 0x80) {
+			step++;
+		}
+	}
+	return step;
+}
+
+// compiles the search prompt unless it's what was compiled last time
+int app_search_compile(void) {
+	if (app.search_compiled && !strcmp(app.search_pattern, app.search_text)) {
+		return 1;
+	}
+	if (app.search_compiled) {
+		regex_destroy(&app.search);
+		app.search_compiled = 0;
+	}
+	if (regex_compile(&app.search, app.search_text, strlen(app.search_text)) !=
+	    NO_ERROR) {
+		return 0;
+	}
+	strcpy(app.search_pattern, app.search_text);
+	app.search_compiled = 1;
+	app.search_literal = strpbrk(app.search_text, "\\.[]()|*+?{}^$") == NULL;
+	return 1;
+}
+
+// next match at or after offset without wrapping. with an index the literal
+// every match starts with is looked up in it first, the leftmost match can't
+// start before that
+int app_search_from(long offset, long *start, long *end) {
+	if (app.document->indexed && app.search.prefix_length >= 3) {
+		offset = trigram_index_find(&app.document->index, offset,
+		    app.search.prefix, app.search.prefix_length);
+		if (offset < 0) {
+			return 0;
+		}
+	}
+	if (!app.search_literal) {
+		return regex_search_next(
+		    &app.search, app.state.buffer, offset, start, end);
+	}
+	long length = strlen(app.search_text);
+	*start = text_buffer_search_next(
+	    app.state.buffer, offset, app.search_text, length);
+	*end = *start + length;
+	return *start >= 0;
+}
+
+// the match before the one ending at or before offset
+int app_search_before(long offset, long *start, long *end) {
+	if (!app.search_literal) {
+		return regex_search_previous(
+		    &app.search, app.state.buffer, offset, start, end);
+	}
+	long length = strlen(app.search_text);
+	*start = text_buffer_search_previous(
+	    app.state.buffer, offset, app.search_text, length);
+	*end = *start + length;
+	return *start >= 0;
+}
+
+// next match at or after offset, wrapping around to the start
+int app_search_next(long offset, long *start, long *end) {
+	return app_search_from(offset, start, end) || app_search_from(0, start, end);
+}
+
+// moves the cursor to the next match of the search prompt, or the previous
+// one going backwards, wrapping around the ends of the buffer
+void app_search(int backwards) {
+	if (!app_search_compile()) {
+		strcpy(app.state.file_manager_text, "bad pattern");
+		return;
+	}
+
+	text_buffer_t *buffer = app.state.buffer;
+	long cursor = text_buffer_cursor(buffer);
+	long size = text_buffer_size(buffer);
+	long start;
+	long end;
+	int found;
+	if (backwards) {
+		found = app_search_before(cursor, &start, &end) ||
+		        app_search_before(size, &start, &end);
+	} else {
+		// one past the cursor so searching again moves on to the next match
+		found = app_search_next(cursor + (cursor < size), &start, &end);
+	}
+	if (!found) {
+		// only what's arrived was searched
+		strcpy(app.state.file_manager_text,
+		    app.document->loading ? "no match yet" : "no match");
+		return;
+	}
+
+	cursor_set_clear(&app.document->cursors);
+	app_move_to(start);
+	sprintf(app.state.file_manager_text, "match at %ld", start);
+}
+
+// follows the prompt as it's typed, back to where it opened if nothing matches
+void app_search_incremental(void) {
+	long target = app.search_origin;
+	long start;
+	long end;
+	if (app.search_text[0] != '\0' && app_search_compile() &&
+	    app_search_next(app.search_origin, &start, &end)) {
+		target = start;
+	}
+	cursor_set_clear(&app.document->cursors);
+	app_move_to(target);
+}
+
+// swaps every match of the search prompt for what's typed at the replace
+// prompt, undone in one go. every match of a plain string is the same length
+// so the split buffer can rebuild itself in one pass.
+void app_replace_all(void) {
+	if (app_readonly()) {
+		return;
+	}
+	if (!app_search_compile()) {
+		strcpy(app.state.file_manager_text, "bad pattern");
+		return;
+	}
+
+	undo_change_t *changes = NULL;
+	long *offsets = NULL;
+	long count = 0;
+	long capacity = 0;
+	long offset = 0;
+	long start;
+	long end;
+	long length = strlen(app.replace_text);
+	while (app_search_from(offset, &start, &end)) {
+		offset = end > start ? end : end + 1;
+		// an empty match has nothing to replace
+		if (end == start) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			long *grown_offsets = realloc(offsets, capacity * sizeof(long));
+			offsets = grown_offsets ? grown_offsets : offsets;
+			undo_change_t *grown_changes =
+			    realloc(changes, capacity * sizeof(undo_change_t));
+			changes = grown_changes ? grown_changes : changes;
+			if (grown_offsets == NULL || grown_changes == NULL) {
+				error("failed to grow match list!");
+				free(offsets);
+				free(changes);
+				return;
+			}
+		}
+		offsets[count] = start;
+		changes[count] = (undo_change_t){start, end, app.replace_text, length};
+		count++;
+	}
+
+	result_t res = NO_ERROR;
+	if (count) {
+		cursor_set_clear(&app.document->cursors);
+		res = app.search_literal
+		          ? undo_journal_replace_at_each(&app.document->journal,
+		                app.state.buffer, offsets, count,
+		                (long)strlen(app.search_text), app.replace_text, length)
+		          : undo_journal_replace_each(&app.document->journal,
+		                app.state.buffer, changes, count);
+	}
+	free(offsets);
+	free(changes);
+	if (res != NO_ERROR) {
+		strcpy(app.state.file_manager_text, "failed to replace");
+	} else {
+		sprintf(app.state.file_manager_text, "replaced %ld", count);
+	}
+}
+
 void change_input_context(int new_context) {
 	if (new_context == app.state.input_context) {
 		return;
@@ -255,6 +1203,9 @@ void change_input_context(int new_context) {
 	    "Control Context",
 	    "Text Context",
 	    "File Context",
+	    "Search Context",
+	    "Line Context",
+	    "Replace Context",
 	};
 
 	debug("switching context from %s to %s",
@@ -289,7 +1240,17 @@ void key_callback(
 			break;
 		case FILE_INPUT_CONTEXT:
 			file_input_callback(key, scancode, action, mods);
+			break;
+		case SEARCH_INPUT_CONTEXT:
+			search_input_callback(key, scancode, action, mods);
+			break;
+		case LINE_INPUT_CONTEXT:
+			line_input_callback(key, scancode, action, mods);
+			break;
+		case REPLACE_INPUT_CONTEXT:
+			replace_input_callback(key, scancode, action, mods);
 		}
+		app.state.cursor_count = app.document->cursors.count;
 	}
 	if (action == GLFW_RELEASE) {
 		switch (key) {
@@ -307,29 +1268,146 @@ void control_input_callback(int key, int scancode, int action, int mods) {
 	result_t res;
 	switch (key) {
 	case GLFW_KEY_S:
-		res = file_manager_save(&app.state.buffer);
+		if (app_readonly()) {
+			break;
+		}
+		res = file_manager_save_background(app.document->handle);
 		if (res != NO_ERROR) {
+			if (!file_manager_encodable(app.document->handle)) {
+				int bom;
+				snprintf(app.state.file_manager_text,
+				    sizeof(app.state.file_manager_text), "can't save %s as %s",
+				    app.state.filename,
+				    encoding_name(
+				        file_manager_encoding(app.document->handle, &bom)));
+			}
 			return;
 		}
-		sprintf(app.state.file_manager_text, "saved %s", app.state.filename);
+		sprintf(app.state.file_manager_text, "saving %s", app.state.filename);
+		app.document->saving = 1;
 		change_input_context(TEXT_INPUT_CONTEXT);
 		break;
 	case GLFW_KEY_Q:
+		if (app.document == &app.scratch) {
+			break;
+		}
 		sprintf(app.state.file_manager_text, "closed %s", app.state.filename);
-		file_manager_close();
-		split_buffer_destroy(&app.state.buffer);
-		app.state.filename[0] = '\0';
-		old_input_context = NO_CONTEXT;
-		break;
+		// a save still being written is waited for without being reported
+		app_close();
+		old_input_context =
+		    app.document == &app.scratch ? NO_CONTEXT : TEXT_INPUT_CONTEXT;
+		break;
+	case GLFW_KEY_TAB: {
+		// through the open documents, backwards with shift
+		app_document_t *document = app.document;
+		if (document == &app.scratch || document->next == document) {
+			break;
+		}
+		app_show(mods & GLFW_MOD_SHIFT ? document->previous : document->next);
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "%s", app.state.filename);
+	} break;
 	case GLFW_KEY_O: {
 		strcpy(app.state.file_manager_text, "opening file");
 		old_input_context = FILE_INPUT_CONTEXT;
 	} break;
+	case GLFW_KEY_F:
+		app.search_text[0] = '\0';
+		app.search_origin = text_buffer_cursor(app.state.buffer);
+		strcpy(app.state.file_manager_text, "/");
+		old_input_context = SEARCH_INPUT_CONTEXT;
+		break;
+	case GLFW_KEY_G:
+		if (app.search_text[0] != '\0') {
+			app_search(mods & GLFW_MOD_SHIFT);
+		}
+		break;
+	case GLFW_KEY_R:
+		// replaces what was last searched for
+		if (app.search_text[0] == '\0') {
+			strcpy(app.state.file_manager_text, "nothing searched for");
+			break;
+		}
+		app.replace_text[0] = '\0';
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "/%s/", app.search_text);
+		old_input_context = REPLACE_INPUT_CONTEXT;
+		break;
+	case GLFW_KEY_L:
+		app.line_text[0] = '\0';
+		strcpy(app.state.file_manager_text, ":");
+		old_input_context = LINE_INPUT_CONTEXT;
+		break;
 	case GLFW_KEY_UP: {
-		app.state.vertical_offset += 14.0f;
+		if (mods & GLFW_MOD_SHIFT) {
+			cursor_set_clear(&app.document->cursors);
+			break;
+		}
+		app.state.view_top = app_view_previous_row(app.state.view_top);
 	} break;
 	case GLFW_KEY_DOWN: {
-		app.state.vertical_offset -= 14.0f;
+		if (mods & GLFW_MOD_SHIFT && !app.document->viewing) {
+			cursor_set_add_below(&app.document->cursors, app.state.buffer);
+			break;
+		}
+		long next = app_view_next_row(app.state.view_top);
+		app.state.view_top = next < 0 ? app.state.view_top : next;
+	} break;
+	case GLFW_KEY_V: {
+		if (app_readonly()) {
+			break;
+		}
+		const char *clipboard = glfwGetClipboardString(app.window);
+		if (clipboard == NULL) {
+			break;
+		}
+		if (app.document->cursors.count > 1) {
+			cursor_set_insert(&app.document->cursors, &app.document->journal,
+			    app.state.buffer, clipboard, strlen(clipboard));
+		} else {
+			undo_journal_insert(&app.document->journal, app.state.buffer,
+			    clipboard, strlen(clipboard));
+		}
+	} break;
+	case GLFW_KEY_Z:
+		if (app_readonly()) {
+			break;
+		}
+		cursor_set_clear(&app.document->cursors);
+		if (mods & GLFW_MOD_SHIFT) {
+			undo_journal_redo(&app.document->journal, app.state.buffer);
+		} else {
+			undo_journal_undo(&app.document->journal, app.state.buffer);
+		}
+		break;
+	case GLFW_KEY_Y:
+		if (app_readonly()) {
+			break;
+		}
+		cursor_set_clear(&app.document->cursors);
+		undo_journal_redo(&app.document->journal, app.state.buffer);
+		break;
+	case GLFW_KEY_HOME:
+		app.document->pending_line = 0;
+		app.document->pending_end = 0;
+		text_buffer_goto_line(app.state.buffer, 0);
+		break;
+	case GLFW_KEY_END: {
+		text_buffer_t *buffer = app.state.buffer;
+		// the end of a file still loading is gone to once it's there
+		if (app.document->loading) {
+			app.document->pending_line = 0;
+			app.document->pending_end = 1;
+			strcpy(app.state.file_manager_text, "going to the end once loaded");
+			break;
+		}
+		// counting the lines of a viewed file could take seconds
+		if (app.document->viewing) {
+			long last = app_view_row_start(text_buffer_size(buffer));
+			app_move_to(last);
+			break;
+		}
+		text_buffer_goto_line(buffer, text_buffer_line_count(buffer) - 1);
 	} break;
 
 	default:
@@ -346,6 +1424,63 @@ void filename_append(char c) {
 	app.state.filename[length + 1] = '\0';
 }
 
+void search_append(char c) {
+	long length = strlen(app.search_text);
+	if (length >= 255) {
+		return;
+	}
+	app.search_text[length] = c;
+	app.search_text[length + 1] = '\0';
+	snprintf(app.state.file_manager_text, sizeof(app.state.file_manager_text),
+	    "/%s", app.search_text);
+	app_search_incremental();
+}
+
+void line_append(char c) {
+	long length = strlen(app.line_text);
+	if (c < '0' || c > '9' || length >= 18) {
+		return;
+	}
+	app.line_text[length] = c;
+	app.line_text[length + 1] = '\0';
+	sprintf(app.state.file_manager_text, ":%s", app.line_text);
+}
+
+void replace_append(char c) {
+	long length = strlen(app.replace_text);
+	if (length >= 255) {
+		return;
+	}
+	app.replace_text[length] = c;
+	app.replace_text[length + 1] = '\0';
+	snprintf(app.state.file_manager_text, sizeof(app.state.file_manager_text),
+	    "/%s/%s", app.search_text, app.replace_text);
+}
+
+void text_append(char c) {
+	if (app.state.input_context == SEARCH_INPUT_CONTEXT) {
+		search_append(c);
+		return;
+	}
+	if (app.state.input_context == REPLACE_INPUT_CONTEXT) {
+		replace_append(c);
+		return;
+	}
+	if (app.state.input_context == LINE_INPUT_CONTEXT) {
+		line_append(c);
+		return;
+	}
+	if (app_readonly()) {
+		return;
+	}
+	if (app.document->cursors.count > 1) {
+		cursor_set_insert(&app.document->cursors, &app.document->journal,
+		    app.state.buffer, &c, 1);
+		return;
+	}
+	undo_journal_append(&app.document->journal, app.state.buffer, c);
+}
+
 char string_pop(char *string) {
 	long length = strlen(string);
 	if (length <= 0) {
@@ -446,18 +1581,96 @@ void file_input_callback(int key, int scancode, int action, int mods) {
 	case GLFW_KEY_MINUS:
 		filename_append((char)(key + shift * 50));
 		break;
+	case GLFW_KEY_ENTER:
+		app_open(shift);
+		break;
+	case GLFW_KEY_BACKSPACE:
+		string_pop(app.state.filename);
+		break;
+	default:
+		break;
+	}
+	// looked up as it's typed, so the prompt can say what's there
+	if (app.state.input_context == FILE_INPUT_CONTEXT) {
+		file_manager_prefetch(app.state.filename);
+	}
+}
+
+// typing goes through the text keymap into the prompt and searches as it
+// goes, enter keeps the match
+void search_input_callback(int key, int scancode, int action, int mods) {
+	switch (key) {
 	case GLFW_KEY_ENTER: {
-		result_t res = file_manager_open(&app.state.buffer, app.state.filename);
-		if (res != NO_ERROR) {
-			error("error opening file!");
-			return;
-		}
 		change_input_context(TEXT_INPUT_CONTEXT);
+		long cursor = text_buffer_cursor(app.state.buffer);
+		long start;
+		long end;
+		if (app.search_text[0] == '\0') {
+			app.state.file_manager_text[0] = '\0';
+		} else if (!app_search_compile()) {
+			strcpy(app.state.file_manager_text, "bad pattern");
+		} else if (app_search_next(cursor, &start, &end) && start == cursor) {
+			sprintf(app.state.file_manager_text, "match at %ld", start);
+		} else {
+			strcpy(app.state.file_manager_text, "no match");
+		}
 	} break;
 	case GLFW_KEY_BACKSPACE:
-		string_pop(app.state.filename);
+		string_pop(app.search_text);
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "/%s", app.search_text);
+		app_search_incremental();
 		break;
 	default:
+		if (key >= GLFW_KEY_SPACE && key <= GLFW_KEY_GRAVE_ACCENT) {
+			text_input_callback(key, scancode, action, mods);
+		}
+		break;
+	}
+}
+
+// typing goes through the text keymap into the prompt, enter replaces every
+// match
+void replace_input_callback(int key, int scancode, int action, int mods) {
+	switch (key) {
+	case GLFW_KEY_ENTER:
+		change_input_context(TEXT_INPUT_CONTEXT);
+		app_replace_all();
+		break;
+	case GLFW_KEY_BACKSPACE:
+		string_pop(app.replace_text);
+		snprintf(app.state.file_manager_text,
+		    sizeof(app.state.file_manager_text), "/%s/%s", app.search_text,
+		    app.replace_text);
+		break;
+	default:
+		if (key >= GLFW_KEY_SPACE && key <= GLFW_KEY_GRAVE_ACCENT) {
+			text_input_callback(key, scancode, action, mods);
+		}
+		break;
+	}
+}
+
+// digits go through the text keymap into the prompt, enter jumps
+void line_input_callback(int key, int scancode, int action, int mods) {
+	switch (key) {
+	case GLFW_KEY_ENTER:
+		change_input_context(TEXT_INPUT_CONTEXT);
+		if (app.line_text[0] == '\0') {
+			app.state.file_manager_text[0] = '\0';
+			break;
+		}
+		app.document->pending_line = 0;
+		app_goto_line(atol(app.line_text));
+		break;
+	case GLFW_KEY_BACKSPACE:
+		string_pop(app.line_text);
+		sprintf(app.state.file_manager_text, ":%s", app.line_text);
+		break;
+	default:
+		if (key >= GLFW_KEY_0 && key <= GLFW_KEY_9) {
+			text_input_callback(key, scancode, action, mods);
+		}
 		break;
 	}
 }
@@ -466,30 +1679,30 @@ void text_input_callback(int key, int scancode, int action, int mods) {
 	int shift = mods & GLFW_MOD_SHIFT;
 	switch (key) {
 	case GLFW_KEY_0:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 7));
+		text_append((char)(key - shift * 7));
 		break;
 	case GLFW_KEY_1:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 16));
+		text_append((char)(key - shift * 16));
 		break;
 	case GLFW_KEY_2:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 14));
+		text_append((char)(key + shift * 14));
 		break;
 	case GLFW_KEY_3:
 	case GLFW_KEY_4:
 	case GLFW_KEY_5:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 16));
+		text_append((char)(key - shift * 16));
 		break;
 	case GLFW_KEY_6:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 40));
+		text_append((char)(key + shift * 40));
 		break;
 	case GLFW_KEY_7:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 17));
+		text_append((char)(key - shift * 17));
 		break;
 	case GLFW_KEY_8:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 14));
+		text_append((char)(key - shift * 14));
 		break;
 	case GLFW_KEY_9:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 17));
+		text_append((char)(key - shift * 17));
 		break;
 	case GLFW_KEY_A:
 	case GLFW_KEY_B:
@@ -517,70 +1730,100 @@ void text_input_callback(int key, int scancode, int action, int mods) {
 	case GLFW_KEY_X:
 	case GLFW_KEY_Y:
 	case GLFW_KEY_Z:
-		split_buffer_append(&app.state.buffer, (char)(key + (!shift) * 32));
+		text_append((char)(key + (!shift) * 32));
 		break;
 	case GLFW_KEY_SPACE:
-		split_buffer_append(&app.state.buffer, (char)key);
+		text_append((char)key);
 		break;
 	case GLFW_KEY_SEMICOLON:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 1));
+		text_append((char)(key - shift * 1));
 		break;
 	case GLFW_KEY_COMMA:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 16));
+		text_append((char)(key + shift * 16));
 		break;
 	case GLFW_KEY_PERIOD:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 16));
+		text_append((char)(key + shift * 16));
 		break;
 	case GLFW_KEY_SLASH:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 16));
+		text_append((char)(key + shift * 16));
 		break;
 	case GLFW_KEY_EQUAL:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 18));
+		text_append((char)(key - shift * 18));
 		break;
 	case GLFW_KEY_MINUS:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 50));
+		text_append((char)(key + shift * 50));
 		break;
 	case GLFW_KEY_GRAVE_ACCENT:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 30));
+		text_append((char)(key + shift * 30));
 		break;
 	case GLFW_KEY_LEFT_BRACKET:
 	case GLFW_KEY_RIGHT_BRACKET:
 	case GLFW_KEY_BACKSLASH:
-		split_buffer_append(&app.state.buffer, (char)(key + shift * 32));
+		text_append((char)(key + shift * 32));
 		break;
 	case GLFW_KEY_APOSTROPHE:
-		split_buffer_append(&app.state.buffer, (char)(key - shift * 5));
+		text_append((char)(key - shift * 5));
 		break;
 	case GLFW_KEY_ENTER:
-		split_buffer_append(&app.state.buffer, '\n');
+		text_append('\n');
 		break;
 	case GLFW_KEY_TAB:
-		split_buffer_append(&app.state.buffer, '\t');
+		text_append('\t');
 		break;
 	case GLFW_KEY_BACKSPACE:
-		split_buffer_remove(&app.state.buffer);
+		if (app_readonly()) {
+			break;
+		}
+		if (app.document->cursors.count > 1) {
+			cursor_set_remove(&app.document->cursors, &app.document->journal,
+			    app.state.buffer);
+		} else {
+			undo_journal_remove(&app.document->journal, app.state.buffer);
+		}
+		break;
+	case GLFW_KEY_DELETE:
+		if (app_readonly()) {
+			break;
+		}
+		if (app.document->cursors.count > 1) {
+			cursor_set_delete(&app.document->cursors, &app.document->journal,
+			    app.state.buffer);
+		} else {
+			undo_journal_delete(&app.document->journal, app.state.buffer);
+		}
 		break;
 	case GLFW_KEY_LEFT: {
-		result_t res = split_buffer_move(&app.state.buffer, -1);
+		if (app.document->cursors.count > 1) {
+			cursor_set_move(&app.document->cursors, app.state.buffer, -1);
+			break;
+		}
+		result_t res =
+		    text_buffer_move(app.state.buffer, -app_codepoint_step(0));
 		if (res != NO_ERROR) {
 			return;
 		}
 	} break;
 	case GLFW_KEY_RIGHT: {
-		result_t res = split_buffer_move(&app.state.buffer, 1);
+		if (app.document->cursors.count > 1) {
+			cursor_set_move(&app.document->cursors, app.state.buffer, 1);
+			break;
+		}
+		result_t res =
+		    text_buffer_move(app.state.buffer, app_codepoint_step(1));
 		if (res != NO_ERROR) {
 			return;
 		}
 	} break;
 	case GLFW_KEY_UP: {
-
-		result_t res = split_buffer_ascend(&app.state.buffer);
+		cursor_set_clear(&app.document->cursors);
+		result_t res = text_buffer_ascend(app.state.buffer);
 		if (res != NO_ERROR) {
 			return;
 		}
 	} break;
 	case GLFW_KEY_DOWN: {
-		result_t res = split_buffer_descend(&app.state.buffer);
+		cursor_set_clear(&app.document->cursors);
+		result_t res = text_buffer_descend(app.state.buffer);
 		if (res != NO_ERROR) {
 			return;
 		}
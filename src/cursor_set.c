@@ -0,0 +1,193 @@
+#include "cursor_set.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+result_t cursor_set_create(cursor_set_t *set) {
+	set->offsets = NULL;
+	set->ranges = NULL;
+	set->count = 0;
+	set->capacity = 0;
+
+	return NO_ERROR;
+}
+
+void cursor_set_destroy(cursor_set_t *set) {
+	free(set->offsets);
+	free(set->ranges);
+	cursor_set_create(set);
+}
+
+void cursor_set_clear(cursor_set_t *set) { set->count = 0; }
+
+static result_t cursor_set_reserve(cursor_set_t *set, long count) {
+	if (count <= set->capacity) {
+		return NO_ERROR;
+	}
+
+	long capacity = set->capacity ? set->capacity * 2 : 16;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	long *offsets = realloc(set->offsets, capacity * sizeof(long));
+	if (offsets == NULL) {
+		error("failed to grow cursor set!");
+		return TEXT_BUFFER_ERROR;
+	}
+	set->offsets = offsets;
+	long *ranges = realloc(set->ranges, capacity * sizeof(long));
+	if (ranges == NULL) {
+		error("failed to grow cursor set!");
+		return TEXT_BUFFER_ERROR;
+	}
+	set->ranges = ranges;
+	set->capacity = capacity;
+
+	return NO_ERROR;
+}
+
+// cursors that an edit pushed onto the same spot become one
+static void cursor_set_merge(cursor_set_t *set) {
+	long count = 0;
+	for (long i = 0; i < set->count; i++) {
+		if (!count || set->offsets[i] != set->offsets[count - 1]) {
+			set->offsets[count++] = set->offsets[i];
+		}
+	}
+	set->count = count;
+}
+
+// keeps the buffer's cursor on the last cursor so it renders and scrolls
+static result_t cursor_set_follow(cursor_set_t *set, text_buffer_t *buffer) {
+	if (!set->count) {
+		return NO_ERROR;
+	}
+	long distance = set->offsets[set->count - 1] - text_buffer_cursor(buffer);
+	if (!distance) {
+		return NO_ERROR;
+	}
+	return text_buffer_move(buffer, distance);
+}
+
+result_t cursor_set_add(cursor_set_t *set, long offset) {
+	result_t res = cursor_set_reserve(set, set->count + 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	long i = set->count;
+	while (i > 0 && set->offsets[i - 1] > offset) {
+		i--;
+	}
+	if (i > 0 && set->offsets[i - 1] == offset) {
+		return NO_ERROR;
+	}
+	memmove(&set->offsets[i + 1], &set->offsets[i],
+	    (set->count - i) * sizeof(long));
+	set->offsets[i] = offset;
+	set->count++;
+
+	return NO_ERROR;
+}
+
+// adds a cursor on the line under the last one, in the same column
+result_t cursor_set_add_below(cursor_set_t *set, text_buffer_t *buffer) {
+	if (!set->count) {
+		result_t res = cursor_set_add(set, text_buffer_cursor(buffer));
+		if (res != NO_ERROR) {
+			return res;
+		}
+	}
+
+	result_t res = cursor_set_follow(set, buffer);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	// on the last line there is nowhere to go and nothing is added
+	res = text_buffer_descend(buffer);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	return cursor_set_add(set, text_buffer_cursor(buffer));
+}
+
+result_t cursor_set_move(
+    cursor_set_t *set, text_buffer_t *buffer, long distance) {
+	long size = text_buffer_size(buffer);
+	for (long i = 0; i < set->count; i++) {
+		long offset = set->offsets[i] + distance;
+		set->offsets[i] = offset < 0 ? 0 : offset > size ? size : offset;
+	}
+	cursor_set_merge(set);
+
+	return cursor_set_follow(set, buffer);
+}
+
+result_t cursor_set_insert(cursor_set_t *set, undo_journal_t *journal,
+    text_buffer_t *buffer, const char *data, long length) {
+	result_t res = undo_journal_insert_at_each(
+	    journal, buffer, set->offsets, set->count, data, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	for (long i = 0; i < set->count; i++) {
+		set->offsets[i] += (i + 1) * length;
+	}
+
+	return NO_ERROR;
+}
+
+result_t cursor_set_remove(
+    cursor_set_t *set, undo_journal_t *journal, text_buffer_t *buffer) {
+	long count = 0;
+	for (long i = 0; i < set->count; i++) {
+		if (set->offsets[i] > 0) {
+			set->ranges[count++] = set->offsets[i] - 1;
+		}
+	}
+
+	result_t res =
+	    undo_journal_delete_at_each(journal, buffer, set->ranges, count, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	long removed = 0;
+	for (long i = 0; i < set->count; i++) {
+		removed += set->offsets[i] > 0;
+		set->offsets[i] -= removed;
+	}
+	cursor_set_merge(set);
+
+	return cursor_set_follow(set, buffer);
+}
+
+result_t cursor_set_delete(
+    cursor_set_t *set, undo_journal_t *journal, text_buffer_t *buffer) {
+	long size = text_buffer_size(buffer);
+	long count = 0;
+	for (long i = 0; i < set->count; i++) {
+		if (set->offsets[i] < size) {
+			set->ranges[count++] = set->offsets[i];
+		}
+	}
+
+	result_t res =
+	    undo_journal_delete_at_each(journal, buffer, set->ranges, count, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	long removed = 0;
+	for (long i = 0; i < set->count; i++) {
+		long offset = set->offsets[i];
+		set->offsets[i] -= removed;
+		removed += offset < size;
+	}
+	cursor_set_merge(set);
+
+	return cursor_set_follow(set, buffer);
+}
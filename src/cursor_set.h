@@ -0,0 +1,50 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "result.h"
+#include "text_buffer.h"
+#include "undo.h"
+
+/*
+every cursor of a multi-cursor edit, kept ascending with no duplicates so an
+edit can be handed to the buffer as one sorted batch. the buffer's own cursor
+follows the last one.
+*/
+typedef struct cursor_set_t {
+	long *offsets;
+	long *ranges;
+	long count;
+	long capacity;
+} cursor_set_t;
+
+result_t cursor_set_create(cursor_set_t *set);
+void cursor_set_destroy(cursor_set_t *set);
+void cursor_set_clear(cursor_set_t *set);
+
+result_t cursor_set_add(cursor_set_t *set, long offset);
+result_t cursor_set_add_below(cursor_set_t *set, text_buffer_t *buffer);
+result_t cursor_set_move(
+    cursor_set_t *set, text_buffer_t *buffer, long distance);
+
+result_t cursor_set_insert(cursor_set_t *set, undo_journal_t *journal,
+    text_buffer_t *buffer, const char *data, long length);
+result_t cursor_set_remove(
+    cursor_set_t *set, undo_journal_t *journal, text_buffer_t *buffer);
+result_t cursor_set_delete(
+    cursor_set_t *set, undo_journal_t *journal, text_buffer_t *buffer);
@@ -0,0 +1,192 @@
+#include "dirty_ranges.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// past this many runs the edits are too scattered to be worth tracking, and
+// every edit would be moving this much around
+#define DIRTY_RANGES_MAX 8192
+
+void dirty_ranges_create(dirty_ranges_t *ranges) {
+	ranges->extents = NULL;
+	ranges->count = 0;
+	ranges->capacity = 0;
+	ranges->original = 0;
+	ranges->length = 0;
+	ranges->lost = 1;
+}
+
+void dirty_ranges_destroy(dirty_ranges_t *ranges) {
+	free(ranges->extents);
+	dirty_ranges_create(ranges);
+}
+
+void dirty_ranges_reset(dirty_ranges_t *ranges, long length) {
+	if (ranges->capacity == 0) {
+		ranges->extents = malloc(16 * sizeof(dirty_extent_t));
+		if (ranges->extents == NULL) {
+			error("failed to allocate dirty ranges!");
+			dirty_ranges_lose(ranges);
+			return;
+		}
+		ranges->capacity = 16;
+	}
+	ranges->count = 0;
+	if (length > 0) {
+		ranges->extents[ranges->count++] = (dirty_extent_t){length, 0};
+	}
+	ranges->original = length;
+	ranges->length = length;
+	ranges->lost = 0;
+}
+
+void dirty_ranges_lose(dirty_ranges_t *ranges) {
+	ranges->count = 0;
+	ranges->lost = 1;
+}
+
+static int dirty_ranges_reserve(dirty_ranges_t *ranges, long count) {
+	if (count <= ranges->capacity) {
+		return 1;
+	}
+	if (count > DIRTY_RANGES_MAX) {
+		debug("more than %d dirty ranges, saving everything", DIRTY_RANGES_MAX);
+		return 0;
+	}
+
+	long capacity = ranges->capacity * 2;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	dirty_extent_t *extents =
+	    realloc(ranges->extents, capacity * sizeof(dirty_extent_t));
+	if (extents == NULL) {
+		error("failed to grow dirty ranges!");
+		return 0;
+	}
+	ranges->extents = extents;
+	ranges->capacity = capacity;
+	return 1;
+}
+
+// the index of the run starting at offset, splitting the one it falls in
+static long dirty_ranges_split(dirty_ranges_t *ranges, long offset) {
+	dirty_extent_t *extents = ranges->extents;
+	long start = 0;
+	long i = 0;
+	while (i < ranges->count && start + extents[i].length <= offset) {
+		start += extents[i++].length;
+	}
+	if (i == ranges->count || start == offset) {
+		return i;
+	}
+
+	memmove(&extents[i + 1], &extents[i],
+	    (ranges->count - i) * sizeof(dirty_extent_t));
+	ranges->count++;
+	long head = offset - start;
+	extents[i].length = head;
+	extents[i + 1].length -= head;
+	if (extents[i + 1].origin >= 0) {
+		extents[i + 1].origin += head;
+	}
+	return i + 1;
+}
+
+// new text next to new text, or file text that carries straight on
+static int dirty_ranges_joins(const dirty_extent_t *a, const dirty_extent_t *b) {
+	if (a->origin < 0) {
+		return b->origin < 0;
+	}
+	return a->origin + a->length == b->origin;
+}
+
+void dirty_ranges_edit(
+    dirty_ranges_t *ranges, long offset, long removed, long inserted) {
+	if (ranges->lost) {
+		return;
+	}
+	if (offset < 0 || removed < 0 || offset + removed > ranges->length ||
+	    !dirty_ranges_reserve(ranges, ranges->count + 3)) {
+		dirty_ranges_lose(ranges);
+		return;
+	}
+
+	dirty_extent_t *extents = ranges->extents;
+	long first = dirty_ranges_split(ranges, offset);
+	long last = dirty_ranges_split(ranges, offset + removed);
+	memmove(&extents[first], &extents[last],
+	    (ranges->count - last) * sizeof(dirty_extent_t));
+	ranges->count -= last - first;
+	if (inserted > 0) {
+		memmove(&extents[first + 1], &extents[first],
+		    (ranges->count - first) * sizeof(dirty_extent_t));
+		extents[first] = (dirty_extent_t){inserted, -1};
+		ranges->count++;
+	}
+	ranges->length += inserted - removed;
+
+	// only the runs either side of the edit can have become joinable
+	long i = first > 0 ? first - 1 : 0;
+	long stop = first + 1;
+	while (i < stop && i + 1 < ranges->count) {
+		if (!dirty_ranges_joins(&extents[i], &extents[i + 1])) {
+			i++;
+			continue;
+		}
+		extents[i].length += extents[i + 1].length;
+		memmove(&extents[i + 1], &extents[i + 2],
+		    (ranges->count - i - 2) * sizeof(dirty_extent_t));
+		ranges->count--;
+		stop--;
+	}
+}
+
+int dirty_ranges_clean(const dirty_ranges_t *ranges) {
+	if (ranges->lost || ranges->length != ranges->original) {
+		return 0;
+	}
+	long start = 0;
+	for (long i = 0; i < ranges->count; i++) {
+		if (ranges->extents[i].origin != start) {
+			return 0;
+		}
+		start += ranges->extents[i].length;
+	}
+	return 1;
+}
+
+long dirty_ranges_list(
+    const dirty_ranges_t *ranges, long block, dirty_range_t **list) {
+	*list = NULL;
+	if (ranges->lost || ranges->length != ranges->original) {
+		return -1;
+	}
+	*list = malloc((ranges->count + 1) * sizeof(dirty_range_t));
+	if (*list == NULL) {
+		error("failed to allocate dirty ranges!");
+		return -1;
+	}
+
+	long count = 0;
+	long start = 0;
+	for (long i = 0; i < ranges->count; i++) {
+		const dirty_extent_t *extent = &ranges->extents[i];
+		if (extent->origin != start) {
+			long from = start / block * block;
+			long to = (start + extent->length + block - 1) / block * block;
+			if (to > ranges->length) {
+				to = ranges->length;
+			}
+			if (count && from <= (*list)[count - 1].end) {
+				(*list)[count - 1].end = to;
+			} else {
+				(*list)[count++] = (dirty_range_t){from, to};
+			}
+		}
+		start += extent->length;
+	}
+	return count;
+}
@@ -0,0 +1,65 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+/*
+where each run of the text came from in the file it was loaded from, so a
+save can find the bytes that actually changed. an edit splits the runs around
+it and adds one of new text, and undoing it joins them back up, so typing a
+character and deleting it again leaves nothing to save.
+*/
+
+typedef struct dirty_extent_t {
+	long length;
+	// offset in the file, -1 for text that wasn't in it
+	long origin;
+} dirty_extent_t;
+
+typedef struct dirty_range_t {
+	long start;
+	long end;
+} dirty_range_t;
+
+typedef struct dirty_ranges_t {
+	dirty_extent_t *extents;
+	long count;
+	long capacity;
+	// length of the file and of the text now
+	long original;
+	long length;
+	// nothing is known about the file, every byte counts as changed
+	int lost;
+} dirty_ranges_t;
+
+// starts out lost, until reset says the text matches a file
+void dirty_ranges_create(dirty_ranges_t *ranges);
+void dirty_ranges_destroy(dirty_ranges_t *ranges);
+// the text is exactly the file, just loaded or saved
+void dirty_ranges_reset(dirty_ranges_t *ranges, long length);
+void dirty_ranges_lose(dirty_ranges_t *ranges);
+// 1 when every byte is still where it was in the file
+int dirty_ranges_clean(const dirty_ranges_t *ranges);
+
+void dirty_ranges_edit(
+    dirty_ranges_t *ranges, long offset, long removed, long inserted);
+
+// the runs of text that differ from the file at the same offset, grown out to
+// whole blocks, merged and in order. -1 when they can't be written in place,
+// because the length changed or nothing is known. the caller frees the list.
+long dirty_ranges_list(
+    const dirty_ranges_t *ranges, long block, dirty_range_t **list);
@@ -0,0 +1,456 @@
+#include "edit_log.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// a batch is synced once this much has built up, or once its oldest edit is
+// this many seconds old, so a burst of typing costs one sync and not one each
+#define EDIT_LOG_BYTES (64L * 1024L)
+#define EDIT_LOG_INTERVAL 0.2
+// records carried over into a restarted log this much at a time
+#define EDIT_LOG_COPY_BLOCK (1024L * 1024L)
+#define EDIT_LOG_MAGIC "tededit1"
+
+typedef struct edit_log_header_t {
+	char magic[8];
+	long device;
+	long inode;
+	long length;
+	long modified;
+	long modified_nanoseconds;
+} edit_log_header_t;
+
+// followed by the inserted bytes. the checksum covers both, so a record cut
+// short by a crash is dropped along with everything after it.
+typedef struct edit_log_record_t {
+	long offset;
+	long removed;
+	long inserted;
+	unsigned long checksum;
+} edit_log_record_t;
+
+static double edit_log_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
+
+static unsigned long edit_log_checksum(
+    const edit_log_record_t *record, const char *text) {
+	unsigned long hash = 14695981039346656037ul;
+	long fields[3] = {record->offset, record->removed, record->inserted};
+	const unsigned char *bytes = (const unsigned char *)fields;
+	for (unsigned long i = 0; i < sizeof(fields); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ul;
+	}
+	for (long i = 0; i < record->inserted; i++) {
+		hash = (hash ^ (unsigned char)text[i]) * 1099511628211ul;
+	}
+	return hash;
+}
+
+static void edit_log_header(
+    edit_log_header_t *header, const struct stat *file_stat) {
+	memset(header, 0, sizeof(edit_log_header_t));
+	memcpy(header->magic, EDIT_LOG_MAGIC, sizeof(header->magic));
+	header->device = file_stat->st_dev;
+	header->inode = file_stat->st_ino;
+	header->length = file_stat->st_size;
+	header->modified = file_stat->st_mtim.tv_sec;
+	header->modified_nanoseconds = file_stat->st_mtim.tv_nsec;
+}
+
+static int edit_log_write(int fd, const char *data, long length, long offset) {
+	while (length > 0) {
+		long bytes = pwrite(fd, data, length, offset);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes <= 0) {
+			return 0;
+		}
+		data += bytes;
+		length -= bytes;
+		offset += bytes;
+	}
+	return 1;
+}
+
+static int edit_log_read(int fd, char *data, long length, long offset) {
+	while (length > 0) {
+		long bytes = pread(fd, data, length, offset);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes <= 0) {
+			return 0;
+		}
+		data += bytes;
+		length -= bytes;
+		offset += bytes;
+	}
+	return 1;
+}
+
+// puts the edits of an old log back into the buffer. returns how many bytes
+// of whole records there were, or -1 when the log isn't for this file.
+static long edit_log_replay(
+    edit_log_t *log, int fd, const struct stat *file_stat) {
+	struct stat log_stat;
+	if (fstat(fd, &log_stat)) {
+		error("failed to stat edit log!");
+		return -1;
+	}
+	long size = log_stat.st_size;
+	char *data = malloc(size > 0 ? size : 1);
+	if (data == NULL) {
+		error("failed to allocate edit log!");
+		return -1;
+	}
+	edit_log_header_t expected;
+	edit_log_header(&expected, file_stat);
+	if (size < (long)sizeof(expected) || !edit_log_read(fd, data, size, 0) ||
+	    memcmp(data, &expected, sizeof(expected))) {
+		warn("ignoring an edit log that isn't for this file.");
+		free(data);
+		return -1;
+	}
+
+	text_buffer_t *buffer = log->buffer;
+	long position = sizeof(expected);
+	while (position + (long)sizeof(edit_log_record_t) <= size) {
+		edit_log_record_t record;
+		memcpy(&record, &data[position], sizeof(record));
+		const char *text = &data[position + sizeof(record)];
+		if (record.offset < 0 || record.removed < 0 || record.inserted < 0 ||
+		    record.inserted > size - position - (long)sizeof(record) ||
+		    edit_log_checksum(&record, text) != record.checksum ||
+		    record.offset + record.removed > text_buffer_size(buffer)) {
+			break;
+		}
+		result_t res = NO_ERROR;
+		if (record.removed > 0) {
+			res = text_buffer_delete_range(
+			    buffer, record.offset, record.offset + record.removed);
+		}
+		long distance = record.offset - text_buffer_cursor(buffer);
+		if (res == NO_ERROR && record.inserted > 0 && distance != 0) {
+			res = text_buffer_move(buffer, distance);
+		}
+		if (res == NO_ERROR && record.inserted > 0) {
+			res = text_buffer_insert(buffer, text, record.inserted);
+		}
+		if (res != NO_ERROR) {
+			break;
+		}
+		position += sizeof(record) + record.inserted;
+		log->recovered++;
+	}
+	if (log->recovered) {
+		info("replayed unsaved edits from the edit log");
+	}
+	debug("replayed %ld edits, %ld bytes", log->recovered, position);
+
+	free(data);
+	return position - sizeof(expected);
+}
+
+static void edit_log_edited(
+    void *context, long offset, long removed, long inserted) {
+	edit_log_t *log = context;
+	pthread_mutex_lock(&log->lock);
+	if (log->broken) {
+		pthread_mutex_unlock(&log->lock);
+		return;
+	}
+	long length = log->pending_length + sizeof(edit_log_record_t) + inserted;
+	if (length > log->pending_capacity) {
+		long capacity = log->pending_capacity * 2;
+		if (capacity < length) {
+			capacity = length;
+		}
+		char *pending = realloc(log->pending, capacity);
+		if (pending == NULL) {
+			error("failed to grow edit log!");
+			log->broken = 1;
+			pthread_mutex_unlock(&log->lock);
+			return;
+		}
+		log->pending = pending;
+		log->pending_capacity = capacity;
+	}
+
+	// the inserted text is in the buffer by now, copied straight out of it
+	char *text = &log->pending[log->pending_length + sizeof(edit_log_record_t)];
+	for (long copied = 0; copied < inserted;) {
+		const char *span;
+		long bytes = text_buffer_span_at(log->buffer, offset + copied, &span);
+		if (bytes <= 0) {
+			error("edit is outside the buffer!");
+			log->broken = 1;
+			pthread_mutex_unlock(&log->lock);
+			return;
+		}
+		if (bytes > inserted - copied) {
+			bytes = inserted - copied;
+		}
+		memcpy(&text[copied], span, bytes);
+		copied += bytes;
+	}
+	edit_log_record_t record = {offset, removed, inserted, 0};
+	record.checksum = edit_log_checksum(&record, text);
+	memcpy(&log->pending[log->pending_length], &record, sizeof(record));
+
+	// the thread only needs waking to start the clock or to write early
+	if (log->pending_length == 0) {
+		log->pending_since = edit_log_time();
+		pthread_cond_signal(&log->wake);
+	} else if (log->pending_length < EDIT_LOG_BYTES &&
+	           length >= EDIT_LOG_BYTES) {
+		pthread_cond_signal(&log->wake);
+	}
+	log->pending_length = length;
+	pthread_mutex_unlock(&log->lock);
+}
+
+// writes the log over again from saved_through on, for the file as it was
+// saved. called with the lock held, which is let go around the writing.
+static void edit_log_restart(edit_log_t *log) {
+	log->restart = 0;
+	long through = log->saved_through;
+	struct stat saved = log->saved;
+	if (through < log->start || through > log->start + log->written) {
+		return;
+	}
+	int old = log->fd;
+	long from = sizeof(edit_log_header_t) + through - log->start;
+	long to = sizeof(edit_log_header_t) + log->written;
+	pthread_mutex_unlock(&log->lock);
+
+	char *temp = malloc(strlen(log->path) + 8);
+	char *block = malloc(EDIT_LOG_COPY_BLOCK);
+	int fd = -1;
+	int done = 0;
+	if (temp != NULL && block != NULL) {
+		sprintf(temp, "%s.XXXXXX", log->path);
+		fd = mkstemp(temp);
+	}
+	if (fd >= 0) {
+		edit_log_header_t header;
+		edit_log_header(&header, &saved);
+		done = edit_log_write(fd, (char *)&header, sizeof(header), 0);
+		for (long offset = from; offset < to && done;) {
+			long length = to - offset;
+			if (length > EDIT_LOG_COPY_BLOCK) {
+				length = EDIT_LOG_COPY_BLOCK;
+			}
+			done = edit_log_read(old, block, length, offset) &&
+			       edit_log_write(fd, block, length,
+			           offset - from + sizeof(edit_log_header_t));
+			offset += length;
+		}
+		done = done && !fdatasync(fd) && !rename(temp, log->path);
+		if (!done) {
+			close(fd);
+			unlink(temp);
+		}
+	}
+	if (!done) {
+		error("failed to restart edit log!");
+	}
+	free(block);
+	free(temp);
+
+	pthread_mutex_lock(&log->lock);
+	if (done) {
+		close(old);
+		log->fd = fd;
+		log->start = through;
+		log->written = to - from;
+	}
+}
+
+static void *edit_log_thread(void *argument) {
+	edit_log_t *log = argument;
+	char *batch = NULL;
+	long batch_capacity = 0;
+	pthread_mutex_lock(&log->lock);
+	while (1) {
+		while (!log->stop && !log->restart &&
+		       log->pending_length < EDIT_LOG_BYTES) {
+			if (log->pending_length == 0) {
+				pthread_cond_wait(&log->wake, &log->lock);
+				continue;
+			}
+			double due = log->pending_since + EDIT_LOG_INTERVAL;
+			if (edit_log_time() >= due) {
+				break;
+			}
+			struct timespec until = {
+			    (time_t)due, (long)((due - (time_t)due) * 1000000000.0)};
+			pthread_cond_timedwait(&log->wake, &log->lock, &until);
+		}
+		// a log that's about to be removed isn't worth syncing
+		if (log->stop) {
+			break;
+		}
+
+		if (log->pending_length > 0 && !log->broken) {
+			// edits carry on into the other buffer while this one's written
+			char *data = log->pending;
+			long length = log->pending_length;
+			long capacity = log->pending_capacity;
+			log->pending = batch;
+			log->pending_capacity = batch_capacity;
+			log->pending_length = 0;
+			batch = data;
+			batch_capacity = capacity;
+			int fd = log->fd;
+			long offset = sizeof(edit_log_header_t) + log->written;
+			pthread_mutex_unlock(&log->lock);
+
+			int done = edit_log_write(fd, batch, length, offset) &&
+			           !fdatasync(fd);
+
+			pthread_mutex_lock(&log->lock);
+			if (done) {
+				log->written += length;
+				log->commits++;
+			} else {
+				// what made it in is still a good log, it just stops there
+				error("failed to write edit log!");
+				if (ftruncate(fd, offset)) {
+					debug("failed to cut edit log back to %ld", offset);
+				}
+				log->broken = 1;
+			}
+			continue;
+		}
+		log->pending_length = 0;
+
+		if (log->restart) {
+			edit_log_restart(log);
+		}
+	}
+	pthread_mutex_unlock(&log->lock);
+	free(batch);
+
+	return NULL;
+}
+
+void edit_log_stop(edit_log_t *log) {
+	if (log->path == NULL) {
+		return;
+	}
+	text_buffer_unobserve(log->buffer, log);
+	if (log->running) {
+		pthread_mutex_lock(&log->lock);
+		log->stop = 1;
+		pthread_cond_signal(&log->wake);
+		pthread_mutex_unlock(&log->lock);
+		pthread_join(log->thread, NULL);
+	}
+	if (log->fd >= 0) {
+		close(log->fd);
+		unlink(log->path);
+	}
+	debug("edit log synced %ld batches", log->commits);
+	free(log->path);
+	free(log->pending);
+	pthread_mutex_destroy(&log->lock);
+	pthread_cond_destroy(&log->wake);
+	memset(log, 0, sizeof(edit_log_t));
+}
+
+result_t edit_log_start(
+    edit_log_t *log, const char *path, int fd, text_buffer_t *buffer) {
+	memset(log, 0, sizeof(edit_log_t));
+	log->fd = -1;
+	log->buffer = buffer;
+	pthread_mutex_init(&log->lock, NULL);
+	// timed waits shouldn't jump when the wall clock is changed
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&log->wake, &attributes);
+	pthread_condattr_destroy(&attributes);
+	log->path = strdup(path);
+	struct stat file_stat;
+	if (log->path == NULL || fstat(fd, &file_stat)) {
+		error("failed to start edit log!");
+		edit_log_stop(log);
+		return FILE_MANAGER_ERROR;
+	}
+
+	// an old log's edits go back in before new ones are taken, and stay in it
+	// since the file still doesn't have them
+	long kept = -1;
+	log->fd = open(path, O_RDWR);
+	if (log->fd >= 0) {
+		kept = edit_log_replay(log, log->fd, &file_stat);
+		if (kept < 0) {
+			close(log->fd);
+		} else if (ftruncate(log->fd, sizeof(edit_log_header_t) + kept)) {
+			debug("failed to cut edit log back to %ld", kept);
+		}
+	}
+	if (kept < 0) {
+		edit_log_header_t header;
+		edit_log_header(&header, &file_stat);
+		log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (log->fd < 0 ||
+		    !edit_log_write(log->fd, (char *)&header, sizeof(header), 0)) {
+			error("failed to create edit log!");
+			edit_log_stop(log);
+			return FILE_MANAGER_ERROR;
+		}
+		kept = 0;
+	}
+	log->written = kept;
+
+	if (pthread_create(&log->thread, NULL, edit_log_thread, log)) {
+		error("failed to start edit log thread!");
+		edit_log_stop(log);
+		return FILE_MANAGER_ERROR;
+	}
+	log->running = 1;
+	text_buffer_observer_t observer = {edit_log_edited, log};
+	result_t res = text_buffer_observe(buffer, observer);
+	if (res != NO_ERROR) {
+		edit_log_stop(log);
+		return res;
+	}
+
+	return NO_ERROR;
+}
+
+long edit_log_mark(edit_log_t *log) {
+	if (!log->running) {
+		return 0;
+	}
+	pthread_mutex_lock(&log->lock);
+	long mark = log->start + log->written + log->pending_length;
+	pthread_mutex_unlock(&log->lock);
+	return mark;
+}
+
+void edit_log_saved(edit_log_t *log, long mark, const struct stat *file_stat) {
+	if (!log->running) {
+		return;
+	}
+	pthread_mutex_lock(&log->lock);
+	if (!log->restart || mark > log->saved_through) {
+		log->restart = 1;
+		log->saved_through = mark;
+		log->saved = *file_stat;
+		pthread_cond_signal(&log->wake);
+	}
+	pthread_mutex_unlock(&log->lock);
+}
@@ -0,0 +1,80 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "result.h"
+#include "text_buffer.h"
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+every edit made to a file's buffer, appended to a log next to the file so
+typing that was never saved survives a crash. a record is the offset, how
+much was deleted and the bytes inserted there. edits are only copied into
+memory on the editing thread, a thread of its own writes them out and syncs
+them a batch at a time, once enough has built up or the oldest has waited
+long enough.
+
+the log starts with the size, inode and time of the file it applies to, so
+one left behind is only replayed over the file it was made against. a save
+starts it over, keeping the edits made since the text being saved was taken.
+*/
+typedef struct edit_log_t {
+	text_buffer_t *buffer;
+	char *path;
+	int fd;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+	int running;
+	int stop;
+	// an edit couldn't be kept, the ones after it would be replayed in the
+	// wrong place so nothing more is logged
+	int broken;
+
+	// records waiting to be written, and when the oldest of them was made
+	char *pending;
+	long pending_length;
+	long pending_capacity;
+	double pending_since;
+	// where the log file starts, counted in bytes of records since logging
+	// began, and how much of it has been written
+	long start;
+	long written;
+	// a save of everything up to saved_through that the log starts over from
+	int restart;
+	long saved_through;
+	struct stat saved;
+
+	// edits replayed when the log was started, and batches synced since
+	long recovered;
+	long commits;
+} edit_log_t;
+
+// replays what an old log of the file in fd holds into buffer, then logs
+// every edit of buffer to path
+result_t edit_log_start(
+    edit_log_t *log, const char *path, int fd, text_buffer_t *buffer);
+// writes out what's waiting and removes the log, the edits are done with
+void edit_log_stop(edit_log_t *log);
+
+// everything logged so far, to tell edit_log_saved how far a save got
+long edit_log_mark(edit_log_t *log);
+// the file now holds every edit before mark, and looks like file_stat
+void edit_log_saved(edit_log_t *log, long mark, const struct stat *file_stat);
@@ -0,0 +1,470 @@
+#include "encoding.h"
+
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#define ENCODING_SSE2
+#include <immintrin.h>
+#endif
+
+#define ENCODING_REPLACEMENT 0xFFFD
+
+static long encoding_ascii(const char *text, long length);
+
+encoding_t encoding_detect(
+    const char *head, long length, int whole, int *bom) {
+	const unsigned char *bytes = (const unsigned char *)head;
+	*bom = 0;
+	if (length >= 3 && !memcmp(head, "\xEF\xBB\xBF", 3)) {
+		*bom = 1;
+		return ENCODING_UTF8;
+	}
+	if (length >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+		*bom = 1;
+		return ENCODING_UTF16LE;
+	}
+	if (length >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+		*bom = 1;
+		return ENCODING_UTF16BE;
+	}
+
+	// utf-16 without a byte order mark is mostly ascii, so one byte of most
+	// pairs is a NUL and hardly ever the other
+	long pairs = length / 2;
+	long even = 0;
+	long odd = 0;
+	for (long i = 0; i < pairs; i++) {
+		even += bytes[2 * i] == 0;
+		odd += bytes[2 * i + 1] == 0;
+	}
+	if (pairs >= 2 && odd * 2 > pairs && even * 8 < pairs) {
+		return ENCODING_UTF16LE;
+	}
+	if (pairs >= 2 && even * 2 > pairs && odd * 8 < pairs) {
+		return ENCODING_UTF16BE;
+	}
+
+	// a sequence cut off by the end of the head isn't held against it, unless
+	// the head is all there is. utf-8 that goes bad after some good non-ascii
+	// is still utf-8, only damaged.
+	long checked = whole ? length : length - encoding_utf8_cut(head, length);
+	long valid = scan_utf8_valid(head, checked);
+	if (valid < checked && encoding_ascii(head, valid) == valid &&
+	    scan_memchr(head, '\0', length) == NULL) {
+		return ENCODING_LATIN1;
+	}
+	return ENCODING_UTF8;
+}
+
+const char *encoding_name(encoding_t encoding) {
+	switch (encoding) {
+	case ENCODING_UTF8:
+		return "utf-8";
+	case ENCODING_UTF16LE:
+		return "utf-16le";
+	case ENCODING_UTF16BE:
+		return "utf-16be";
+	case ENCODING_LATIN1:
+		return "latin-1";
+	}
+	return "unknown";
+}
+
+int encoding_transcoded(encoding_t encoding, int bom) {
+	return encoding != ENCODING_UTF8 || bom;
+}
+
+int encoding_fits(encoding_t encoding, const char *text, long length) {
+	if (encoding != ENCODING_LATIN1) {
+		return 1;
+	}
+	// anything past U+00FF starts with a byte past the two that lead the
+	// rest of latin-1
+	const unsigned char *bytes = (const unsigned char *)text;
+	for (long i = 0; i < length; i++) {
+		i += encoding_ascii(&text[i], length - i);
+		if (i < length && bytes[i] >= 0xC4) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+long encoding_utf8_cut(const char *text, long length) {
+	for (long back = 1; back <= 3 && back <= length; back++) {
+		unsigned char c = text[length - back];
+		if ((c & 0xC0) != 0x80) {
+			long need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+			return need > back ? back : 0;
+		}
+	}
+	return 0;
+}
+
+static int encoding_bom_length(encoding_t encoding) {
+	switch (encoding) {
+	case ENCODING_UTF8:
+		return 3;
+	case ENCODING_UTF16LE:
+	case ENCODING_UTF16BE:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+void encoding_begin(encoding_state_t *state, encoding_t encoding, int bom) {
+	memset(state, 0, sizeof(encoding_state_t));
+	state->encoding = encoding;
+	state->bom = bom ? encoding_bom_length(encoding) : 0;
+}
+
+// bytes at the start of text that are ascii
+static long encoding_ascii(const char *text, long length) {
+	long i = 0;
+#ifdef ENCODING_SSE2
+	for (; i + 16 <= length; i += 16) {
+		int mask =
+		    _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)&text[i]));
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	while (i < length && !(text[i] & 0x80)) {
+		i++;
+	}
+	return i;
+}
+
+// ascii bytes spread out into utf-16 units, each with a NUL on its high side
+static void encoding_widen(const char *in, long length, char *out, int big) {
+	long i = 0;
+#ifdef ENCODING_SSE2
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i low = big ? _mm_unpacklo_epi8(zero, bytes)
+		                  : _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = big ? _mm_unpackhi_epi8(zero, bytes)
+		                   : _mm_unpackhi_epi8(bytes, zero);
+		_mm_storeu_si128((__m128i *)&out[2 * i], low);
+		_mm_storeu_si128((__m128i *)&out[2 * i + 16], high);
+	}
+#endif
+	for (; i < length; i++) {
+		out[2 * i + big] = in[i];
+		out[2 * i + !big] = 0;
+	}
+}
+
+// utf-16 units at the start of in that are ascii, narrowed into out sixteen
+// at a time. returns how many were.
+static long encoding_narrow(const char *in, long units, char *out, int big) {
+	long i = 0;
+#ifdef ENCODING_SSE2
+	// loaded little endian, a big endian unit has its high byte at the bottom
+	__m128i wide = _mm_set1_epi16(big ? (short)0x80FF : (short)0xFF80);
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= units; i += 16) {
+		__m128i low = _mm_loadu_si128((const __m128i *)&in[2 * i]);
+		__m128i high = _mm_loadu_si128((const __m128i *)&in[2 * i + 16]);
+		__m128i ascii = _mm_cmpeq_epi16(
+		    _mm_and_si128(_mm_or_si128(low, high), wide), zero);
+		if (_mm_movemask_epi8(ascii) != 0xFFFF) {
+			break;
+		}
+		if (big) {
+			low = _mm_srli_epi16(low, 8);
+			high = _mm_srli_epi16(high, 8);
+		}
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packus_epi16(low, high));
+	}
+#endif
+	return i;
+}
+
+static long encoding_put_utf8(uint32_t codepoint, char *out) {
+	if (codepoint < 0x80) {
+		out[0] = (char)codepoint;
+		return 1;
+	}
+	if (codepoint < 0x800) {
+		out[0] = (char)(0xC0 | codepoint >> 6);
+		out[1] = (char)(0x80 | (codepoint & 0x3F));
+		return 2;
+	}
+	if (codepoint < 0x10000) {
+		out[0] = (char)(0xE0 | codepoint >> 12);
+		out[1] = (char)(0x80 | (codepoint >> 6 & 0x3F));
+		out[2] = (char)(0x80 | (codepoint & 0x3F));
+		return 3;
+	}
+	out[0] = (char)(0xF0 | codepoint >> 18);
+	out[1] = (char)(0x80 | (codepoint >> 12 & 0x3F));
+	out[2] = (char)(0x80 | (codepoint >> 6 & 0x3F));
+	out[3] = (char)(0x80 | (codepoint & 0x3F));
+	return 4;
+}
+
+static long encoding_put_unit(uint32_t unit, char *out, int big) {
+	out[big] = (char)(unit & 0xFF);
+	out[!big] = (char)(unit >> 8);
+	return 2;
+}
+
+// one utf-16 unit as utf-8, surrogates that aren't in a pair are replaced
+static long encoding_decode_unit(
+    encoding_state_t *state, uint32_t unit, char *out) {
+	long written = 0;
+	if (state->high) {
+		uint32_t high = state->high;
+		state->high = 0;
+		if (unit >= 0xDC00 && unit <= 0xDFFF) {
+			return encoding_put_utf8(
+			    0x10000 + ((high - 0xD800) << 10) + (unit - 0xDC00), out);
+		}
+		written += encoding_put_utf8(ENCODING_REPLACEMENT, out);
+		state->replaced++;
+	}
+	if (unit >= 0xD800 && unit <= 0xDBFF) {
+		state->high = unit;
+		return written;
+	}
+	if (unit >= 0xDC00 && unit <= 0xDFFF) {
+		unit = ENCODING_REPLACEMENT;
+		state->replaced++;
+	}
+	return written + encoding_put_utf8(unit, &out[written]);
+}
+
+static long encoding_decode_utf16(
+    encoding_state_t *state, const char *in, long length, char *out) {
+	const unsigned char *bytes = (const unsigned char *)in;
+	int big = state->encoding == ENCODING_UTF16BE;
+	long i = 0;
+	long written = 0;
+	// a unit split between the last chunk and this one
+	if (state->carried && length > 0) {
+		uint32_t unit = big ? (uint32_t)state->carry[0] << 8 | bytes[0]
+		                    : (uint32_t)bytes[0] << 8 | state->carry[0];
+		written += encoding_decode_unit(state, unit, out);
+		state->carried = 0;
+		i = 1;
+	}
+	while (length - i >= 2) {
+		if (!state->high) {
+			long units =
+			    encoding_narrow(&in[i], (length - i) / 2, &out[written], big);
+			i += 2 * units;
+			written += units;
+		}
+		// the block narrowing stopped in goes a unit at a time, then it's
+		// tried again on the next
+		long stop = length - i < 32 ? length : i + 32;
+		for (; stop - i >= 2; i += 2) {
+			uint32_t unit = big ? (uint32_t)bytes[i] << 8 | bytes[i + 1]
+			                    : (uint32_t)bytes[i + 1] << 8 | bytes[i];
+			if (unit < 0x80 && !state->high) {
+				out[written++] = (char)unit;
+			} else {
+				written += encoding_decode_unit(state, unit, &out[written]);
+			}
+		}
+	}
+	if (i < length) {
+		state->carry[0] = bytes[i];
+		state->carried = 1;
+	}
+	return written;
+}
+
+static long encoding_decode_latin1(const char *in, long length, char *out) {
+	long i = 0;
+	long written = 0;
+	while (i < length) {
+		long run = encoding_ascii(&in[i], length - i);
+		memcpy(&out[written], &in[i], run);
+		i += run;
+		written += run;
+		if (i < length) {
+			written += encoding_put_utf8((unsigned char)in[i++], &out[written]);
+		}
+	}
+	return written;
+}
+
+long encoding_decode(
+    encoding_state_t *state, const char *in, long length, char *out) {
+	// the byte order mark was only there to say what the rest is
+	long skip = state->bom < length ? state->bom : length;
+	state->bom -= skip;
+	in += skip;
+	length -= skip;
+
+	switch (state->encoding) {
+	case ENCODING_UTF16LE:
+	case ENCODING_UTF16BE:
+		return encoding_decode_utf16(state, in, length, out);
+	case ENCODING_LATIN1:
+		return encoding_decode_latin1(in, length, out);
+	default:
+		memcpy(out, in, length);
+		return length;
+	}
+}
+
+long encoding_decode_end(encoding_state_t *state, char *out) {
+	long written = 0;
+	if (state->high || state->carried) {
+		written = encoding_put_utf8(ENCODING_REPLACEMENT, out);
+		state->replaced++;
+	}
+	state->high = 0;
+	state->carried = 0;
+	return written;
+}
+
+/*
+the codepoint at the start of text and how many bytes it takes. as much of a
+sequence as was valid before it went wrong is one replacement character, and
+0 is returned for one that's fine so far but cut short by length.
+*/
+static long encoding_next(
+    const unsigned char *text, long length, uint32_t *codepoint) {
+	unsigned char c = text[0];
+	if (c < 0x80) {
+		*codepoint = c;
+		return 1;
+	}
+	long need;
+	uint32_t value;
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	if (c >= 0xC2 && c <= 0xDF) {
+		need = 1;
+		value = c & 0x1F;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		need = 2;
+		value = c & 0x0F;
+		low = c == 0xE0 ? 0xA0 : low;
+		high = c == 0xED ? 0x9F : high;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		need = 3;
+		value = c & 0x07;
+		low = c == 0xF0 ? 0x90 : low;
+		high = c == 0xF4 ? 0x8F : high;
+	} else {
+		*codepoint = ENCODING_REPLACEMENT;
+		return 1;
+	}
+	for (long k = 1; k <= need; k++) {
+		if (k >= length) {
+			return 0;
+		}
+		if (text[k] < low || text[k] > high) {
+			*codepoint = ENCODING_REPLACEMENT;
+			return k;
+		}
+		low = 0x80;
+		high = 0xBF;
+		value = value << 6 | (text[k] & 0x3F);
+	}
+	*codepoint = value;
+	return need + 1;
+}
+
+static long encoding_put(
+    encoding_state_t *state, uint32_t codepoint, char *out) {
+	if (state->encoding == ENCODING_LATIN1) {
+		if (codepoint > 0xFF) {
+			state->replaced++;
+			codepoint = '?';
+		}
+		out[0] = (char)codepoint;
+		return 1;
+	}
+	int big = state->encoding == ENCODING_UTF16BE;
+	if (codepoint < 0x10000) {
+		return encoding_put_unit(codepoint, out, big);
+	}
+	codepoint -= 0x10000;
+	encoding_put_unit(0xD800 + (codepoint >> 10), out, big);
+	return 2 + encoding_put_unit(0xDC00 + (codepoint & 0x3FF), &out[2], big);
+}
+
+long encoding_encode(
+    encoding_state_t *state, const char *in, long length, char *out) {
+	static const char *marks[] = {"\xEF\xBB\xBF", "\xFF\xFE", "\xFE\xFF"};
+	long written = 0;
+	if (state->bom) {
+		memcpy(out, marks[state->encoding], state->bom);
+		written = state->bom;
+		state->bom = 0;
+	}
+	if (state->encoding == ENCODING_UTF8) {
+		memcpy(&out[written], in, length);
+		return written + length;
+	}
+
+	const unsigned char *bytes = (const unsigned char *)in;
+	long i = 0;
+	uint32_t codepoint;
+	// a sequence split between the last span and this one, a byte at a time
+	// until it's whole or goes wrong
+	while (state->carried > 0 && i < length) {
+		state->carry[state->carried++] = bytes[i++];
+		long taken = encoding_next(state->carry, state->carried, &codepoint);
+		if (taken > 0) {
+			// the byte it went wrong at starts whatever comes next
+			i -= state->carried - taken;
+			state->carried = 0;
+			written += encoding_put(state, codepoint, &out[written]);
+		}
+	}
+
+	int big = state->encoding == ENCODING_UTF16BE;
+	while (i < length) {
+		long run = encoding_ascii(&in[i], length - i);
+		if (state->encoding == ENCODING_LATIN1) {
+			memcpy(&out[written], &in[i], run);
+			written += run;
+		} else {
+			encoding_widen(&in[i], run, &out[written], big);
+			written += 2 * run;
+		}
+		i += run;
+		// the block the run stopped in goes a character at a time
+		long stop = length - i < 16 ? length : i + 16;
+		while (i < stop) {
+			if (bytes[i] < 0x80 && state->encoding == ENCODING_LATIN1) {
+				out[written++] = (char)bytes[i++];
+				continue;
+			}
+			if (bytes[i] < 0x80) {
+				written += encoding_put_unit(bytes[i++], &out[written], big);
+				continue;
+			}
+			long taken = encoding_next(&bytes[i], length - i, &codepoint);
+			if (taken == 0) {
+				state->carried = length - i;
+				memcpy(state->carry, &bytes[i], state->carried);
+				return written;
+			}
+			i += taken;
+			written += encoding_put(state, codepoint, &out[written]);
+		}
+	}
+	return written;
+}
+
+long encoding_encode_end(encoding_state_t *state, char *out) {
+	long written = 0;
+	if (state->carried) {
+		written = encoding_put(state, ENCODING_REPLACEMENT, out);
+	}
+	state->carried = 0;
+	return written;
+}
@@ -0,0 +1,78 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+files that aren't utf-8 are turned into it as they're read and back again as
+they're written, a chunk at a time. whatever a chunk ends part way through is
+carried on to the next. runs of ascii go through a vector at a time, which is
+most of the text in most files.
+*/
+typedef enum encoding_t {
+	ENCODING_UTF8 = 0,
+	ENCODING_UTF16LE,
+	ENCODING_UTF16BE,
+	ENCODING_LATIN1,
+} encoding_t;
+
+typedef struct encoding_state_t {
+	encoding_t encoding;
+	// bytes of byte order mark still to skip when decoding, or to write when
+	// encoding
+	int bom;
+	unsigned char carry[4];
+	int carried;
+	// a high surrogate waiting for the low one after it
+	uint32_t high;
+	// characters the encoding couldn't hold, written as replacements
+	long replaced;
+} encoding_state_t;
+
+// the most decoding or encoding length bytes can come to
+#define ENCODING_ROOM(length) ((length) * 2 + 8)
+
+/*
+the encoding of a file from the first length bytes of it. a byte order mark
+decides it when there is one, and bom is set. otherwise text with a NUL on
+the same side of most characters is utf-16, and text that isn't utf-8 and has
+no NULs at all is latin-1. anything else is left as utf-8. whole is whether
+the head is all of the file.
+*/
+encoding_t encoding_detect(
+    const char *head, long length, int whole, int *bom);
+const char *encoding_name(encoding_t encoding);
+// whether the text has to go through the decoder and encoder at all
+int encoding_transcoded(encoding_t encoding, int bom);
+// whether the encoding can hold every character of the utf-8 text. only
+// latin-1 can't, past U+00FF. a sequence can be split between calls.
+int encoding_fits(encoding_t encoding, const char *text, long length);
+// trailing bytes that start a utf-8 sequence text ends before the end of
+long encoding_utf8_cut(const char *text, long length);
+
+void encoding_begin(encoding_state_t *state, encoding_t encoding, int bom);
+// the next length bytes of the file as utf-8 in out, which needs
+// ENCODING_ROOM(length) bytes. returns how many were written.
+long encoding_decode(
+    encoding_state_t *state, const char *in, long length, char *out);
+// whatever the file ended part way through, as a replacement character
+long encoding_decode_end(encoding_state_t *state, char *out);
+// the next length bytes of utf-8 text in the file's encoding, the same way
+long encoding_encode(
+    encoding_state_t *state, const char *in, long length, char *out);
+long encoding_encode_end(encoding_state_t *state, char *out);
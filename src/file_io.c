@@ -0,0 +1,539 @@
+// syscall, preadv and MAP_POPULATE are only declared for the default source
+#define _DEFAULT_SOURCE
+
+#include "file_io.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ring size, the pieces one big read is split into and how many of those are
+// in flight at once, and the iovecs each readv or writev is handed
+#define FILE_IO_ENTRIES 64
+#define FILE_IO_BLOCK (1L << 20)
+#define FILE_IO_DEPTH 32
+#define FILE_IO_GROUP 64
+#define FILE_IO_REQUESTS 8
+// user data of the requests something is waiting on right now, the rest are
+// stats and opens numbered from 1
+#define FILE_IO_WAITED (1UL << 63)
+
+typedef enum file_io_kind_t {
+	FILE_IO_STAT,
+	FILE_IO_OPEN,
+} file_io_kind_t;
+
+typedef struct file_io_request_t {
+	int busy;
+	int done;
+	file_io_kind_t kind;
+	unsigned long tag;
+	long result;
+	char *path;
+	struct statx statx;
+} file_io_request_t;
+
+static int file_io_setup(unsigned entries, struct io_uring_params *params) {
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int file_io_enter(
+    int ring, unsigned submit, unsigned complete, unsigned flags) {
+	return (int)syscall(
+	    __NR_io_uring_enter, ring, submit, complete, flags, NULL, 0);
+}
+
+static result_t file_io_map(file_io_t *io) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	io->ring = file_io_setup(FILE_IO_ENTRIES, &params);
+	if (io->ring < 0) {
+		return FILE_MANAGER_ERROR;
+	}
+	io->entries = params.sq_entries;
+
+	io->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	io->cq_map_size =
+	    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	io->sq_map = mmap(NULL, io->sq_map_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQ_RING);
+	io->cq_map = mmap(NULL, io->cq_map_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_CQ_RING);
+	io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, io->ring, IORING_OFF_SQES);
+	if (io->sq_map == MAP_FAILED || io->cq_map == MAP_FAILED ||
+	    io->sqes == MAP_FAILED) {
+		return FILE_MANAGER_ERROR;
+	}
+
+	char *sq = io->sq_map;
+	io->sq_head = (unsigned *)(sq + params.sq_off.head);
+	io->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	io->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+	io->sq_array = (unsigned *)(sq + params.sq_off.array);
+	char *cq = io->cq_map;
+	io->cq_head = (unsigned *)(cq + params.cq_off.head);
+	io->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	io->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+	io->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	return NO_ERROR;
+}
+
+static void file_io_unmap(file_io_t *io) {
+	if (io->sq_map != NULL && io->sq_map != MAP_FAILED) {
+		munmap(io->sq_map, io->sq_map_size);
+	}
+	if (io->cq_map != NULL && io->cq_map != MAP_FAILED) {
+		munmap(io->cq_map, io->cq_map_size);
+	}
+	if (io->sqes != NULL && io->sqes != MAP_FAILED) {
+		munmap(io->sqes, io->sqes_size);
+	}
+	if (io->ring >= 0) {
+		close(io->ring);
+	}
+	io->sq_map = NULL;
+	io->cq_map = NULL;
+	io->sqes = NULL;
+	io->ring = -1;
+}
+
+void file_io_destroy(file_io_t *io) {
+	if (io->requests != NULL) {
+		for (int i = 0; i < FILE_IO_REQUESTS; i++) {
+			free(io->requests[i].path);
+			// an open nobody polled for still has to be closed
+			if (io->requests[i].busy && io->requests[i].done &&
+			    io->requests[i].kind == FILE_IO_OPEN &&
+			    io->requests[i].result >= 0) {
+				close(io->requests[i].result);
+			}
+		}
+		free(io->requests);
+	}
+	file_io_unmap(io);
+	memset(io, 0, sizeof(file_io_t));
+	io->ring = -1;
+}
+
+result_t file_io_create(file_io_t *io, file_io_engine_t engine) {
+	memset(io, 0, sizeof(file_io_t));
+	io->ring = -1;
+	io->requests = calloc(FILE_IO_REQUESTS, sizeof(file_io_request_t));
+	if (io->requests == NULL) {
+		error("failed to allocate file io requests!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	io->engine = FILE_IO_POSIX;
+	if (engine != FILE_IO_POSIX) {
+		if (file_io_map(io) == NO_ERROR) {
+			io->engine = FILE_IO_URING;
+		} else if (engine == FILE_IO_URING) {
+			error("io_uring isn't available!");
+			file_io_destroy(io);
+			return FILE_MANAGER_ERROR;
+		} else {
+			// seccomp, an old kernel or io_uring turned off, all the same here
+			info("io_uring isn't available, using pread and pwrite");
+			file_io_unmap(io);
+		}
+	}
+	debug("file io engine %s", file_io_name(io));
+
+	return NO_ERROR;
+}
+
+const char *file_io_name(const file_io_t *io) {
+	return io->engine == FILE_IO_URING ? "io_uring" : "posix";
+}
+
+// the next free sqe, cleared. callers never queue more than the ring holds
+// before running them.
+static struct io_uring_sqe *file_io_sqe(file_io_t *io) {
+	unsigned tail = *io->sq_tail + io->queued;
+	unsigned index = tail & io->sq_mask;
+	io->sq_array[index] = index;
+	io->queued++;
+	struct io_uring_sqe *sqe = &io->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+static int file_io_submit(file_io_t *io, unsigned complete) {
+	__atomic_store_n(
+	    io->sq_tail, *io->sq_tail + io->queued, __ATOMIC_RELEASE);
+	unsigned submit = io->queued;
+	io->queued = 0;
+	while (1) {
+		int res = file_io_enter(
+		    io->ring, submit, complete, complete ? IORING_ENTER_GETEVENTS : 0);
+		if (res >= 0 || errno != EINTR) {
+			return res;
+		}
+		// the interrupted call may still have taken the sqes
+		submit = 0;
+	}
+}
+
+// takes every completion there is, the waited on ones into results and the
+// rest into their requests
+static unsigned file_io_reap(file_io_t *io, long *results) {
+	unsigned reaped = 0;
+	unsigned head = *io->cq_head;
+	unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = &io->cqes[head & io->cq_mask];
+		if (cqe->user_data & FILE_IO_WAITED) {
+			if (results != NULL) {
+				results[cqe->user_data & ~FILE_IO_WAITED] = cqe->res;
+			}
+			reaped++;
+		} else {
+			file_io_request_t *request = &io->requests[cqe->user_data - 1];
+			request->result = cqe->res;
+			request->done = 1;
+		}
+	}
+	__atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+	return reaped;
+}
+
+// submits the count queued sqes and waits for all of them, each one's result
+// lands in results at the index it was given
+static result_t file_io_run(file_io_t *io, long *results, unsigned count) {
+	if (file_io_submit(io, count) < 0) {
+		error("failed to submit to io_uring!");
+		return FILE_MANAGER_ERROR;
+	}
+	unsigned reaped = file_io_reap(io, results);
+	while (reaped < count) {
+		if (file_io_enter(io->ring, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+		    errno != EINTR) {
+			error("failed to wait on io_uring!");
+			return FILE_MANAGER_ERROR;
+		}
+		reaped += file_io_reap(io, results);
+	}
+	return NO_ERROR;
+}
+
+result_t file_io_read(file_io_t *io, int fd, char *buffer, long length,
+    long offset, long *bytes) {
+	*bytes = 0;
+	if (io->engine != FILE_IO_URING) {
+		long limit = FILE_IO_BLOCK * FILE_IO_DEPTH;
+		while (1) {
+			long res = pread(fd, buffer, length < limit ? length : limit, offset);
+			if (res >= 0) {
+				*bytes = res;
+				return NO_ERROR;
+			}
+			if (errno != EINTR) {
+				error("failed to read file!");
+				return FILE_MANAGER_ERROR;
+			}
+		}
+	}
+
+	long results[FILE_IO_DEPTH];
+	unsigned count = 0;
+	for (long start = 0; start < length && count < FILE_IO_DEPTH;
+	     start += FILE_IO_BLOCK) {
+		struct io_uring_sqe *sqe = file_io_sqe(io);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)&buffer[start];
+		sqe->len = length - start < FILE_IO_BLOCK ? length - start : FILE_IO_BLOCK;
+		sqe->off = offset + start;
+		sqe->user_data = FILE_IO_WAITED | count++;
+	}
+	result_t res = file_io_run(io, results, count);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	// everything up to the first piece that came up short
+	for (unsigned i = 0; i < count; i++) {
+		if (results[i] < 0 && *bytes == 0) {
+			error("failed to read file!");
+			return FILE_MANAGER_ERROR;
+		}
+		if (results[i] < 0) {
+			break;
+		}
+		*bytes += results[i];
+		long asked = length - i * FILE_IO_BLOCK;
+		if (results[i] < (asked < FILE_IO_BLOCK ? asked : FILE_IO_BLOCK)) {
+			break;
+		}
+	}
+	return NO_ERROR;
+}
+
+// a readv or writev split over several sqes, each a group of vectors at its
+// own offset. bytes counts up to the first group that came up short.
+static result_t file_io_vectored(file_io_t *io, int opcode, int fd,
+    const struct iovec *vectors, int count, long offset, long *bytes) {
+	long results[FILE_IO_ENTRIES];
+	long asked[FILE_IO_ENTRIES];
+	unsigned groups = 0;
+	*bytes = 0;
+	for (int first = 0; first < count && groups < FILE_IO_ENTRIES;
+	     first += FILE_IO_GROUP) {
+		int group = count - first < FILE_IO_GROUP ? count - first : FILE_IO_GROUP;
+		asked[groups] = 0;
+		for (int i = first; i < first + group; i++) {
+			asked[groups] += vectors[i].iov_len;
+		}
+		struct io_uring_sqe *sqe = file_io_sqe(io);
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)&vectors[first];
+		sqe->len = group;
+		sqe->off = offset;
+		sqe->user_data = FILE_IO_WAITED | groups++;
+		offset += asked[groups - 1];
+	}
+	result_t res = file_io_run(io, results, groups);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	for (unsigned i = 0; i < groups; i++) {
+		if (results[i] < 0 && *bytes == 0) {
+			return FILE_MANAGER_ERROR;
+		}
+		if (results[i] < 0) {
+			break;
+		}
+		*bytes += results[i];
+		if (results[i] < asked[i]) {
+			break;
+		}
+	}
+	return NO_ERROR;
+}
+
+result_t file_io_readv(file_io_t *io, int fd, const struct iovec *vectors,
+    int count, long offset, long *bytes) {
+	if (io->engine == FILE_IO_URING) {
+		result_t res = file_io_vectored(
+		    io, IORING_OP_READV, fd, vectors, count, offset, bytes);
+		if (res != NO_ERROR) {
+			error("failed to read file!");
+		}
+		return res;
+	}
+
+	while (1) {
+		long res = preadv(fd, vectors, count, offset);
+		if (res >= 0) {
+			*bytes = res;
+			return NO_ERROR;
+		}
+		if (errno != EINTR) {
+			error("failed to read file!");
+			return FILE_MANAGER_ERROR;
+		}
+	}
+}
+
+result_t file_io_writev(file_io_t *io, int fd, const struct iovec *vectors,
+    int count, long offset, long *bytes) {
+	if (io->engine == FILE_IO_URING) {
+		result_t res = file_io_vectored(
+		    io, IORING_OP_WRITEV, fd, vectors, count, offset, bytes);
+		if (res != NO_ERROR) {
+			error("failed to write file!");
+		}
+		return res;
+	}
+
+	while (1) {
+		long res = pwritev(fd, vectors, count, offset);
+		if (res >= 0) {
+			*bytes = res;
+			return NO_ERROR;
+		}
+		if (errno != EINTR) {
+			error("failed to write file!");
+			return FILE_MANAGER_ERROR;
+		}
+	}
+}
+
+result_t file_io_commit(
+    file_io_t *io, int fd, const char *from, const char *to, int durable) {
+	if (io->engine != FILE_IO_URING) {
+		int failed = durable && fsync(fd);
+		failed |= close(fd);
+		if (failed || rename(from, to)) {
+			error("failed to replace file!");
+			return FILE_MANAGER_ERROR;
+		}
+		return NO_ERROR;
+	}
+
+	// linked, so a failed sync never lets the rename through
+	long results[3];
+	unsigned count = 0;
+	if (durable) {
+		struct io_uring_sqe *sqe = file_io_sqe(io);
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = fd;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->user_data = FILE_IO_WAITED | count++;
+	}
+	struct io_uring_sqe *sqe = file_io_sqe(io);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = fd;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = FILE_IO_WAITED | count++;
+	sqe = file_io_sqe(io);
+	sqe->opcode = IORING_OP_RENAMEAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (unsigned long)from;
+	sqe->len = AT_FDCWD;
+	sqe->addr2 = (unsigned long)to;
+	sqe->user_data = FILE_IO_WAITED | count++;
+	result_t res = file_io_run(io, results, count);
+	if (res != NO_ERROR) {
+		// mostly a ring that didn't take the close at all
+		close(fd);
+		return res;
+	}
+	// a failed sync cancels the close too
+	if (results[count - 2] == -ECANCELED) {
+		close(fd);
+	}
+	for (unsigned i = 0; i < count; i++) {
+		// kernels before 5.11 can't rename, everything before it went through
+		if (i == count - 1 && results[i] == -EINVAL) {
+			results[i] = rename(from, to) ? -errno : 0;
+		}
+		if (results[i] < 0) {
+			error("failed to replace file!");
+			return FILE_MANAGER_ERROR;
+		}
+	}
+	return NO_ERROR;
+}
+
+static file_io_request_t *file_io_request(
+    file_io_t *io, file_io_kind_t kind, const char *path, unsigned long tag) {
+	for (int i = 0; io->requests != NULL && i < FILE_IO_REQUESTS; i++) {
+		file_io_request_t *request = &io->requests[i];
+		if (request->busy) {
+			continue;
+		}
+		request->path = strdup(path);
+		if (request->path == NULL) {
+			return NULL;
+		}
+		request->busy = 1;
+		request->done = 0;
+		request->kind = kind;
+		request->tag = tag;
+		return request;
+	}
+	return NULL;
+}
+
+result_t file_io_stat(file_io_t *io, const char *path, unsigned long tag) {
+	file_io_request_t *request = file_io_request(io, FILE_IO_STAT, path, tag);
+	if (request == NULL) {
+		warn("too many file requests in flight!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	if (io->engine != FILE_IO_URING) {
+		struct stat file_stat;
+		request->result = stat(path, &file_stat) ? -errno : 0;
+		if (request->result == 0) {
+			request->statx.stx_size = file_stat.st_size;
+			request->statx.stx_mode = file_stat.st_mode;
+		}
+		request->done = 1;
+		return NO_ERROR;
+	}
+
+	struct io_uring_sqe *sqe = file_io_sqe(io);
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (unsigned long)request->path;
+	sqe->len = STATX_SIZE | STATX_MODE;
+	sqe->off = (unsigned long)&request->statx;
+	sqe->user_data = request - io->requests + 1;
+	if (file_io_submit(io, 0) < 0) {
+		error("failed to submit to io_uring!");
+		free(request->path);
+		request->path = NULL;
+		request->busy = 0;
+		return FILE_MANAGER_ERROR;
+	}
+	return NO_ERROR;
+}
+
+result_t file_io_open(
+    file_io_t *io, const char *path, int flags, unsigned long tag) {
+	file_io_request_t *request = file_io_request(io, FILE_IO_OPEN, path, tag);
+	if (request == NULL) {
+		warn("too many file requests in flight!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	if (io->engine != FILE_IO_URING) {
+		int fd = open(path, flags | O_CLOEXEC, 0666);
+		request->result = fd < 0 ? -errno : fd;
+		request->done = 1;
+		return NO_ERROR;
+	}
+
+	struct io_uring_sqe *sqe = file_io_sqe(io);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (unsigned long)request->path;
+	sqe->len = 0666;
+	sqe->open_flags = flags | O_CLOEXEC;
+	sqe->user_data = request - io->requests + 1;
+	if (file_io_submit(io, 0) < 0) {
+		error("failed to submit to io_uring!");
+		free(request->path);
+		request->path = NULL;
+		request->busy = 0;
+		return FILE_MANAGER_ERROR;
+	}
+	return NO_ERROR;
+}
+
+int file_io_poll(file_io_t *io, file_io_event_t *event) {
+	if (io->engine == FILE_IO_URING) {
+		file_io_reap(io, NULL);
+	}
+	for (int i = 0; io->requests != NULL && i < FILE_IO_REQUESTS; i++) {
+		file_io_request_t *request = &io->requests[i];
+		if (!request->busy || !request->done) {
+			continue;
+		}
+		event->tag = request->tag;
+		event->result = request->result;
+		event->size = request->kind == FILE_IO_STAT ? request->statx.stx_size : 0;
+		event->mode = request->kind == FILE_IO_STAT ? request->statx.stx_mode : 0;
+		free(request->path);
+		request->path = NULL;
+		request->busy = 0;
+		return 1;
+	}
+	return 0;
+}
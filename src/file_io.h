@@ -0,0 +1,100 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "result.h"
+
+#include <sys/uio.h>
+
+/*
+reads and writes for loading and saving files. with io_uring a batch of
+requests is handed to the kernel at once and waited on together, so the disk
+has many in flight from one thread. kernels without it get pread and pwrite,
+one request at a time. both engines do the same thing, only how fast differs.
+
+an engine belongs to the thread that created it, a ring can't be shared.
+*/
+
+typedef enum file_io_engine_t {
+	// io_uring when the kernel has it, posix otherwise
+	FILE_IO_AUTO = 0,
+	FILE_IO_URING,
+	FILE_IO_POSIX,
+} file_io_engine_t;
+
+// a finished stat or open. result is the new fd of an open, 0 for a stat, and
+// -errno if it failed. size and mode are only set by a stat.
+typedef struct file_io_event_t {
+	unsigned long tag;
+	long result;
+	long size;
+	unsigned mode;
+} file_io_event_t;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct file_io_request_t;
+
+typedef struct file_io_t {
+	file_io_engine_t engine;
+	int ring;
+	unsigned entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_map;
+	long sq_map_size;
+	void *cq_map;
+	long cq_map_size;
+	long sqes_size;
+	// sqes filled in since the last submit
+	unsigned queued;
+	// stats and opens that haven't been polled yet
+	struct file_io_request_t *requests;
+} file_io_t;
+
+result_t file_io_create(file_io_t *io, file_io_engine_t engine);
+void file_io_destroy(file_io_t *io);
+const char *file_io_name(const file_io_t *io);
+
+// bytes is how much of the file from offset on came back in one go, less than
+// asked for only near the end of the file and 0 past it
+result_t file_io_read(file_io_t *io, int fd, char *buffer, long length,
+    long offset, long *bytes);
+result_t file_io_readv(file_io_t *io, int fd, const struct iovec *vectors,
+    int count, long offset, long *bytes);
+// bytes is how much was written from offset on, which can come up short
+result_t file_io_writev(file_io_t *io, int fd, const struct iovec *vectors,
+    int count, long offset, long *bytes);
+// syncs fd if durable, closes it and renames from over to, in one trip to the
+// kernel with io_uring. fd is closed whatever happens.
+result_t file_io_commit(
+    file_io_t *io, int fd, const char *from, const char *to, int durable);
+
+// started now and finished whenever, file_io_poll hands back each one once
+// with its tag
+result_t file_io_stat(file_io_t *io, const char *path, unsigned long tag);
+result_t file_io_open(
+    file_io_t *io, const char *path, int flags, unsigned long tag);
+int file_io_poll(file_io_t *io, file_io_event_t *event);
@@ -1,43 +1,617 @@
+// realpath is only declared for xopen
+#define _XOPEN_SOURCE 700
 
 #include "file_manager.h"
 
+#include "edit_log.h"
+#include "encoding.h"
+#define NDEBUG
 #include "logger.h"
+#include "scan.h"
+#include "snapshot.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
-static FILE *active_file = NULL;
-static char *active_filepath = NULL;
+// spans handed to each writev, the most linux takes at once, and the most
+// bytes written by one so a background save can report progress and stop
+#define FILE_MANAGER_WRITE_VECTORS 1024
+#define FILE_MANAGER_WRITE_BLOCK (8L * 1024L * 1024L)
+// read ahead of a file picked at the prompt, past this it'd be mapped anyway
+#define FILE_MANAGER_PREFETCH (64L * 1024L * 1024L)
+// changes are written in place as whole pages, and only while they're a small
+// part of the file, past that they'd be written twice for little gain
+#define FILE_MANAGER_PATCH_BLOCK 4096L
+#define FILE_MANAGER_PATCH_SHARE 4
+// most of a piece table's changes copied off its file on the main thread, so
+// it can be saved in place in the background
+#define FILE_MANAGER_DETACH_LIMIT (64L * FILE_MANAGER_PATCH_BLOCK)
+// copied from a journal into the file this much at a time
+#define FILE_MANAGER_REPLAY_BLOCK (1024L * 1024L)
+#define FILE_MANAGER_JOURNAL_MAGIC "tedsave1"
+// a file being written by something else is reloaded once it's been left
+// alone this long, or once it's been written for the longer time without a
+// break
+#define FILE_MANAGER_SETTLE 0.1
+#define FILE_MANAGER_SETTLE_LIMIT 1.0
+// a reload compares the buffer and the file a chunk at a time. chunks end
+// where a rolling hash of the bytes before says so, so text inserted in one
+// only changes the chunks around it and the ones after it line up again.
+#define FILE_MANAGER_CHUNK_MIN 2048L
+#define FILE_MANAGER_CHUNK_MAX (64L * 1024L)
+#define FILE_MANAGER_CHUNK_MASK 0x1ffful
+// a file that only grew is taken to have been appended to when this much of
+// the end of what it had is still the same
+#define FILE_MANAGER_APPEND_CHECK (64L * 1024L)
+// a file opened in the background has comfortably more than a screen of it
+// read before the open returns. the rest streams in a chunk at a time, read a
+// few chunks ahead of the buffer, and a frame moves no more than its budget
+// into buffers so drawing doesn't stall on a big one.
+#define FILE_MANAGER_FIRST_SCREEN (16L * 1024L)
+#define FILE_MANAGER_STREAM_CHUNK (1024L * 1024L)
+#define FILE_MANAGER_STREAM_AHEAD 4
+#define FILE_MANAGER_STREAM_BUDGET (4L * 1024L * 1024L)
+// bytes of a file that isn't utf-8 read at a time, as much as still fits in a
+// chunk of the ring however much decoding it grows
+#define FILE_MANAGER_DECODE_CHUNK ((FILE_MANAGER_STREAM_CHUNK - 8) / 2)
+// bytes of text encoded at a time to save a file that isn't utf-8
+#define FILE_MANAGER_ENCODE_BLOCK (1024L * 1024L)
+
+/*
+written and synced next to a file before any of it is changed in place, so a
+crash part way through can be finished the next time it's opened. each record
+is its offset and length followed by its bytes, and the journal ends with a
+checksum of everything before it, so one cut short is thrown away.
+*/
+typedef struct file_manager_journal_t {
+	char magic[8];
+	// the file it belongs to, one replaced since doesn't get it
+	long device;
+	long inode;
+	long length;
+	long count;
+} file_manager_journal_t;
+
+/*
+a file's text counted and checked as it's read, a chunk at a time in the order
+it's in the file. a sequence cut by the end of one chunk is carried over to be
+finished by the next.
+*/
+typedef struct file_manager_utf8_t {
+	long offset;
+	long codepoints;
+	// the first byte that isn't utf-8, -1 while all of it is
+	long invalid;
+	char carry[4];
+	long carried;
+} file_manager_utf8_t;
+
+// how far a save has got, and whether a newer one of the same file wants it
+// to stop
+typedef struct file_manager_progress_t {
+	_Atomic long written;
+	_Atomic int cancel;
+} file_manager_progress_t;
+
+/*
+one open file. each is allocated on its own and never moves, the writer and
+loader threads hold on to it while the table of them grows, and its buffer is
+watched by whatever the app builds over it.
+*/
+typedef struct file_handle_t {
+	FILE *file;
+	char *filepath;
+	// where the file really is, it's found by this however it's named
+	char *target;
+	unsigned long hash;
+	text_buffer_t buffer;
+	text_buffer_backend_t backend;
+	// opened for viewing, saving it is refused
+	int readonly;
+	// how fast it was loaded, in MB/s
+	double load_rate;
+	// whether the text was utf-8 when it was read, and how many codepoints.
+	// the loader owns it while the file streams in.
+	file_manager_utf8_t utf8;
+	// what the file is in on disk, its text is kept as utf-8 and turned back
+	// into this when it's saved. found when it's first read and kept after.
+	encoding_t encoding;
+	int bom;
+	encoding_state_t decoder;
+	// the file as this editor last read or wrote it, anything else writing it
+	// changes this
+	struct stat stat;
+	// every edit of the buffer, until it's closed
+	edit_log_t log;
+	// the watch on its directory, and when it was first and last written
+	// since it was last checked
+	int watch;
+	double since;
+	double seen;
+
+	// streamed in on a thread of its own. the thread only reads into the
+	// ring, the main thread moves each chunk from there onto the end of the
+	// buffer, so the buffer holds whatever has arrived so far
+	int loading;
+	pthread_t loader;
+	result_t load_result;
+	double load_start;
+	long load_length;
+	long streamed;
+	long stream_from;
+	char *ring;
+	// the rest of the stream is the stream lock's. a chunk's length is its
+	// text, and raw is how much of the file that was.
+	long ring_lengths[FILE_MANAGER_STREAM_AHEAD];
+	long ring_raw[FILE_MANAGER_STREAM_AHEAD];
+	long ring_read;
+	long ring_taken;
+	int stream_done;
+	int stream_stop;
+	result_t stream_result;
+
+	// the rest is the save lock's. only the newest waiting save is kept, and
+	// a newer one stops the write in progress since it would be replaced
+	// straight after anyway.
+	text_snapshot_t *pending;
+	char *pending_path;
+	// what changed since the last save, -1 to write the whole file
+	dirty_range_t *pending_ranges;
+	long pending_range_count;
+	// the file as it was when the changes were taken, a patch finding
+	// anything else writes the whole file
+	struct stat pending_stat;
+	// how much of the edit log a save holds, passed on to the log once it's
+	// done
+	long pending_mark;
+	// waiting its turn on the writer thread, behind other files
+	int queued;
+	struct file_handle_t *queue_next;
+	int writing;
+	file_manager_progress_t progress;
+	long save_length;
+	result_t save_result;
+	// a save failed after the buffer was told it was saved, so the next one
+	// has to write everything
+	int save_lost;
+	int logged;
+	long logged_mark;
+	struct stat logged_stat;
+} file_handle_t;
+
+// a directory watched for the open files in it, one watch for all of them
+typedef struct file_manager_watch_t {
+	int descriptor;
+	int references;
+	char *directory;
+} file_manager_watch_t;
+
+/*
+open addressing over hashes, each slot one more than the index it holds so
+zero is empty. what the indexes are compared by is up to whoever looks them
+up, the table only keeps their hashes.
+*/
+typedef struct file_manager_table_t {
+	unsigned long *hashes;
+	int *indexes;
+	long capacity;
+	long count;
+} file_manager_table_t;
+
+// every open file by handle, a closed one's slot is reused before the table
+// grows
+static file_handle_t **handles = NULL;
+static int handle_capacity = 0;
+static int *handle_free = NULL;
+static int handle_free_count = 0;
+// handles by where their file really is, so opening one twice finds it
+static file_manager_table_t handle_paths;
+
+// reads and writes on the main thread, the writer thread and loaders have
+// their own
+static file_io_t active_io;
+static file_io_engine_t active_engine = FILE_IO_AUTO;
+
+// an open file's directory is watched rather than the file, so one replaced
+// by a rename is still noticed. the watches are found by descriptor.
+static int watch_fd = -1;
+static file_manager_watch_t *watches = NULL;
+static int watch_capacity = 0;
+static file_manager_table_t watch_descriptors;
+
+// the path last typed at the prompt, stats for older ones are ignored
+static unsigned long prefetch_tag = 0;
+static char prefetch_path[256];
+
+// saves handed to the writer thread, one file after another in the order
+// they were asked for
+static pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t save_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t save_idle = PTHREAD_COND_INITIALIZER;
+static pthread_t save_thread;
+static int save_started = 0;
+static int save_stop = 0;
+static file_handle_t *save_first = NULL;
+static file_handle_t *save_last = NULL;
+
+// files streaming in, a loader waits on it while its ring is full
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stream_wake = PTHREAD_COND_INITIALIZER;
+
+static double file_manager_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 0.000000001;
+}
 
 result_t file_manager_startup(void) {
+	result_t res = file_io_create(&active_io, active_engine);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd < 0) {
+		warn("files changed by other programs won't be reloaded.");
+	}
 	info("file manager started");
 
 	return NO_ERROR;
 }
 
+static void file_manager_save_wait(file_handle_t *handle);
+static void file_manager_recover(const char *filepath);
+static char *file_manager_directory(const char *filepath);
+static char *file_manager_hidden_path(const char *target, const char *kind);
+static unsigned long file_manager_hash(
+    unsigned long hash, const void *data, long length);
+static result_t file_manager_read_all(
+    file_io_t *io, int fd, void *data, long length, long offset);
+
+// anything saved in the background is written before the thread stops
+static void file_manager_save_stop(void) {
+	if (save_started) {
+		pthread_mutex_lock(&save_lock);
+		save_stop = 1;
+		pthread_cond_signal(&save_wake);
+		pthread_mutex_unlock(&save_lock);
+		pthread_join(save_thread, NULL);
+		save_started = 0;
+		save_stop = 0;
+	}
+}
+
+static void file_manager_table_destroy(file_manager_table_t *table) {
+	free(table->hashes);
+	free(table->indexes);
+	memset(table, 0, sizeof(file_manager_table_t));
+}
+
 void file_manager_shutdown(void) {
-	if (active_file != NULL) {
-		warn("attempting to shutdown file manager without closing active file.");
-		file_manager_close();
+	for (int i = 0; i < handle_capacity; i++) {
+		if (handles[i] != NULL) {
+			warn("attempting to shutdown file manager without closing a file.");
+			file_manager_close(i);
+		}
+	}
+
+	file_manager_save_stop();
+	file_io_destroy(&active_io);
+	if (watch_fd >= 0) {
+		close(watch_fd);
+		watch_fd = -1;
 	}
+	free(handles);
+	handles = NULL;
+	handle_capacity = 0;
+	free(handle_free);
+	handle_free = NULL;
+	handle_free_count = 0;
+	file_manager_table_destroy(&handle_paths);
+	free(watches);
+	watches = NULL;
+	watch_capacity = 0;
+	file_manager_table_destroy(&watch_descriptors);
 }
 
-// create file if it doesn't exist
-result_t file_manager_open(split_buffer_t *buffer, const char *filepath) {
-	if (active_file != NULL) {
-		warn("attempting to open a new file without closing the previous one.");
-		file_manager_close();
+result_t file_manager_use_engine(file_io_engine_t engine) {
+	// the writer thread picks up the engine when it's next started
+	file_manager_save_stop();
+	file_io_t io;
+	result_t res = file_io_create(&io, engine);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	file_io_destroy(&active_io);
+	active_io = io;
+	active_engine = engine;
+
+	return NO_ERROR;
+}
+
+const char *file_manager_engine(void) {
+	return file_io_name(&active_io);
+}
+
+// the next index after *slot with this hash, starting from its home slot
+// when *slot is -1. -1 once there are no more.
+static int file_manager_table_next(
+    const file_manager_table_t *table, unsigned long hash, long *slot) {
+	if (table->capacity == 0) {
+		return -1;
+	}
+	long mask = table->capacity - 1;
+	*slot = *slot < 0 ? (long)(hash & mask) : (*slot + 1) & mask;
+	for (; table->indexes[*slot]; *slot = (*slot + 1) & mask) {
+		if (table->hashes[*slot] == hash) {
+			return table->indexes[*slot] - 1;
+		}
+	}
+	return -1;
+}
+
+// kept at most half full so probes stay short
+static result_t file_manager_table_insert(
+    file_manager_table_t *table, unsigned long hash, int index) {
+	if ((table->count + 1) * 2 > table->capacity) {
+		long capacity = table->capacity ? table->capacity * 2 : 64;
+		unsigned long *hashes = malloc(capacity * sizeof(unsigned long));
+		int *indexes = calloc(capacity, sizeof(int));
+		if (hashes == NULL || indexes == NULL) {
+			error("failed to grow file table!");
+			free(hashes);
+			free(indexes);
+			return FILE_MANAGER_ERROR;
+		}
+		for (long i = 0; i < table->capacity; i++) {
+			if (table->indexes[i]) {
+				long slot = table->hashes[i] & (capacity - 1);
+				while (indexes[slot]) {
+					slot = (slot + 1) & (capacity - 1);
+				}
+				hashes[slot] = table->hashes[i];
+				indexes[slot] = table->indexes[i];
+			}
+		}
+		free(table->hashes);
+		free(table->indexes);
+		table->hashes = hashes;
+		table->indexes = indexes;
+		table->capacity = capacity;
+	}
+	long mask = table->capacity - 1;
+	long slot = hash & mask;
+	while (table->indexes[slot]) {
+		slot = (slot + 1) & mask;
+	}
+	table->hashes[slot] = hash;
+	table->indexes[slot] = index + 1;
+	table->count++;
+	return NO_ERROR;
+}
+
+// the ones probed past it are moved back into its place, so nothing is left
+// behind to probe over
+static void file_manager_table_remove(
+    file_manager_table_t *table, unsigned long hash, int index) {
+	long slot = -1;
+	int found;
+	while ((found = file_manager_table_next(table, hash, &slot)) >= 0 &&
+	       found != index) {
+	}
+	if (found < 0) {
+		return;
+	}
+	long mask = table->capacity - 1;
+	long hole = slot;
+	for (long next = (hole + 1) & mask; table->indexes[next];
+	     next = (next + 1) & mask) {
+		long home = table->hashes[next] & mask;
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			table->hashes[hole] = table->hashes[next];
+			table->indexes[hole] = table->indexes[next];
+			hole = next;
+		}
+	}
+	table->indexes[hole] = 0;
+	table->count--;
+}
+
+static unsigned long file_manager_hash_path(const char *path) {
+	return file_manager_hash(14695981039346656037ul, path, strlen(path));
+}
+
+static unsigned long file_manager_hash_descriptor(int descriptor) {
+	return file_manager_hash(
+	    14695981039346656037ul, &descriptor, sizeof(descriptor));
+}
+
+static file_handle_t *file_manager_handle(int handle) {
+	if (handle < 0 || handle >= handle_capacity || handles[handle] == NULL) {
+		error("unknown file handle!");
+		return NULL;
+	}
+	return handles[handle];
+}
+
+static int file_manager_find_target(const char *target) {
+	unsigned long hash = file_manager_hash_path(target);
+	long slot = -1;
+	int index;
+	while ((index = file_manager_table_next(&handle_paths, hash, &slot)) >= 0) {
+		if (!strcmp(handles[index]->target, target)) {
+			return index;
+		}
+	}
+	return FILE_MANAGER_NO_HANDLE;
+}
+
+int file_manager_find(const char *filepath) {
+	char *target = filepath == NULL ? NULL : realpath(filepath, NULL);
+	if (target == NULL) {
+		return FILE_MANAGER_NO_HANDLE;
+	}
+	int handle = file_manager_find_target(target);
+	free(target);
+	return handle;
+}
+
+static int file_manager_find_watch(int descriptor) {
+	long slot = -1;
+	int index;
+	while ((index = file_manager_table_next(&watch_descriptors,
+	            file_manager_hash_descriptor(descriptor), &slot)) >= 0) {
+		if (watches[index].descriptor == descriptor) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+// watches the directory a file is in, shared with the other files there
+static void file_manager_watch(file_handle_t *handle) {
+	handle->watch = -1;
+	handle->since = 0.0;
+	handle->seen = 0.0;
+	char *directory =
+	    watch_fd < 0 ? NULL : file_manager_directory(handle->target);
+	int descriptor = directory == NULL
+	                     ? -1
+	                     : inotify_add_watch(watch_fd, directory,
+	                           IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+	                               IN_CREATE);
+	if (descriptor < 0) {
+		if (watch_fd >= 0) {
+			warn("can't watch the open file for changes.");
+		}
+		free(directory);
+		return;
+	}
+	int index = file_manager_find_watch(descriptor);
+	if (index >= 0) {
+		watches[index].references++;
+		handle->watch = index;
+		free(directory);
+		return;
+	}
+	for (index = 0; index < watch_capacity; index++) {
+		if (watches[index].references == 0) {
+			break;
+		}
+	}
+	if (index == watch_capacity) {
+		int capacity = watch_capacity ? watch_capacity * 2 : 16;
+		file_manager_watch_t *grown =
+		    realloc(watches, capacity * sizeof(file_manager_watch_t));
+		if (grown == NULL) {
+			error("failed to grow watch table!");
+			inotify_rm_watch(watch_fd, descriptor);
+			free(directory);
+			return;
+		}
+		memset(&grown[watch_capacity], 0,
+		    (capacity - watch_capacity) * sizeof(file_manager_watch_t));
+		watches = grown;
+		watch_capacity = capacity;
+	}
+	if (file_manager_table_insert(&watch_descriptors,
+	        file_manager_hash_descriptor(descriptor), index) != NO_ERROR) {
+		inotify_rm_watch(watch_fd, descriptor);
+		free(directory);
+		return;
+	}
+	watches[index] = (file_manager_watch_t){descriptor, 1, directory};
+	handle->watch = index;
+}
+
+static void file_manager_unwatch(file_handle_t *handle) {
+	if (handle->watch < 0) {
+		return;
+	}
+	file_manager_watch_t *watch = &watches[handle->watch];
+	handle->watch = -1;
+	if (--watch->references > 0) {
+		return;
+	}
+	inotify_rm_watch(watch_fd, watch->descriptor);
+	file_manager_table_remove(&watch_descriptors,
+	    file_manager_hash_descriptor(watch->descriptor), watch - watches);
+	free(watch->directory);
+	watch->directory = NULL;
+}
+
+// a slot in the table for a file that's just been opened
+static int file_manager_attach(file_handle_t *handle) {
+	int index;
+	if (handle_free_count > 0) {
+		index = handle_free[--handle_free_count];
+	} else {
+		int capacity = handle_capacity ? handle_capacity * 2 : 16;
+		file_handle_t **grown =
+		    realloc(handles, capacity * sizeof(file_handle_t *));
+		int *free_slots = realloc(handle_free, capacity * sizeof(int));
+		if (grown != NULL) {
+			handles = grown;
+		}
+		if (free_slots != NULL) {
+			handle_free = free_slots;
+		}
+		if (grown == NULL || free_slots == NULL) {
+			error("failed to grow file table!");
+			return FILE_MANAGER_NO_HANDLE;
+		}
+		for (int i = capacity - 1; i > handle_capacity; i--) {
+			handles[i] = NULL;
+			handle_free[handle_free_count++] = i;
+		}
+		index = handle_capacity;
+		handle_capacity = capacity;
+	}
+	if (file_manager_table_insert(&handle_paths, handle->hash, index) !=
+	    NO_ERROR) {
+		handle_free[handle_free_count++] = index;
+		return FILE_MANAGER_NO_HANDLE;
 	}
+	handles[index] = handle;
+	return index;
+}
 
+/*
+the part of opening a file that doesn't read it: finishing a save a crash cut
+short, opening it and giving it a handle. a file that's already open gets the
+handle it has, *opened says whether it's a new one.
+*/
+static result_t file_manager_prepare(const char *filepath, int readonly,
+    text_buffer_backend_t backend, int *handle, int *opened) {
+	*handle = FILE_MANAGER_NO_HANDLE;
+	*opened = 0;
 	if (filepath == NULL) {
 		error("improper file path!");
 		return FILE_MANAGER_ERROR;
 	}
+	*handle = file_manager_find(filepath);
+	if (*handle != FILE_MANAGER_NO_HANDLE) {
+		return NO_ERROR;
+	}
 
-	if (access(filepath, F_OK)) {
-		active_file = fopen(filepath, "w+");
+	FILE *file;
+	if (readonly) {
+		if (access(filepath, R_OK)) {
+			error("missing permissions for specified file!");
+			return FILE_MANAGER_ERROR;
+		}
+		file_manager_recover(filepath);
+		file = fopen(filepath, "r");
+	} else if (access(filepath, F_OK)) {
+		file = fopen(filepath, "w+");
 	} else {
 		if (access(filepath, R_OK | W_OK)) {
 			error("missing permissions for specified file!");
@@ -49,66 +623,2353 @@ result_t file_manager_open(split_buffer_t *buffer, const char *filepath) {
 			return FILE_MANAGER_ERROR;
 		}
 
-		active_file = fopen(filepath, "r+");
+		file_manager_recover(filepath);
+		file = fopen(filepath, "r+");
+	}
+	if (file == NULL) {
+		error("failed to open file!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	file_handle_t *opening = calloc(1, sizeof(file_handle_t));
+	char *target = realpath(filepath, NULL);
+	if (opening == NULL || target == NULL) {
+		error("failed to allocate file handle!");
+		free(opening);
+		free(target);
+		fclose(file);
+		return FILE_MANAGER_ERROR;
+	}
+	opening->file = file;
+	opening->filepath = strdup(filepath);
+	opening->target = target;
+	opening->hash = file_manager_hash_path(target);
+	opening->backend = readonly ? PIECE_TABLE_BACKEND : backend;
+	opening->readonly = readonly;
+	opening->watch = -1;
+	opening->pending_range_count = -1;
+	opening->load_result = FILE_MANAGER_ERROR;
+	text_buffer_create(&opening->buffer, SPLIT_BUFFER_BACKEND, "");
+	*handle = file_manager_attach(opening);
+	if (*handle == FILE_MANAGER_NO_HANDLE) {
+		free(opening->filepath);
+		free(opening->target);
+		free(opening);
+		fclose(file);
+		return FILE_MANAGER_ERROR;
+	}
+	*opened = 1;
+	return NO_ERROR;
+}
+
+static void file_manager_utf8_begin(file_manager_utf8_t *utf8) {
+	*utf8 = (file_manager_utf8_t){0, 0, -1, {0}, 0};
+}
+
+// the next length bytes of the file, checked once the first bad byte is found
+// only to be counted
+static void file_manager_utf8_chunk(
+    file_manager_utf8_t *utf8, const char *data, long length) {
+	utf8->codepoints += scan_codepoints(data, length);
+	long start = 0;
+	if (utf8->carried > 0 && utf8->invalid < 0) {
+		char joined[8];
+		long taken = length < 3 ? length : 3;
+		memcpy(joined, utf8->carry, utf8->carried);
+		memcpy(&joined[utf8->carried], data, taken);
+		long joined_length = utf8->carried + taken;
+		long cut = encoding_utf8_cut(joined, joined_length);
+		if (cut == joined_length) {
+			// still not finished, this chunk was too short
+			memcpy(utf8->carry, joined, joined_length);
+			utf8->carried = joined_length;
+			utf8->offset += length;
+			return;
+		}
+		long valid = scan_utf8_valid(joined, joined_length - cut);
+		if (valid < utf8->carried) {
+			utf8->invalid = utf8->offset - utf8->carried + valid;
+		}
+		start = valid - utf8->carried;
+	}
+	utf8->carried = 0;
+	if (utf8->invalid < 0) {
+		long cut = encoding_utf8_cut(&data[start], length - start);
+		long valid = scan_utf8_valid(&data[start], length - start - cut);
+		if (valid < length - start - cut) {
+			utf8->invalid = utf8->offset + start + valid;
+		} else {
+			memcpy(utf8->carry, &data[length - cut], cut);
+			utf8->carried = cut;
+		}
+	}
+	utf8->offset += length;
+}
+
+// a sequence the file ends part way through isn't utf-8
+static void file_manager_utf8_end(file_manager_utf8_t *utf8) {
+	if (utf8->carried > 0 && utf8->invalid < 0) {
+		utf8->invalid = utf8->offset - utf8->carried;
 	}
+	utf8->carried = 0;
+}
 
-	active_filepath = malloc(256);
-	strncpy(active_filepath, filepath, 256);
+static int file_manager_transcoded(const file_handle_t *handle) {
+	return encoding_transcoded(handle->encoding, handle->bom);
+}
 
-	if (active_file == NULL) {
-		error("failed to open file!");
+// what a file is in, from its first screen. one that isn't utf-8 can't be
+// mapped, what's on disk isn't its text, so it's decoded into a rope instead.
+static void file_manager_detect(
+    file_handle_t *handle, const char *head, long length, int whole) {
+	handle->encoding = encoding_detect(head, length, whole, &handle->bom);
+	encoding_begin(&handle->decoder, handle->encoding, handle->bom);
+	if (!file_manager_transcoded(handle)) {
+		return;
+	}
+	debug("reading %s as %s%s", handle->filepath,
+	    encoding_name(handle->encoding), handle->bom ? " with a bom" : "");
+	if (handle->backend == PIECE_TABLE_BACKEND) {
+		handle->backend = ROPE_BACKEND;
+	}
+}
+
+static result_t file_manager_sniff(
+    file_handle_t *handle, file_io_t *io, int fd, long length) {
+	long head_length = length < FILE_MANAGER_FIRST_SCREEN
+	                       ? length
+	                       : FILE_MANAGER_FIRST_SCREEN;
+	char *head = malloc(FILE_MANAGER_FIRST_SCREEN);
+	if (head == NULL) {
+		error("failed to allocate file head!");
 		return FILE_MANAGER_ERROR;
 	}
+	result_t res = file_manager_read_all(io, fd, head, head_length, 0);
+	if (res == NO_ERROR) {
+		file_manager_detect(
+		    handle, head, head_length, head_length == length);
+	}
+	free(head);
+	return res;
+}
 
-	char file_buffer[4096];
-	size_t bytes_read = fread(file_buffer, 1, 4096, active_file);
-	file_buffer[bytes_read] = '\0';
-	split_buffer_create(buffer, file_buffer);
+// a file that isn't utf-8 goes through the decoder a block at a time on its
+// way into a fresh buffer
+static result_t file_manager_decode(
+    file_handle_t *handle, file_io_t *io, int fd, long length) {
+	text_buffer_t *buffer = &handle->buffer;
+	result_t res = text_buffer_create(buffer, handle->backend, "");
+	if (res != NO_ERROR) {
+		return res;
+	}
+	char *block = malloc(FILE_MANAGER_DECODE_CHUNK + FILE_MANAGER_STREAM_CHUNK);
+	if (block == NULL) {
+		error("failed to allocate decode block!");
+		res = FILE_MANAGER_ERROR;
+	}
+	char *text = &block[FILE_MANAGER_DECODE_CHUNK];
+	for (long offset = 0; offset < length && res == NO_ERROR;) {
+		long bytes = length - offset < FILE_MANAGER_DECODE_CHUNK
+		                 ? length - offset
+		                 : FILE_MANAGER_DECODE_CHUNK;
+		res = file_manager_read_all(io, fd, block, bytes, offset);
+		long decoded = 0;
+		if (res == NO_ERROR) {
+			decoded = encoding_decode(&handle->decoder, block, bytes, text);
+		}
+		if (decoded > 0) {
+			res = text_buffer_insert(buffer, text, decoded);
+		}
+		offset += bytes;
+	}
+	long decoded =
+	    res == NO_ERROR ? encoding_decode_end(&handle->decoder, text) : 0;
+	if (decoded > 0) {
+		res = text_buffer_insert(buffer, text, decoded);
+	}
+	free(block);
 
+	long size = text_buffer_size(buffer);
+	if (res == NO_ERROR && size > 0) {
+		res = text_buffer_move(buffer, -size);
+	}
+	if (res != NO_ERROR) {
+		text_buffer_destroy(buffer);
+		return res;
+	}
+	dirty_ranges_reset(&buffer->dirty, size);
 	return NO_ERROR;
 }
 
-void file_manager_close(void) {
-	if (active_file == NULL) {
-		warn("attempting to close an unopened file.");
-		return;
+// reads a prepared file into its buffer, on whatever thread io belongs to
+static result_t file_manager_load(file_handle_t *handle, file_io_t *io) {
+	int fd = fileno(handle->file);
+	struct stat file_stat;
+	if (fstat(fd, &file_stat)) {
+		error("failed to stat file!");
+		return FILE_MANAGER_ERROR;
 	}
+	// read front to back exactly once, so the kernel can read ahead as far as
+	// it likes
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-	free(active_filepath);
-	active_filepath = NULL;
+	text_buffer_destroy(&handle->buffer);
+	double start = file_manager_time();
+	// a view maps the file as it is
+	result_t res = handle->readonly ? NO_ERROR
+	                                : file_manager_sniff(
+	                                      handle, io, fd, file_stat.st_size);
+	if (res == NO_ERROR && file_manager_transcoded(handle)) {
+		res = file_manager_decode(handle, io, fd, file_stat.st_size);
+	} else if (res == NO_ERROR) {
+		res = text_buffer_load(
+		    &handle->buffer, handle->backend, io, fd, file_stat.st_size);
+	}
+	if (res != NO_ERROR) {
+		error("failed to load file!");
+		// what's there is an empty buffer, whatever the load left behind
+		text_buffer_create(&handle->buffer, SPLIT_BUFFER_BACKEND, "");
+		return res;
+	}
+	double elapsed = file_manager_time() - start;
+	handle->load_rate =
+	    elapsed > 0.0 ? file_stat.st_size / elapsed / 1000000.0 : 0.0;
+	handle->stat = file_stat;
 
-	fclose(active_file);
-	active_file = NULL;
+	// a mapped file isn't read, checking it would read all of it
+	file_manager_utf8_begin(&handle->utf8);
+	if (handle->backend == PIECE_TABLE_BACKEND) {
+		handle->utf8.codepoints = -1;
+		return NO_ERROR;
+	}
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	text_buffer_iterator_begin(&handle->buffer, &iterator, 0, -1);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		file_manager_utf8_chunk(&handle->utf8, span.data, span.length);
+	}
+	file_manager_utf8_end(&handle->utf8);
+	return NO_ERROR;
 }
 
-void file_manager_delete(const char *filepath) {
-	if (filepath == NULL) {
-		error("improper active file path!");
+// back on the main thread once the buffer is there, the file is watched and
+// its edits logged
+static void file_manager_loaded_on(file_handle_t *handle) {
+	file_manager_watch(handle);
+	if (handle->readonly) {
 		return;
 	}
+	// edits that were never saved before a crash come back out of the log
+	char *log_path = file_manager_hidden_path(handle->target, "edits");
+	if (log_path == NULL ||
+	    edit_log_start(&handle->log, log_path, fileno(handle->file),
+	        &handle->buffer) != NO_ERROR) {
+		warn("editing without an edit log.");
+	}
+	free(log_path);
+}
 
-	if (strncmp(filepath, "text-editor-log.txt", 32) == 0) {
-		error("attempting to delete protected file!");
+// reads a prepared file all at once, one that can't be read is closed again
+static result_t file_manager_open_now(int *handle) {
+	file_handle_t *opening = handles[*handle];
+	opening->load_result = file_manager_load(opening, &active_io);
+	if (opening->load_result != NO_ERROR) {
+		file_manager_close(*handle);
+		*handle = FILE_MANAGER_NO_HANDLE;
+		return FILE_MANAGER_ERROR;
+	}
+	file_manager_loaded_on(opening);
+
+	return NO_ERROR;
+}
+
+// create file if it doesn't exist
+result_t file_manager_open(
+    const char *filepath, text_buffer_backend_t backend, int *handle) {
+	int opened;
+	result_t res = file_manager_prepare(filepath, 0, backend, handle, &opened);
+	if (res != NO_ERROR || !opened) {
+		return res;
+	}
+	return file_manager_open_now(handle);
+}
+
+// arrived text goes on the end, wherever the cursor has been moved to since
+static result_t file_manager_stream_append(
+    text_buffer_t *buffer, const char *data, long length) {
+	if (length == 0) {
+		return NO_ERROR;
+	}
+	long cursor = text_buffer_cursor(buffer);
+	long size = text_buffer_size(buffer);
+	if (cursor != size) {
+		text_buffer_move(buffer, size - cursor);
+	}
+	result_t res = text_buffer_insert(buffer, data, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	return text_buffer_move(buffer, cursor - size - length);
+}
+
+// reads the file into the ring a chunk at a time, waiting while it's full. a
+// file that isn't utf-8 is read into a block of its own and decoded into the
+// ring from there.
+static void *file_manager_stream_thread(void *argument) {
+	file_handle_t *handle = argument;
+	file_io_t io;
+	if (file_io_create(&io, active_engine) != NO_ERROR) {
+		file_io_create(&io, FILE_IO_POSIX);
+	}
+	int fd = fileno(handle->file);
+	long offset = handle->stream_from;
+	result_t res = NO_ERROR;
+	int transcoded = file_manager_transcoded(handle);
+	long most = transcoded ? FILE_MANAGER_DECODE_CHUNK
+	                       : FILE_MANAGER_STREAM_CHUNK;
+	char *raw = transcoded ? malloc(FILE_MANAGER_DECODE_CHUNK) : NULL;
+	if (transcoded && raw == NULL) {
+		error("failed to allocate decode block!");
+		res = FILE_MANAGER_ERROR;
+	}
+	while (offset < handle->load_length && res == NO_ERROR) {
+		pthread_mutex_lock(&stream_lock);
+		while (handle->ring_read - handle->ring_taken ==
+		           FILE_MANAGER_STREAM_AHEAD &&
+		       !handle->stream_stop) {
+			pthread_cond_wait(&stream_wake, &stream_lock);
+		}
+		int stop = handle->stream_stop;
+		long slot = handle->ring_read % FILE_MANAGER_STREAM_AHEAD;
+		pthread_mutex_unlock(&stream_lock);
+		if (stop) {
+			break;
+		}
+
+		char *chunk = &handle->ring[slot * FILE_MANAGER_STREAM_CHUNK];
+		char *read = transcoded ? raw : chunk;
+		long wanted = handle->load_length - offset;
+		wanted = wanted < most ? wanted : most;
+		long length = 0;
+		while (length < wanted) {
+			long bytes;
+			res = file_io_read(&io, fd, &read[length], wanted - length,
+			    offset + length, &bytes);
+			if (res != NO_ERROR || bytes == 0) {
+				break;
+			}
+			length += bytes;
+		}
+		if (res != NO_ERROR) {
+			error("failed to stream file!");
+			break;
+		}
+		long text_length = length;
+		if (transcoded) {
+			text_length =
+			    encoding_decode(&handle->decoder, raw, length, chunk);
+			if (length < wanted || offset + length == handle->load_length) {
+				text_length +=
+				    encoding_decode_end(&handle->decoder, &chunk[text_length]);
+			}
+		}
+		file_manager_utf8_chunk(&handle->utf8, chunk, text_length);
+
+		pthread_mutex_lock(&stream_lock);
+		handle->ring_lengths[slot] = text_length;
+		handle->ring_raw[slot] = length;
+		handle->ring_read++;
+		pthread_mutex_unlock(&stream_lock);
+		// the file got shorter since it was opened, what's there is all of it
+		if (length < wanted) {
+			break;
+		}
+		offset += length;
+	}
+	free(raw);
+	file_io_destroy(&io);
+
+	pthread_mutex_lock(&stream_lock);
+	handle->stream_result = res;
+	handle->stream_done = 1;
+	pthread_mutex_unlock(&stream_lock);
+	return NULL;
+}
+
+// the loader is stopped if it's still reading, and its ring goes with it
+static void file_manager_stream_stop(file_handle_t *handle) {
+	pthread_mutex_lock(&stream_lock);
+	handle->stream_stop = 1;
+	pthread_cond_broadcast(&stream_wake);
+	pthread_mutex_unlock(&stream_lock);
+	pthread_join(handle->loader, NULL);
+	handle->loading = 0;
+	free(handle->ring);
+	handle->ring = NULL;
+}
+
+// the whole file is in the buffer, or as much as could be read of it before
+// it failed
+static void file_manager_streamed(file_handle_t *handle, result_t res) {
+	free(handle->ring);
+	handle->ring = NULL;
+	handle->loading = 0;
+	handle->load_result = res;
+	if (res != NO_ERROR) {
+		// what's there is an empty buffer, whatever had arrived
+		text_buffer_destroy(&handle->buffer);
+		text_buffer_create(&handle->buffer, SPLIT_BUFFER_BACKEND, "");
 		return;
 	}
+	file_manager_utf8_end(&handle->utf8);
+	text_buffer_t *buffer = &handle->buffer;
+	dirty_ranges_reset(&buffer->dirty, text_buffer_size(buffer));
+	double elapsed = file_manager_time() - handle->load_start;
+	handle->load_rate =
+	    elapsed > 0.0 ? handle->streamed / elapsed / 1000000.0 : 0.0;
+	file_manager_loaded_on(handle);
+}
 
-	debug("deleting %s.", filepath);
+// moves what the loader has read onto the end of the buffer, until budget
+// bytes have been. 1 once the whole file is in and the loader is gone.
+static int file_manager_stream_in(file_handle_t *handle, long *budget) {
+	pthread_mutex_lock(&stream_lock);
+	long read = handle->ring_read;
+	int done = handle->stream_done;
+	pthread_mutex_unlock(&stream_lock);
 
-	if (remove(filepath)) {
-		error("failed to delete specified file!");
+	long taken = handle->ring_taken;
+	result_t res = NO_ERROR;
+	while (taken < read && *budget > 0 && res == NO_ERROR) {
+		long slot = taken % FILE_MANAGER_STREAM_AHEAD;
+		long length = handle->ring_lengths[slot];
+		res = file_manager_stream_append(&handle->buffer,
+		    &handle->ring[slot * FILE_MANAGER_STREAM_CHUNK], length);
+		handle->streamed += handle->ring_raw[slot];
+		*budget -= length;
+		taken++;
 	}
+	if (res != NO_ERROR) {
+		error("failed to stream file into buffer!");
+		file_manager_stream_stop(handle);
+		file_manager_streamed(handle, res);
+		return 1;
+	}
+
+	pthread_mutex_lock(&stream_lock);
+	handle->ring_taken = taken;
+	pthread_cond_broadcast(&stream_wake);
+	pthread_mutex_unlock(&stream_lock);
+	if (!done || taken < read) {
+		return 0;
+	}
+	pthread_join(handle->loader, NULL);
+	file_manager_streamed(handle, handle->stream_result);
+	return 1;
+}
+
+/*
+puts the first screen of a prepared file in its buffer before returning, and
+starts a loader on the rest. a file that fits in the first screen is all read
+here and nothing is started.
+*/
+static result_t file_manager_stream_start(file_handle_t *handle, double start) {
+	int fd = fileno(handle->file);
+	if (fstat(fd, &handle->stat)) {
+		error("failed to stat file!");
+		return FILE_MANAGER_ERROR;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	handle->load_start = start;
+	handle->load_length = handle->stat.st_size;
+	handle->ring =
+	    malloc(FILE_MANAGER_STREAM_AHEAD * FILE_MANAGER_STREAM_CHUNK);
+	if (handle->ring == NULL) {
+		error("failed to allocate stream ring!");
+		return FILE_MANAGER_ERROR;
+	}
+	text_buffer_destroy(&handle->buffer);
+
+	long first = handle->load_length < FILE_MANAGER_FIRST_SCREEN
+	                 ? handle->load_length
+	                 : FILE_MANAGER_FIRST_SCREEN;
+	long length = 0;
+	result_t res = NO_ERROR;
+	while (length < first) {
+		long bytes;
+		res = file_io_read(&active_io, fd, &handle->ring[length],
+		    first - length, length, &bytes);
+		if (res != NO_ERROR || bytes == 0) {
+			break;
+		}
+		length += bytes;
+	}
+	// what the buffer is depends on what the file turned out to be in
+	if (res == NO_ERROR) {
+		file_manager_detect(handle, handle->ring, length,
+		    length == handle->load_length || length < first);
+		res = text_buffer_create(&handle->buffer, handle->backend, "");
+	}
+	char *text = handle->ring;
+	long text_length = length;
+	if (res == NO_ERROR && file_manager_transcoded(handle)) {
+		text = &handle->ring[FILE_MANAGER_STREAM_CHUNK];
+		text_length =
+		    encoding_decode(&handle->decoder, handle->ring, length, text);
+		if (length == handle->load_length || length < first) {
+			text_length +=
+			    encoding_decode_end(&handle->decoder, &text[text_length]);
+		}
+	}
+	if (res == NO_ERROR) {
+		res = file_manager_stream_append(&handle->buffer, text, text_length);
+	}
+	if (res != NO_ERROR) {
+		error("failed to load file!");
+		file_manager_streamed(handle, res);
+		return res;
+	}
+	file_manager_utf8_begin(&handle->utf8);
+	file_manager_utf8_chunk(&handle->utf8, text, text_length);
+	handle->streamed = length;
+	handle->stream_from = length;
+	if (length == handle->load_length || length < first) {
+		file_manager_streamed(handle, NO_ERROR);
+		return NO_ERROR;
+	}
+
+	handle->loading = 1;
+	if (pthread_create(
+	        &handle->loader, NULL, file_manager_stream_thread, handle)) {
+		error("failed to start load thread!");
+		handle->loading = 0;
+		file_manager_streamed(handle, FILE_MANAGER_ERROR);
+		return FILE_MANAGER_ERROR;
+	}
+	return NO_ERROR;
 }
 
-result_t file_manager_save(split_buffer_t *buffer) {
-	if (active_file == NULL || active_filepath == NULL) {
-		error("expected active file to not be null!");
+result_t file_manager_open_background(
+    const char *filepath, text_buffer_backend_t backend, int *handle) {
+	double start = file_manager_time();
+	int opened;
+	result_t res = file_manager_prepare(filepath, 0, backend, handle, &opened);
+	if (res != NO_ERROR || !opened) {
+		return res;
+	}
+	// a mapped file is on screen as soon as it's mapped, there's nothing to
+	// stream
+	file_handle_t *opening = handles[*handle];
+	if (opening->backend == PIECE_TABLE_BACKEND) {
+		return file_manager_open_now(handle);
+	}
+	if (file_manager_stream_start(opening, start) != NO_ERROR) {
+		file_manager_close(*handle);
+		*handle = FILE_MANAGER_NO_HANDLE;
 		return FILE_MANAGER_ERROR;
 	}
-	freopen(active_filepath, "w", active_file);
 
-	fwrite(buffer->buffer, 1, buffer->pre_cursor_index, active_file);
-	fwrite(&buffer->buffer[buffer->post_cursor_index], 1,
-	    MAX_BUFFER_SIZE - buffer->post_cursor_index - 1, active_file);
+	return NO_ERROR;
+}
+
+int file_manager_loaded(int handle, result_t *res) {
+	file_handle_t *opened = file_manager_handle(handle);
+	if (opened == NULL) {
+		*res = FILE_MANAGER_ERROR;
+		return 1;
+	}
+	long budget = FILE_MANAGER_STREAM_BUDGET;
+	if (opened->loading && !file_manager_stream_in(opened, &budget)) {
+		return 0;
+	}
+	*res = opened->load_result;
+	return 1;
+}
+
+int file_manager_loading(int handle, long *loaded, long *length) {
+	file_handle_t *opened = file_manager_handle(handle);
+	if (opened == NULL || !opened->loading) {
+		return 0;
+	}
+	*loaded = opened->streamed;
+	*length = opened->load_length;
+	return 1;
+}
+
+void file_manager_stream(void) {
+	long budget = FILE_MANAGER_STREAM_BUDGET;
+	for (int i = 0; i < handle_capacity && budget > 0; i++) {
+		if (handles[i] != NULL && handles[i]->loading) {
+			file_manager_stream_in(handles[i], &budget);
+		}
+	}
+}
+
+// opens an existing file read only and maps it into a piece table, nothing
+// in it is read until it's displayed or searched
+result_t file_manager_view(const char *filepath, int *handle) {
+	int opened;
+	result_t res = file_manager_prepare(
+	    filepath, 1, PIECE_TABLE_BACKEND, handle, &opened);
+	if (res != NO_ERROR || !opened) {
+		return res;
+	}
+	return file_manager_open_now(handle);
+}
+
+text_buffer_t *file_manager_buffer(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened == NULL ? NULL : &opened->buffer;
+}
+
+const char *file_manager_path(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened == NULL ? NULL : opened->filepath;
+}
+
+int file_manager_readonly(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened != NULL && opened->readonly;
+}
+
+double file_manager_load_rate(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened == NULL ? 0.0 : opened->load_rate;
+}
+
+long file_manager_codepoints(int handle, long *invalid) {
+	file_handle_t *opened = file_manager_handle(handle);
+	if (opened == NULL || opened->loading || opened->utf8.codepoints < 0) {
+		*invalid = -1;
+		return -1;
+	}
+	*invalid = opened->utf8.invalid;
+	return opened->utf8.codepoints;
+}
+
+encoding_t file_manager_encoding(int handle, int *bom) {
+	file_handle_t *opened = file_manager_handle(handle);
+	*bom = opened == NULL ? 0 : opened->bom;
+	return opened == NULL ? ENCODING_UTF8 : opened->encoding;
+}
+
+// the whole buffer is looked through, only for a file in an encoding that
+// can't hold everything
+static int file_manager_fits(file_handle_t *handle) {
+	if (handle->encoding != ENCODING_LATIN1) {
+		return 1;
+	}
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	text_buffer_iterator_begin(&handle->buffer, &iterator, 0, -1);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		if (!encoding_fits(handle->encoding, span.data, span.length)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int file_manager_encodable(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened == NULL || file_manager_fits(opened);
+}
+
+long file_manager_recovered(int handle) {
+	file_handle_t *opened = file_manager_handle(handle);
+	return opened == NULL ? 0 : opened->log.recovered;
+}
+
+void file_manager_prefetch(const char *filepath) {
+	prefetch_tag++;
+	if (filepath[0] == '\0') {
+		return;
+	}
+	snprintf(prefetch_path, sizeof(prefetch_path), "%s", filepath);
+	// stats are even tags and opens odd ones
+	file_io_stat(&active_io, prefetch_path, prefetch_tag * 2);
+}
+
+int file_manager_prefetched(long *size, int *directory) {
+	int found = 0;
+	file_io_event_t event;
+	while (file_io_poll(&active_io, &event)) {
+		int current = event.tag / 2 == prefetch_tag;
+		if (event.tag % 2) {
+			// the first part of the file is read ahead while the name is still
+			// on the prompt, whatever comes of it nobody waits on it
+			if (event.result >= 0) {
+				if (current) {
+					posix_fadvise(event.result, 0, FILE_MANAGER_PREFETCH,
+					    POSIX_FADV_WILLNEED);
+				}
+				close(event.result);
+			}
+			continue;
+		}
+		if (!current) {
+			continue;
+		}
+		found = 1;
+		*size = event.result < 0 ? -1 : event.size;
+		*directory = event.result >= 0 && S_ISDIR(event.mode);
+		if (event.result >= 0 && S_ISREG(event.mode) && event.size > 0) {
+			file_io_open(&active_io, prefetch_path, O_RDONLY, event.tag + 1);
+		}
+	}
+	return found;
+}
+
+// a save of it still being written is finished first, and one still streaming
+// in stops where it is
+void file_manager_close(int handle) {
+	file_handle_t *closing = file_manager_handle(handle);
+	if (closing == NULL) {
+		warn("attempting to close an unopened file.");
+		return;
+	}
+	if (closing->loading) {
+		file_manager_stream_stop(closing);
+	}
+	if (save_started) {
+		file_manager_save_wait(closing);
+	}
+
+	// closing throws the unsaved edits away, so their log goes too
+	edit_log_stop(&closing->log);
+	file_manager_unwatch(closing);
+	file_manager_table_remove(&handle_paths, closing->hash, handle);
+	handles[handle] = NULL;
+	handle_free[handle_free_count++] = handle;
+
+	text_buffer_destroy(&closing->buffer);
+	if (closing->file != NULL) {
+		fclose(closing->file);
+	}
+	free(closing->filepath);
+	free(closing->target);
+	free(closing);
+}
+
+void file_manager_delete(const char *filepath) {
+	if (filepath == NULL) {
+		error("improper active file path!");
+		return;
+	}
+
+	if (strncmp(filepath, "text-editor-log.txt", 32) == 0) {
+		error("attempting to delete protected file!");
+		return;
+	}
+
+	debug("deleting %s.", filepath);
+
+	if (remove(filepath)) {
+		error("failed to delete specified file!");
+	}
+}
+
+// the next span of either a live buffer or a snapshot of one
+static int file_manager_next_span(text_buffer_iterator_t *iterator,
+    const text_snapshot_t *snapshot, long *index, text_span_t *span) {
+	if (snapshot == NULL) {
+		return text_buffer_iterator_next(iterator, span);
+	}
+	if (*index >= snapshot->span_count) {
+		return 0;
+	}
+	*span = snapshot->spans[(*index)++];
+	return 1;
+}
+
+// writes all of the vectors at offset and moves it on, picking up where a
+// short write left off
+static result_t file_manager_write_all(file_io_t *io, int fd,
+    struct iovec *vectors, int count, long *offset) {
+	int first = 0;
+	while (first < count) {
+		long bytes;
+		if (file_io_writev(io, fd, &vectors[first], count - first, *offset,
+		        &bytes) != NO_ERROR) {
+			return FILE_MANAGER_ERROR;
+		}
+		if (bytes == 0) {
+			error("failed to write file!");
+			return FILE_MANAGER_ERROR;
+		}
+		*offset += bytes;
+		while (first < count && (long)vectors[first].iov_len <= bytes) {
+			bytes -= vectors[first++].iov_len;
+		}
+		if (bytes > 0) {
+			vectors[first].iov_base = (char *)vectors[first].iov_base + bytes;
+			vectors[first].iov_len -= bytes;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+// writes every span in a file's own encoding, a block of text at a time
+// through the encoder
+static result_t file_manager_encode(file_io_t *io,
+    const text_buffer_t *buffer, const text_snapshot_t *snapshot, int fd,
+    encoding_t encoding, int bom, file_manager_progress_t *progress) {
+	char *block = malloc(ENCODING_ROOM(FILE_MANAGER_ENCODE_BLOCK));
+	if (block == NULL) {
+		error("failed to allocate encode block!");
+		return FILE_MANAGER_ERROR;
+	}
+	encoding_state_t encoder;
+	encoding_begin(&encoder, encoding, bom);
+	text_buffer_iterator_t iterator;
+	long index = 0;
+	long offset = 0;
+	text_span_t span = {NULL, 0};
+	if (snapshot == NULL) {
+		text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+	}
+	result_t res = NO_ERROR;
+	int more = 1;
+	while (more && res == NO_ERROR) {
+		if (span.length == 0 &&
+		    !file_manager_next_span(&iterator, snapshot, &index, &span)) {
+			more = 0;
+		}
+		long length = span.length < FILE_MANAGER_ENCODE_BLOCK
+		                  ? span.length
+		                  : FILE_MANAGER_ENCODE_BLOCK;
+		long encoded = encoding_encode(&encoder, span.data, length, block);
+		if (!more) {
+			encoded += encoding_encode_end(&encoder, &block[encoded]);
+		}
+		span.data += length;
+		span.length -= length;
+		if (encoded > 0) {
+			struct iovec vector = {block, encoded};
+			res = file_manager_write_all(io, fd, &vector, 1, &offset);
+		}
+		if (res != NO_ERROR || progress == NULL) {
+			continue;
+		}
+		atomic_fetch_add(&progress->written, length);
+		if (atomic_load(&progress->cancel)) {
+			debug("cancelled saving after %ld bytes",
+			    atomic_load(&progress->written));
+			res = FILE_MANAGER_ERROR;
+		}
+	}
+	free(block);
+	return res;
+}
+
+// writes every span, a batch of spans per writev. a cancelled save stops
+// between batches.
+static result_t file_manager_gather(file_io_t *io, const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, int fd,
+    encoding_t encoding, int bom, file_manager_progress_t *progress) {
+	if (encoding_transcoded(encoding, bom)) {
+		return file_manager_encode(
+		    io, buffer, snapshot, fd, encoding, bom, progress);
+	}
+	struct iovec vectors[FILE_MANAGER_WRITE_VECTORS];
+	text_buffer_iterator_t iterator;
+	long index = 0;
+	long offset = 0;
+	text_span_t span = {NULL, 0};
+	if (snapshot == NULL) {
+		text_buffer_iterator_begin(buffer, &iterator, 0, -1);
+	}
+	while (1) {
+		int vector_count = 0;
+		long batch = 0;
+		while (vector_count < FILE_MANAGER_WRITE_VECTORS &&
+		       batch < FILE_MANAGER_WRITE_BLOCK) {
+			if (span.length == 0 &&
+			    !file_manager_next_span(&iterator, snapshot, &index, &span)) {
+				break;
+			}
+			long length = span.length < FILE_MANAGER_WRITE_BLOCK - batch
+			                  ? span.length
+			                  : FILE_MANAGER_WRITE_BLOCK - batch;
+			if (length > 0) {
+				vectors[vector_count++] = (struct iovec){(char *)span.data, length};
+			}
+			span.data += length;
+			span.length -= length;
+			batch += length;
+		}
+		if (vector_count == 0) {
+			break;
+		}
+
+		result_t res =
+		    file_manager_write_all(io, fd, vectors, vector_count, &offset);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		if (progress == NULL) {
+			continue;
+		}
+		atomic_fetch_add(&progress->written, batch);
+		if (atomic_load(&progress->cancel)) {
+			debug("cancelled saving after %ld bytes",
+			    atomic_load(&progress->written));
+			return FILE_MANAGER_ERROR;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+// the directory a file is in, so the temp file lands on the same filesystem
+// and the rename can't fail half way
+static char *file_manager_directory(const char *filepath) {
+	const char *slash = strrchr(filepath, '/');
+	if (slash == NULL) {
+		return strdup(".");
+	}
+	if (slash == filepath) {
+		return strdup("/");
+	}
+	char *directory = malloc(slash - filepath + 1);
+	if (directory != NULL) {
+		memcpy(directory, filepath, slash - filepath);
+		directory[slash - filepath] = '\0';
+	}
+	return directory;
+}
+
+static void file_manager_sync_directory(const char *directory) {
+	int fd = open(directory, O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
+
+// the journal of a save in place and the edit log sit next to the file,
+// hidden
+static char *file_manager_hidden_path(const char *target, const char *kind) {
+	char *directory = file_manager_directory(target);
+	if (directory == NULL) {
+		return NULL;
+	}
+	const char *slash = strrchr(target, '/');
+	const char *name = slash == NULL ? target : slash + 1;
+	char *path = malloc(strlen(directory) + strlen(name) + strlen(kind) + 32);
+	if (path != NULL) {
+		sprintf(path, "%s/.%s.text-editor-%s", directory, name, kind);
+	}
+	free(directory);
+	return path;
+}
+
+// the text from start up to end, out of a live buffer or a snapshot walked
+// forward from span *index at *base, so starts have to keep moving forward
+static long file_manager_text_at(const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, long *index, long *base, long start,
+    long end, const char **text) {
+	long length;
+	if (snapshot == NULL) {
+		length = text_buffer_span_at(buffer, start, text);
+	} else {
+		const text_span_t *spans = snapshot->spans;
+		while (*index < snapshot->span_count &&
+		       *base + spans[*index].length <= start) {
+			*base += spans[(*index)++].length;
+		}
+		if (*index >= snapshot->span_count) {
+			return 0;
+		}
+		*text = &spans[*index].data[start - *base];
+		length = spans[*index].length - (start - *base);
+	}
+	return length < end - start ? length : end - start;
+}
+
+static unsigned long file_manager_hash(
+    unsigned long hash, const void *data, long length) {
+	const unsigned char *bytes = data;
+	for (long i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ul;
+	}
+	return hash;
+}
+
+// gathers what goes into a journal into as few writevs as it can
+typedef struct file_manager_writer_t {
+	file_io_t *io;
+	int fd;
+	long offset;
+	int count;
+	struct iovec vectors[FILE_MANAGER_WRITE_VECTORS];
+	unsigned long checksum;
+} file_manager_writer_t;
+
+static result_t file_manager_append(
+    file_manager_writer_t *writer, const void *data, long length) {
+	if (writer->count == FILE_MANAGER_WRITE_VECTORS) {
+		result_t res = file_manager_write_all(
+		    writer->io, writer->fd, writer->vectors, writer->count, &writer->offset);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		writer->count = 0;
+	}
+	writer->vectors[writer->count++] = (struct iovec){(void *)data, length};
+	writer->checksum = file_manager_hash(writer->checksum, data, length);
+	return NO_ERROR;
+}
+
+static result_t file_manager_journal(file_io_t *io, const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, const dirty_range_t *ranges, long count,
+    const struct stat *file_stat, int fd) {
+	long(*records)[2] = malloc((count + 1) * sizeof(*records));
+	file_manager_writer_t *writer = malloc(sizeof(file_manager_writer_t));
+	if (records == NULL || writer == NULL) {
+		error("failed to allocate save journal!");
+		free(records);
+		free(writer);
+		return FILE_MANAGER_ERROR;
+	}
+	writer->io = io;
+	writer->fd = fd;
+	writer->offset = 0;
+	writer->count = 0;
+	writer->checksum = 14695981039346656037ul;
+
+	file_manager_journal_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FILE_MANAGER_JOURNAL_MAGIC, sizeof(header.magic));
+	header.device = file_stat->st_dev;
+	header.inode = file_stat->st_ino;
+	header.length = file_stat->st_size;
+	header.count = count;
+	result_t res = file_manager_append(writer, &header, sizeof(header));
+
+	long index = 0;
+	long base = 0;
+	for (long i = 0; i < count && res == NO_ERROR; i++) {
+		records[i][0] = ranges[i].start;
+		records[i][1] = ranges[i].end - ranges[i].start;
+		res = file_manager_append(writer, records[i], sizeof(records[i]));
+		for (long start = ranges[i].start;
+		     start < ranges[i].end && res == NO_ERROR;) {
+			const char *text;
+			long length = file_manager_text_at(
+			    buffer, snapshot, &index, &base, start, ranges[i].end, &text);
+			if (length <= 0) {
+				error("changed text is outside the buffer!");
+				res = FILE_MANAGER_ERROR;
+				break;
+			}
+			res = file_manager_append(writer, text, length);
+			start += length;
+		}
+	}
+
+	unsigned long checksum = writer->checksum;
+	if (res == NO_ERROR) {
+		res = file_manager_append(writer, &checksum, sizeof(checksum));
+	}
+	if (res == NO_ERROR) {
+		res = file_manager_write_all(
+		    io, fd, writer->vectors, writer->count, &writer->offset);
+	}
+	free(records);
+	free(writer);
+	return res;
+}
+
+static result_t file_manager_read_all(
+    file_io_t *io, int fd, void *data, long length, long offset) {
+	long done = 0;
+	while (done < length) {
+		long bytes;
+		if (file_io_read(io, fd, (char *)data + done, length - done,
+		        offset + done, &bytes) != NO_ERROR) {
+			return FILE_MANAGER_ERROR;
+		}
+		if (bytes == 0) {
+			error("file ended early!");
+			return FILE_MANAGER_ERROR;
+		}
+		done += bytes;
+	}
+	return NO_ERROR;
+}
+
+// copies every record of a journal into fd and syncs it. a journal being
+// recovered is checked in full first, one just written is trusted.
+static result_t file_manager_replay(file_io_t *io, int journal, int fd,
+    int verify, file_manager_progress_t *progress) {
+	struct stat journal_stat;
+	struct stat file_stat;
+	if (fstat(journal, &journal_stat) || fstat(fd, &file_stat)) {
+		error("failed to stat file!");
+		return FILE_MANAGER_ERROR;
+	}
+	file_manager_journal_t header;
+	long end = journal_stat.st_size - (long)sizeof(unsigned long);
+	if (end < (long)sizeof(header) ||
+	    file_manager_read_all(io, journal, &header, sizeof(header), 0) !=
+	        NO_ERROR ||
+	    memcmp(header.magic, FILE_MANAGER_JOURNAL_MAGIC, sizeof(header.magic)) ||
+	    header.device != (long)file_stat.st_dev ||
+	    header.inode != (long)file_stat.st_ino ||
+	    header.length != file_stat.st_size) {
+		warn("ignoring a save journal that isn't for this file.");
+		return FILE_MANAGER_ERROR;
+	}
+	char *block = malloc(FILE_MANAGER_REPLAY_BLOCK);
+	if (block == NULL) {
+		error("failed to allocate journal block!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	result_t res = NO_ERROR;
+	if (verify) {
+		unsigned long checksum = 14695981039346656037ul;
+		for (long offset = 0; offset < end && res == NO_ERROR;) {
+			long length = end - offset < FILE_MANAGER_REPLAY_BLOCK
+			                  ? end - offset
+			                  : FILE_MANAGER_REPLAY_BLOCK;
+			res = file_manager_read_all(io, journal, block, length, offset);
+			checksum = file_manager_hash(checksum, block, length);
+			offset += length;
+		}
+		unsigned long stored = 0;
+		if (res == NO_ERROR) {
+			res = file_manager_read_all(
+			    io, journal, &stored, sizeof(stored), end);
+		}
+		if (res == NO_ERROR && stored != checksum) {
+			warn("ignoring a save journal that was cut short.");
+			res = FILE_MANAGER_ERROR;
+		}
+	}
+
+	long position = sizeof(header);
+	for (long i = 0; i < header.count && res == NO_ERROR; i++) {
+		long record[2];
+		res = file_manager_read_all(
+		    io, journal, record, sizeof(record), position);
+		position += sizeof(record);
+		if (res == NO_ERROR &&
+		    (record[0] < 0 || record[1] < 0 ||
+		        record[0] + record[1] > header.length ||
+		        position + record[1] > end)) {
+			error("save journal is corrupt!");
+			res = FILE_MANAGER_ERROR;
+		}
+		for (long done = 0; done < record[1] && res == NO_ERROR;) {
+			long length = record[1] - done < FILE_MANAGER_REPLAY_BLOCK
+			                  ? record[1] - done
+			                  : FILE_MANAGER_REPLAY_BLOCK;
+			res = file_manager_read_all(
+			    io, journal, block, length, position + done);
+			struct iovec vector = {block, length};
+			long offset = record[0] + done;
+			if (res == NO_ERROR) {
+				res = file_manager_write_all(io, fd, &vector, 1, &offset);
+			}
+			if (progress != NULL) {
+				atomic_fetch_add(&progress->written, length);
+			}
+			done += length;
+		}
+		position += record[1];
+	}
+	free(block);
+
+	if (res == NO_ERROR && fsync(fd)) {
+		error("failed to sync file!");
+		res = FILE_MANAGER_ERROR;
+	}
+	return res;
+}
+
+static int file_manager_same_file(const struct stat *a, const struct stat *b) {
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+	       a->st_size == b->st_size && a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+	       a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/*
+writes only the ranges of filepath that changed, over the file itself. they
+go into a journal next to it first, synced before the file is touched, so a
+crash half way through is finished from it when the file is next opened.
+the file has to still be expected, as it was last read or saved. touched
+says whether any of the file was written, until then it's untouched and can
+still be saved some other way.
+*/
+static result_t file_manager_patch(file_io_t *io, const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, const dirty_range_t *ranges, long count,
+    const char *filepath, const struct stat *expected, long length,
+    file_manager_progress_t *progress, int *touched) {
+	*touched = 0;
+	if (count == 0) {
+		return NO_ERROR;
+	}
+	char *target = filepath == NULL ? NULL : realpath(filepath, NULL);
+	char *directory = target == NULL ? NULL : file_manager_directory(target);
+	char *journal_path =
+	    directory == NULL ? NULL : file_manager_hidden_path(target, "save");
+	if (journal_path == NULL) {
+		debug("can't save %s in place", filepath);
+		free(directory);
+		free(target);
+		return FILE_MANAGER_ERROR;
+	}
+
+	int fd = open(target, O_WRONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) || !S_ISREG(file_stat.st_mode) ||
+	    !file_manager_same_file(&file_stat, expected) ||
+	    file_stat.st_size != length) {
+		debug("%s changed since it was read, saving all of it", target);
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(journal_path);
+		free(directory);
+		free(target);
+		return FILE_MANAGER_ERROR;
+	}
+
+	result_t res = NO_ERROR;
+	int journal = open(journal_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (journal < 0) {
+		error("failed to create save journal!");
+		res = FILE_MANAGER_ERROR;
+	}
+	if (res == NO_ERROR) {
+		res = file_manager_journal(
+		    io, buffer, snapshot, ranges, count, &file_stat, journal);
+	}
+	if (res == NO_ERROR && fsync(journal)) {
+		error("failed to sync save journal!");
+		res = FILE_MANAGER_ERROR;
+	}
+	if (res == NO_ERROR) {
+		// a journal that can't be found after a crash is no use
+		file_manager_sync_directory(directory);
+		*touched = 1;
+		res = file_manager_replay(io, journal, fd, 0, progress);
+	}
+	close(fd);
+	if (journal >= 0) {
+		close(journal);
+		// one that was only partly applied stays to be finished later
+		if (!*touched || res == NO_ERROR) {
+			unlink(journal_path);
+		}
+	}
+	if (res == NO_ERROR) {
+		debug("saved %ld ranges of %s in place", count, target);
+	}
+
+	free(journal_path);
+	free(directory);
+	free(target);
+	return res;
+}
+
+// finishes a save in place that a crash cut short, before the file is read
+static void file_manager_recover(const char *filepath) {
+	char *target = realpath(filepath, NULL);
+	char *journal_path =
+	    target == NULL ? NULL : file_manager_hidden_path(target, "save");
+	int journal = journal_path == NULL ? -1 : open(journal_path, O_RDONLY);
+	if (journal < 0) {
+		free(journal_path);
+		free(target);
+		return;
+	}
+
+	int fd = open(target, O_WRONLY);
+	if (fd < 0) {
+		warn("can't finish an interrupted save without write permission.");
+	} else {
+		if (file_manager_replay(&active_io, journal, fd, 1, NULL) == NO_ERROR) {
+			info("finished an interrupted save");
+		}
+		close(fd);
+		unlink(journal_path);
+	}
+	close(journal);
+
+	free(journal_path);
+	free(target);
+}
+
+// the blocks of the buffer to write in place, or -1 when the whole file has
+// to be written again
+static long file_manager_changes(
+    const text_buffer_t *buffer, dirty_range_t **ranges) {
+	long count =
+	    dirty_ranges_list(&buffer->dirty, FILE_MANAGER_PATCH_BLOCK, ranges);
+	long changed = 0;
+	for (long i = 0; i < count; i++) {
+		changed += (*ranges)[i].end - (*ranges)[i].start;
+	}
+	if (changed > text_buffer_size(buffer) / FILE_MANAGER_PATCH_SHARE) {
+		free(*ranges);
+		*ranges = NULL;
+		return -1;
+	}
+	return count;
+}
+
+static result_t file_manager_replace(file_io_t *io, const text_buffer_t *buffer,
+    const text_snapshot_t *snapshot, const char *filepath, int durable,
+    encoding_t encoding, int bom, file_manager_progress_t *progress) {
+	if (filepath == NULL) {
+		error("improper file path!");
+		return FILE_MANAGER_ERROR;
+	}
+
+	// a symlink is saved through, not replaced by a plain file
+	char *target = realpath(filepath, NULL);
+	if (target == NULL) {
+		target = strdup(filepath);
+	}
+	char *directory = target == NULL ? NULL : file_manager_directory(target);
+	char *temp = directory == NULL ? NULL : malloc(strlen(directory) + 32);
+	if (temp == NULL) {
+		error("failed to allocate file path!");
+		free(directory);
+		free(target);
+		return FILE_MANAGER_ERROR;
+	}
+	sprintf(temp, "%s/.text-editor-XXXXXX", directory);
+
+	int fd = mkstemp(temp);
+	if (fd < 0) {
+		error("failed to create temporary file!");
+		free(temp);
+		free(directory);
+		free(target);
+		return FILE_MANAGER_ERROR;
+	}
+
+	// the saved file keeps the owner and permissions of the one it replaces,
+	// a new one gets what creating it normally would have
+	struct stat file_stat;
+	if (!stat(target, &file_stat)) {
+		if (fchown(fd, file_stat.st_uid, file_stat.st_gid)) {
+			debug("kept own group and user saving %s", target);
+		}
+		fchmod(fd, file_stat.st_mode & 07777);
+	} else {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+	}
+
+	result_t res = file_manager_gather(
+	    io, buffer, snapshot, fd, encoding, bom, progress);
+	if (res == NO_ERROR) {
+		res = file_io_commit(io, fd, temp, target, durable);
+	} else {
+		close(fd);
+	}
+	if (res != NO_ERROR) {
+		unlink(temp);
+	} else if (durable) {
+		// the rename itself only survives a crash once the directory is synced
+		file_manager_sync_directory(directory);
+	}
+	if (res == NO_ERROR) {
+		// a journal left by a patch that failed was for the file just replaced
+		char *journal = file_manager_hidden_path(target, "save");
+		if (journal != NULL) {
+			unlink(journal);
+			free(journal);
+		}
+	}
+
+	free(temp);
+	free(directory);
+	free(target);
+	return res;
+}
+
+result_t file_manager_write(
+    const text_buffer_t *buffer, const char *filepath, int durable) {
+	return file_manager_replace(
+	    &active_io, buffer, NULL, filepath, durable, ENCODING_UTF8, 0, NULL);
+}
+
+static void *file_manager_save_thread(void *argument) {
+	(void)argument;
+	file_io_t io;
+	if (file_io_create(&io, active_engine) != NO_ERROR) {
+		file_io_create(&io, FILE_IO_POSIX);
+	}
+	pthread_mutex_lock(&save_lock);
+	while (1) {
+		while (save_first == NULL && !save_stop) {
+			pthread_cond_wait(&save_wake, &save_lock);
+		}
+		if (save_first == NULL) {
+			break;
+		}
+		file_handle_t *handle = save_first;
+		save_first = handle->queue_next;
+		if (save_first == NULL) {
+			save_last = NULL;
+		}
+		handle->queue_next = NULL;
+		handle->queued = 0;
+		text_snapshot_t *snapshot = handle->pending;
+		char *filepath = handle->pending_path;
+		dirty_range_t *ranges = handle->pending_ranges;
+		long range_count = handle->pending_range_count;
+		struct stat expected = handle->pending_stat;
+		long mark = handle->pending_mark;
+		handle->pending = NULL;
+		handle->pending_path = NULL;
+		handle->pending_ranges = NULL;
+		handle->pending_range_count = -1;
+		handle->writing = 1;
+		handle->save_length = snapshot->length;
+		if (range_count >= 0) {
+			handle->save_length = 0;
+			for (long i = 0; i < range_count; i++) {
+				handle->save_length += ranges[i].end - ranges[i].start;
+			}
+		}
+		file_manager_progress_t *progress = &handle->progress;
+		atomic_store(&progress->written, 0);
+		atomic_store(&progress->cancel, 0);
+		pthread_mutex_unlock(&save_lock);
+
+		result_t res = text_snapshot_list(snapshot);
+		if (res == NO_ERROR && range_count >= 0) {
+			int touched;
+			res = file_manager_patch(&io, NULL, snapshot, ranges, range_count,
+			    filepath, &expected, snapshot->length, progress, &touched);
+			// one that didn't get as far as the file can still write it whole
+			if (res != NO_ERROR && !touched) {
+				pthread_mutex_lock(&save_lock);
+				handle->save_length = snapshot->length;
+				atomic_store(&progress->written, 0);
+				pthread_mutex_unlock(&save_lock);
+				range_count = -1;
+				res = NO_ERROR;
+			}
+		}
+		if (res == NO_ERROR && range_count < 0) {
+			res = file_manager_replace(&io, NULL, snapshot, filepath, 1,
+			    handle->encoding, handle->bom, progress);
+		}
+		struct stat file_stat;
+		int logged = res == NO_ERROR && !stat(filepath, &file_stat);
+		text_snapshot_release(snapshot);
+		free(ranges);
+		free(filepath);
+
+		pthread_mutex_lock(&save_lock);
+		handle->writing = 0;
+		// a cancelled save has a newer one waiting, that one's result counts
+		if (!atomic_load(&progress->cancel)) {
+			handle->save_result = res;
+			if (res != NO_ERROR) {
+				handle->save_lost = 1;
+			}
+			if (logged) {
+				handle->logged = 1;
+				handle->logged_mark = mark;
+				handle->logged_stat = file_stat;
+			}
+		}
+		pthread_cond_broadcast(&save_idle);
+	}
+	pthread_mutex_unlock(&save_lock);
+	file_io_destroy(&io);
+
+	return NULL;
+}
+
+// only for saves of this file, the others can take as long as they like
+static void file_manager_save_wait(file_handle_t *handle) {
+	pthread_mutex_lock(&save_lock);
+	while (handle->writing || handle->pending != NULL) {
+		pthread_cond_wait(&save_idle, &save_lock);
+	}
+	pthread_mutex_unlock(&save_lock);
+}
+
+// a file can't be saved before it's read, while it's only being viewed, or
+// with text its encoding can't hold
+static file_handle_t *file_manager_saveable(int handle) {
+	file_handle_t *saving = file_manager_handle(handle);
+	if (saving == NULL) {
+		return NULL;
+	}
+	if (saving->loading) {
+		error("attempting to save a file that's still loading!");
+		return NULL;
+	}
+	if (saving->readonly) {
+		error("attempting to save a file opened for viewing!");
+		return NULL;
+	}
+	if (!file_manager_fits(saving)) {
+		warn("refusing to save characters the file's encoding can't hold.");
+		return NULL;
+	}
+	return saving;
+}
+
+// the edit log starts over, and the file is known to be the saved one, once a
+// background save is in it. called with the save lock held
+static void file_manager_save_logged(file_handle_t *handle) {
+	if (handle->logged) {
+		edit_log_saved(&handle->log, handle->logged_mark, &handle->logged_stat);
+		handle->stat = handle->logged_stat;
+		handle->logged = 0;
+	}
+}
+
+result_t file_manager_save_background(int handle) {
+	file_handle_t *saving = file_manager_saveable(handle);
+	if (saving == NULL) {
+		return FILE_MANAGER_ERROR;
+	}
+	text_buffer_t *buffer = &saving->buffer;
+
+	text_snapshot_t *snapshot;
+	// a rope's leaves are listed by the writer thread
+	result_t res = text_snapshot_defer(buffer, &snapshot);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	char *filepath = strdup(saving->filepath);
+	if (filepath == NULL) {
+		error("failed to allocate file path!");
+		text_snapshot_release(snapshot);
+		return FILE_MANAGER_ERROR;
+	}
+
+	// changes are only known against the last save, which has to have made it
+	// into the file for this one to go on from it. only this thread hands
+	// saves over, so one that's done now stays done.
+	pthread_mutex_lock(&save_lock);
+	file_manager_save_logged(saving);
+	int follows =
+	    !saving->writing && saving->pending == NULL && !saving->save_lost;
+	pthread_mutex_unlock(&save_lock);
+
+	// a file that isn't utf-8 isn't laid out like the buffer, it's always
+	// written whole
+	dirty_range_t *ranges = NULL;
+	long range_count = !follows || file_manager_transcoded(saving)
+	                       ? -1
+	                       : file_manager_changes(buffer, &ranges);
+	// a piece table still reads this thread's text out of the parts of the
+	// file about to be written, those are copied off it first. only a few
+	// blocks are worth copying while a frame waits.
+	if (range_count > 0 && buffer->backend == PIECE_TABLE_BACKEND) {
+		long changed = 0;
+		for (long i = 0; i < range_count; i++) {
+			changed += ranges[i].end - ranges[i].start;
+		}
+		if (changed > FILE_MANAGER_DETACH_LIMIT ||
+		    piece_table_detach(&buffer->piece_table, ranges, range_count) !=
+		        NO_ERROR) {
+			free(ranges);
+			ranges = NULL;
+			range_count = -1;
+		}
+	}
+
+	pthread_mutex_lock(&save_lock);
+	if (!save_started) {
+		if (pthread_create(&save_thread, NULL, file_manager_save_thread, NULL)) {
+			pthread_mutex_unlock(&save_lock);
+			error("failed to start save thread!");
+			text_snapshot_release(snapshot);
+			free(filepath);
+			free(ranges);
+			return FILE_MANAGER_ERROR;
+		}
+		save_started = 1;
+	}
+	saving->save_lost = 0;
+	if (saving->pending != NULL) {
+		text_snapshot_release(saving->pending);
+		free(saving->pending_path);
+		free(saving->pending_ranges);
+	}
+	if (saving->writing) {
+		atomic_store(&saving->progress.cancel, 1);
+	}
+	saving->pending = snapshot;
+	saving->pending_path = filepath;
+	saving->pending_ranges = ranges;
+	saving->pending_range_count = range_count;
+	saving->pending_stat = saving->stat;
+	saving->pending_mark = edit_log_mark(&saving->log);
+	if (!saving->queued) {
+		saving->queued = 1;
+		if (save_last == NULL) {
+			save_first = saving;
+		} else {
+			save_last->queue_next = saving;
+		}
+		save_last = saving;
+	}
+	pthread_cond_signal(&save_wake);
+	pthread_mutex_unlock(&save_lock);
+	// once it's written the file is the buffer as it is now
+	dirty_ranges_reset(&buffer->dirty, text_buffer_size(buffer));
+
+	return NO_ERROR;
+}
+
+int file_manager_saving(int handle, long *written, long *length) {
+	*written = 0;
+	*length = 0;
+	file_handle_t *saving = file_manager_handle(handle);
+	if (saving == NULL) {
+		return 0;
+	}
+	pthread_mutex_lock(&save_lock);
+	file_manager_save_logged(saving);
+	int busy = saving->writing || saving->pending != NULL;
+	if (saving->writing) {
+		*written = atomic_load(&saving->progress.written);
+		*length = saving->save_length;
+	} else if (saving->pending != NULL) {
+		*length = saving->pending->length;
+	}
+	pthread_mutex_unlock(&save_lock);
+	return busy;
+}
+
+result_t file_manager_save_result(int handle) {
+	file_handle_t *saving = file_manager_handle(handle);
+	if (saving == NULL) {
+		return FILE_MANAGER_ERROR;
+	}
+	pthread_mutex_lock(&save_lock);
+	result_t res = saving->save_result;
+	pthread_mutex_unlock(&save_lock);
+	return res;
+}
+
+result_t file_manager_save(int handle) {
+	file_handle_t *saving = file_manager_saveable(handle);
+	if (saving == NULL) {
+		return FILE_MANAGER_ERROR;
+	}
+	text_buffer_t *buffer = &saving->buffer;
+
+	// an older background save finishing later would overwrite this one
+	if (save_started) {
+		file_manager_save_wait(saving);
+		pthread_mutex_lock(&save_lock);
+		if (saving->save_lost) {
+			dirty_ranges_lose(&buffer->dirty);
+		}
+		saving->save_lost = 0;
+		file_manager_save_logged(saving);
+		pthread_mutex_unlock(&save_lock);
+	}
+
+	// a small change is written over the file in place, anything else
+	// replaces it. a piece table can write straight out of its mapping, the
+	// old file stays mapped until the table is rebuilt over the new one.
+	dirty_range_t *ranges;
+	long count = file_manager_transcoded(saving)
+	                 ? -1
+	                 : file_manager_changes(buffer, &ranges);
+	result_t res = FILE_MANAGER_ERROR;
+	int touched = 0;
+	if (count >= 0) {
+		res = file_manager_patch(&active_io, buffer, NULL, ranges, count,
+		    saving->filepath, &saving->stat, text_buffer_size(buffer), NULL,
+		    &touched);
+		free(ranges);
+	}
+	if (res != NO_ERROR && !touched) {
+		res = file_manager_replace(&active_io, buffer, NULL, saving->filepath,
+		    1, saving->encoding, saving->bom, NULL);
+	}
+	if (res != NO_ERROR) {
+		return res;
+	}
+	if (freopen(saving->filepath, "r+", saving->file) == NULL) {
+		error("failed to reopen saved file!");
+		saving->file = NULL;
+		return FILE_MANAGER_ERROR;
+	}
+
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		// rebuilding also drops the add buffer
+		piece_table_t *table = &buffer->piece_table;
+		long cursor = table->cursor;
+		piece_table_destroy(table);
+		res = piece_table_create(table, fileno(saving->file));
+		if (res != NO_ERROR) {
+			return res;
+		}
+		table->cursor = cursor;
+	}
+	dirty_ranges_reset(&buffer->dirty, text_buffer_size(buffer));
+	struct stat file_stat;
+	if (!fstat(fileno(saving->file), &file_stat)) {
+		edit_log_saved(&saving->log, edit_log_mark(&saving->log), &file_stat);
+		saving->stat = file_stat;
+	}
+
+	return NO_ERROR;
+}
+
+static void file_manager_written(file_handle_t *handle, double now) {
+	handle->seen = now;
+	if (handle->since == 0.0) {
+		handle->since = now;
+	}
+}
+
+// hands out what the watches saw to the files it was about. an event names
+// the file within its watched directory, which together are looked up the
+// same way the file was opened by.
+static void file_manager_drain(void) {
+	char events[4096]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[4096];
+	long bytes;
+	while ((bytes = read(watch_fd, events, sizeof(events))) > 0) {
+		double now = file_manager_time();
+		for (long at = 0; at < bytes;) {
+			const struct inotify_event *event = (const void *)&events[at];
+			at += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				// no telling what was missed, so every file is checked
+				for (int i = 0; i < handle_capacity; i++) {
+					if (handles[i] != NULL) {
+						file_manager_written(handles[i], now);
+					}
+				}
+				continue;
+			}
+			int watch = file_manager_find_watch(event->wd);
+			if (watch < 0 || !event->len) {
+				continue;
+			}
+			const char *directory = watches[watch].directory;
+			int length = snprintf(path, sizeof(path), "%s%s%s", directory,
+			    strcmp(directory, "/") ? "/" : "", event->name);
+			if (length >= (int)sizeof(path)) {
+				continue;
+			}
+			int handle = file_manager_find_target(path);
+			if (handle != FILE_MANAGER_NO_HANDLE) {
+				file_manager_written(handles[handle], now);
+			}
+		}
+	}
+}
+
+int file_manager_changed(int handle) {
+	if (handle < 0 || handle >= handle_capacity || handles[handle] == NULL) {
+		return 0;
+	}
+	file_handle_t *watched = handles[handle];
+	if (watched->loading || watched->watch < 0) {
+		return 0;
+	}
+	file_manager_drain();
+	double now = file_manager_time();
+	int settled = now - watched->seen >= FILE_MANAGER_SETTLE ||
+	              now - watched->since >= FILE_MANAGER_SETTLE_LIMIT;
+	if (watched->seen == 0.0 || !settled) {
+		return 0;
+	}
+
+	// this editor's own saves are told apart by what the file looks like once
+	// they're done
+	if (save_started) {
+		pthread_mutex_lock(&save_lock);
+		int saving = watched->writing || watched->pending != NULL;
+		if (!saving) {
+			file_manager_save_logged(watched);
+		}
+		pthread_mutex_unlock(&save_lock);
+		if (saving) {
+			return 0;
+		}
+	}
+	watched->since = 0.0;
+	watched->seen = 0.0;
+	// one that's been deleted is written again by the next save
+	struct stat file_stat;
+	if (stat(watched->filepath, &file_stat)) {
+		return 0;
+	}
+	return !file_manager_same_file(&file_stat, &watched->stat);
+}
+
+// where a reload's chunks are collected, for the buffer or the file
+typedef struct file_manager_chunk_t {
+	long offset;
+	long length;
+	unsigned long hash;
+} file_manager_chunk_t;
+
+typedef struct file_manager_chunker_t {
+	file_manager_chunk_t *chunks;
+	long count;
+	long capacity;
+	// bytes chunked so far, and where the chunk they're in started
+	long offset;
+	long start;
+	unsigned long roll;
+	unsigned long hash;
+	// bytes waiting to make up a whole word of the hash, so where the text is
+	// split into spans doesn't change it
+	unsigned char carry[8];
+	int carried;
+} file_manager_chunker_t;
+
+// random values for the rolling hash, the same every run
+static unsigned long file_manager_gear[256];
+static int file_manager_gear_filled = 0;
+
+static void file_manager_gear_fill(void) {
+	if (file_manager_gear_filled) {
+		return;
+	}
+	unsigned long state = 0;
+	for (int i = 0; i < 256; i++) {
+		state += 0x9e3779b97f4a7c15ul;
+		unsigned long value = state;
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ul;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebul;
+		file_manager_gear[i] = value ^ (value >> 31);
+	}
+	file_manager_gear_filled = 1;
+}
+
+static unsigned long file_manager_mix(unsigned long hash, unsigned long word) {
+	hash = (hash ^ word) * 0x9e3779b97f4a7c15ul;
+	return hash ^ (hash >> 32);
+}
+
+// hashes a chunk a word at a time
+static void file_manager_digest(
+    file_manager_chunker_t *chunker, const char *data, long length) {
+	while (length > 0) {
+		if (chunker->carried == 0 && length >= 8) {
+			unsigned long hash = chunker->hash;
+			for (; length >= 8; data += 8, length -= 8) {
+				unsigned long word;
+				memcpy(&word, data, sizeof(word));
+				hash = file_manager_mix(hash, word);
+			}
+			chunker->hash = hash;
+			continue;
+		}
+		chunker->carry[chunker->carried++] = *data++;
+		length--;
+		if (chunker->carried == 8) {
+			unsigned long word;
+			memcpy(&word, chunker->carry, sizeof(word));
+			chunker->hash = file_manager_mix(chunker->hash, word);
+			chunker->carried = 0;
+		}
+	}
+}
+
+static result_t file_manager_cut(file_manager_chunker_t *chunker, long end) {
+	if (chunker->count == chunker->capacity) {
+		long capacity = chunker->capacity ? chunker->capacity * 2 : 1024;
+		file_manager_chunk_t *chunks =
+		    realloc(chunker->chunks, capacity * sizeof(file_manager_chunk_t));
+		if (chunks == NULL) {
+			error("failed to allocate reload chunks!");
+			return FILE_MANAGER_ERROR;
+		}
+		chunker->chunks = chunks;
+		chunker->capacity = capacity;
+	}
+	if (chunker->carried) {
+		unsigned long word = 0;
+		memcpy(&word, chunker->carry, chunker->carried);
+		chunker->hash = file_manager_mix(chunker->hash, word);
+		chunker->carried = 0;
+	}
+	chunker->chunks[chunker->count++] = (file_manager_chunk_t){
+	    chunker->start, end - chunker->start, chunker->hash};
+	chunker->start = end;
+	chunker->roll = 0;
+	chunker->hash = 0;
+	return NO_ERROR;
+}
+
+// no chunk ends in its first bytes, so those aren't even rolled
+static result_t file_manager_chunk(
+    file_manager_chunker_t *chunker, const char *data, long length) {
+	long hashed = 0;
+	long i = 0;
+	while (i < length) {
+		long skip = chunker->start + FILE_MANAGER_CHUNK_MIN - chunker->offset;
+		if (skip > i) {
+			i = skip;
+			continue;
+		}
+		long limit = chunker->start + FILE_MANAGER_CHUNK_MAX - chunker->offset;
+		if (limit > length) {
+			limit = length;
+		}
+		unsigned long roll = chunker->roll;
+		int found = 0;
+		while (i < limit && !found) {
+			roll = (roll << 1) + file_manager_gear[(unsigned char)data[i++]];
+			found = !(roll & FILE_MANAGER_CHUNK_MASK);
+		}
+		chunker->roll = roll;
+		if (found ||
+		    chunker->offset + i - chunker->start == FILE_MANAGER_CHUNK_MAX) {
+			file_manager_digest(chunker, &data[hashed], i - hashed);
+			hashed = i;
+			if (file_manager_cut(chunker, chunker->offset + i) != NO_ERROR) {
+				return FILE_MANAGER_ERROR;
+			}
+		}
+	}
+	file_manager_digest(chunker, &data[hashed], length - hashed);
+	chunker->offset += length;
+	return NO_ERROR;
+}
+
+static result_t file_manager_chunk_end(file_manager_chunker_t *chunker) {
+	if (chunker->offset == chunker->start) {
+		return NO_ERROR;
+	}
+	return file_manager_cut(chunker, chunker->offset);
+}
+
+static long file_manager_chunk_offset(
+    const file_manager_chunker_t *chunker, long index) {
+	return index < chunker->count ? chunker->chunks[index].offset
+	                               : chunker->offset;
+}
+
+static int file_manager_same_chunk(
+    const file_manager_chunk_t *a, const file_manager_chunk_t *b) {
+	return a->length == b->length && a->hash == b->hash;
+}
+
+/*
+lines the chunks of the file up with the buffer's. past the ends they share,
+each of the file's chunks is looked up among the buffer's that haven't been
+passed yet, and whatever was skipped over on either side on the way to a
+match is a change. ranges holds the buffer's range and the file's for each.
+*/
+static long file_manager_match(const file_manager_chunker_t *old,
+    const file_manager_chunker_t *new, long (**ranges)[4]) {
+	long head = 0;
+	while (head < old->count && head < new->count &&
+	       file_manager_same_chunk(&old->chunks[head], &new->chunks[head])) {
+		head++;
+	}
+	long old_end = old->count;
+	long new_end = new->count;
+	while (old_end > head && new_end > head &&
+	       file_manager_same_chunk(
+	           &old->chunks[old_end - 1], &new->chunks[new_end - 1])) {
+		old_end--;
+		new_end--;
+	}
+
+	long slots = 16;
+	while (slots < 2 * (old_end - head)) {
+		slots *= 2;
+	}
+	long *table = calloc(slots, sizeof(long));
+	*ranges = malloc((new_end - head + 1) * sizeof(**ranges));
+	if (table == NULL || *ranges == NULL) {
+		error("failed to allocate reload table!");
+		free(table);
+		free(*ranges);
+		*ranges = NULL;
+		return -1;
+	}
+	// duplicates sit further along the probe than the ones before them
+	for (long k = head; k < old_end; k++) {
+		long slot = old->chunks[k].hash & (slots - 1);
+		while (table[slot]) {
+			slot = (slot + 1) & (slots - 1);
+		}
+		table[slot] = k + 1;
+	}
+
+	long count = 0;
+	long i = head;
+	long from = head;
+	for (long j = head; j <= new_end; j++) {
+		long k = j == new_end ? old_end : -1;
+		if (j < new_end) {
+			for (long slot = new->chunks[j].hash & (slots - 1); table[slot];
+			     slot = (slot + 1) & (slots - 1)) {
+				long candidate = table[slot] - 1;
+				if (candidate >= i &&
+				    file_manager_same_chunk(
+				        &old->chunks[candidate], &new->chunks[j])) {
+					k = candidate;
+					break;
+				}
+			}
+		}
+		if (k < 0) {
+			continue;
+		}
+		if (k > i || j > from) {
+			(*ranges)[count][0] = file_manager_chunk_offset(old, i);
+			(*ranges)[count][1] = file_manager_chunk_offset(old, k);
+			(*ranges)[count][2] = file_manager_chunk_offset(new, from);
+			(*ranges)[count][3] = file_manager_chunk_offset(new, j);
+			count++;
+		}
+		i = k + 1;
+		from = j + 1;
+	}
+	free(table);
+	return count;
+}
+
+// the changes with the file's text read in behind them, all one allocation
+static long file_manager_read_changes(int fd, long (*ranges)[4], long count,
+    undo_change_t **changes) {
+	long bytes = 0;
+	for (long i = 0; i < count; i++) {
+		bytes += ranges[i][3] - ranges[i][2];
+	}
+	*changes = malloc(count * sizeof(undo_change_t) + bytes + 1);
+	if (*changes == NULL) {
+		error("failed to allocate reloaded text!");
+		return -1;
+	}
+	char *text = (char *)&(*changes)[count];
+	for (long i = 0; i < count; i++) {
+		long length = ranges[i][3] - ranges[i][2];
+		if (file_manager_read_all(&active_io, fd, text, length, ranges[i][2]) !=
+		    NO_ERROR) {
+			free(*changes);
+			*changes = NULL;
+			return -1;
+		}
+		(*changes)[i] =
+		    (undo_change_t){ranges[i][0], ranges[i][1], text, length};
+		text += length;
+	}
+	return count;
+}
+
+// a file that grew without being replaced is most likely being appended to,
+// so only the end of what it had is checked before its new end is read
+static long file_manager_appended(const text_buffer_t *buffer, int fd,
+    long length, undo_change_t **changes) {
+	long size = text_buffer_size(buffer);
+	long check = size < FILE_MANAGER_APPEND_CHECK ? size
+	                                              : FILE_MANAGER_APPEND_CHECK;
+	char *block = malloc(check + 1);
+	if (block == NULL ||
+	    file_manager_read_all(&active_io, fd, block, check, size - check) !=
+	        NO_ERROR) {
+		free(block);
+		return -1;
+	}
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	long at = 0;
+	int same = 1;
+	text_buffer_iterator_begin(buffer, &iterator, size - check, size);
+	while (same && text_buffer_iterator_next(&iterator, &span)) {
+		same = !memcmp(&block[at], span.data, span.length);
+		at += span.length;
+	}
+	free(block);
+	if (!same) {
+		return -1;
+	}
+	long range[1][4] = {{size, size, size, length}};
+	return file_manager_read_changes(fd, range, 1, changes);
+}
+
+// how many of length bytes are the same at the start of both, and at the end
+static long file_manager_same_head(const char *a, const char *b, long length) {
+	if (!memcmp(a, b, length)) {
+		return length;
+	}
+	long same = 0;
+	while (a[same] == b[same]) {
+		same++;
+	}
+	return same;
+}
+
+static long file_manager_same_tail(const char *a, const char *b, long length) {
+	if (!memcmp(a, b, length)) {
+		return length;
+	}
+	long same = 0;
+	while (a[length - 1 - same] == b[length - 1 - same]) {
+		same++;
+	}
+	return same;
+}
+
+// how far the buffer and the file start and end the same. comparing them
+// directly is much quicker than hashing, and usually leaves little between.
+static result_t file_manager_common(const text_buffer_t *buffer, int fd,
+    long length, char *block, long *head, long *tail) {
+	long size = text_buffer_size(buffer);
+	long most = size < length ? size : length;
+	*head = 0;
+	*tail = 0;
+	int differs = 0;
+	while (*head < most && !differs) {
+		long bytes = most - *head < FILE_MANAGER_REPLAY_BLOCK
+		                 ? most - *head
+		                 : FILE_MANAGER_REPLAY_BLOCK;
+		if (file_manager_read_all(&active_io, fd, block, bytes, *head) !=
+		    NO_ERROR) {
+			return FILE_MANAGER_ERROR;
+		}
+		text_buffer_iterator_t iterator;
+		text_span_t span;
+		long at = 0;
+		text_buffer_iterator_begin(buffer, &iterator, *head, *head + bytes);
+		while (!differs && text_buffer_iterator_next(&iterator, &span)) {
+			long same =
+			    file_manager_same_head(&block[at], span.data, span.length);
+			differs = same < span.length;
+			at += same;
+		}
+		*head += at;
+	}
+	differs = 0;
+	while (*tail < most - *head && !differs) {
+		long bytes = most - *head - *tail < FILE_MANAGER_REPLAY_BLOCK
+		                 ? most - *head - *tail
+		                 : FILE_MANAGER_REPLAY_BLOCK;
+		if (file_manager_read_all(&active_io, fd, block, bytes,
+		        length - *tail - bytes) != NO_ERROR) {
+			return FILE_MANAGER_ERROR;
+		}
+		for (long at = bytes; at > 0 && !differs;) {
+			const char *text;
+			long span = text_buffer_span_before(buffer, size - *tail, &text);
+			if (span > at) {
+				text += span - at;
+				span = at;
+			}
+			long same = file_manager_same_tail(&block[at - span], text, span);
+			differs = same < span;
+			*tail += same;
+			at -= same;
+		}
+	}
+	return NO_ERROR;
+}
+
+// only what lies between the ends the two share is chunked and hashed, and
+// only the file's changed chunks are read again
+static long file_manager_difference(const text_buffer_t *buffer, int fd,
+    long length, undo_change_t **changes) {
+	file_manager_gear_fill();
+	char *block = malloc(FILE_MANAGER_REPLAY_BLOCK);
+	long head = 0;
+	long tail = 0;
+	result_t res = block == NULL ? FILE_MANAGER_ERROR
+	                             : file_manager_common(buffer, fd, length,
+	                                   block, &head, &tail);
+	file_manager_chunker_t old;
+	file_manager_chunker_t new;
+	memset(&old, 0, sizeof(old));
+	memset(&new, 0, sizeof(new));
+	old.offset = old.start = new.offset = new.start = head;
+
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	text_buffer_iterator_begin(
+	    buffer, &iterator, head, text_buffer_size(buffer) - tail);
+	while (res == NO_ERROR && text_buffer_iterator_next(&iterator, &span)) {
+		res = file_manager_chunk(&old, span.data, span.length);
+	}
+	if (res == NO_ERROR) {
+		res = file_manager_chunk_end(&old);
+	}
+	for (long offset = head; offset < length - tail && res == NO_ERROR;) {
+		long bytes = length - tail - offset < FILE_MANAGER_REPLAY_BLOCK
+		                 ? length - tail - offset
+		                 : FILE_MANAGER_REPLAY_BLOCK;
+		res = file_manager_read_all(&active_io, fd, block, bytes, offset);
+		if (res == NO_ERROR) {
+			res = file_manager_chunk(&new, block, bytes);
+		}
+		offset += bytes;
+	}
+	if (res == NO_ERROR) {
+		res = file_manager_chunk_end(&new);
+	}
+	free(block);
+
+	long count = -1;
+	long(*ranges)[4] = NULL;
+	if (res == NO_ERROR) {
+		count = file_manager_match(&old, &new, &ranges);
+	}
+	if (count >= 0) {
+		debug("%ld changes among %ld chunks, %ld bytes the same around them",
+		    count, new.count, head + tail);
+		count = file_manager_read_changes(fd, ranges, count, changes);
+	}
+	free(ranges);
+	free(old.chunks);
+	free(new.chunks);
+	return count;
+}
+
+// a piece table over a file cut short in place can't read the end of its
+// own text any more, so all of it is thrown away and read in again. so is a
+// file that isn't utf-8, through decoder, its bytes aren't the buffer's.
+static result_t file_manager_refill(text_buffer_t *buffer,
+    undo_journal_t *journal, int fd, long length, encoding_state_t *decoder) {
+	undo_journal_clear(journal);
+	long cursor = text_buffer_cursor(buffer);
+	long room = decoder == NULL ? 0 : ENCODING_ROOM(FILE_MANAGER_REPLAY_BLOCK);
+	char *block = malloc(FILE_MANAGER_REPLAY_BLOCK + room);
+	char *text = block == NULL ? NULL : &block[FILE_MANAGER_REPLAY_BLOCK];
+	result_t res = block == NULL
+	                   ? FILE_MANAGER_ERROR
+	                   : text_buffer_delete_range(
+	                         buffer, 0, text_buffer_size(buffer));
+	for (long offset = 0; offset < length && res == NO_ERROR;) {
+		long bytes = length - offset < FILE_MANAGER_REPLAY_BLOCK
+		                 ? length - offset
+		                 : FILE_MANAGER_REPLAY_BLOCK;
+		res = file_manager_read_all(&active_io, fd, block, bytes, offset);
+		if (res == NO_ERROR && decoder == NULL) {
+			res = text_buffer_insert(buffer, block, bytes);
+		} else if (res == NO_ERROR) {
+			long decoded = encoding_decode(decoder, block, bytes, text);
+			res = decoded > 0 ? text_buffer_insert(buffer, text, decoded)
+			                  : NO_ERROR;
+		}
+		offset += bytes;
+	}
+	if (res == NO_ERROR && decoder != NULL) {
+		long decoded = encoding_decode_end(decoder, text);
+		res = decoded > 0 ? text_buffer_insert(buffer, text, decoded)
+		                  : NO_ERROR;
+	}
+	free(block);
+	long size = text_buffer_size(buffer);
+	long distance =
+	    (cursor < size ? cursor : size) - text_buffer_cursor(buffer);
+	if (res == NO_ERROR && distance) {
+		text_buffer_move(buffer, distance);
+	}
+	return res;
+}
+
+result_t file_manager_reload(int handle, undo_journal_t *journal) {
+	file_handle_t *reloading = file_manager_handle(handle);
+	if (reloading == NULL || reloading->loading) {
+		return FILE_MANAGER_ERROR;
+	}
+	text_buffer_t *buffer = &reloading->buffer;
+
+	int fd = open(reloading->filepath, O_RDONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) || !S_ISREG(file_stat.st_mode)) {
+		error("failed to open changed file!");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return FILE_MANAGER_ERROR;
+	}
+	// whatever comes of it, this is the file from now on
+	struct stat known = reloading->stat;
+	reloading->stat = file_stat;
+	int replaced =
+	    known.st_dev != file_stat.st_dev || known.st_ino != file_stat.st_ino;
+	if (!replaced && buffer->backend == PIECE_TABLE_BACKEND) {
+		piece_table_truncated(&buffer->piece_table, file_stat.st_size);
+	}
+	if (!dirty_ranges_clean(&buffer->dirty)) {
+		// the next save can't go by what the file used to have
+		warn("kept unsaved edits over a file changed on disk.");
+		dirty_ranges_lose(&buffer->dirty);
+		close(fd);
+		return FILE_MANAGER_ERROR;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	long size = text_buffer_size(buffer);
+	result_t res;
+	if (file_manager_transcoded(reloading)) {
+		// the encoding stays, whether the file starts with a mark may not
+		char head[4];
+		long head_length = file_stat.st_size < 4 ? file_stat.st_size : 4;
+		int bom = 0;
+		if (file_manager_read_all(&active_io, fd, head, head_length, 0) !=
+		        NO_ERROR ||
+		    encoding_detect(head, head_length, 0, &bom) !=
+		        reloading->encoding) {
+			bom = 0;
+		}
+		reloading->bom = bom;
+		encoding_state_t decoder;
+		encoding_begin(&decoder, reloading->encoding, reloading->bom);
+		res = file_manager_refill(
+		    buffer, journal, fd, file_stat.st_size, &decoder);
+	} else if (!replaced && buffer->backend == PIECE_TABLE_BACKEND &&
+	           file_stat.st_size < buffer->piece_table.original_length) {
+		res = file_manager_refill(
+		    buffer, journal, fd, file_stat.st_size, NULL);
+	} else {
+		undo_change_t *changes = NULL;
+		long count = -1;
+		if (!replaced && file_stat.st_size > size) {
+			count =
+			    file_manager_appended(buffer, fd, file_stat.st_size, &changes);
+		}
+		if (count < 0) {
+			count =
+			    file_manager_difference(buffer, fd, file_stat.st_size, &changes);
+		}
+		res = count < 0 ? FILE_MANAGER_ERROR
+		                : undo_journal_replace_each(
+		                      journal, buffer, changes, count);
+		free(changes);
+	}
+	if (res != NO_ERROR) {
+		error("failed to reload file!");
+		dirty_ranges_lose(&buffer->dirty);
+		close(fd);
+		return res;
+	}
+
+	// saves and the edit log go on from the new file
+	close(fd);
+	FILE *file = fopen(reloading->filepath, reloading->readonly ? "r" : "r+");
+	if (file != NULL) {
+		if (reloading->file != NULL) {
+			fclose(reloading->file);
+		}
+		reloading->file = file;
+	}
+	dirty_ranges_reset(&buffer->dirty, text_buffer_size(buffer));
+	edit_log_saved(&reloading->log, edit_log_mark(&reloading->log), &file_stat);
 
 	return NO_ERROR;
 }
@@ -16,16 +16,105 @@
 
 #pragma once
 
+#include "encoding.h"
 #include "result.h"
-#include "split_buffer.h"
+#include "text_buffer.h"
+#include "undo.h"
+
+#include <stdio.h>
 
 result_t file_manager_startup(void);
 void file_manager_shutdown(void);
+// io_uring or plain posix reads and writes, picked at startup by default
+result_t file_manager_use_engine(file_io_engine_t engine);
+const char *file_manager_engine(void);
+
+/*
+every open file is a handle, its own file, buffer, edit log and saves. a file
+is found by where it really is, so opening one that's open already gives back
+the handle it has instead of reading it again.
+*/
+#define FILE_MANAGER_NO_HANDLE -1
+
+result_t file_manager_open(
+    const char *filepath, text_buffer_backend_t backend, int *handle);
+/*
+the same, but only the first screen of the file is read before it returns,
+the rest streams in on a thread of its own. the buffer can be drawn, searched
+and moved around in while it grows, and its end is where the text has got to.
+it can't be edited or saved until file_manager_loaded says it's done.
+*/
+result_t file_manager_open_background(
+    const char *filepath, text_buffer_backend_t backend, int *handle);
+// 1 once a file opened in the background is all in its buffer, with how that
+// went. one that failed still has to be closed. what has arrived since it was
+// last asked is moved into the buffer first.
+int file_manager_loaded(int handle, result_t *res);
+// 1 while the file is streaming in, with how much of it is in the buffer
+int file_manager_loading(int handle, long *loaded, long *length);
+// moves what has arrived into the buffers of every file streaming in, a
+// frame's worth at most. called every frame so files not on screen keep
+// loading.
+void file_manager_stream(void);
+// read only, for files too big to edit. saving it is refused.
+result_t file_manager_view(const char *filepath, int *handle);
+// the handle of the file at filepath, FILE_MANAGER_NO_HANDLE if it isn't open
+int file_manager_find(const char *filepath);
+// the file's text, where it stays until the file is closed
+text_buffer_t *file_manager_buffer(int handle);
+const char *file_manager_path(int handle);
+int file_manager_readonly(int handle);
+// MB/s the file was read at, mapped files don't read anything up front
+double file_manager_load_rate(int handle);
+/*
+codepoints in the file as it was read, checked on the way in, and where it
+stops being utf-8, -1 if it never does. -1 codepoints until it has all been
+read, and for a mapped file, which never is.
+*/
+long file_manager_codepoints(int handle, long *invalid);
+// what the file is in on disk. the buffer is always utf-8, a file in anything
+// else is decoded as it's read and encoded again as it's saved.
+encoding_t file_manager_encoding(int handle, int *bom);
+// 1 when the file's encoding can hold all of the buffer, a file that can't is
+// refused rather than saved with characters lost
+int file_manager_encodable(int handle);
+// unsaved edits put back from the edit log when the file was opened
+long file_manager_recovered(int handle);
+// looks a path typed at the prompt up without waiting on it, and starts
+// reading a file that's there into the page cache
+void file_manager_prefetch(const char *filepath);
+// 1 when the last prefetched path has been looked up, size is -1 if there's
+// nothing there
+int file_manager_prefetched(long *size, int *directory);
+// waits for the file's own save if one's being written, the buffer goes with
+// it
+void file_manager_close(int handle);
 
-result_t file_manager_open(split_buffer_t *buffer, const char *filepath);
-void file_manager_close(void);
+// 1 once something other than this editor has written the file and left it
+// alone for a moment. it never blocks, so it's checked every frame.
+int file_manager_changed(int handle);
+// brings what changed on disk into the buffer as one edit, keeping the
+// cursor and the undo history. only the chunks that differ are read, and a
+// file that was appended to only has its new end read. a buffer with unsaved
+// edits is left as it is and overwrites the file when it's saved.
+result_t file_manager_reload(int handle, undo_journal_t *journal);
 
 void file_manager_delete(const char *filepath);
-result_t file_manager_save(split_buffer_t *buffer);
+// replaces filepath with the buffer all at once, by writing a temp file next
+// to it and renaming that over it. durable syncs both before returning.
+result_t file_manager_write(
+    const text_buffer_t *buffer, const char *filepath, int durable);
+// when only some bytes changed and the length didn't, they're written over the
+// file in place, journalled first so an open after a crash finishes the save.
+// anything else replaces the file like file_manager_write.
+result_t file_manager_save(int handle);
+// saves a snapshot of the buffer on a writer thread, so editing carries on.
+// saving again before it's done replaces the older save of the same file,
+// saves of other files wait their turn.
+result_t file_manager_save_background(int handle);
+// 1 while a background save is waiting or being written, with how far along
+int file_manager_saving(int handle, long *written, long *length);
+// how the file's last background save that wasn't replaced went
+result_t file_manager_save_result(int handle);
 
 char *read_file(FILE *file);
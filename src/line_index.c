@@ -0,0 +1,237 @@
+#include "line_index.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// text counted between taking the lock to publish, and the pieces a block
+// is narrowed down by when looking for one newline in it
+#define LINE_INDEX_BLOCK (1L << 20)
+#define LINE_INDEX_PAGE 4096L
+
+// the nth newline of text, which has to have at least n of them
+static const char *line_index_nth(const char *text, long length, long n) {
+	while (length > LINE_INDEX_PAGE) {
+		long count = scan_count(text, '\n', LINE_INDEX_PAGE);
+		if (count >= n) {
+			break;
+		}
+		n -= count;
+		text += LINE_INDEX_PAGE;
+		length -= LINE_INDEX_PAGE;
+	}
+	while (1) {
+		const char *newline = scan_memchr(text, '\n', length);
+		if (--n == 0) {
+			return newline;
+		}
+		length -= newline + 1 - text;
+		text = newline + 1;
+	}
+}
+
+static void *line_index_thread(void *argument) {
+	line_index_t *index = argument;
+	const text_snapshot_t *snapshot = index->snapshot;
+	long marks[LINE_INDEX_BLOCK / LINE_INDEX_STRIDE + 1];
+	long lines = 0;
+	long offset = 0;
+	for (long s = 0; s < snapshot->span_count && !index->stop; s++) {
+		const text_span_t *span = &snapshot->spans[s];
+		for (long start = 0; start < span->length && !index->stop;
+		     start += LINE_INDEX_BLOCK) {
+			const char *text = &span->data[start];
+			long length = span->length - start < LINE_INDEX_BLOCK
+			                  ? span->length - start
+			                  : LINE_INDEX_BLOCK;
+			long count = scan_count(text, '\n', length);
+
+			// only blocks a stride boundary falls in need the newlines found
+			long mark_count = 0;
+			long target = (lines / LINE_INDEX_STRIDE + 1) * LINE_INDEX_STRIDE;
+			long seen = lines;
+			const char *from = text;
+			while (lines + count >= target) {
+				const char *newline =
+				    line_index_nth(from, text + length - from, target - seen);
+				marks[mark_count++] = offset + (newline + 1 - text);
+				from = newline + 1;
+				seen = target;
+				target += LINE_INDEX_STRIDE;
+			}
+			lines += count;
+			offset += length;
+
+			pthread_mutex_lock(&index->lock);
+			if (index->mark_count + mark_count > index->mark_capacity) {
+				long capacity = index->mark_capacity * 2 + mark_count;
+				long *grown = realloc(index->marks, capacity * sizeof(long));
+				if (grown == NULL) {
+					pthread_mutex_unlock(&index->lock);
+					error("failed to grow line index!");
+					return NULL;
+				}
+				index->marks = grown;
+				index->mark_capacity = capacity;
+			}
+			memcpy(&index->marks[index->mark_count], marks,
+			    mark_count * sizeof(long));
+			index->mark_count += mark_count;
+			index->lines = lines;
+			index->scanned = offset;
+			pthread_mutex_unlock(&index->lock);
+		}
+	}
+
+	pthread_mutex_lock(&index->lock);
+	index->done = !index->stop;
+	pthread_mutex_unlock(&index->lock);
+	debug("counted %ld lines", lines);
+	return NULL;
+}
+
+void line_index_destroy(line_index_t *index) {
+	if (index->running) {
+		index->stop = 1;
+		pthread_join(index->thread, NULL);
+		index->running = 0;
+	}
+	if (index->snapshot != NULL) {
+		text_snapshot_release(index->snapshot);
+	}
+	free(index->starts);
+	free(index->marks);
+	pthread_mutex_destroy(&index->lock);
+	memset(index, 0, sizeof(line_index_t));
+}
+
+result_t line_index_create(line_index_t *index, text_buffer_t *buffer) {
+	memset(index, 0, sizeof(line_index_t));
+	pthread_mutex_init(&index->lock, NULL);
+
+	result_t res = text_snapshot_create(buffer, &index->snapshot);
+	if (res != NO_ERROR) {
+		line_index_destroy(index);
+		return res;
+	}
+	const text_snapshot_t *snapshot = index->snapshot;
+	index->starts = malloc((snapshot->span_count + 1) * sizeof(long));
+	index->mark_capacity = 1024;
+	index->marks = malloc(index->mark_capacity * sizeof(long));
+	if (index->starts == NULL || index->marks == NULL) {
+		error("failed to allocate line index!");
+		line_index_destroy(index);
+		return TEXT_BUFFER_ERROR;
+	}
+	index->starts[0] = 0;
+	for (long i = 0; i < snapshot->span_count; i++) {
+		index->starts[i + 1] = index->starts[i] + snapshot->spans[i].length;
+	}
+	index->marks[0] = 0;
+	index->mark_count = 1;
+
+	if (pthread_create(&index->thread, NULL, line_index_thread, index)) {
+		error("failed to start line index thread!");
+		line_index_destroy(index);
+		return TEXT_BUFFER_ERROR;
+	}
+	index->running = 1;
+
+	return NO_ERROR;
+}
+
+long line_index_line_count(line_index_t *index, int *done) {
+	pthread_mutex_lock(&index->lock);
+	long lines = index->lines + 1;
+	*done = index->done;
+	pthread_mutex_unlock(&index->lock);
+	return lines;
+}
+
+// the span offset falls in, the last one for the very end of the text
+static long line_index_span(const line_index_t *index, long offset) {
+	long low = 0;
+	long high = index->snapshot->span_count - 1;
+	while (low < high) {
+		long middle = (low + high + 1) / 2;
+		if (index->starts[middle] <= offset) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+
+// just past the nth newline after offset, which has to be in the text
+static long line_index_skip(const line_index_t *index, long offset, long n) {
+	const text_snapshot_t *snapshot = index->snapshot;
+	for (long s = line_index_span(index, offset); n > 0; s++) {
+		const text_span_t *span = &snapshot->spans[s];
+		long skip = offset - index->starts[s];
+		long count = scan_count(&span->data[skip], '\n', span->length - skip);
+		if (count >= n) {
+			const char *newline =
+			    line_index_nth(&span->data[skip], span->length - skip, n);
+			return index->starts[s] + (newline + 1 - span->data);
+		}
+		n -= count;
+		offset = index->starts[s + 1];
+	}
+	return offset;
+}
+
+static long line_index_count(const line_index_t *index, long start, long end) {
+	const text_snapshot_t *snapshot = index->snapshot;
+	long count = 0;
+	for (long s = line_index_span(index, start);
+	     s < snapshot->span_count && index->starts[s] < end; s++) {
+		const text_span_t *span = &snapshot->spans[s];
+		long from = start > index->starts[s] ? start - index->starts[s] : 0;
+		long to = end - index->starts[s] < span->length ? end - index->starts[s]
+		                                                : span->length;
+		count += scan_count(&span->data[from], '\n', to - from);
+	}
+	return count;
+}
+
+long line_index_line_start(line_index_t *index, long line) {
+	pthread_mutex_lock(&index->lock);
+	// only lines whose start has been counted are known to exist
+	if (line > index->lines) {
+		if (!index->done) {
+			pthread_mutex_unlock(&index->lock);
+			return -1;
+		}
+		line = index->lines;
+	}
+	long mark = line / LINE_INDEX_STRIDE;
+	long offset = index->marks[mark];
+	pthread_mutex_unlock(&index->lock);
+
+	return line_index_skip(index, offset, line - mark * LINE_INDEX_STRIDE);
+}
+
+long line_index_line_of(line_index_t *index, long offset) {
+	pthread_mutex_lock(&index->lock);
+	if (offset > index->scanned && !index->done) {
+		pthread_mutex_unlock(&index->lock);
+		return -1;
+	}
+	long low = 0;
+	long high = index->mark_count - 1;
+	while (low < high) {
+		long middle = (low + high + 1) / 2;
+		if (index->marks[middle] <= offset) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	long start = index->marks[low];
+	pthread_mutex_unlock(&index->lock);
+
+	return low * LINE_INDEX_STRIDE + line_index_count(index, start, offset);
+}
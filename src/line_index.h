@@ -0,0 +1,65 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "result.h"
+#include "snapshot.h"
+#include "text_buffer.h"
+
+#include <pthread.h>
+
+// lines between the offsets the index keeps, finding any other line scans at
+// most this many from the nearest one
+#define LINE_INDEX_STRIDE 1024
+
+/*
+sparse line offsets for a buffer that isn't going to change, such as a file
+opened for viewing. a background thread counts newlines through a snapshot
+and records where every stride'th line starts, so the first screen never
+waits on it and lookups work on whatever part has been counted so far.
+*/
+typedef struct line_index_t {
+	text_snapshot_t *snapshot;
+	// where each of the snapshot's spans starts, for finding an offset in it
+	long *starts;
+	pthread_mutex_t lock;
+	pthread_t thread;
+	int running;
+	_Atomic int stop;
+
+	// marks[i] is where line i * LINE_INDEX_STRIDE starts
+	long *marks;
+	long mark_count;
+	long mark_capacity;
+	// newlines counted so far and how far into the text they were counted
+	long lines;
+	long scanned;
+	int done;
+} line_index_t;
+
+result_t line_index_create(line_index_t *index, text_buffer_t *buffer);
+void line_index_destroy(line_index_t *index);
+
+// lines counted so far, the total once done is set
+long line_index_line_count(line_index_t *index, int *done);
+
+// where line starts, -1 while the thread hasn't counted that far. lines past
+// the end of a fully counted buffer give the start of its last line.
+long line_index_line_start(line_index_t *index, long line);
+// the line offset is on, -1 while the thread hasn't counted that far
+long line_index_line_of(line_index_t *index, long offset);
@@ -0,0 +1,817 @@
+// MAP_ANONYMOUS is only declared for the default source
+#define _DEFAULT_SOURCE
+
+#include "piece_table.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint32_t piece_random(piece_table_t *table) {
+	uint32_t x = table->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	table->seed = x;
+	return x;
+}
+
+static long piece_subtree_length(const piece_t *piece) {
+	return piece == NULL ? 0 : piece->subtree_length;
+}
+
+static long piece_subtree_newlines(const piece_t *piece) {
+	return piece == NULL ? 0 : piece->subtree_newlines;
+}
+
+static void piece_update(piece_t *piece) {
+	piece->subtree_length = piece_subtree_length(piece->left) + piece->length +
+	                        piece_subtree_length(piece->right);
+	long left = piece_subtree_newlines(piece->left);
+	long right = piece_subtree_newlines(piece->right);
+	piece->subtree_newlines = left < 0 || piece->newlines < 0 || right < 0
+	                              ? -1
+	                              : left + piece->newlines + right;
+}
+
+static piece_t *piece_create(
+    piece_table_t *table, const char *text, long length, long newlines) {
+	piece_t *piece = malloc(sizeof(piece_t));
+	if (piece == NULL) {
+		return NULL;
+	}
+	piece->left = NULL;
+	piece->right = NULL;
+	piece->priority = piece_random(table);
+	piece->text = text;
+	piece->length = length;
+	piece->subtree_length = length;
+	piece->newlines = newlines;
+	piece->subtree_newlines = newlines;
+	return piece;
+}
+
+static void piece_destroy(piece_t *piece) {
+	if (piece == NULL) {
+		return;
+	}
+	piece_destroy(piece->left);
+	piece_destroy(piece->right);
+	free(piece);
+}
+
+static piece_t *piece_merge(piece_t *left, piece_t *right) {
+	if (left == NULL) {
+		return right;
+	}
+	if (right == NULL) {
+		return left;
+	}
+	if (left->priority > right->priority) {
+		left->right = piece_merge(left->right, right);
+		piece_update(left);
+		return left;
+	}
+	right->left = piece_merge(left, right->left);
+	piece_update(right);
+	return right;
+}
+
+// split the text at offset, a piece straddling the offset is cut in two. the
+// only allocation is for that cut, so the split fails only if it fails.
+static result_t piece_split(piece_table_t *table, piece_t *piece, long offset,
+    piece_t **left, piece_t **right) {
+	if (piece == NULL) {
+		*left = NULL;
+		*right = NULL;
+		return NO_ERROR;
+	}
+
+	result_t res = NO_ERROR;
+	long left_length = piece_subtree_length(piece->left);
+	if (offset <= left_length) {
+		res = piece_split(table, piece->left, offset, left, &piece->left);
+		piece_update(piece);
+		*right = piece;
+	} else if (offset >= left_length + piece->length) {
+		res = piece_split(table, piece->right, offset - left_length - piece->length,
+		    &piece->right, right);
+		piece_update(piece);
+		*left = piece;
+	} else {
+		long cut = offset - left_length;
+		// a counted piece stays counted, by counting the shorter side
+		long tail_newlines = -1;
+		if (piece->newlines >= 0 && cut < piece->length - cut) {
+			tail_newlines =
+			    piece->newlines - scan_count(piece->text, '\n', cut);
+		} else if (piece->newlines >= 0) {
+			tail_newlines =
+			    scan_count(piece->text + cut, '\n', piece->length - cut);
+		}
+		piece_t *tail = piece_create(
+		    table, piece->text + cut, piece->length - cut, tail_newlines);
+		if (tail == NULL) {
+			error("failed to allocate piece!");
+			*left = piece;
+			*right = NULL;
+			return TEXT_BUFFER_ERROR;
+		}
+		// sharing the priority keeps the heap order intact above the cut
+		tail->priority = piece->priority;
+		piece_t *old_right = piece->right;
+		piece->length = cut;
+		if (piece->newlines >= 0) {
+			piece->newlines -= tail_newlines;
+		}
+		piece->right = NULL;
+		piece_update(piece);
+		*left = piece;
+		*right = piece_merge(tail, old_right);
+	}
+
+	return res;
+}
+
+// grow the last piece of a subtree, used when typing extends the newest add
+static void piece_extend_last(piece_t *piece, long length, long newlines) {
+	while (piece != NULL) {
+		piece->subtree_length += length;
+		if (piece->subtree_newlines >= 0) {
+			piece->subtree_newlines += newlines;
+		}
+		if (piece->right == NULL) {
+			piece->length += length;
+			if (piece->newlines >= 0) {
+				piece->newlines += newlines;
+			}
+			return;
+		}
+		piece = piece->right;
+	}
+}
+
+static const piece_t *piece_last(const piece_t *piece) {
+	while (piece != NULL && piece->right != NULL) {
+		piece = piece->right;
+	}
+	return piece;
+}
+
+// find the piece containing offset and how far into it offset lies
+static const piece_t *piece_find(
+    const piece_t *piece, long offset, long *piece_offset) {
+	while (piece != NULL) {
+		long left_length = piece_subtree_length(piece->left);
+		if (offset < left_length) {
+			piece = piece->left;
+		} else if (offset < left_length + piece->length) {
+			*piece_offset = offset - left_length;
+			return piece;
+		} else {
+			offset -= left_length + piece->length;
+			piece = piece->right;
+		}
+	}
+	return NULL;
+}
+
+// copy data to the end of the add buffer, the returned text never moves
+static const char *piece_table_add(
+    piece_table_t *table, const char *data, long length) {
+	add_block_t *block = table->add;
+	if (block == NULL || block->capacity - block->length < length) {
+		long capacity = length > ADD_BLOCK_SIZE ? length : ADD_BLOCK_SIZE;
+		block = malloc(sizeof(add_block_t) + capacity);
+		if (block == NULL) {
+			return NULL;
+		}
+		block->next = table->add;
+		block->length = 0;
+		block->capacity = capacity;
+		table->add = block;
+	}
+
+	char *text = &block->data[block->length];
+	memcpy(text, data, length);
+	block->length += length;
+	return text;
+}
+
+static void piece_table_free_text(
+    const char *original, long original_length, add_block_t *add) {
+	if (original != NULL) {
+		munmap((void *)original, original_length);
+	}
+	while (add != NULL) {
+		add_block_t *next = add->next;
+		free(add);
+		add = next;
+	}
+}
+
+result_t piece_table_create(piece_table_t *table, int fd) {
+	table->root = NULL;
+	table->original = NULL;
+	table->original_length = 0;
+	table->add = NULL;
+	table->storage = NULL;
+	table->cursor = 0;
+	table->current_size = 0;
+	table->seed = 2463534242u;
+
+	if (fd < 0) {
+		return NO_ERROR;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat)) {
+		error("failed to stat file for piece table!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (file_stat.st_size == 0) {
+		return NO_ERROR;
+	}
+
+	// the mapping is read only, edits go to the add buffer so no page of the
+	// original is copied or even touched until it's displayed or saved
+	void *original =
+	    mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (original == MAP_FAILED) {
+		error("failed to map file for piece table!");
+		return TEXT_BUFFER_ERROR;
+	}
+	table->original = original;
+	table->original_length = file_stat.st_size;
+
+	for (long start = 0; start < table->original_length;
+	     start += PIECE_ORIGINAL_SIZE) {
+		long length = table->original_length - start < PIECE_ORIGINAL_SIZE
+		                  ? table->original_length - start
+		                  : PIECE_ORIGINAL_SIZE;
+		piece_t *piece =
+		    piece_create(table, table->original + start, length, -1);
+		if (piece == NULL) {
+			error("failed to allocate piece!");
+			piece_table_destroy(table);
+			return TEXT_BUFFER_ERROR;
+		}
+		table->root = piece_merge(table->root, piece);
+	}
+	table->current_size = table->original_length;
+	debug("mapped %ld bytes into piece table", table->original_length);
+
+	return NO_ERROR;
+}
+
+// where the pieces read the original inside the ranges, as spans of the text
+typedef struct piece_detach_t {
+	const piece_table_t *table;
+	const dirty_range_t *ranges;
+	long range_count;
+	long (*cuts)[2];
+	long count;
+	long capacity;
+} piece_detach_t;
+
+static result_t piece_detach_find(
+    piece_detach_t *detach, const piece_t *piece, long *position) {
+	if (piece == NULL) {
+		return NO_ERROR;
+	}
+	if (piece_detach_find(detach, piece->left, position) != NO_ERROR) {
+		return TEXT_BUFFER_ERROR;
+	}
+	const piece_table_t *table = detach->table;
+	const dirty_range_t *ranges = detach->ranges;
+	if (piece->text >= table->original &&
+	    piece->text < table->original + table->original_length) {
+		long start = piece->text - table->original;
+		long end = start + piece->length;
+		// the first range that ends past the start of the piece
+		long low = 0;
+		long high = detach->range_count;
+		while (low < high) {
+			long middle = (low + high) / 2;
+			if (ranges[middle].end <= start) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		for (long i = low; i < detach->range_count && ranges[i].start < end;
+		     i++) {
+			if (detach->count == detach->capacity) {
+				long capacity = detach->capacity == 0 ? 16 : detach->capacity * 2;
+				long(*cuts)[2] = realloc(detach->cuts, capacity * sizeof(*cuts));
+				if (cuts == NULL) {
+					return TEXT_BUFFER_ERROR;
+				}
+				detach->cuts = cuts;
+				detach->capacity = capacity;
+			}
+			long from = ranges[i].start > start ? ranges[i].start : start;
+			long to = ranges[i].end < end ? ranges[i].end : end;
+			detach->cuts[detach->count][0] = *position + from - start;
+			detach->cuts[detach->count][1] = to - from;
+			detach->count++;
+		}
+	}
+	*position += piece->length;
+	return piece_detach_find(detach, piece->right, position);
+}
+
+result_t piece_table_detach(
+    piece_table_t *table, const dirty_range_t *ranges, long count) {
+	if (table->original == NULL || count == 0) {
+		return NO_ERROR;
+	}
+	piece_detach_t detach = {table, ranges, count, NULL, 0, 0};
+	long position = 0;
+	if (piece_detach_find(&detach, table->root, &position) != NO_ERROR) {
+		error("failed to allocate detached pieces!");
+		free(detach.cuts);
+		return TEXT_BUFFER_ERROR;
+	}
+
+	// each cut is cut out on its own, which leaves it a single piece
+	result_t res = NO_ERROR;
+	for (long i = 0; i < detach.count && res == NO_ERROR; i++) {
+		piece_t *left;
+		piece_t *middle;
+		piece_t *right;
+		res = piece_split(table, table->root, detach.cuts[i][0], &left, &right);
+		if (res != NO_ERROR) {
+			table->root = piece_merge(left, right);
+			break;
+		}
+		res = piece_split(table, right, detach.cuts[i][1], &middle, &right);
+		if (res == NO_ERROR) {
+			const char *text =
+			    piece_table_add(table, middle->text, middle->length);
+			if (text == NULL) {
+				error("failed to grow add buffer!");
+				res = TEXT_BUFFER_ERROR;
+			} else {
+				middle->text = text;
+			}
+		}
+		table->root = piece_merge(left, piece_merge(middle, right));
+	}
+	free(detach.cuts);
+	debug("detached %ld pieces from the file", detach.count);
+
+	return res;
+}
+
+void piece_table_truncated(piece_table_t *table, long length) {
+	long page = sysconf(_SC_PAGESIZE);
+	long start = (length + page - 1) / page * page;
+	if (table->original == NULL || start >= table->original_length) {
+		return;
+	}
+	if (mmap((char *)table->original + start, table->original_length - start,
+	        PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+	        0) == MAP_FAILED) {
+		error("failed to cover the end of a cut short file!");
+	}
+}
+
+void piece_table_destroy(piece_table_t *table) {
+	piece_destroy(table->root);
+	table->root = NULL;
+
+	if (table->storage != NULL) {
+		// snapshots may still be reading it, the last one frees it
+		table->storage->original = table->original;
+		table->storage->original_length = table->original_length;
+		table->storage->add = table->add;
+		piece_storage_release(table->storage);
+	} else {
+		piece_table_free_text(
+		    table->original, table->original_length, table->add);
+	}
+	table->storage = NULL;
+	table->original = NULL;
+	table->original_length = 0;
+	table->add = NULL;
+
+	table->cursor = 0;
+	table->current_size = 0;
+}
+
+result_t piece_table_move(piece_table_t *table, long distance) {
+	if (!distance) {
+		error("distance must be non zero!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (table->cursor + distance > table->current_size ||
+	    table->cursor + distance < 0) {
+		error("distance must be within the bounds of the buffer's current size!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	table->cursor += distance;
+	debug("cursor: %ld, current size: %ld", table->cursor, table->current_size);
+
+	return NO_ERROR;
+}
+
+// moving up and down finds lines by scanning outwards from the cursor, which
+// only ever touches the lines involved
+static long piece_table_find_next(
+    const piece_table_t *table, long offset, char c) {
+	while (offset < table->current_size) {
+		const char *text;
+		long length = piece_table_span_at(table, offset, &text);
+		const char *found = scan_memchr(text, c, length);
+		if (found != NULL) {
+			return offset + (found - text);
+		}
+		offset += length;
+	}
+	return -1;
+}
+
+static long piece_table_find_previous(
+    const piece_table_t *table, long offset, char c) {
+	while (offset > 0) {
+		long piece_offset = 0;
+		const piece_t *piece = piece_find(table->root, offset - 1, &piece_offset);
+		const char *found = scan_memrchr(piece->text, c, piece_offset + 1);
+		if (found != NULL) {
+			return offset - 1 - (piece_offset - (found - piece->text));
+		}
+		offset -= piece_offset + 1;
+	}
+	return -1;
+}
+
+static long piece_table_line_end(const piece_table_t *table, long offset) {
+	long newline = piece_table_find_next(table, offset, '\n');
+	return newline < 0 ? table->current_size : newline;
+}
+
+// columns are codepoints, counted over the pieces a line is made of
+static long piece_table_columns(
+    const piece_table_t *table, long start, long end) {
+	long columns = 0;
+	while (start < end) {
+		const char *text;
+		long length = piece_table_span_at(table, start, &text);
+		length = length < end - start ? length : end - start;
+		columns += scan_codepoints(text, length);
+		start += length;
+	}
+	return columns;
+}
+
+// where column is in the line from start to end, its end if it's shorter
+static long piece_table_column_offset(
+    const piece_table_t *table, long start, long end, long column) {
+	while (start < end) {
+		const char *text;
+		long length = piece_table_span_at(table, start, &text);
+		length = length < end - start ? length : end - start;
+		long offset = scan_codepoint_offset(text, length, column);
+		if (offset < length) {
+			return start + offset;
+		}
+		column -= scan_codepoints(text, length);
+		start += length;
+	}
+	return end;
+}
+
+result_t piece_table_ascend(piece_table_t *table, long *column) {
+	long line_start = piece_table_find_previous(table, table->cursor, '\n') + 1;
+	if (line_start == 0) {
+		trace("end of buffer");
+		return NO_ERROR;
+	}
+
+	if (*column < 0) {
+		*column = piece_table_columns(table, line_start, table->cursor);
+	}
+	long start = piece_table_find_previous(table, line_start - 1, '\n') + 1;
+	table->cursor =
+	    piece_table_column_offset(table, start, line_start - 1, *column);
+
+	return NO_ERROR;
+}
+
+result_t piece_table_descend(piece_table_t *table, long *column) {
+	long newline = piece_table_find_next(table, table->cursor, '\n');
+	if (newline < 0) {
+		trace("end of buffer");
+		return NO_ERROR;
+	}
+
+	if (*column < 0) {
+		long line_start =
+		    piece_table_find_previous(table, table->cursor, '\n') + 1;
+		*column = piece_table_columns(table, line_start, table->cursor);
+	}
+	long start = newline + 1;
+	table->cursor = piece_table_column_offset(
+	    table, start, piece_table_line_end(table, start), *column);
+
+	return NO_ERROR;
+}
+
+// counts whatever in the subtree hasn't been yet, only ever once per piece
+static long piece_count_newlines(piece_t *piece) {
+	if (piece == NULL) {
+		return 0;
+	}
+	if (piece->subtree_newlines >= 0) {
+		return piece->subtree_newlines;
+	}
+	if (piece->newlines < 0) {
+		piece->newlines = scan_count(piece->text, '\n', piece->length);
+	}
+	piece->subtree_newlines = piece_count_newlines(piece->left) +
+	                          piece->newlines +
+	                          piece_count_newlines(piece->right);
+	return piece->subtree_newlines;
+}
+
+result_t piece_table_goto_line(piece_table_t *table, long line) {
+	if (line < 0 || line > piece_count_newlines(table->root)) {
+		error("line must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	// the line starts after its line-th newline, found by the counts down to
+	// its piece and then in that piece's text
+	long offset = 0;
+	const piece_t *piece = table->root;
+	while (line > 0) {
+		long left = piece_subtree_newlines(piece->left);
+		if (line <= left) {
+			piece = piece->left;
+			continue;
+		}
+		offset += piece_subtree_length(piece->left);
+		line -= left;
+		if (line > piece->newlines) {
+			offset += piece->length;
+			line -= piece->newlines;
+			piece = piece->right;
+			continue;
+		}
+		const char *text = piece->text;
+		while (line-- > 0) {
+			text = scan_memchr(text, '\n', piece->text + piece->length - text) + 1;
+		}
+		offset += text - piece->text;
+		break;
+	}
+	table->cursor = offset;
+
+	return NO_ERROR;
+}
+
+long piece_table_line_count(const piece_table_t *table) {
+	return 1 + piece_count_newlines(table->root);
+}
+
+result_t piece_table_append(piece_table_t *table, char c) {
+	if (!c) {
+		error("character must non null!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	result_t res = piece_table_insert_at(table, table->cursor, &c, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	table->cursor++;
+
+	return NO_ERROR;
+}
+
+result_t piece_table_remove(piece_table_t *table) {
+	if (table->cursor == 0) {
+		error("no character before the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	result_t res = piece_table_delete_at(table, table->cursor - 1, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	table->cursor--;
+
+	return NO_ERROR;
+}
+
+result_t piece_table_insert(
+    piece_table_t *table, const char *data, long length) {
+	result_t res = piece_table_insert_at(table, table->cursor, data, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	table->cursor += length;
+
+	return NO_ERROR;
+}
+
+result_t piece_table_delete(piece_table_t *table) {
+	if (table->cursor == table->current_size) {
+		error("no character after the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+	return piece_table_delete_at(table, table->cursor, 1);
+}
+
+// the cursor ends up at start, same as the split buffer
+result_t piece_table_delete_range(
+    piece_table_t *table, long start, long end) {
+	if (start > end) {
+		error("range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	result_t res = piece_table_delete_at(table, start, end - start);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	table->cursor = start;
+
+	return NO_ERROR;
+}
+
+result_t piece_table_insert_at(
+    piece_table_t *table, long offset, const char *data, long length) {
+	if (offset < 0 || offset > table->current_size) {
+		error("insert offset must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (length <= 0) {
+		return NO_ERROR;
+	}
+
+	// remember where the add buffer ended, so typing straight after the last
+	// insert grows that piece instead of creating a new one per keystroke
+	const char *add_end =
+	    table->add == NULL ? NULL : &table->add->data[table->add->length];
+	const char *text = piece_table_add(table, data, length);
+	if (text == NULL) {
+		error("failed to grow add buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	piece_t *left;
+	piece_t *right;
+	if (piece_split(table, table->root, offset, &left, &right) != NO_ERROR) {
+		table->root = piece_merge(left, right);
+		return TEXT_BUFFER_ERROR;
+	}
+
+	long newlines = scan_count(text, '\n', length);
+	const piece_t *last = piece_last(left);
+	if (last != NULL && text == add_end && last->text + last->length == text) {
+		piece_extend_last(left, length, newlines);
+	} else {
+		piece_t *piece = piece_create(table, text, length, newlines);
+		if (piece == NULL) {
+			error("failed to allocate piece!");
+			table->root = piece_merge(left, right);
+			return TEXT_BUFFER_ERROR;
+		}
+		left = piece_merge(left, piece);
+	}
+
+	table->root = piece_merge(left, right);
+	table->current_size += length;
+	debug("inserted %ld bytes at %ld", length, offset);
+
+	return NO_ERROR;
+}
+
+result_t piece_table_delete_at(piece_table_t *table, long offset, long length) {
+	if (offset < 0 || length < 0 || offset + length > table->current_size) {
+		error("delete range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (length == 0) {
+		return NO_ERROR;
+	}
+
+	piece_t *left;
+	piece_t *middle;
+	piece_t *right;
+	if (piece_split(table, table->root, offset, &left, &right) != NO_ERROR) {
+		table->root = piece_merge(left, right);
+		return TEXT_BUFFER_ERROR;
+	}
+	if (piece_split(table, right, length, &middle, &right) != NO_ERROR) {
+		table->root = piece_merge(left, piece_merge(middle, right));
+		return TEXT_BUFFER_ERROR;
+	}
+
+	piece_destroy(middle);
+	table->root = piece_merge(left, right);
+	table->current_size -= length;
+	debug("deleted %ld bytes at %ld", length, offset);
+
+	return NO_ERROR;
+}
+
+long piece_table_span_at(
+    const piece_table_t *table, long offset, const char **text) {
+	long piece_offset = 0;
+	const piece_t *piece = piece_find(table->root, offset, &piece_offset);
+	if (piece == NULL) {
+		*text = NULL;
+		return 0;
+	}
+	*text = piece->text + piece_offset;
+	return piece->length - piece_offset;
+}
+
+// contiguous text ending at offset, back to the start of its piece
+long piece_table_span_before(
+    const piece_table_t *table, long offset, const char **text) {
+	long piece_offset = 0;
+	const piece_t *piece = offset > 0
+	                           ? piece_find(table->root, offset - 1, &piece_offset)
+	                           : NULL;
+	if (piece == NULL) {
+		*text = NULL;
+		return 0;
+	}
+	*text = piece->text;
+	return piece_offset + 1;
+}
+
+char *piece_table_to_string(piece_table_t *table) {
+	if (table->current_size == 0) {
+		return NULL;
+	}
+	char *string = malloc(table->current_size + 1);
+	if (string == NULL) {
+		return NULL;
+	}
+
+	long offset = 0;
+	while (offset < table->current_size) {
+		const char *text;
+		long length = piece_table_span_at(table, offset, &text);
+		memcpy(&string[offset], text, length);
+		offset += length;
+	}
+	string[table->current_size] = '\0';
+
+	return string;
+}
+
+piece_storage_t *piece_table_share(piece_table_t *table) {
+	if (table->storage == NULL) {
+		table->storage = malloc(sizeof(piece_storage_t));
+		if (table->storage == NULL) {
+			error("failed to allocate piece storage!");
+			return NULL;
+		}
+		atomic_init(&table->storage->references, 1);
+		table->storage->original = NULL;
+		table->storage->original_length = 0;
+		table->storage->add = NULL;
+	}
+	atomic_fetch_add(&table->storage->references, 1);
+	return table->storage;
+}
+
+void piece_storage_release(piece_storage_t *storage) {
+	if (atomic_fetch_sub(&storage->references, 1) != 1) {
+		return;
+	}
+	piece_table_free_text(
+	    storage->original, storage->original_length, storage->add);
+	free(storage);
+}
+
+static long piece_spans(const piece_t *piece, text_span_t *spans,
+    long capacity, long count) {
+	if (piece == NULL) {
+		return count;
+	}
+	count = piece_spans(piece->left, spans, capacity, count);
+	if (count < capacity) {
+		spans[count] = (text_span_t){piece->text, piece->length};
+	}
+	count++;
+	return piece_spans(piece->right, spans, capacity, count);
+}
+
+// fills spans with the pieces in order, returns how many there are even if
+// that's more than capacity
+long piece_table_spans(
+    const piece_table_t *table, text_span_t *spans, long capacity) {
+	return piece_spans(table->root, spans, capacity, 0);
+}
@@ -0,0 +1,121 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+#pragma once
+
+#include "dirty_ranges.h"
+#include "result.h"
+#include "text_span.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// add blocks are never reallocated, so a piece can point straight at its text
+#define ADD_BLOCK_SIZE 65536
+// the file starts out as pieces of at most this much, so counting the lines
+// on either side of a cut never reads more than one of them
+#define PIECE_ORIGINAL_SIZE (1024L * 1024L)
+
+/*
+pieces are kept in a treap ordered by their position in the text, every node
+caches the length of its subtree so finding, splitting and joining pieces at
+an offset costs O(log pieces). newlines are cached the same way, but the
+file's pieces aren't counted until a line is first asked for, so opening one
+doesn't read it.
+*/
+typedef struct piece_t {
+	struct piece_t *left;
+	struct piece_t *right;
+	uint32_t priority;
+	const char *text;
+	long length;
+	long subtree_length;
+	// -1 until counted, for a subtree until all of it is
+	long newlines;
+	long subtree_newlines;
+} piece_t;
+
+typedef struct add_block_t {
+	struct add_block_t *next;
+	long length;
+	long capacity;
+	char data[];
+} add_block_t;
+
+/*
+the text pieces point at never changes once written, so a snapshot only has to
+keep it alive. the table and every snapshot hold a reference and whoever lets
+go last unmaps the original and frees the add blocks.
+*/
+typedef struct piece_storage_t {
+	_Atomic long references;
+	const char *original;
+	long original_length;
+	add_block_t *add;
+} piece_storage_t;
+
+typedef struct piece_table_t {
+	piece_t *root;
+	const char *original;
+	long original_length;
+	add_block_t *add;
+	piece_storage_t *storage;
+	long cursor;
+	long current_size;
+	uint32_t seed;
+} piece_table_t;
+
+result_t piece_table_create(piece_table_t *table, int fd);
+void piece_table_destroy(piece_table_t *table);
+// copies the text still read out of the given ranges of the file, in order,
+// into the add buffer so those parts of the file can be written over
+result_t piece_table_detach(
+    piece_table_t *table, const dirty_range_t *ranges, long count);
+// the file under the mapping was cut short where it is. reading whole pages
+// past its end would fault, so they read as zeros instead.
+void piece_table_truncated(piece_table_t *table, long length);
+
+result_t piece_table_move(piece_table_t *table, long distance);
+// column is the codepoint column to land in, -1 for the cursor's own
+result_t piece_table_ascend(piece_table_t *table, long *column);
+result_t piece_table_descend(piece_table_t *table, long *column);
+result_t piece_table_goto_line(piece_table_t *table, long line);
+
+long piece_table_line_count(const piece_table_t *table);
+
+result_t piece_table_append(piece_table_t *table, char c);
+result_t piece_table_remove(piece_table_t *table);
+result_t piece_table_insert(
+    piece_table_t *table, const char *data, long length);
+result_t piece_table_delete(piece_table_t *table);
+result_t piece_table_delete_range(piece_table_t *table, long start, long end);
+
+result_t piece_table_insert_at(
+    piece_table_t *table, long offset, const char *data, long length);
+result_t piece_table_delete_at(piece_table_t *table, long offset, long length);
+
+long piece_table_span_at(
+    const piece_table_t *table, long offset, const char **text);
+
+long piece_table_span_before(
+    const piece_table_t *table, long offset, const char **text);
+
+char *piece_table_to_string(piece_table_t *table);
+
+piece_storage_t *piece_table_share(piece_table_t *table);
+void piece_storage_release(piece_storage_t *storage);
+long piece_table_spans(
+    const piece_table_t *table, text_span_t *spans, long capacity);
@@ -37,58 +37,93 @@ void font_update(font_t *font, long cursor_position, const char *string,
 		font->object.vertices = 0;
 		return;
 	}
-	int cursor = 0;
-	if (cursor_position >= 0) {
-		cursor = 1;
-	}
+	text_span_t span = {string, (long)strlen(string)};
+	font_update_spans(font, cursor_position, &span, 1, vertical_offset);
+}
 
-	// debug("string: %s, %i", string, strlen(string));
-	render_object_load_data(
-	    &font->object, (strlen(string) + cursor) * 48 * sizeof(float), NULL);
-	vec2_t current_position =
-	    (vec2_t){{font->position.x, font->position.y + vertical_offset}};
-	long advance = font->characters[(int)' '].advance.x >> 6;
+static void font_cursor(font_t *font, vec2_t position, long slot) {
+	char_glyph_t cursor = font->characters[(int)'|'];
+	float temp_vertices[6][8] = {
+	    {position.x, position.y + font->font_size, cursor.start.x, cursor.end.y,
+	        font->color.r, font->color.g, font->color.b, font->color.a},
 
-	for (int i = 0; i < strlen(string); ++i) {
-		char_glyph_t character = font->characters[(int)string[i]];
-		// debug("current char: %c; current character advance: %ld", string[i],
-		// character.advance.x >> 6);
-		if (i == cursor_position && cursor) {
-			char_glyph_t cursor = font->characters[(int)'|'];
-			float temp_vertices[6][8] = {
-			    {current_position.x, current_position.y + font->font_size,
-			        cursor.start.x, cursor.end.y, font->color.r, font->color.g,
-			        font->color.b, font->color.a},
+	    {position.x + 4, position.y + font->font_size, cursor.end.x,
+	        cursor.end.y, font->color.r, font->color.g, font->color.b,
+	        font->color.a},
 
-			    {current_position.x + 4, current_position.y + font->font_size,
-			        cursor.end.x, cursor.end.y, font->color.r, font->color.g,
-			        font->color.b, font->color.a},
+	    {position.x, position.y, cursor.start.x, cursor.start.y, font->color.r,
+	        font->color.g, font->color.b, font->color.a},
 
-			    {current_position.x, current_position.y, cursor.start.x,
-			        cursor.start.y, font->color.r, font->color.g, font->color.b,
-			        font->color.a},
+	    {position.x + 4, position.y, cursor.end.x, cursor.start.y,
+	        font->color.r, font->color.g, font->color.b, font->color.a},
 
-			    {current_position.x + 4, current_position.y, cursor.end.x,
-			        cursor.start.y, font->color.r, font->color.g, font->color.b,
-			        font->color.a},
+	    {position.x, position.y, cursor.start.x, cursor.start.y, font->color.r,
+	        font->color.g, font->color.b, font->color.a},
 
-			    {current_position.x, current_position.y, cursor.start.x,
-			        cursor.start.y, font->color.r, font->color.g, font->color.b,
-			        font->color.a},
+	    {position.x + 4, position.y + font->font_size, cursor.end.x,
+	        cursor.end.y, font->color.r, font->color.g, font->color.b,
+	        font->color.a},
+	};
+	render_object_load_sub_data(&font->object, sizeof(temp_vertices),
+	    sizeof(temp_vertices) * slot, temp_vertices);
+}
 
-			    {current_position.x + 4, current_position.y + font->font_size,
-			        cursor.end.x, cursor.end.y, font->color.r, font->color.g,
-			        font->color.b, font->color.a},
-			};
-			// debug("current_position %f, %f", current_position.x,
-			// current_position.y);
-			render_object_load_sub_data(
-			    &font->object, sizeof(temp_vertices), 0, temp_vertices);
+// lay out text that is split over several spans, such as the two sides of a
+// split buffer's gap, without joining it into one string first
+void font_update_spans(font_t *font, long cursor_position,
+    const text_span_t *spans, long span_count, float vertical_offset) {
+	font_update_cursors(font, &cursor_position, cursor_position >= 0 ? 1 : 0,
+	    spans, span_count, vertical_offset);
+}
+
+// cursors must be ascending, their glyphs take the first cursor_count slots
+// of the vertex buffer and the text follows
+void font_update_cursors(font_t *font, const long *cursors, long cursor_count,
+    const text_span_t *spans, long span_count, float vertical_offset) {
+	long cursor = 0;
+
+	long length = 0;
+	for (long span = 0; span < span_count; span++) {
+		length += spans[span].length;
+	}
+	render_object_load_data(
+	    &font->object, (length + cursor_count) * 48 * sizeof(float), NULL);
+	vec2_t current_position =
+	    (vec2_t){{font->position.x, font->position.y + vertical_offset}};
+	long advance = font->characters[(int)' '].advance.x >> 6;
+	// continuation bytes still to come of the codepoint being drawn
+	int following = 0;
+
+	long span = 0;
+	long span_offset = 0;
+	for (long i = 0; i < length; ++i) {
+		while (span_offset == spans[span].length) {
+			span++;
+			span_offset = 0;
+		}
+		unsigned char c = spans[span].data[span_offset++];
+		// anything past ascii is one replacement glyph per codepoint, its
+		// continuation bytes keep their slots but draw nothing. a byte that
+		// can't be part of one is a replacement glyph of its own.
+		char_glyph_t character = {0};
+		if (c < 0x80) {
+			following = 0;
+			character = font->characters[c];
+		} else if ((c & 0xC0) == 0x80 && following > 0) {
+			following--;
+		} else {
+			following = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+			character = font->characters[RENDER_OBJECT_REPLACEMENT];
+		}
+		// debug("current char: %c; current character advance: %ld", c,
+		// character.advance.x >> 6);
+		while (cursor < cursor_count && cursors[cursor] == i) {
+			font_cursor(font, current_position, cursor++);
 		}
-		if (string[i] == '\n') {
+		if (c == '\n') {
 			current_position.x = font->position.x;
 			current_position.y += font->font_size;
-		} else if (string[i] == '\t') {
+		} else if (c == '\t') {
 			current_position.x += (advance)*2;
 		}
 		if (current_position.x + advance < font->position.x + font->size.x &&
@@ -133,7 +168,7 @@ void font_update(font_t *font, long cursor_position, const char *string,
 			// debug("current_position %f, %f", current_position.x,
 			// current_position.y);
 			render_object_load_sub_data(&font->object, sizeof(temp_vertices),
-			    sizeof(temp_vertices) * (i + cursor), temp_vertices);
+			    sizeof(temp_vertices) * (i + cursor_count), temp_vertices);
 		} else {
 			float temp_vertices[6][8] = {
 			    {current_position.x + character.bearing.x,
@@ -171,38 +206,12 @@ void font_update(font_t *font, long cursor_position, const char *string,
 			// debug("current_position %f, %f", current_position.x,
 			// current_position.y);
 			render_object_load_sub_data(&font->object, sizeof(temp_vertices),
-			    sizeof(temp_vertices) * (i + cursor), temp_vertices);
+			    sizeof(temp_vertices) * (i + cursor_count), temp_vertices);
 		}
 	}
 
-	if (strlen(string) == cursor_position && cursor) {
-		char_glyph_t cursor = font->characters[(int)'|'];
-		float temp_vertices[6][8] = {
-		    {current_position.x, current_position.y + font->font_size,
-		        cursor.start.x, cursor.end.y, font->color.r, font->color.g,
-		        font->color.b, font->color.a},
-
-		    {current_position.x + 4, current_position.y + font->font_size,
-		        cursor.end.x, cursor.end.y, font->color.r, font->color.g,
-		        font->color.b, font->color.a},
-
-		    {current_position.x, current_position.y, cursor.start.x, cursor.start.y,
-		        font->color.r, font->color.g, font->color.b, font->color.a},
-
-		    {current_position.x + 4, current_position.y, cursor.end.x,
-		        cursor.start.y, font->color.r, font->color.g, font->color.b,
-		        font->color.a},
-
-		    {current_position.x, current_position.y, cursor.start.x, cursor.start.y,
-		        font->color.r, font->color.g, font->color.b, font->color.a},
-
-		    {current_position.x + 4, current_position.y + font->font_size,
-		        cursor.end.x, cursor.end.y, font->color.r, font->color.g,
-		        font->color.b, font->color.a},
-		};
-		// debug("current_position %f, %f", current_position.x, current_position.y);
-		render_object_load_sub_data(
-		    &font->object, sizeof(temp_vertices), 0, temp_vertices);
+	while (cursor < cursor_count && cursors[cursor] == length) {
+		font_cursor(font, current_position, cursor++);
 	}
 }
 
@@ -19,6 +19,7 @@
 #include <render_object.h>
 #include <math/vector.h>
 #include <math/matrix.h>
+#include <text_span.h>
 
 typedef struct font_t {
 	render_object_t object;
@@ -27,10 +28,12 @@ typedef struct font_t {
 	vec2_t size;
 	vec4_t color;
 
-	char_glyph_t characters[128];
+	char_glyph_t characters[RENDER_OBJECT_GLYPHS];
 	float font_size;
 } font_t;
 
 int font_load(font_t *font, long cursor_position, const char *font_filepath, const char *string, mat4_t projection);
 void font_update(font_t *font, long cursor_position, const char *string, float vertical_offset);
+void font_update_spans(font_t *font, long cursor_position, const text_span_t *spans, long span_count, float vertical_offset);
+void font_update_cursors(font_t *font, const long *cursors, long cursor_count, const text_span_t *spans, long span_count, float vertical_offset);
 void font_destroy(font_t *font);
@@ -0,0 +1,1082 @@
+#include "regex.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum regex_node_type_t {
+	REGEX_BYTES = 0,
+	REGEX_SPLIT,
+	REGEX_EMPTY,
+	// ^ going forwards, $ going backwards: the byte before was a newline
+	REGEX_AFTER_NEWLINE,
+	// $ going forwards, ^ going backwards: the next byte is a newline. this
+	// isn't known until the next byte is read so it stays in the state
+	REGEX_BEFORE_NEWLINE,
+	REGEX_MATCH,
+};
+
+// a match ended just before the byte that led to this state
+#define REGEX_MATCHED 1
+#define REGEX_LINE_START 2
+
+typedef struct regex_fragment_t {
+	int start;
+	// dangling outs as a list threaded through the out fields themselves
+	int patch;
+} regex_fragment_t;
+
+typedef struct regex_parser_t {
+	const char *pattern;
+	long length;
+	long position;
+	int reverse;
+	int ignore_case;
+	regex_program_t *program;
+	const char *error;
+} regex_parser_t;
+
+static int regex_set_has(const regex_set_t *set, unsigned char c) {
+	return (set->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void regex_set_put(regex_set_t *set, unsigned char c) {
+	set->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static void regex_set_add(regex_parser_t *parser, regex_set_t *set, int c) {
+	regex_set_put(set, c);
+	if (parser->ignore_case && c >= 'a' && c <= 'z') {
+		regex_set_put(set, c - 32);
+	} else if (parser->ignore_case && c >= 'A' && c <= 'Z') {
+		regex_set_put(set, c + 32);
+	}
+}
+
+static int regex_set_create(regex_parser_t *parser) {
+	regex_program_t *program = parser->program;
+	if (program->set_count == program->set_capacity) {
+		int capacity = program->set_capacity ? program->set_capacity * 2 : 16;
+		regex_set_t *sets =
+		    realloc(program->sets, capacity * sizeof(regex_set_t));
+		if (sets == NULL) {
+			parser->error = "out of memory";
+			return -1;
+		}
+		program->sets = sets;
+		program->set_capacity = capacity;
+	}
+	memset(&program->sets[program->set_count], 0, sizeof(regex_set_t));
+	return program->set_count++;
+}
+
+static int regex_node_create(
+    regex_parser_t *parser, int type, int out, int out1, int set) {
+	regex_program_t *program = parser->program;
+	if (program->node_count >= REGEX_MAX_NODES) {
+		parser->error = "pattern too big";
+		return -1;
+	}
+	if (program->node_count == program->node_capacity) {
+		int capacity = program->node_capacity ? program->node_capacity * 2 : 64;
+		regex_node_t *nodes =
+		    realloc(program->nodes, capacity * sizeof(regex_node_t));
+		if (nodes == NULL) {
+			parser->error = "out of memory";
+			return -1;
+		}
+		program->nodes = nodes;
+		program->node_capacity = capacity;
+	}
+	program->nodes[program->node_count] =
+	    (regex_node_t){type, out, out1, set};
+	return program->node_count++;
+}
+
+static int *regex_slot(regex_program_t *program, int slot) {
+	regex_node_t *node = &program->nodes[slot >> 1];
+	return slot & 1 ? &node->out1 : &node->out;
+}
+
+static void regex_patch(regex_program_t *program, int patch, int target) {
+	while (patch != -1) {
+		int *slot = regex_slot(program, patch);
+		patch = *slot;
+		*slot = target;
+	}
+}
+
+static int regex_join(regex_program_t *program, int a, int b) {
+	if (a == -1) {
+		return b;
+	}
+	int patch = a;
+	while (*regex_slot(program, patch) != -1) {
+		patch = *regex_slot(program, patch);
+	}
+	*regex_slot(program, patch) = b;
+	return a;
+}
+
+static regex_fragment_t regex_single(
+    regex_parser_t *parser, int type, int set) {
+	int node = regex_node_create(parser, type, -1, -1, set);
+	return (regex_fragment_t){node, node < 0 ? -1 : node * 2};
+}
+
+// a then b in matching order, which is b then a for the reverse program
+static regex_fragment_t regex_concat(
+    regex_parser_t *parser, regex_fragment_t a, regex_fragment_t b) {
+	if (a.start == -1) {
+		return b;
+	}
+	if (b.start == -1) {
+		return a;
+	}
+	if (parser->reverse) {
+		regex_fragment_t swap = a;
+		a = b;
+		b = swap;
+	}
+	regex_patch(parser->program, a.patch, b.start);
+	return (regex_fragment_t){a.start, b.patch};
+}
+
+static regex_fragment_t regex_alternate(
+    regex_parser_t *parser, regex_fragment_t a, regex_fragment_t b) {
+	int node = regex_node_create(parser, REGEX_SPLIT, a.start, b.start, -1);
+	if (node < 0) {
+		return (regex_fragment_t){-1, -1};
+	}
+	return (regex_fragment_t){
+	    node, regex_join(parser->program, a.patch, b.patch)};
+}
+
+// x? and x*, a greedy split prefers going through x
+static regex_fragment_t regex_optional(
+    regex_parser_t *parser, regex_fragment_t a, int greedy, int loop) {
+	int node = regex_node_create(parser, REGEX_SPLIT, greedy ? a.start : -1,
+	    greedy ? -1 : a.start, -1);
+	if (node < 0) {
+		return (regex_fragment_t){-1, -1};
+	}
+	int exit = node * 2 + (greedy ? 1 : 0);
+	if (loop) {
+		regex_patch(parser->program, a.patch, node);
+		return (regex_fragment_t){node, exit};
+	}
+	return (regex_fragment_t){node, regex_join(parser->program, a.patch, exit)};
+}
+
+static regex_fragment_t regex_plus(
+    regex_parser_t *parser, regex_fragment_t a, int greedy) {
+	regex_fragment_t loop = regex_optional(parser, a, greedy, 1);
+	if (loop.start < 0) {
+		return loop;
+	}
+	return (regex_fragment_t){a.start, loop.patch};
+}
+
+static int regex_peek(const regex_parser_t *parser) {
+	if (parser->position >= parser->length) {
+		return -1;
+	}
+	return (unsigned char)parser->pattern[parser->position];
+}
+
+static int regex_hex(int c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+static void regex_set_range(
+    regex_parser_t *parser, regex_set_t *set, int low, int high) {
+	for (int c = low; c <= high; c++) {
+		regex_set_add(parser, set, c);
+	}
+}
+
+static void regex_set_invert(regex_set_t *set) {
+	for (int i = 0; i < 8; i++) {
+		set->bits[i] = ~set->bits[i];
+	}
+}
+
+// \d \w \s and friends, each with an upper case negation
+static int regex_set_named(regex_set_t *set, int name) {
+	regex_set_t named = {{0}};
+	switch (name | 32) {
+	case 'd':
+		for (int c = '0'; c <= '9'; c++) {
+			regex_set_put(&named, c);
+		}
+		break;
+	case 'w':
+		for (int c = 0; c < 256; c++) {
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			    (c >= '0' && c <= '9') || c == '_') {
+				regex_set_put(&named, c);
+			}
+		}
+		break;
+	case 's':
+		regex_set_put(&named, ' ');
+		for (int c = '\t'; c <= '\r'; c++) {
+			regex_set_put(&named, c);
+		}
+		break;
+	default:
+		return 0;
+	}
+	if (name >= 'A' && name <= 'Z') {
+		regex_set_invert(&named);
+	}
+	for (int i = 0; i < 8; i++) {
+		set->bits[i] |= named.bits[i];
+	}
+	return 1;
+}
+
+// adds the escape after a backslash to set, returns the byte it stands for
+// or -1 if it was a whole class
+static int regex_parse_escape(regex_parser_t *parser, regex_set_t *set) {
+	int c = regex_peek(parser);
+	if (c < 0) {
+		parser->error = "trailing backslash";
+		return -1;
+	}
+	parser->position++;
+	if (regex_set_named(set, c)) {
+		return -1;
+	}
+
+	switch (c) {
+	case 'n':
+		c = '\n';
+		break;
+	case 't':
+		c = '\t';
+		break;
+	case 'r':
+		c = '\r';
+		break;
+	case 'f':
+		c = '\f';
+		break;
+	case 'v':
+		c = '\v';
+		break;
+	case 'x': {
+		int high = regex_hex(regex_peek(parser));
+		parser->position++;
+		int low = regex_hex(regex_peek(parser));
+		parser->position++;
+		if (high < 0 || low < 0) {
+			parser->error = "bad \\x escape";
+			return -1;
+		}
+		c = high * 16 + low;
+	} break;
+	default:
+		break;
+	}
+	regex_set_add(parser, set, c);
+	return c;
+}
+
+static regex_fragment_t regex_parse_class(regex_parser_t *parser) {
+	int index = regex_set_create(parser);
+	if (index < 0) {
+		return (regex_fragment_t){-1, -1};
+	}
+	regex_set_t set = {{0}};
+	int negate = regex_peek(parser) == '^';
+	parser->position += negate;
+
+	int first = 1;
+	while (parser->position < parser->length &&
+	       (regex_peek(parser) != ']' || first)) {
+		first = 0;
+		int low = regex_peek(parser);
+		parser->position++;
+		if (low == '\\') {
+			low = regex_parse_escape(parser, &set);
+			if (parser->error != NULL) {
+				return (regex_fragment_t){-1, -1};
+			}
+			if (low < 0) {
+				continue;
+			}
+		}
+		if (regex_peek(parser) != '-' ||
+		    parser->position + 1 >= parser->length ||
+		    parser->pattern[parser->position + 1] == ']') {
+			regex_set_add(parser, &set, low);
+			continue;
+		}
+
+		parser->position++;
+		int high = regex_peek(parser);
+		parser->position++;
+		if (high == '\\') {
+			regex_set_t ignored = {{0}};
+			high = regex_parse_escape(parser, &ignored);
+		}
+		if (high < low) {
+			parser->error = parser->error ? parser->error : "bad range";
+			return (regex_fragment_t){-1, -1};
+		}
+		regex_set_range(parser, &set, low, high);
+	}
+	if (regex_peek(parser) != ']') {
+		parser->error = "missing ]";
+		return (regex_fragment_t){-1, -1};
+	}
+	parser->position++;
+
+	if (negate) {
+		regex_set_invert(&set);
+	}
+	parser->program->sets[index] = set;
+	return regex_single(parser, REGEX_BYTES, index);
+}
+
+static regex_fragment_t regex_parse_alternation(regex_parser_t *parser);
+static int regex_parse_count(regex_parser_t *parser, long *min, long *max);
+
+static regex_fragment_t regex_parse_atom(regex_parser_t *parser) {
+	int c = regex_peek(parser);
+	parser->position++;
+	switch (c) {
+	case '(': {
+		if (parser->position + 1 < parser->length &&
+		    parser->pattern[parser->position] == '?' &&
+		    parser->pattern[parser->position + 1] == ':') {
+			parser->position += 2;
+		}
+		regex_fragment_t group = regex_parse_alternation(parser);
+		if (parser->error != NULL) {
+			return group;
+		}
+		if (regex_peek(parser) != ')') {
+			parser->error = "missing )";
+			return (regex_fragment_t){-1, -1};
+		}
+		parser->position++;
+		return group;
+	}
+	case '[':
+		return regex_parse_class(parser);
+	case '^':
+	case '$':
+		parser->program->anchors = 1;
+		return regex_single(parser,
+		    (c == '^') != parser->reverse ? REGEX_AFTER_NEWLINE
+		                                  : REGEX_BEFORE_NEWLINE,
+		    -1);
+	case '*':
+	case '+':
+	case '?':
+		parser->error = "nothing to repeat";
+		return (regex_fragment_t){-1, -1};
+	case '{': {
+		// a { that isn't a count is just a brace
+		long min;
+		long max;
+		parser->position--;
+		if (regex_parse_count(parser, &min, &max)) {
+			parser->error = "nothing to repeat";
+			return (regex_fragment_t){-1, -1};
+		}
+		parser->position++;
+	} break;
+	default:
+		break;
+	}
+
+	int index = regex_set_create(parser);
+	if (index < 0) {
+		return (regex_fragment_t){-1, -1};
+	}
+	regex_set_t set = {{0}};
+	if (c == '.') {
+		regex_set_invert(&set);
+		set.bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+	} else if (c == '\\') {
+		regex_parse_escape(parser, &set);
+		if (parser->error != NULL) {
+			return (regex_fragment_t){-1, -1};
+		}
+	} else {
+		regex_set_add(parser, &set, c);
+	}
+	parser->program->sets[index] = set;
+	return regex_single(parser, REGEX_BYTES, index);
+}
+
+// {m}, {m,} or {m,n}, returns 0 and leaves position alone if it isn't one
+static int regex_parse_count(regex_parser_t *parser, long *min, long *max) {
+	long position = parser->position + 1;
+	long values[2] = {0, -1};
+	int digits[2] = {0, 0};
+	int field = 0;
+	while (position < parser->length) {
+		char c = parser->pattern[position++];
+		if (c >= '0' && c <= '9') {
+			if (values[field] < 0) {
+				values[field] = 0;
+			}
+			values[field] = values[field] * 10 + c - '0';
+			if (values[field] > REGEX_MAX_REPEAT) {
+				values[field] = REGEX_MAX_REPEAT + 1;
+			}
+			digits[field]++;
+		} else if (c == ',' && field == 0 && digits[0]) {
+			field = 1;
+		} else if (c == '}' && digits[0]) {
+			*min = values[0];
+			*max = field == 0 ? values[0] : values[1];
+			parser->position = position;
+			return 1;
+		} else {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// parses the atom at position again for another copy of it
+static regex_fragment_t regex_parse_copy(regex_parser_t *parser, long atom) {
+	long position = parser->position;
+	parser->position = atom;
+	regex_fragment_t copy = regex_parse_atom(parser);
+	parser->position = position;
+	return copy;
+}
+
+static regex_fragment_t regex_parse_counted(regex_parser_t *parser,
+    regex_fragment_t fragment, long atom, long min, long max, int greedy) {
+	regex_fragment_t result = {-1, -1};
+	for (long i = 0; i < min && parser->error == NULL; i++) {
+		regex_fragment_t copy = i ? regex_parse_copy(parser, atom) : fragment;
+		result = regex_concat(parser, result, copy);
+	}
+	if (max < 0 && parser->error == NULL) {
+		regex_fragment_t copy = min ? regex_parse_copy(parser, atom) : fragment;
+		result = regex_concat(
+		    parser, result, regex_optional(parser, copy, greedy, 1));
+	}
+	// x{2,4} is xx(x(x)?)?, built from the inside out
+	regex_fragment_t tail = {-1, -1};
+	for (long i = max - 1; i >= min && parser->error == NULL; i--) {
+		regex_fragment_t copy =
+		    i || min ? regex_parse_copy(parser, atom) : fragment;
+		tail = regex_optional(
+		    parser, regex_concat(parser, copy, tail), greedy, 0);
+	}
+	if (tail.start != -1) {
+		result = regex_concat(parser, result, tail);
+	}
+	if (result.start == -1 && parser->error == NULL) {
+		result = regex_single(parser, REGEX_EMPTY, -1);
+	}
+	return result;
+}
+
+static regex_fragment_t regex_parse_repeat(regex_parser_t *parser) {
+	long atom = parser->position;
+	regex_fragment_t fragment = regex_parse_atom(parser);
+	int counted = 0;
+	while (parser->error == NULL) {
+		int c = regex_peek(parser);
+		long min;
+		long max;
+		if (c == '{' && !counted && regex_parse_count(parser, &min, &max)) {
+			if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT ||
+			    (max >= 0 && max < min)) {
+				parser->error = "bad repeat count";
+				break;
+			}
+			int greedy = regex_peek(parser) != '?';
+			parser->position += !greedy;
+			fragment =
+			    regex_parse_counted(parser, fragment, atom, min, max, greedy);
+			counted = 1;
+			continue;
+		}
+		if (c != '*' && c != '+' && c != '?') {
+			break;
+		}
+		parser->position++;
+		int greedy = regex_peek(parser) != '?';
+		parser->position += !greedy;
+		if (c == '+') {
+			fragment = regex_plus(parser, fragment, greedy);
+		} else {
+			fragment = regex_optional(parser, fragment, greedy, c == '*');
+		}
+		// a count after this would copy the atom without what came after it
+		counted = 1;
+	}
+	return fragment;
+}
+
+static regex_fragment_t regex_parse_concat(regex_parser_t *parser) {
+	regex_fragment_t fragment = {-1, -1};
+	while (parser->error == NULL && parser->position < parser->length &&
+	       regex_peek(parser) != '|' && regex_peek(parser) != ')') {
+		regex_fragment_t piece = regex_parse_repeat(parser);
+		if (parser->error != NULL) {
+			break;
+		}
+		fragment = regex_concat(parser, fragment, piece);
+	}
+	if (fragment.start == -1 && parser->error == NULL) {
+		fragment = regex_single(parser, REGEX_EMPTY, -1);
+	}
+	return fragment;
+}
+
+static regex_fragment_t regex_parse_alternation(regex_parser_t *parser) {
+	regex_fragment_t fragment = regex_parse_concat(parser);
+	while (parser->error == NULL && regex_peek(parser) == '|') {
+		parser->position++;
+		regex_fragment_t right = regex_parse_concat(parser);
+		if (parser->error != NULL) {
+			break;
+		}
+		fragment = regex_alternate(parser, fragment, right);
+	}
+	return fragment;
+}
+
+static void regex_program_destroy(regex_program_t *program) {
+	free(program->nodes);
+	free(program->sets);
+	memset(program, 0, sizeof(regex_program_t));
+}
+
+static result_t regex_program_create(regex_program_t *program,
+    const char *pattern, long length, int ignore_case, int reverse) {
+	memset(program, 0, sizeof(regex_program_t));
+	regex_parser_t parser = {
+	    pattern, length, 0, reverse, ignore_case, program, NULL};
+
+	regex_fragment_t fragment = regex_parse_alternation(&parser);
+	if (parser.error == NULL && parser.position < length) {
+		parser.error = "unmatched )";
+	}
+	int match = parser.error == NULL
+	                ? regex_node_create(&parser, REGEX_MATCH, -1, -1, -1)
+	                : -1;
+	int any = parser.error == NULL ? regex_set_create(&parser) : -1;
+	int loop = any >= 0 ? regex_node_create(
+	                          &parser, REGEX_SPLIT, fragment.start, -1, -1)
+	                    : -1;
+	int step =
+	    loop >= 0 ? regex_node_create(&parser, REGEX_BYTES, loop, -1, any) : -1;
+	if (parser.error != NULL || step < 0) {
+		debug("bad pattern at %ld: %s", parser.position, parser.error);
+		error("failed to compile pattern!");
+		regex_program_destroy(program);
+		return REGEX_ERROR;
+	}
+
+	regex_patch(program, fragment.patch, match);
+	regex_set_invert(&program->sets[any]);
+	program->nodes[loop].out1 = step;
+	program->start = fragment.start;
+	program->unanchored = loop;
+
+	return NO_ERROR;
+}
+
+/*
+bytes that no set or anchor can tell apart share a class, so the transition
+table has a column per class instead of per byte. classes are runs of
+neighbouring bytes which is coarser than it could be but cheap to work out.
+*/
+static int regex_classes(const regex_program_t *program, uint8_t classes[256]) {
+	uint8_t boundary[256] = {0};
+	for (int i = 0; i < program->set_count; i++) {
+		for (int c = 1; c < 256; c++) {
+			if (regex_set_has(&program->sets[i], c) !=
+			    regex_set_has(&program->sets[i], c - 1)) {
+				boundary[c] = 1;
+			}
+		}
+	}
+	boundary['\n'] = 1;
+	boundary['\n' + 1] = 1;
+
+	int class = 0;
+	for (int c = 0; c < 256; c++) {
+		class += c > 0 && boundary[c];
+		classes[c] = class;
+	}
+	return class + 1;
+}
+
+static void regex_dfa_flush(regex_dfa_t *dfa) {
+	dfa->state_count = 0;
+	dfa->pool_length = 0;
+	memset(dfa->table, -1, dfa->table_capacity * sizeof(int));
+	for (int i = 0; i < 4; i++) {
+		dfa->starts[i] = -1;
+	}
+	dfa->flushed = 1;
+	dfa->flushes++;
+	debug("flushed the dfa cache");
+}
+
+static void regex_dfa_destroy(regex_dfa_t *dfa) {
+	regex_program_destroy(&dfa->program);
+	free(dfa->states);
+	free(dfa->transitions);
+	free(dfa->pool);
+	free(dfa->table);
+	free(dfa->list);
+	free(dfa->resolved);
+	free(dfa->stack);
+	free(dfa->marks);
+	free(dfa->resolved_marks);
+	memset(dfa, 0, sizeof(regex_dfa_t));
+}
+
+// everything is allocated up front so a search never has to fail
+static result_t regex_dfa_create(
+    regex_dfa_t *dfa, const uint8_t classes[256], int class_count) {
+	int nodes = dfa->program.node_count;
+	memcpy(dfa->classes, classes, 256);
+	dfa->class_count = class_count;
+	dfa->states = malloc(REGEX_CACHE_STATES * sizeof(regex_state_t));
+	dfa->transitions =
+	    malloc((long)REGEX_CACHE_STATES * class_count * sizeof(int));
+	dfa->pool_capacity = REGEX_CACHE_STATES * 16 + nodes;
+	dfa->pool = malloc(dfa->pool_capacity * sizeof(int));
+	dfa->table_capacity = REGEX_CACHE_STATES * 2;
+	dfa->table = malloc(dfa->table_capacity * sizeof(int));
+	dfa->list = malloc(nodes * sizeof(int));
+	dfa->resolved = malloc(nodes * sizeof(int));
+	dfa->stack = malloc((nodes * 2 + 1) * sizeof(int));
+	dfa->marks = calloc(nodes, sizeof(unsigned));
+	dfa->resolved_marks = calloc(nodes, sizeof(unsigned));
+	if (dfa->states == NULL || dfa->transitions == NULL || dfa->pool == NULL ||
+	    dfa->table == NULL || dfa->list == NULL || dfa->resolved == NULL ||
+	    dfa->stack == NULL || dfa->marks == NULL ||
+	    dfa->resolved_marks == NULL) {
+		error("failed to allocate dfa!");
+		return REGEX_ERROR;
+	}
+	dfa->generation = 0;
+	dfa->flushes = 0;
+	regex_dfa_flush(dfa);
+	dfa->flushes = 0;
+	return NO_ERROR;
+}
+
+static void regex_dfa_generation(regex_dfa_t *dfa) {
+	if (++dfa->generation == 0) {
+		memset(dfa->marks, 0, dfa->program.node_count * sizeof(unsigned));
+		memset(
+		    dfa->resolved_marks, 0, dfa->program.node_count * sizeof(unsigned));
+		dfa->generation = 1;
+	}
+}
+
+/*
+adds what node reaches without reading a byte to list, in priority order.
+threads that wait on a byte, unresolved $ checks and the match itself are
+kept. going forwards nothing below a match can win so the list stops there,
+which is returned as 1.
+*/
+static int regex_follow(regex_dfa_t *dfa, int *list, int *count,
+    unsigned *marks, int node, int after_newline, int before_newline) {
+	const regex_node_t *nodes = dfa->program.nodes;
+	int top = 0;
+	dfa->stack[top++] = node;
+	while (top > 0) {
+		int n = dfa->stack[--top];
+		if (marks[n] == dfa->generation) {
+			continue;
+		}
+		marks[n] = dfa->generation;
+		switch (nodes[n].type) {
+		case REGEX_BYTES:
+			list[(*count)++] = n;
+			break;
+		case REGEX_SPLIT:
+			dfa->stack[top++] = nodes[n].out1;
+			dfa->stack[top++] = nodes[n].out;
+			break;
+		case REGEX_EMPTY:
+			dfa->stack[top++] = nodes[n].out;
+			break;
+		case REGEX_AFTER_NEWLINE:
+			if (after_newline) {
+				dfa->stack[top++] = nodes[n].out;
+			}
+			break;
+		case REGEX_BEFORE_NEWLINE:
+			if (before_newline) {
+				dfa->stack[top++] = nodes[n].out;
+			} else {
+				list[(*count)++] = n;
+			}
+			break;
+		case REGEX_MATCH:
+			list[(*count)++] = n;
+			if (!dfa->longest) {
+				return 1;
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+static unsigned regex_hash(const int *list, int count, int flags) {
+	unsigned hash = 2166136261u ^ (unsigned)flags;
+	for (int i = 0; i < count; i++) {
+		hash = (hash ^ (unsigned)list[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static int regex_intern(
+    regex_dfa_t *dfa, const int *list, int count, int flags) {
+	unsigned mask = dfa->table_capacity - 1;
+	unsigned hash = regex_hash(list, count, flags);
+	unsigned slot = hash & mask;
+	while (dfa->table[slot] != -1) {
+		const regex_state_t *state = &dfa->states[dfa->table[slot]];
+		if (state->flags == flags && state->thread_count == count &&
+		    !memcmp(&dfa->pool[state->threads], list, count * sizeof(int))) {
+			return dfa->table[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (dfa->state_count == REGEX_CACHE_STATES ||
+	    dfa->pool_length + count > dfa->pool_capacity) {
+		regex_dfa_flush(dfa);
+		slot = hash & mask;
+	}
+	int index = dfa->state_count++;
+	dfa->states[index] = (regex_state_t){dfa->pool_length, count, flags, -1, 0};
+	memcpy(&dfa->pool[dfa->pool_length], list, count * sizeof(int));
+	dfa->pool_length += count;
+	memset(&dfa->transitions[(long)index * dfa->class_count], -1,
+	    dfa->class_count * sizeof(int));
+	dfa->table[slot] = index;
+	return index;
+}
+
+static int regex_start(regex_dfa_t *dfa, int anchored, int line_start) {
+	line_start = line_start && dfa->program.anchors;
+	int index = anchored * 2 + line_start;
+	if (dfa->starts[index] >= 0) {
+		return dfa->starts[index];
+	}
+
+	regex_dfa_generation(dfa);
+	int count = 0;
+	regex_follow(dfa, dfa->list, &count, dfa->marks,
+	    anchored ? dfa->program.start : dfa->program.unanchored, line_start, 0);
+	int state = regex_intern(
+	    dfa, dfa->list, count, line_start ? REGEX_LINE_START : 0);
+	dfa->states[state].start = !anchored;
+	dfa->starts[index] = state;
+	return state;
+}
+
+// the state after reading c, worked out from the nfa and cached
+static int regex_compute(regex_dfa_t *dfa, int state, unsigned char c) {
+	const regex_node_t *nodes = dfa->program.nodes;
+	const regex_state_t from = dfa->states[state];
+	int after_newline = from.flags & REGEX_LINE_START;
+	regex_dfa_generation(dfa);
+
+	// settle the $ checks against c first, in place so priorities hold
+	int resolved = 0;
+	for (int i = 0; i < from.thread_count; i++) {
+		int n = dfa->pool[from.threads + i];
+		if (nodes[n].type == REGEX_BEFORE_NEWLINE) {
+			if (c == '\n' && regex_follow(dfa, dfa->resolved, &resolved,
+			                     dfa->resolved_marks, nodes[n].out,
+			                     after_newline, 1)) {
+				break;
+			}
+		} else if (dfa->resolved_marks[n] != dfa->generation) {
+			dfa->resolved_marks[n] = dfa->generation;
+			dfa->resolved[resolved++] = n;
+		}
+	}
+
+	int count = 0;
+	int flags = c == '\n' && dfa->program.anchors ? REGEX_LINE_START : 0;
+	for (int i = 0; i < resolved; i++) {
+		const regex_node_t *node = &nodes[dfa->resolved[i]];
+		if (node->type == REGEX_MATCH) {
+			flags |= REGEX_MATCHED;
+			if (!dfa->longest) {
+				break;
+			}
+		} else if (node->type == REGEX_BYTES &&
+		           regex_set_has(&dfa->program.sets[node->set], c) &&
+		           regex_follow(dfa, dfa->list, &count, dfa->marks, node->out,
+		               c == '\n', 0)) {
+			break;
+		}
+	}
+
+	dfa->flushed = 0;
+	int next = regex_intern(dfa, dfa->list, count, flags);
+	if (!dfa->flushed) {
+		dfa->transitions[(long)state * dfa->class_count + dfa->classes[c]] =
+		    next;
+	}
+	return next;
+}
+
+static inline int regex_step(regex_dfa_t *dfa, int state, unsigned char c) {
+	int next =
+	    dfa->transitions[(long)state * dfa->class_count + dfa->classes[c]];
+	return next >= 0 ? next : regex_compute(dfa, state, c);
+}
+
+// whether a match ends at the end of the input in this state
+static int regex_eof(regex_dfa_t *dfa, int state) {
+	regex_state_t *from = &dfa->states[state];
+	if (from->eof >= 0) {
+		return from->eof;
+	}
+	const regex_node_t *nodes = dfa->program.nodes;
+	regex_dfa_generation(dfa);
+	int resolved = 0;
+	for (int i = 0; i < from->thread_count; i++) {
+		int n = dfa->pool[from->threads + i];
+		if (nodes[n].type == REGEX_BEFORE_NEWLINE) {
+			regex_follow(dfa, dfa->resolved, &resolved, dfa->resolved_marks,
+			    nodes[n].out, from->flags & REGEX_LINE_START, 1);
+		} else if (nodes[n].type == REGEX_MATCH &&
+		           dfa->resolved_marks[n] != dfa->generation) {
+			dfa->resolved_marks[n] = dfa->generation;
+			dfa->resolved[resolved++] = n;
+		}
+	}
+	from->eof = 0;
+	for (int i = 0; i < resolved; i++) {
+		from->eof |= nodes[dfa->resolved[i]].type == REGEX_MATCH;
+	}
+	return from->eof;
+}
+
+static int regex_byte_at(const text_buffer_t *buffer, long offset) {
+	const char *text;
+	if (!text_buffer_span_at(buffer, offset, &text)) {
+		return -1;
+	}
+	return (unsigned char)text[0];
+}
+
+/*
+end of the leftmost first match starting at or after offset, -1 if there is
+none. runs over the buffer's own spans, and while it's sitting in the start
+state it skips straight to the next copy of the literal prefix.
+*/
+static long regex_scan_forward(
+    regex_t *regex, const text_buffer_t *buffer, long offset) {
+	regex_dfa_t *dfa = &regex->forward;
+	int skip = regex->prefix_length > 0;
+	int line_start = offset == 0 || regex_byte_at(buffer, offset - 1) == '\n';
+	int state = regex_start(dfa, 0, line_start);
+	long end = -1;
+	long size = text_buffer_size(buffer);
+	long position = offset;
+	while (position < size) {
+		const char *text;
+		long length = text_buffer_span_at(buffer, position, &text);
+		for (long i = 0; i < length; i++) {
+			if (skip && dfa->states[state].start) {
+				const char *found = scan_find(
+				    &text[i], length - i, regex->prefix, regex->prefix_length);
+				if (found != NULL) {
+					i = found - text;
+				} else if (length - regex->prefix_length + 1 > i) {
+					// the prefix could still start here and run into the next
+					// span
+					i = length - regex->prefix_length + 1;
+					if (i >= length) {
+						break;
+					}
+				}
+			}
+			state = regex_step(dfa, state, text[i]);
+			const regex_state_t *next = &dfa->states[state];
+			if (next->flags & REGEX_MATCHED) {
+				end = position + i;
+			}
+			if (!next->thread_count) {
+				return end;
+			}
+		}
+		position += length;
+	}
+	if (regex_eof(dfa, state)) {
+		end = size;
+	}
+	return end;
+}
+
+/*
+walks back from offset with the reverse program, which keeps every thread so
+it finds the furthest start. anchored it runs until no thread is left and
+returns where the longest match starts, unanchored it stops at the first
+start it sees. never looks before limit.
+*/
+static long regex_scan_backward(regex_t *regex, const text_buffer_t *buffer,
+    long offset, long limit, int anchored) {
+	regex_dfa_t *dfa = &regex->reverse;
+	long size = text_buffer_size(buffer);
+	int state = regex_start(dfa, anchored,
+	    offset == size || regex_byte_at(buffer, offset) == '\n');
+	long start = -1;
+	long position = offset;
+	while (position > limit) {
+		const char *text;
+		long length = text_buffer_span_before(buffer, position, &text);
+		if (length > position - limit) {
+			text += length - (position - limit);
+			length = position - limit;
+		}
+		for (long i = length - 1; i >= 0; i--) {
+			state = regex_step(dfa, state, text[i]);
+			const regex_state_t *next = &dfa->states[state];
+			if (next->flags & REGEX_MATCHED) {
+				start = position - length + i + 1;
+				if (!anchored) {
+					return start;
+				}
+			}
+			if (!next->thread_count) {
+				return start;
+			}
+		}
+		position -= length;
+	}
+
+	// a ^ at the limit still has to look at the byte before it
+	if (limit == 0 ? regex_eof(dfa, state)
+	               : dfa->states[regex_step(dfa, state,
+	                                 regex_byte_at(buffer, limit - 1))]
+	                         .flags &
+	                     REGEX_MATCHED) {
+		start = limit;
+	}
+	return start;
+}
+
+// the literal every match has to start with, if the pattern opens with one
+static void regex_prefix(regex_t *regex, const char *pattern, long length) {
+	regex->prefix_length = 0;
+	for (long i = 0; i < length; i++) {
+		char c = pattern[i];
+		if (strchr("\\.[](){}|^$*+?", c) != NULL) {
+			// an optional byte can't be part of the prefix
+			if (strchr("*?{", c) != NULL && regex->prefix_length > 0) {
+				regex->prefix_length--;
+			}
+			if (c == '|') {
+				regex->prefix_length = 0;
+			}
+			return;
+		}
+		regex->prefix[regex->prefix_length++] = c;
+	}
+}
+
+result_t regex_compile(regex_t *regex, const char *pattern, long length) {
+	memset(regex, 0, sizeof(regex_t));
+	int ignore_case = 0;
+	if (length >= 4 && !memcmp(pattern, "(?i)", 4)) {
+		ignore_case = 1;
+		pattern += 4;
+		length -= 4;
+	}
+
+	result_t res = regex_program_create(
+	    &regex->forward.program, pattern, length, ignore_case, 0);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	res = regex_program_create(
+	    &regex->reverse.program, pattern, length, ignore_case, 1);
+	if (res != NO_ERROR) {
+		regex_destroy(regex);
+		return res;
+	}
+	regex->reverse.longest = 1;
+
+	uint8_t classes[256];
+	int class_count = regex_classes(&regex->forward.program, classes);
+	regex->prefix = malloc(length + 1);
+	if (regex->prefix == NULL ||
+	    regex_dfa_create(&regex->forward, classes, class_count) != NO_ERROR ||
+	    regex_dfa_create(&regex->reverse, classes, class_count) != NO_ERROR) {
+		regex_destroy(regex);
+		return REGEX_ERROR;
+	}
+	if (!ignore_case && !memchr(pattern, '|', length)) {
+		regex_prefix(regex, pattern, length);
+	}
+	debug("compiled %ld byte pattern to %d nodes, %d byte classes, prefix %ld",
+	    length, regex->forward.program.node_count, class_count,
+	    regex->prefix_length);
+
+	return NO_ERROR;
+}
+
+void regex_destroy(regex_t *regex) {
+	regex_dfa_destroy(&regex->forward);
+	regex_dfa_destroy(&regex->reverse);
+	free(regex->prefix);
+	regex->prefix = NULL;
+	regex->prefix_length = 0;
+}
+
+int regex_search_next(regex_t *regex, const text_buffer_t *buffer,
+    long offset, long *start, long *end) {
+	if (offset < 0 || offset > text_buffer_size(buffer)) {
+		return 0;
+	}
+	*end = regex_scan_forward(regex, buffer, offset);
+	if (*end < 0) {
+		return 0;
+	}
+	*start = regex_scan_backward(regex, buffer, *end, offset, 1);
+	return *start >= 0;
+}
+
+int regex_search_previous(regex_t *regex, const text_buffer_t *buffer,
+    long offset, long *start, long *end) {
+	if (offset < 0 || offset > text_buffer_size(buffer)) {
+		return 0;
+	}
+	*start = regex_scan_backward(regex, buffer, offset, 0, 0);
+	if (*start < 0) {
+		return 0;
+	}
+	*end = regex_scan_forward(regex, buffer, *start);
+	return *end >= 0;
+}
@@ -0,0 +1,129 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+#pragma once
+
+#include "result.h"
+#include "text_buffer.h"
+
+#include <stdint.h>
+
+// dfa states kept per direction, the cache is thrown away and rebuilt from
+// the current state once it fills up
+#define REGEX_CACHE_STATES 1024
+// bigger patterns are refused so a state can't grow past the scratch space
+#define REGEX_MAX_NODES 8192
+#define REGEX_MAX_REPEAT 1000
+
+typedef struct regex_node_t {
+	int type;
+	int out;
+	// second branch of a split, out is the preferred one
+	int out1;
+	int set;
+} regex_node_t;
+
+typedef struct regex_set_t {
+	uint32_t bits[8];
+} regex_set_t;
+
+/*
+thompson nfa for one direction. the reverse program is the same pattern with
+every concatenation flipped, it's what finds where a match starts once the
+forward one has found where it ends.
+*/
+typedef struct regex_program_t {
+	regex_node_t *nodes;
+	int node_count;
+	int node_capacity;
+	regex_set_t *sets;
+	int set_count;
+	int set_capacity;
+	int start;
+	// start with a lazy any byte loop in front, for searching
+	int unanchored;
+	int anchors;
+} regex_program_t;
+
+typedef struct regex_state_t {
+	int threads;
+	int thread_count;
+	int flags;
+	// whether the input ending here matches, -1 until someone asks
+	int eof;
+	// the unanchored start, where the literal prefix can be skipped to
+	int start;
+} regex_state_t;
+
+/*
+a dfa built one transition at a time while scanning. a state is the ordered
+list of nfa threads alive at a position, so the forward direction keeps
+leftmost first priorities and drops everything below a match. the reverse
+direction keeps every thread to find the longest match. states are
+interned in a fixed cache, when it's full everything is flushed and scanning
+carries on from the state it was in, so memory is bounded and a pattern that
+explodes into states only costs an nfa step per byte instead of freezing.
+*/
+typedef struct regex_dfa_t {
+	regex_program_t program;
+	int longest;
+	uint8_t classes[256];
+	int class_count;
+
+	regex_state_t *states;
+	int state_count;
+	int *transitions;
+	int *pool;
+	int pool_length;
+	int pool_capacity;
+	int *table;
+	int table_capacity;
+	int starts[4];
+	int flushed;
+	long flushes;
+
+	int *list;
+	int *resolved;
+	int *stack;
+	unsigned *marks;
+	unsigned *resolved_marks;
+	unsigned generation;
+} regex_dfa_t;
+
+/*
+supports literals, ., [] classes with ranges, \d \w \s and their negations,
+groups, |, * + ? and {m,n} with lazy variants, ^ and $ at line boundaries and
+a leading (?i) for ascii case folding. matching is on bytes.
+not thread safe, the dfa cache is filled in by the searches.
+*/
+typedef struct regex_t {
+	regex_dfa_t forward;
+	regex_dfa_t reverse;
+	// literal every match starts with, empty if there isn't one
+	char *prefix;
+	long prefix_length;
+} regex_t;
+
+result_t regex_compile(regex_t *regex, const char *pattern, long length);
+void regex_destroy(regex_t *regex);
+
+// leftmost match starting at or after offset, 0 if there is none
+int regex_search_next(regex_t *regex, const text_buffer_t *buffer,
+    long offset, long *start, long *end);
+// the match starting closest before offset that ends at or before it, 0 if
+// there is none
+int regex_search_previous(regex_t *regex, const text_buffer_t *buffer,
+    long offset, long *start, long *end);
@@ -117,9 +117,18 @@ int render_object_load_font(render_object_t *object, char_glyph_t *characters,
 	}
 
 	FT_Set_Pixel_Sizes(face, 0, font_size);
+	// a font without U+FFFD gives its missing glyph box instead
+	uint32_t codes[RENDER_OBJECT_GLYPHS];
+	int code_count = 0;
+	for (uint32_t c = ' '; c <= '~'; ++c) {
+		codes[code_count++] = c;
+	}
+	codes[code_count++] = 0xFFFD;
+	memset(characters, 0, RENDER_OBJECT_GLYPHS * sizeof(char_glyph_t));
+
 	uint32_t width = 0, height = 0;
-	for (uint8_t c = ' '; c < '~'; ++c) {
-		if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+	for (int i = 0; i < code_count; ++i) {
+		if (FT_Load_Char(face, codes[i], FT_LOAD_RENDER)) {
 			error("failed to load character");
 			continue;
 		}
@@ -144,8 +153,9 @@ int render_object_load_font(render_object_t *object, char_glyph_t *characters,
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	ivec2_t position = {{0}};
-	for (uint8_t c = ' '; c <= '~'; ++c) {
-		debug("loading character %c", c);
+	for (int i = 0; i < code_count; ++i) {
+		uint32_t c = codes[i];
+		debug("loading character %u", c);
 		if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
 			error("failed to load character");
 			continue;
@@ -174,7 +184,7 @@ int render_object_load_font(render_object_t *object, char_glyph_t *characters,
 		    glyph.start.x, glyph.start.y, glyph.end.x, glyph.end.y, glyph.size.x,
 		    glyph.size.y, glyph.bearing.x, glyph.bearing.y);
 
-		characters[c] = glyph;
+		characters[c < 128 ? c : RENDER_OBJECT_REPLACEMENT] = glyph;
 		if (position.x == width * 9) {
 			position.y += height;
 			position.x = 0;
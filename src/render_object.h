@@ -56,6 +56,11 @@ typedef struct char_glyph_t {
 	lvec2_t advance;
 } char_glyph_t;
 
+// printable ascii by its own code, and U+FFFD after it for everything else.
+// the rest of the table is empty glyphs.
+#define RENDER_OBJECT_REPLACEMENT 128
+#define RENDER_OBJECT_GLYPHS 129
+
 void buffer_layout_create(buffer_layout_t *layout);
 void buffer_layout_load(buffer_layout_t *layout, buffer_element_t element);
 
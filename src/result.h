@@ -26,6 +26,7 @@ typedef enum result_t {
   WINDOWING_ERROR,
   OPENGL_ERROR,
   TEXT_BUFFER_ERROR,
+  REGEX_ERROR,
 } result_t;
 
 void print_result(result_t result);
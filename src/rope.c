@@ -0,0 +1,911 @@
+#include "rope.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// bulk loaded nodes are left partly empty so the first edits don't split them
+#define ROPE_LEAF_FILL (ROPE_LEAF_SIZE * 3 / 4)
+#define ROPE_BRANCH_FILL (ROPE_BRANCH_SIZE * 3 / 4)
+// leaves filled by each readv while loading, the most linux takes at once
+#define ROPE_LOAD_VECTORS 1024
+
+static rope_metrics_t rope_measure(const char *text, long length) {
+	return (rope_metrics_t){length, scan_count(text, '\n', length),
+	    scan_codepoints(text, length)};
+}
+
+static void rope_metrics_add(rope_metrics_t *metrics, rope_metrics_t other) {
+	metrics->bytes += other.bytes;
+	metrics->newlines += other.newlines;
+	metrics->codepoints += other.codepoints;
+}
+
+static void rope_metrics_subtract(
+    rope_metrics_t *metrics, rope_metrics_t other) {
+	metrics->bytes -= other.bytes;
+	metrics->newlines -= other.newlines;
+	metrics->codepoints -= other.codepoints;
+}
+
+static rope_node_t *rope_leaf_create(const char *text, long length) {
+	rope_node_t *node = malloc(sizeof(rope_node_t));
+	if (node == NULL) {
+		return NULL;
+	}
+	atomic_init(&node->references, 1);
+	node->leaf = 1;
+	node->count = 0;
+	memcpy(node->text, text, length);
+	node->metrics = rope_measure(text, length);
+	return node;
+}
+
+// a whole node even though a branch only uses its children, anything smaller
+// can't be read through rope_node_t. branches are a sixteenth of the leaves.
+static rope_node_t *rope_branch_create(void) {
+	rope_node_t *node = malloc(sizeof(rope_node_t));
+	if (node == NULL) {
+		return NULL;
+	}
+	atomic_init(&node->references, 1);
+	node->leaf = 0;
+	node->count = 0;
+	node->metrics = (rope_metrics_t){0, 0, 0};
+	return node;
+}
+
+void rope_node_release(rope_node_t *node) {
+	if (atomic_fetch_sub(&node->references, 1) != 1) {
+		return;
+	}
+	if (!node->leaf) {
+		for (int i = 0; i < node->count; i++) {
+			rope_node_release(node->children[i]);
+		}
+	}
+	free(node);
+}
+
+// for a branch whose children were just moved into another node. if nobody
+// else holds it the children simply changed owner, otherwise they are shared
+// from now on
+static void rope_node_absorb(rope_node_t *node) {
+	if (atomic_load(&node->references) == 1) {
+		free(node);
+		return;
+	}
+	for (int i = 0; i < node->count; i++) {
+		atomic_fetch_add(&node->children[i]->references, 1);
+	}
+	rope_node_release(node);
+}
+
+// makes sure the node in slot can be written to, copying it if it's shared
+static result_t rope_node_unshare(rope_node_t **slot) {
+	rope_node_t *node = *slot;
+	if (atomic_load(&node->references) == 1) {
+		return NO_ERROR;
+	}
+
+	rope_node_t *copy;
+	if (node->leaf) {
+		copy = rope_leaf_create(node->text, node->metrics.bytes);
+	} else {
+		copy = rope_branch_create();
+		if (copy != NULL) {
+			memcpy(copy->children, node->children,
+			    node->count * sizeof(rope_node_t *));
+			copy->count = node->count;
+			copy->metrics = node->metrics;
+			for (int i = 0; i < copy->count; i++) {
+				atomic_fetch_add(&copy->children[i]->references, 1);
+			}
+		}
+	}
+	if (copy == NULL) {
+		error("failed to copy shared rope node!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	rope_node_release(node);
+	*slot = copy;
+	return NO_ERROR;
+}
+
+static void rope_branch_measure(rope_node_t *node) {
+	node->metrics = (rope_metrics_t){0, 0, 0};
+	for (int i = 0; i < node->count; i++) {
+		rope_metrics_add(&node->metrics, node->children[i]->metrics);
+	}
+}
+
+static void rope_branch_insert_child(
+    rope_node_t *node, int index, rope_node_t *child) {
+	memmove(&node->children[index + 1], &node->children[index],
+	    (node->count - index) * sizeof(rope_node_t *));
+	node->children[index] = child;
+	node->count++;
+}
+
+static void rope_branch_remove_child(rope_node_t *node, int index) {
+	memmove(&node->children[index], &node->children[index + 1],
+	    (node->count - index - 1) * sizeof(rope_node_t *));
+	node->count--;
+}
+
+// insert at most ROPE_LEAF_SIZE bytes below node, if the node had to split
+// the new right half is returned for the parent to adopt
+static rope_node_t *rope_node_insert(rope_node_t *node, long offset,
+    const char *data, long length, rope_metrics_t added, result_t *res) {
+	if (node->leaf) {
+		long bytes = node->metrics.bytes;
+		if (bytes + length <= ROPE_LEAF_SIZE) {
+			memmove(&node->text[offset + length], &node->text[offset],
+			    bytes - offset);
+			memcpy(&node->text[offset], data, length);
+			rope_metrics_add(&node->metrics, added);
+			return NULL;
+		}
+
+		char combined[ROPE_LEAF_SIZE * 2];
+		memcpy(combined, node->text, offset);
+		memcpy(&combined[offset], data, length);
+		memcpy(&combined[offset + length], &node->text[offset], bytes - offset);
+
+		long total = bytes + length;
+		long half = total / 2;
+		rope_node_t *sibling = rope_leaf_create(&combined[half], total - half);
+		if (sibling == NULL) {
+			error("failed to allocate rope leaf!");
+			*res = TEXT_BUFFER_ERROR;
+			return NULL;
+		}
+		memcpy(node->text, combined, half);
+		node->metrics = rope_measure(node->text, half);
+		return sibling;
+	}
+
+	int index = 0;
+	while (index < node->count - 1 &&
+	       offset > node->children[index]->metrics.bytes) {
+		offset -= node->children[index]->metrics.bytes;
+		index++;
+	}
+
+	if (rope_node_unshare(&node->children[index]) != NO_ERROR) {
+		*res = TEXT_BUFFER_ERROR;
+		return NULL;
+	}
+	rope_node_t *child = node->children[index];
+	rope_node_t *split =
+	    rope_node_insert(child, offset, data, length, added, res);
+	if (split == NULL) {
+		if (*res == NO_ERROR) {
+			rope_metrics_add(&node->metrics, added);
+		} else {
+			rope_branch_measure(node);
+		}
+		return NULL;
+	}
+
+	if (node->count < ROPE_BRANCH_SIZE) {
+		rope_branch_insert_child(node, index + 1, split);
+		rope_metrics_add(&node->metrics, added);
+		return NULL;
+	}
+
+	rope_node_t *sibling = rope_branch_create();
+	if (sibling == NULL) {
+		error("failed to allocate rope branch!");
+		*res = TEXT_BUFFER_ERROR;
+		// keep the text reachable by giving up the split
+		rope_node_release(split);
+		rope_branch_measure(node);
+		return NULL;
+	}
+
+	rope_node_t *children[ROPE_BRANCH_SIZE + 1];
+	memcpy(children, node->children, node->count * sizeof(rope_node_t *));
+	memmove(&children[index + 2], &children[index + 1],
+	    (node->count - index - 1) * sizeof(rope_node_t *));
+	children[index + 1] = split;
+
+	int total = node->count + 1;
+	int half = total / 2;
+	memcpy(node->children, children, half * sizeof(rope_node_t *));
+	node->count = half;
+	memcpy(sibling->children, &children[half],
+	    (total - half) * sizeof(rope_node_t *));
+	sibling->count = total - half;
+
+	rope_branch_measure(node);
+	rope_branch_measure(sibling);
+	return sibling;
+}
+
+static int rope_node_mergeable(
+    const rope_node_t *left, const rope_node_t *right) {
+	if (left->leaf) {
+		return left->metrics.bytes + right->metrics.bytes <= ROPE_LEAF_SIZE &&
+		       (left->metrics.bytes < ROPE_LEAF_SIZE / 2 ||
+		           right->metrics.bytes < ROPE_LEAF_SIZE / 2);
+	}
+	return left->count + right->count <= ROPE_BRANCH_SIZE &&
+	       (left->count < ROPE_BRANCH_SIZE / 2 ||
+	           right->count < ROPE_BRANCH_SIZE / 2);
+}
+
+// merge small neighbours so deletes can't leave a trail of tiny nodes
+static void rope_branch_rebalance(rope_node_t *node) {
+	int i = 0;
+	while (i < node->count - 1) {
+		if (!rope_node_mergeable(node->children[i], node->children[i + 1]) ||
+		    rope_node_unshare(&node->children[i]) != NO_ERROR) {
+			i++;
+			continue;
+		}
+
+		rope_node_t *left = node->children[i];
+		rope_node_t *right = node->children[i + 1];
+		if (left->leaf) {
+			memcpy(&left->text[left->metrics.bytes], right->text,
+			    right->metrics.bytes);
+			rope_metrics_add(&left->metrics, right->metrics);
+			rope_node_release(right);
+		} else {
+			memcpy(&left->children[left->count], right->children,
+			    right->count * sizeof(rope_node_t *));
+			left->count += right->count;
+			rope_metrics_add(&left->metrics, right->metrics);
+			rope_node_absorb(right);
+		}
+		rope_branch_remove_child(node, i + 1);
+	}
+}
+
+// node must not be shared. if a shared child can't be copied the delete stops
+// there, the tree stays consistent but only part of the range is gone.
+static result_t rope_node_delete(
+    rope_node_t *node, long offset, long length) {
+	if (node->leaf) {
+		rope_metrics_subtract(
+		    &node->metrics, rope_measure(&node->text[offset], length));
+		memmove(&node->text[offset], &node->text[offset + length],
+		    node->metrics.bytes - offset);
+		return NO_ERROR;
+	}
+
+	result_t res = NO_ERROR;
+	long start = 0;
+	int i = 0;
+	while (i < node->count && length > 0) {
+		rope_node_t *child = node->children[i];
+		long bytes = child->metrics.bytes;
+		if (offset >= start + bytes) {
+			start += bytes;
+			i++;
+			continue;
+		}
+
+		long child_offset = offset - start;
+		long child_length = bytes - child_offset;
+		if (child_length > length) {
+			child_length = length;
+		}
+		if (child_length == bytes) {
+			rope_node_release(child);
+			rope_branch_remove_child(node, i);
+		} else {
+			res = rope_node_unshare(&node->children[i]);
+			if (res == NO_ERROR) {
+				child = node->children[i];
+				res = rope_node_delete(child, child_offset, child_length);
+			}
+			if (res != NO_ERROR) {
+				break;
+			}
+			start += child->metrics.bytes;
+			i++;
+		}
+		length -= child_length;
+	}
+
+	rope_branch_rebalance(node);
+	rope_branch_measure(node);
+	return res;
+}
+
+// drop levels that only have a single child left after a delete
+static result_t rope_collapse(rope_t *rope) {
+	while (!rope->root->leaf && rope->root->count == 1) {
+		rope_node_t *child = rope->root->children[0];
+		rope_node_absorb(rope->root);
+		rope->root = child;
+	}
+	if (!rope->root->leaf && rope->root->count == 0) {
+		rope_node_release(rope->root);
+		rope->root = rope_leaf_create("", 0);
+		if (rope->root == NULL) {
+			error("failed to allocate rope leaf!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	return NO_ERROR;
+}
+
+// stacks a level of leaves into a tree one level at a time and frees level
+static result_t rope_build(rope_t *rope, rope_node_t **level, long count) {
+	while (count > 1) {
+		long parents = (count + ROPE_BRANCH_FILL - 1) / ROPE_BRANCH_FILL;
+		for (long i = 0; i < parents; i++) {
+			rope_node_t *parent = rope_branch_create();
+			if (parent == NULL) {
+				error("failed to allocate rope branch!");
+				for (long j = 0; j < i; j++) {
+					rope_node_release(level[j]);
+				}
+				for (long j = i * ROPE_BRANCH_FILL; j < count; j++) {
+					rope_node_release(level[j]);
+				}
+				free(level);
+				return TEXT_BUFFER_ERROR;
+			}
+			for (long j = i * ROPE_BRANCH_FILL;
+			     j < count && j < (i + 1) * ROPE_BRANCH_FILL; j++) {
+				parent->children[parent->count++] = level[j];
+			}
+			rope_branch_measure(parent);
+			level[i] = parent;
+		}
+		count = parents;
+	}
+
+	rope->root = level[0];
+	free(level);
+
+	return NO_ERROR;
+}
+
+result_t rope_create(rope_t *rope, const char *data, long length) {
+	rope->cursor = 0;
+	rope->root = NULL;
+
+	// build bottom up, one level at a time, so loading is O(n)
+	long count = length == 0 ? 1 : (length + ROPE_LEAF_FILL - 1) / ROPE_LEAF_FILL;
+	rope_node_t **level = malloc(count * sizeof(rope_node_t *));
+	if (level == NULL) {
+		error("failed to allocate rope!");
+		return TEXT_BUFFER_ERROR;
+	}
+	for (long i = 0; i < count; i++) {
+		long offset = i * ROPE_LEAF_FILL;
+		long size = length - offset < ROPE_LEAF_FILL ? length - offset
+		                                             : ROPE_LEAF_FILL;
+		level[i] = rope_leaf_create(&data[offset], size);
+		if (level[i] == NULL) {
+			error("failed to allocate rope leaf!");
+			for (long j = 0; j < i; j++) {
+				rope_node_release(level[j]);
+			}
+			free(level);
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+
+	result_t res = rope_build(rope, level, count);
+	if (res == NO_ERROR) {
+		debug("built rope of %ld bytes", length);
+	}
+	return res;
+}
+
+// reads fd straight into freshly allocated leaves, measuring each one as it
+// fills, so the text is only ever touched while it's in cache
+result_t rope_load(rope_t *rope, file_io_t *io, int fd, long length) {
+	if (length == 0) {
+		return rope_create(rope, "", 0);
+	}
+	rope->cursor = 0;
+	rope->root = NULL;
+
+	long count = (length + ROPE_LEAF_FILL - 1) / ROPE_LEAF_FILL;
+	rope_node_t **level = malloc(count * sizeof(rope_node_t *));
+	if (level == NULL) {
+		error("failed to allocate rope!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	long loaded = 0;
+	long leaf = 0;
+	long allocated = 0;
+	while (1) {
+		// every leaf the text read so far covers completely
+		while (leaf < allocated) {
+			long start = leaf * ROPE_LEAF_FILL;
+			long end = length - start < ROPE_LEAF_FILL ? length
+			                                           : start + ROPE_LEAF_FILL;
+			if (end > loaded) {
+				break;
+			}
+			level[leaf]->metrics = rope_measure(level[leaf]->text, end - start);
+			leaf++;
+		}
+		if (loaded == length) {
+			break;
+		}
+
+		// a batch at a time, so faulting the leaves in overlaps with the kernel
+		// reading ahead
+		long batch = count - leaf < ROPE_LOAD_VECTORS ? count
+		                                              : leaf + ROPE_LOAD_VECTORS;
+		for (; allocated < batch; allocated++) {
+			level[allocated] = rope_leaf_create("", 0);
+			if (level[allocated] == NULL) {
+				error("failed to allocate rope leaf!");
+				break;
+			}
+		}
+		if (allocated < batch) {
+			break;
+		}
+
+		struct iovec vectors[ROPE_LOAD_VECTORS];
+		int vector_count = 0;
+		for (long i = leaf; i < batch; i++) {
+			long start = i * ROPE_LEAF_FILL;
+			long end = length - start < ROPE_LEAF_FILL ? length
+			                                           : start + ROPE_LEAF_FILL;
+			long from = loaded > start ? loaded : start;
+			vectors[vector_count++] = (struct iovec){
+			    &level[i]->text[from - start], end - from};
+		}
+		long bytes;
+		if (file_io_readv(io, fd, vectors, vector_count, loaded, &bytes) !=
+		    NO_ERROR) {
+			error("failed to read into rope!");
+			break;
+		}
+		loaded += bytes;
+		// the file came up short, the leaves past its end go unused
+		if (bytes == 0) {
+			long used =
+			    loaded == 0 ? 1 : (loaded + ROPE_LEAF_FILL - 1) / ROPE_LEAF_FILL;
+			for (long i = used; i < allocated; i++) {
+				rope_node_release(level[i]);
+			}
+			count = used;
+			allocated = allocated < used ? allocated : used;
+			length = loaded;
+		}
+	}
+	if (loaded < length) {
+		for (long i = 0; i < allocated; i++) {
+			rope_node_release(level[i]);
+		}
+		free(level);
+		return TEXT_BUFFER_ERROR;
+	}
+
+	result_t res = rope_build(rope, level, count);
+	if (res == NO_ERROR) {
+		debug("loaded rope of %ld bytes", length);
+	}
+	return res;
+}
+
+void rope_destroy(rope_t *rope) {
+	if (rope->root != NULL) {
+		rope_node_release(rope->root);
+	}
+	rope->root = NULL;
+	rope->cursor = 0;
+}
+
+long rope_size(const rope_t *rope) {
+	return rope->root == NULL ? 0 : rope->root->metrics.bytes;
+}
+
+long rope_line_count(const rope_t *rope) {
+	return rope->root == NULL ? 1 : rope->root->metrics.newlines + 1;
+}
+
+// offset of the first byte of a zero based line, -1 past the last line
+long rope_line_start(const rope_t *rope, long line) {
+	if (line == 0) {
+		return 0;
+	}
+	if (rope->root == NULL || line > rope->root->metrics.newlines) {
+		return -1;
+	}
+
+	const rope_node_t *node = rope->root;
+	long offset = 0;
+	while (!node->leaf) {
+		for (int i = 0; i < node->count; i++) {
+			const rope_node_t *child = node->children[i];
+			if (line <= child->metrics.newlines) {
+				node = child;
+				break;
+			}
+			line -= child->metrics.newlines;
+			offset += child->metrics.bytes;
+		}
+	}
+
+	const char *text = node->text;
+	const char *end = text + node->metrics.bytes;
+	while (text < end) {
+		const char *newline = scan_memchr(text, '\n', end - text);
+		if (--line == 0) {
+			return offset + (newline - node->text) + 1;
+		}
+		text = newline + 1;
+	}
+
+	return -1;
+}
+
+// zero based line containing offset
+long rope_line_of(const rope_t *rope, long offset) {
+	if (rope->root == NULL) {
+		return 0;
+	}
+
+	const rope_node_t *node = rope->root;
+	long line = 0;
+	while (!node->leaf) {
+		int i = 0;
+		while (i < node->count - 1 && offset >= node->children[i]->metrics.bytes) {
+			offset -= node->children[i]->metrics.bytes;
+			line += node->children[i]->metrics.newlines;
+			i++;
+		}
+		node = node->children[i];
+	}
+
+	if (offset > node->metrics.bytes) {
+		offset = node->metrics.bytes;
+	}
+	return line + scan_count(node->text, '\n', offset);
+}
+
+result_t rope_move(rope_t *rope, long distance) {
+	if (!distance) {
+		error("distance must be non zero!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (rope->cursor + distance > rope_size(rope) ||
+	    rope->cursor + distance < 0) {
+		error("distance must be within the bounds of the buffer's current size!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	rope->cursor += distance;
+	debug("cursor: %ld, current size: %ld", rope->cursor, rope_size(rope));
+
+	return NO_ERROR;
+}
+
+static long rope_line_end(const rope_t *rope, long line) {
+	long next = rope_line_start(rope, line + 1);
+	return next < 0 ? rope_size(rope) : next - 1;
+}
+
+// codepoints before offset, from the counts every node keeps
+static long rope_codepoints_before(const rope_t *rope, long offset) {
+	if (rope->root == NULL) {
+		return 0;
+	}
+
+	const rope_node_t *node = rope->root;
+	long codepoints = 0;
+	while (!node->leaf) {
+		int i = 0;
+		while (i < node->count - 1 &&
+		       offset >= node->children[i]->metrics.bytes) {
+			offset -= node->children[i]->metrics.bytes;
+			codepoints += node->children[i]->metrics.codepoints;
+			i++;
+		}
+		node = node->children[i];
+	}
+
+	if (offset > node->metrics.bytes) {
+		offset = node->metrics.bytes;
+	}
+	return codepoints + scan_codepoints(node->text, offset);
+}
+
+// offset of the zero based codepoint, the size of the rope past the last one
+static long rope_codepoint_offset(const rope_t *rope, long codepoint) {
+	if (rope->root == NULL || codepoint >= rope->root->metrics.codepoints) {
+		return rope_size(rope);
+	}
+
+	const rope_node_t *node = rope->root;
+	long offset = 0;
+	while (!node->leaf) {
+		int i = 0;
+		while (i < node->count - 1 &&
+		       codepoint >= node->children[i]->metrics.codepoints) {
+			codepoint -= node->children[i]->metrics.codepoints;
+			offset += node->children[i]->metrics.bytes;
+			i++;
+		}
+		node = node->children[i];
+	}
+
+	return offset +
+	       scan_codepoint_offset(node->text, node->metrics.bytes, codepoint);
+}
+
+// columns are codepoints, so moving between lines of multibyte text keeps to
+// the same character
+static long rope_column_offset(
+    const rope_t *rope, long start, long end, long column) {
+	long codepoint = rope_codepoints_before(rope, start) + column;
+	long offset = rope_codepoint_offset(rope, codepoint);
+	return offset < end ? offset : end;
+}
+
+result_t rope_ascend(rope_t *rope, long *column) {
+	long line = rope_line_of(rope, rope->cursor);
+	if (line == 0) {
+		trace("end of buffer");
+		return NO_ERROR;
+	}
+
+	if (*column < 0) {
+		*column = rope_codepoints_before(rope, rope->cursor) -
+		          rope_codepoints_before(rope, rope_line_start(rope, line));
+	}
+	long start = rope_line_start(rope, line - 1);
+	rope->cursor =
+	    rope_column_offset(rope, start, rope_line_end(rope, line - 1), *column);
+
+	return NO_ERROR;
+}
+
+result_t rope_descend(rope_t *rope, long *column) {
+	long line = rope_line_of(rope, rope->cursor);
+	if (line + 1 >= rope_line_count(rope)) {
+		trace("end of buffer");
+		return NO_ERROR;
+	}
+
+	if (*column < 0) {
+		*column = rope_codepoints_before(rope, rope->cursor) -
+		          rope_codepoints_before(rope, rope_line_start(rope, line));
+	}
+	long start = rope_line_start(rope, line + 1);
+	rope->cursor =
+	    rope_column_offset(rope, start, rope_line_end(rope, line + 1), *column);
+
+	return NO_ERROR;
+}
+
+result_t rope_goto_line(rope_t *rope, long line) {
+	long start = rope_line_start(rope, line);
+	if (start < 0) {
+		error("line must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	rope->cursor = start;
+
+	return NO_ERROR;
+}
+
+result_t rope_append(rope_t *rope, char c) {
+	if (!c) {
+		error("character must non null!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	result_t res = rope_insert_at(rope, rope->cursor, &c, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	rope->cursor++;
+
+	return NO_ERROR;
+}
+
+result_t rope_remove(rope_t *rope) {
+	if (rope->cursor == 0) {
+		error("no character before the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	result_t res = rope_delete_at(rope, rope->cursor - 1, 1);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	rope->cursor--;
+
+	return NO_ERROR;
+}
+
+result_t rope_insert(rope_t *rope, const char *data, long length) {
+	result_t res = rope_insert_at(rope, rope->cursor, data, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	rope->cursor += length;
+
+	return NO_ERROR;
+}
+
+result_t rope_delete(rope_t *rope) {
+	if (rope->cursor == rope_size(rope)) {
+		error("no character after the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+	return rope_delete_at(rope, rope->cursor, 1);
+}
+
+// the cursor ends up at start, same as the split buffer
+result_t rope_delete_range(rope_t *rope, long start, long end) {
+	if (start > end) {
+		error("range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	result_t res = rope_delete_at(rope, start, end - start);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	rope->cursor = start;
+
+	return NO_ERROR;
+}
+
+result_t rope_insert_at(
+    rope_t *rope, long offset, const char *data, long length) {
+	if (offset < 0 || offset > rope_size(rope)) {
+		error("insert offset must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	// the tree only ever takes a leaf's worth at a time, big inserts are fed in
+	// as consecutive chunks
+	while (length > 0) {
+		long chunk = length < ROPE_LEAF_SIZE ? length : ROPE_LEAF_SIZE;
+		result_t res = rope_node_unshare(&rope->root);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		rope_node_t *split = rope_node_insert(
+		    rope->root, offset, data, chunk, rope_measure(data, chunk), &res);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		if (split != NULL) {
+			rope_node_t *root = rope_branch_create();
+			if (root == NULL) {
+				error("failed to allocate rope branch!");
+				return TEXT_BUFFER_ERROR;
+			}
+			root->children[0] = rope->root;
+			root->children[1] = split;
+			root->count = 2;
+			rope_branch_measure(root);
+			rope->root = root;
+		}
+		offset += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+
+	return NO_ERROR;
+}
+
+result_t rope_delete_at(rope_t *rope, long offset, long length) {
+	if (offset < 0 || length < 0 || offset + length > rope_size(rope)) {
+		error("delete range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (length == 0) {
+		return NO_ERROR;
+	}
+
+	result_t res = rope_node_unshare(&rope->root);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	res = rope_node_delete(rope->root, offset, length);
+	result_t collapsed = rope_collapse(rope);
+	return res != NO_ERROR ? res : collapsed;
+}
+
+long rope_span_at(const rope_t *rope, long offset, const char **text) {
+	if (rope->root == NULL || offset < 0 || offset >= rope->root->metrics.bytes) {
+		*text = NULL;
+		return 0;
+	}
+
+	const rope_node_t *node = rope->root;
+	while (!node->leaf) {
+		int i = 0;
+		while (offset >= node->children[i]->metrics.bytes) {
+			offset -= node->children[i]->metrics.bytes;
+			i++;
+		}
+		node = node->children[i];
+	}
+
+	*text = &node->text[offset];
+	return node->metrics.bytes - offset;
+}
+
+// contiguous text ending at offset, back to the start of its leaf
+long rope_span_before(const rope_t *rope, long offset, const char **text) {
+	if (rope->root == NULL || offset <= 0 || offset > rope->root->metrics.bytes) {
+		*text = NULL;
+		return 0;
+	}
+
+	const rope_node_t *node = rope->root;
+	offset--;
+	while (!node->leaf) {
+		int i = 0;
+		while (offset >= node->children[i]->metrics.bytes) {
+			offset -= node->children[i]->metrics.bytes;
+			i++;
+		}
+		node = node->children[i];
+	}
+	*text = node->text;
+	return offset + 1;
+}
+
+char *rope_to_string(rope_t *rope) {
+	long size = rope_size(rope);
+	if (size == 0) {
+		return NULL;
+	}
+	char *string = malloc(size + 1);
+	if (string == NULL) {
+		return NULL;
+	}
+
+	long offset = 0;
+	while (offset < size) {
+		const char *text;
+		long length = rope_span_at(rope, offset, &text);
+		memcpy(&string[offset], text, length);
+		offset += length;
+	}
+	string[size] = '\0';
+
+	return string;
+}
+
+rope_node_t *rope_share(rope_t *rope) {
+	atomic_fetch_add(&rope->root->references, 1);
+	return rope->root;
+}
+
+// fills spans with the leaves under node in order, returns how many there are
+// even if that's more than capacity
+long rope_node_spans(
+    const rope_node_t *node, text_span_t *spans, long capacity) {
+	if (node->leaf) {
+		if (capacity > 0 && node->metrics.bytes > 0) {
+			spans[0] = (text_span_t){node->text, node->metrics.bytes};
+		}
+		return node->metrics.bytes > 0;
+	}
+
+	long count = 0;
+	for (int i = 0; i < node->count; i++) {
+		long remaining = capacity > count ? capacity - count : 0;
+		count += rope_node_spans(
+		    node->children[i], remaining ? &spans[count] : NULL, remaining);
+	}
+	return count;
+}
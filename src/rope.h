@@ -0,0 +1,95 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "file_io.h"
+#include "result.h"
+#include "text_span.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROPE_LEAF_SIZE 2048
+#define ROPE_BRANCH_SIZE 16
+
+typedef struct rope_metrics_t {
+	long bytes;
+	long newlines;
+	long codepoints;
+} rope_metrics_t;
+
+/*
+a B-tree of text chunks, every leaf sits at the same depth and every node
+caches the metrics of its subtree so offsets, lines and codepoints can all be
+found in O(log n) without touching the text in between.
+
+nodes are reference counted so snapshots can share them. a node with more than
+one reference is never written to, an edit copies the nodes on its path first.
+*/
+typedef struct rope_node_t {
+	rope_metrics_t metrics;
+	_Atomic int references;
+	int leaf;
+	int count;
+	union {
+		struct rope_node_t *children[ROPE_BRANCH_SIZE];
+		char text[ROPE_LEAF_SIZE];
+	};
+} rope_node_t;
+
+typedef struct rope_t {
+	rope_node_t *root;
+	long cursor;
+} rope_t;
+
+result_t rope_create(rope_t *rope, const char *data, long length);
+// the first length bytes of fd, the same tree rope_create would build
+result_t rope_load(rope_t *rope, file_io_t *io, int fd, long length);
+void rope_destroy(rope_t *rope);
+
+long rope_size(const rope_t *rope);
+long rope_line_count(const rope_t *rope);
+long rope_line_start(const rope_t *rope, long line);
+long rope_line_of(const rope_t *rope, long offset);
+
+result_t rope_move(rope_t *rope, long distance);
+// column is the codepoint column to land in, -1 for the cursor's own
+result_t rope_ascend(rope_t *rope, long *column);
+result_t rope_descend(rope_t *rope, long *column);
+result_t rope_goto_line(rope_t *rope, long line);
+
+result_t rope_append(rope_t *rope, char c);
+result_t rope_remove(rope_t *rope);
+result_t rope_insert(rope_t *rope, const char *data, long length);
+result_t rope_delete(rope_t *rope);
+result_t rope_delete_range(rope_t *rope, long start, long end);
+
+result_t rope_insert_at(rope_t *rope, long offset, const char *data, long length);
+result_t rope_delete_at(rope_t *rope, long offset, long length);
+
+long rope_span_at(const rope_t *rope, long offset, const char **text);
+long rope_span_before(const rope_t *rope, long offset, const char **text);
+
+char *rope_to_string(rope_t *rope);
+
+// hands out another reference to the current tree, it stays as it is no matter
+// what is done to the rope afterwards
+rope_node_t *rope_share(rope_t *rope);
+void rope_node_release(rope_node_t *node);
+long rope_node_spans(
+    const rope_node_t *node, text_span_t *spans, long capacity);
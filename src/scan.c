@@ -0,0 +1,885 @@
+#include "scan.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef struct scan_functions_t {
+	const char *name;
+	const char *(*memchr)(const char *text, char c, long length);
+	const char *(*memrchr)(const char *text, char c, long length);
+	long (*count)(const char *text, char c, long length);
+	long (*positions)(
+	    const char *text, char c, long length, long offset, long *positions);
+	long (*codepoints)(const char *text, long length);
+	long (*utf8_valid)(const char *text, long length);
+	long (*codepoint_offset)(const char *text, long length, long count);
+	const char *(*find_any)(
+	    const char *text, long length, const char *set, int set_size);
+	const char *(*find)(const char *text, long length, const char *needle,
+	    long needle_length);
+	const char *(*rfind)(const char *text, long length, const char *needle,
+	    long needle_length);
+} scan_functions_t;
+
+static const char *scalar_memchr(const char *text, char c, long length) {
+	return memchr(text, c, length);
+}
+
+static const char *scalar_memrchr(const char *text, char c, long length) {
+	for (long i = length - 1; i >= 0; i--) {
+		if (text[i] == c) {
+			return &text[i];
+		}
+	}
+	return NULL;
+}
+
+static long scalar_count(const char *text, char c, long length) {
+	long count = 0;
+	for (long i = 0; i < length; i++) {
+		count += text[i] == c;
+	}
+	return count;
+}
+
+static long scalar_positions(
+    const char *text, char c, long length, long offset, long *positions) {
+	long count = 0;
+	for (long i = 0; i < length; i++) {
+		if (text[i] == c) {
+			positions[count++] = offset + i;
+		}
+	}
+	return count;
+}
+
+static long scalar_codepoints(const char *text, long length) {
+	long count = 0;
+	for (long i = 0; i < length; i++) {
+		count += (text[i] & 0xC0) != 0x80;
+	}
+	return count;
+}
+
+// length of the valid utf-8 sequence at i, 0 when it isn't one or is cut
+// short by the end. overlong forms, surrogates and anything past U+10FFFF
+// aren't valid.
+static long scalar_utf8_sequence(const char *text, long i, long length) {
+	const unsigned char *bytes = (const unsigned char *)text;
+	unsigned char c = bytes[i];
+	if (c < 0x80) {
+		return 1;
+	}
+	long need;
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	if (c >= 0xC2 && c <= 0xDF) {
+		need = 1;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		need = 2;
+		low = c == 0xE0 ? 0xA0 : low;
+		high = c == 0xED ? 0x9F : high;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		need = 3;
+		low = c == 0xF0 ? 0x90 : low;
+		high = c == 0xF4 ? 0x8F : high;
+	} else {
+		return 0;
+	}
+	if (length - i <= need || bytes[i + 1] < low || bytes[i + 1] > high) {
+		return 0;
+	}
+	for (long k = 2; k <= need; k++) {
+		if ((bytes[i + k] & 0xC0) != 0x80) {
+			return 0;
+		}
+	}
+	return need + 1;
+}
+
+static long scalar_utf8_valid(const char *text, long length) {
+	long i = 0;
+	while (i < length) {
+		long step = scalar_utf8_sequence(text, i, length);
+		if (step == 0) {
+			return i;
+		}
+		i += step;
+	}
+	return length;
+}
+
+static long scalar_codepoint_offset(
+    const char *text, long length, long count) {
+	for (long i = 0; i < length; i++) {
+		if ((text[i] & 0xC0) != 0x80 && count-- == 0) {
+			return i;
+		}
+	}
+	return length;
+}
+
+static const char *scalar_find_any(
+    const char *text, long length, const char *set, int set_size) {
+	unsigned char table[256] = {0};
+	for (int i = 0; i < set_size; i++) {
+		table[(unsigned char)set[i]] = 1;
+	}
+	for (long i = 0; i < length; i++) {
+		if (table[(unsigned char)text[i]]) {
+			return &text[i];
+		}
+	}
+	return NULL;
+}
+
+// horspool, the shift comes from the last byte of the window
+static const char *scalar_find(
+    const char *text, long length, const char *needle, long needle_length) {
+	long skip[256];
+	for (int i = 0; i < 256; i++) {
+		skip[i] = needle_length;
+	}
+	for (long i = 0; i < needle_length - 1; i++) {
+		skip[(unsigned char)needle[i]] = needle_length - 1 - i;
+	}
+
+	char last = needle[needle_length - 1];
+	for (long i = 0; i <= length - needle_length;) {
+		char c = text[i + needle_length - 1];
+		if (c == last && !memcmp(&text[i], needle, needle_length - 1)) {
+			return &text[i];
+		}
+		i += skip[(unsigned char)c];
+	}
+	return NULL;
+}
+
+// horspool run backwards, the shift comes from the first byte of the window
+static const char *scalar_rfind(
+    const char *text, long length, const char *needle, long needle_length) {
+	long skip[256];
+	for (int i = 0; i < 256; i++) {
+		skip[i] = needle_length;
+	}
+	for (long i = needle_length - 1; i > 0; i--) {
+		skip[(unsigned char)needle[i]] = i;
+	}
+
+	char first = needle[0];
+	for (long i = length - needle_length; i >= 0;) {
+		char c = text[i];
+		if (c == first &&
+		    !memcmp(&text[i + 1], &needle[1], needle_length - 1)) {
+			return &text[i];
+		}
+		i -= skip[(unsigned char)c];
+	}
+	return NULL;
+}
+
+static const scan_functions_t scalar_functions = {
+    "scalar",
+    scalar_memchr,
+    scalar_memrchr,
+    scalar_count,
+    scalar_positions,
+    scalar_codepoints,
+    scalar_utf8_valid,
+    scalar_codepoint_offset,
+    scalar_find_any,
+    scalar_find,
+    scalar_rfind,
+};
+
+#ifdef SCAN_X86
+
+#define SCAN_MAX_SET 16
+
+__attribute__((target("sse2"))) static const char *sse2_memchr(
+    const char *text, char c, long length) {
+	__m128i needle = _mm_set1_epi8(c);
+	long i = 0;
+	for (; i + 64 <= length; i += 64) {
+		__m128i a = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), needle);
+		__m128i b = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i + 16]), needle);
+		__m128i d = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i + 32]), needle);
+		__m128i e = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i + 48]), needle);
+		if (_mm_movemask_epi8(
+		        _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(d, e)))) {
+			break;
+		}
+	}
+	for (; i + 16 <= length; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), needle));
+		if (mask) {
+			return &text[i + __builtin_ctz(mask)];
+		}
+	}
+	return scalar_memchr(&text[i], c, length - i);
+}
+
+__attribute__((target("sse2"))) static const char *sse2_memrchr(
+    const char *text, char c, long length) {
+	__m128i needle = _mm_set1_epi8(c);
+	long i = length;
+	while (i >= 16) {
+		i -= 16;
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), needle));
+		if (mask) {
+			return &text[i + 31 - __builtin_clz(mask)];
+		}
+	}
+	return scalar_memrchr(text, c, i);
+}
+
+__attribute__((target("sse2"))) static long sse2_count(
+    const char *text, char c, long length) {
+	__m128i needle = _mm_set1_epi8(c);
+	long count = 0;
+	long i = 0;
+	while (length - i >= 16) {
+		// each byte lane counts to at most 255 before it is summed out
+		long blocks = (length - i) / 16;
+		if (blocks > 255) {
+			blocks = 255;
+		}
+		__m128i counts = _mm_setzero_si128();
+		for (long block = 0; block < blocks; block++, i += 16) {
+			counts = _mm_sub_epi8(counts,
+			    _mm_cmpeq_epi8(
+			        _mm_loadu_si128((const __m128i *)&text[i]), needle));
+		}
+		__m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+		count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+	}
+	return count + scalar_count(&text[i], c, length - i);
+}
+
+__attribute__((target("sse2"))) static const char *sse2_find_any(
+    const char *text, long length, const char *set, int set_size) {
+	if (set_size > SCAN_MAX_SET) {
+		return scalar_find_any(text, length, set, set_size);
+	}
+	__m128i needles[SCAN_MAX_SET];
+	for (int i = 0; i < set_size; i++) {
+		needles[i] = _mm_set1_epi8(set[i]);
+	}
+
+	long i = 0;
+	for (; i + 16 <= length; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)&text[i]);
+		__m128i matches = _mm_setzero_si128();
+		for (int j = 0; j < set_size; j++) {
+			matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, needles[j]));
+		}
+		int mask = _mm_movemask_epi8(matches);
+		if (mask) {
+			return &text[i + __builtin_ctz(mask)];
+		}
+	}
+	return scalar_find_any(&text[i], length - i, set, set_size);
+}
+
+/*
+substring search filters on the needle's first and last byte at once, a
+window only gets a memcmp when both line up. that keeps the filter at the
+speed of memchr on real text where the first byte alone is common.
+*/
+__attribute__((target("sse2"))) static const char *sse2_find(
+    const char *text, long length, const char *needle, long needle_length) {
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+	long i = 0;
+	for (; i + 16 + needle_length - 1 <= length; i += 16) {
+		__m128i a = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), first);
+		__m128i b = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i + needle_length - 1]),
+		    last);
+		int mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (!memcmp(&text[i + bit + 1], &needle[1], needle_length - 2)) {
+				return &text[i + bit];
+			}
+			mask &= mask - 1;
+		}
+	}
+	return scalar_find(&text[i], length - i, needle, needle_length);
+}
+
+__attribute__((target("sse2"))) static const char *sse2_rfind(
+    const char *text, long length, const char *needle, long needle_length) {
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+	// i is one past the last window start still to check
+	long i = length - needle_length + 1;
+	while (i >= 16) {
+		i -= 16;
+		__m128i a = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), first);
+		__m128i b = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i + needle_length - 1]),
+		    last);
+		int mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+		while (mask) {
+			int bit = 31 - __builtin_clz(mask);
+			if (!memcmp(&text[i + bit + 1], &needle[1], needle_length - 2)) {
+				return &text[i + bit];
+			}
+			mask &= ~(1 << bit);
+		}
+	}
+	return scalar_rfind(text, i + needle_length - 1, needle, needle_length);
+}
+
+// a 64 bit mask of the matches in each 64 bytes, then one store per set bit
+__attribute__((target("sse2"))) static long sse2_positions(
+    const char *text, char c, long length, long offset, long *positions) {
+	__m128i needle = _mm_set1_epi8(c);
+	long count = 0;
+	long i = 0;
+	for (; i + 64 <= length; i += 64) {
+		uint64_t mask = 0;
+		for (int j = 0; j < 4; j++) {
+			mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			            _mm_loadu_si128((const __m128i *)&text[i + j * 16]),
+			            needle))
+			        << (j * 16);
+		}
+		while (mask) {
+			positions[count++] = offset + i + __builtin_ctzll(mask);
+			mask &= mask - 1;
+		}
+	}
+	return count + scalar_positions(&text[i], c, length - i, offset + i,
+	                   &positions[count]);
+}
+
+// continuation bytes are exactly the signed bytes below -64
+__attribute__((target("sse2"))) static long sse2_codepoints(
+    const char *text, long length) {
+	__m128i floor = _mm_set1_epi8(-65);
+	long count = 0;
+	long i = 0;
+	while (length - i >= 16) {
+		long blocks = (length - i) / 16;
+		if (blocks > 255) {
+			blocks = 255;
+		}
+		__m128i counts = _mm_setzero_si128();
+		for (long block = 0; block < blocks; block++, i += 16) {
+			counts = _mm_sub_epi8(counts,
+			    _mm_cmpgt_epi8(
+			        _mm_loadu_si128((const __m128i *)&text[i]), floor));
+		}
+		__m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+		count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+	}
+	return count + scalar_codepoints(&text[i], length - i);
+}
+
+// ascii a block at a time, a sequence at a time past anything else
+__attribute__((target("sse2"))) static long sse2_utf8_valid(
+    const char *text, long length) {
+	long i = 0;
+	while (i < length) {
+		if (length - i >= 16 &&
+		    !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)&text[i]))) {
+			i += 16;
+			continue;
+		}
+		long step = scalar_utf8_sequence(text, i, length);
+		if (step == 0) {
+			return i;
+		}
+		i += step;
+	}
+	return length;
+}
+
+// a block's codepoints are counted off its mask of lead bytes, the block with
+// the one wanted in it finds it by dropping the ones before
+__attribute__((target("sse2"))) static long sse2_codepoint_offset(
+    const char *text, long length, long count) {
+	__m128i floor = _mm_set1_epi8(-65);
+	long i = 0;
+	for (; i + 16 <= length; i += 16) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpgt_epi8(
+		    _mm_loadu_si128((const __m128i *)&text[i]), floor));
+		long leads = __builtin_popcount(mask);
+		if (count < leads) {
+			while (count-- > 0) {
+				mask &= mask - 1;
+			}
+			return i + __builtin_ctz(mask);
+		}
+		count -= leads;
+	}
+	return i + scalar_codepoint_offset(&text[i], length - i, count);
+}
+
+static const scan_functions_t sse2_functions = {
+    "sse2",
+    sse2_memchr,
+    sse2_memrchr,
+    sse2_count,
+    sse2_positions,
+    sse2_codepoints,
+    sse2_utf8_valid,
+    sse2_codepoint_offset,
+    sse2_find_any,
+    sse2_find,
+    sse2_rfind,
+};
+
+__attribute__((target("avx2"))) static const char *avx2_memchr(
+    const char *text, char c, long length) {
+	__m256i needle = _mm256_set1_epi8(c);
+	long i = 0;
+	for (; i + 128 <= length; i += 128) {
+		__m256i a = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), needle);
+		__m256i b = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i + 32]), needle);
+		__m256i d = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i + 64]), needle);
+		__m256i e = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i + 96]), needle);
+		if (_mm256_movemask_epi8(
+		        _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(d, e)))) {
+			break;
+		}
+	}
+	for (; i + 32 <= length; i += 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), needle));
+		if (mask) {
+			return &text[i + __builtin_ctz(mask)];
+		}
+	}
+	return sse2_memchr(&text[i], c, length - i);
+}
+
+__attribute__((target("avx2"))) static const char *avx2_memrchr(
+    const char *text, char c, long length) {
+	__m256i needle = _mm256_set1_epi8(c);
+	long i = length;
+	while (i >= 32) {
+		i -= 32;
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), needle));
+		if (mask) {
+			return &text[i + 31 - __builtin_clz(mask)];
+		}
+	}
+	return sse2_memrchr(text, c, i);
+}
+
+__attribute__((target("avx2"))) static long avx2_count(
+    const char *text, char c, long length) {
+	__m256i needle = _mm256_set1_epi8(c);
+	long count = 0;
+	long i = 0;
+	while (length - i >= 32) {
+		long blocks = (length - i) / 32;
+		if (blocks > 255) {
+			blocks = 255;
+		}
+		__m256i counts = _mm256_setzero_si256();
+		for (long block = 0; block < blocks; block++, i += 32) {
+			counts = _mm256_sub_epi8(counts,
+			    _mm256_cmpeq_epi8(
+			        _mm256_loadu_si256((const __m256i *)&text[i]), needle));
+		}
+		__m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+		__m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums),
+		    _mm256_extracti128_si256(sums, 1));
+		count += _mm_cvtsi128_si32(halves) + _mm_extract_epi16(halves, 4);
+	}
+	return count + sse2_count(&text[i], c, length - i);
+}
+
+__attribute__((target("avx2"))) static const char *avx2_find_any(
+    const char *text, long length, const char *set, int set_size) {
+	if (set_size > SCAN_MAX_SET) {
+		return scalar_find_any(text, length, set, set_size);
+	}
+	__m256i needles[SCAN_MAX_SET];
+	for (int i = 0; i < set_size; i++) {
+		needles[i] = _mm256_set1_epi8(set[i]);
+	}
+
+	long i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)&text[i]);
+		__m256i matches = _mm256_setzero_si256();
+		for (int j = 0; j < set_size; j++) {
+			matches =
+			    _mm256_or_si256(matches, _mm256_cmpeq_epi8(chunk, needles[j]));
+		}
+		unsigned mask = _mm256_movemask_epi8(matches);
+		if (mask) {
+			return &text[i + __builtin_ctz(mask)];
+		}
+	}
+	return sse2_find_any(&text[i], length - i, set, set_size);
+}
+
+__attribute__((target("avx2"))) static const char *avx2_find(
+    const char *text, long length, const char *needle, long needle_length) {
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+	const char *end = &text[needle_length - 1];
+	long i = 0;
+	// two blocks a round so the loop overhead hides behind the loads
+	for (; i + 64 + needle_length - 1 <= length; i += 64) {
+		__m256i a = _mm256_and_si256(
+		    _mm256_cmpeq_epi8(
+		        _mm256_loadu_si256((const __m256i *)&text[i]), first),
+		    _mm256_cmpeq_epi8(
+		        _mm256_loadu_si256((const __m256i *)&end[i]), last));
+		__m256i b = _mm256_and_si256(
+		    _mm256_cmpeq_epi8(
+		        _mm256_loadu_si256((const __m256i *)&text[i + 32]), first),
+		    _mm256_cmpeq_epi8(
+		        _mm256_loadu_si256((const __m256i *)&end[i + 32]), last));
+		uint64_t mask = (uint32_t)_mm256_movemask_epi8(a) |
+		                (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32;
+		while (mask) {
+			int bit = __builtin_ctzll(mask);
+			if (!memcmp(&text[i + bit + 1], &needle[1], needle_length - 2)) {
+				return &text[i + bit];
+			}
+			mask &= mask - 1;
+		}
+	}
+	return sse2_find(&text[i], length - i, needle, needle_length);
+}
+
+__attribute__((target("avx2"))) static const char *avx2_rfind(
+    const char *text, long length, const char *needle, long needle_length) {
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+	long i = length - needle_length + 1;
+	while (i >= 32) {
+		i -= 32;
+		__m256i a = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), first);
+		__m256i b = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i + needle_length - 1]),
+		    last);
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(a, b));
+		while (mask) {
+			int bit = 31 - __builtin_clz(mask);
+			if (!memcmp(&text[i + bit + 1], &needle[1], needle_length - 2)) {
+				return &text[i + bit];
+			}
+			mask &= ~(1u << bit);
+		}
+	}
+	return sse2_rfind(text, i + needle_length - 1, needle, needle_length);
+}
+
+__attribute__((target("avx2"))) static long avx2_positions(
+    const char *text, char c, long length, long offset, long *positions) {
+	__m256i needle = _mm256_set1_epi8(c);
+	long count = 0;
+	long i = 0;
+	for (; i + 64 <= length; i += 64) {
+		uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), needle));
+		uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i + 32]), needle));
+		uint64_t mask = low | high << 32;
+		while (mask) {
+			positions[count++] = offset + i + __builtin_ctzll(mask);
+			mask &= mask - 1;
+		}
+	}
+	return count + scalar_positions(&text[i], c, length - i, offset + i,
+	                   &positions[count]);
+}
+
+__attribute__((target("avx2"))) static long avx2_codepoints(
+    const char *text, long length) {
+	__m256i floor = _mm256_set1_epi8(-65);
+	long count = 0;
+	long i = 0;
+	while (length - i >= 32) {
+		long blocks = (length - i) / 32;
+		if (blocks > 255) {
+			blocks = 255;
+		}
+		__m256i counts = _mm256_setzero_si256();
+		for (long block = 0; block < blocks; block++, i += 32) {
+			counts = _mm256_sub_epi8(counts,
+			    _mm256_cmpgt_epi8(
+			        _mm256_loadu_si256((const __m256i *)&text[i]), floor));
+		}
+		__m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+		__m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums),
+		    _mm256_extracti128_si256(sums, 1));
+		count += _mm_cvtsi128_si32(halves) + _mm_extract_epi16(halves, 4);
+	}
+	return count + sse2_codepoints(&text[i], length - i);
+}
+
+// the bytes n places back of each in input, the ones before the block come
+// from previous
+#define AVX2_PREVIOUS(input, previous, n) \
+	_mm256_alignr_epi8((input), \
+	    _mm256_permute2x128_si256((previous), (input), 0x21), 16 - (n))
+// sixteen bytes looked up by nibble, the same in both lanes
+#define AVX2_TABLE(...) \
+	_mm256_broadcastsi128_si256(_mm_setr_epi8(AVX2_BYTES(__VA_ARGS__)))
+#define AVX2_BYTES(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+	(char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), \
+	    (char)(g), (char)(h), (char)(i), (char)(j), (char)(k), (char)(l), \
+	    (char)(m), (char)(n), (char)(o), (char)(p)
+
+/*
+keiser and lemire's lookup validation. the high and low nibble of each byte
+and the high nibble of the one after it each look up which errors they could
+be part of, and only a pair that every lookup agrees on is one. whether the
+second and third byte after a lead are continuations is checked separately,
+and a block ending part way through a sequence is an error unless the next
+block carries on with it. a block with an error in it is gone over again a
+sequence at a time to find where.
+*/
+__attribute__((target("avx2"))) static long avx2_utf8_valid(
+    const char *text, long length) {
+	enum {
+		TOO_SHORT = 1 << 0,
+		TOO_LONG = 1 << 1,
+		OVERLONG_3 = 1 << 2,
+		TOO_LARGE = 1 << 3,
+		SURROGATE = 1 << 4,
+		OVERLONG_2 = 1 << 5,
+		TOO_LARGE_1000 = 1 << 6,
+		OVERLONG_4 = 1 << 6,
+		TWO_CONTINUATIONS = 1 << 7,
+		CARRY = TOO_SHORT | TOO_LONG | TWO_CONTINUATIONS,
+		LARGE = CARRY | TOO_LARGE | TOO_LARGE_1000,
+	};
+	const __m256i first_high = AVX2_TABLE(TOO_LONG, TOO_LONG, TOO_LONG,
+	    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TWO_CONTINUATIONS,
+	    TWO_CONTINUATIONS, TWO_CONTINUATIONS, TWO_CONTINUATIONS,
+	    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+	    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+	const __m256i first_low =
+	    AVX2_TABLE(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	        CARRY | OVERLONG_2, CARRY, CARRY, CARRY | TOO_LARGE, LARGE, LARGE,
+	        LARGE, LARGE, LARGE, LARGE, LARGE, LARGE, LARGE | SURROGATE, LARGE,
+	        LARGE);
+	const __m256i second_high = AVX2_TABLE(TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	    TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 |
+	        TOO_LARGE_1000 | OVERLONG_4,
+	    TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 | TOO_LARGE,
+	    TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE,
+	    TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE,
+	    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+	// a lead in the last three bytes of a block that needs more than are left
+	const __m256i cut = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+	    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	    -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+	__m256i previous = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+	long i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i input = _mm256_loadu_si256((const __m256i *)&text[i]);
+		__m256i errors;
+		if (!_mm256_movemask_epi8(input)) {
+			errors = incomplete;
+		} else {
+			__m256i previous1 = AVX2_PREVIOUS(input, previous, 1);
+			__m256i special = _mm256_and_si256(
+			    _mm256_and_si256(
+			        _mm256_shuffle_epi8(first_high,
+			            _mm256_and_si256(
+			                _mm256_srli_epi16(previous1, 4), nibble)),
+			        _mm256_shuffle_epi8(
+			            first_low, _mm256_and_si256(previous1, nibble))),
+			    _mm256_shuffle_epi8(second_high,
+			        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+			__m256i third = _mm256_subs_epu8(AVX2_PREVIOUS(input, previous, 2),
+			    _mm256_set1_epi8(0xE0 - 0x80));
+			__m256i fourth = _mm256_subs_epu8(AVX2_PREVIOUS(input, previous, 3),
+			    _mm256_set1_epi8(0xF0 - 0x80));
+			__m256i continuations =
+			    _mm256_and_si256(_mm256_or_si256(third, fourth),
+			        _mm256_set1_epi8((char)0x80));
+			errors = _mm256_xor_si256(continuations, special);
+		}
+		if (!_mm256_testz_si256(errors, errors)) {
+			break;
+		}
+		incomplete = _mm256_subs_epu8(input, cut);
+		previous = input;
+	}
+
+	// the last sequence of the blocks that passed may run on past them
+	long start = i;
+	while (start > 0 && i - start < 3 && (text[start - 1] & 0xC0) == 0x80) {
+		start--;
+	}
+	if (start > 0 && (text[start - 1] & 0xC0) == 0xC0) {
+		start--;
+	}
+	return start + scalar_utf8_valid(&text[start], length - start);
+}
+
+__attribute__((target("avx2"))) static long avx2_codepoint_offset(
+    const char *text, long length, long count) {
+	__m256i floor = _mm256_set1_epi8(-65);
+	long i = 0;
+	for (; i + 32 <= length; i += 32) {
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(
+		    _mm256_loadu_si256((const __m256i *)&text[i]), floor));
+		long leads = __builtin_popcount(mask);
+		if (count < leads) {
+			while (count-- > 0) {
+				mask &= mask - 1;
+			}
+			return i + __builtin_ctz(mask);
+		}
+		count -= leads;
+	}
+	return i + sse2_codepoint_offset(&text[i], length - i, count);
+}
+
+static const scan_functions_t avx2_functions = {
+    "avx2",
+    avx2_memchr,
+    avx2_memrchr,
+    avx2_count,
+    avx2_positions,
+    avx2_codepoints,
+    avx2_utf8_valid,
+    avx2_codepoint_offset,
+    avx2_find_any,
+    avx2_find,
+    avx2_rfind,
+};
+
+#endif
+
+static _Atomic(const scan_functions_t *) scan_functions = NULL;
+
+static const scan_functions_t *scan_select(void) {
+	const scan_functions_t *functions = atomic_load(&scan_functions);
+	if (functions != NULL) {
+		return functions;
+	}
+
+	functions = &scalar_functions;
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		functions = &avx2_functions;
+	} else if (__builtin_cpu_supports("sse2")) {
+		functions = &sse2_functions;
+	}
+#endif
+	atomic_store(&scan_functions, functions);
+	return functions;
+}
+
+const char *scan_memchr(const char *text, char c, long length) {
+	if (length <= 0) {
+		return NULL;
+	}
+	return scan_select()->memchr(text, c, length);
+}
+
+const char *scan_memrchr(const char *text, char c, long length) {
+	if (length <= 0) {
+		return NULL;
+	}
+	return scan_select()->memrchr(text, c, length);
+}
+
+long scan_count(const char *text, char c, long length) {
+	if (length <= 0) {
+		return 0;
+	}
+	return scan_select()->count(text, c, length);
+}
+
+long scan_positions(
+    const char *text, char c, long length, long offset, long *positions) {
+	if (length <= 0) {
+		return 0;
+	}
+	return scan_select()->positions(text, c, length, offset, positions);
+}
+
+long scan_codepoints(const char *text, long length) {
+	if (length <= 0) {
+		return 0;
+	}
+	return scan_select()->codepoints(text, length);
+}
+
+long scan_utf8_valid(const char *text, long length) {
+	if (length <= 0) {
+		return 0;
+	}
+	return scan_select()->utf8_valid(text, length);
+}
+
+long scan_codepoint_offset(const char *text, long length, long count) {
+	if (length <= 0) {
+		return 0;
+	}
+	return scan_select()->codepoint_offset(text, length, count);
+}
+
+const char *scan_find_any(
+    const char *text, long length, const char *set, int set_size) {
+	if (length <= 0 || set_size <= 0) {
+		return NULL;
+	}
+	return scan_select()->find_any(text, length, set, set_size);
+}
+
+const char *scan_find(
+    const char *text, long length, const char *needle, long needle_length) {
+	if (needle_length <= 0 || length < needle_length) {
+		return NULL;
+	}
+	if (needle_length == 1) {
+		return scan_memchr(text, needle[0], length);
+	}
+	return scan_select()->find(text, length, needle, needle_length);
+}
+
+const char *scan_rfind(
+    const char *text, long length, const char *needle, long needle_length) {
+	if (needle_length <= 0 || length < needle_length) {
+		return NULL;
+	}
+	if (needle_length == 1) {
+		return scan_memrchr(text, needle[0], length);
+	}
+	return scan_select()->rfind(text, length, needle, needle_length);
+}
+
+const char *scan_implementation(void) { return scan_select()->name; }
@@ -0,0 +1,54 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+/*
+vectorised byte scanning. SSE2 is the baseline on x86, AVX2 is picked at
+runtime when the cpu has it, and everything else falls back to scalar loops.
+lengths are explicit so none of these stop at a NUL byte.
+*/
+
+// first occurrence of c, NULL if there isn't one
+const char *scan_memchr(const char *text, char c, long length);
+// last occurrence of c, NULL if there isn't one
+const char *scan_memrchr(const char *text, char c, long length);
+// number of occurrences of c
+long scan_count(const char *text, char c, long length);
+// offset plus the index of every occurrence of c, positions needs room for
+// all of them. returns how many there were.
+long scan_positions(
+    const char *text, char c, long length, long offset, long *positions);
+// bytes that start a utf-8 codepoint, everything but continuation bytes
+long scan_codepoints(const char *text, long length);
+// bytes from the start that are valid utf-8, a sequence cut short by the end
+// isn't. length when all of it is.
+long scan_utf8_valid(const char *text, long length);
+// where the codepoint count codepoints in starts, length if there aren't that
+// many
+long scan_codepoint_offset(const char *text, long length, long count);
+// first byte that is any of the set_size bytes in set
+const char *scan_find_any(
+    const char *text, long length, const char *set, int set_size);
+// first occurrence of needle, NULL if there isn't one
+const char *scan_find(
+    const char *text, long length, const char *needle, long needle_length);
+// last occurrence of needle, NULL if there isn't one
+const char *scan_rfind(
+    const char *text, long length, const char *needle, long needle_length);
+
+const char *scan_implementation(void);
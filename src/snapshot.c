@@ -0,0 +1,156 @@
+#include "snapshot.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static result_t text_snapshot_copy(
+    text_buffer_t *buffer, text_snapshot_t *snapshot) {
+	if (!snapshot->length) {
+		return NO_ERROR;
+	}
+	snapshot->text = malloc(snapshot->length);
+	snapshot->spans = malloc(sizeof(text_span_t));
+	if (snapshot->text == NULL || snapshot->spans == NULL) {
+		return TEXT_BUFFER_ERROR;
+	}
+
+	text_span_t spans[2];
+	int count = split_buffer_spans(&buffer->split_buffer, spans);
+	long offset = 0;
+	for (int i = 0; i < count; i++) {
+		memcpy(&snapshot->text[offset], spans[i].data, spans[i].length);
+		offset += spans[i].length;
+	}
+	snapshot->spans[0] = (text_span_t){snapshot->text, snapshot->length};
+	snapshot->span_count = 1;
+
+	return NO_ERROR;
+}
+
+static result_t text_snapshot_share(
+    text_buffer_t *buffer, text_snapshot_t *snapshot, int defer) {
+	long count;
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		snapshot->storage = piece_table_share(&buffer->piece_table);
+		if (snapshot->storage == NULL) {
+			return TEXT_BUFFER_ERROR;
+		}
+		count = piece_table_spans(&buffer->piece_table, NULL, 0);
+	} else {
+		snapshot->root = rope_share(&buffer->rope);
+		// the shared tree never changes again, its leaves can be listed later
+		if (defer) {
+			snapshot->listed = 0;
+			return NO_ERROR;
+		}
+		count = rope_node_spans(snapshot->root, NULL, 0);
+	}
+	if (!count) {
+		return NO_ERROR;
+	}
+
+	snapshot->spans = malloc(count * sizeof(text_span_t));
+	if (snapshot->spans == NULL) {
+		return TEXT_BUFFER_ERROR;
+	}
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		piece_table_spans(&buffer->piece_table, snapshot->spans, count);
+	} else {
+		rope_node_spans(snapshot->root, snapshot->spans, count);
+	}
+	snapshot->span_count = count;
+
+	return NO_ERROR;
+}
+
+static result_t text_snapshot_take(
+    text_buffer_t *buffer, text_snapshot_t **snapshot, int defer) {
+	*snapshot = malloc(sizeof(text_snapshot_t));
+	if (*snapshot == NULL) {
+		error("failed to allocate snapshot!");
+		return TEXT_BUFFER_ERROR;
+	}
+	atomic_init(&(*snapshot)->references, 1);
+	(*snapshot)->backend = buffer->backend;
+	(*snapshot)->version = buffer->version;
+	(*snapshot)->length = text_buffer_size(buffer);
+	(*snapshot)->spans = NULL;
+	(*snapshot)->span_count = 0;
+	(*snapshot)->listed = 1;
+	(*snapshot)->text = NULL;
+
+	result_t res = buffer->backend == SPLIT_BUFFER_BACKEND
+	                   ? text_snapshot_copy(buffer, *snapshot)
+	                   : text_snapshot_share(buffer, *snapshot, defer);
+	if (res != NO_ERROR) {
+		error("failed to snapshot buffer!");
+		text_snapshot_release(*snapshot);
+		*snapshot = NULL;
+		return res;
+	}
+	debug("snapshot of version %lu, %ld spans", buffer->version,
+	    (*snapshot)->span_count);
+
+	return NO_ERROR;
+}
+
+result_t text_snapshot_create(
+    text_buffer_t *buffer, text_snapshot_t **snapshot) {
+	return text_snapshot_take(buffer, snapshot, 0);
+}
+
+result_t text_snapshot_defer(
+    text_buffer_t *buffer, text_snapshot_t **snapshot) {
+	return text_snapshot_take(buffer, snapshot, 1);
+}
+
+result_t text_snapshot_list(text_snapshot_t *snapshot) {
+	if (snapshot->listed) {
+		return NO_ERROR;
+	}
+	long count = rope_node_spans(snapshot->root, NULL, 0);
+	if (count) {
+		snapshot->spans = malloc(count * sizeof(text_span_t));
+		if (snapshot->spans == NULL) {
+			error("failed to list snapshot!");
+			return TEXT_BUFFER_ERROR;
+		}
+		rope_node_spans(snapshot->root, snapshot->spans, count);
+	}
+	snapshot->span_count = count;
+	snapshot->listed = 1;
+
+	return NO_ERROR;
+}
+
+text_snapshot_t *text_snapshot_retain(text_snapshot_t *snapshot) {
+	atomic_fetch_add(&snapshot->references, 1);
+	return snapshot;
+}
+
+void text_snapshot_release(text_snapshot_t *snapshot) {
+	if (atomic_fetch_sub(&snapshot->references, 1) != 1) {
+		return;
+	}
+
+	switch (snapshot->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		free(snapshot->text);
+		break;
+	case PIECE_TABLE_BACKEND:
+		if (snapshot->storage != NULL) {
+			piece_storage_release(snapshot->storage);
+		}
+		break;
+	case ROPE_BACKEND:
+		if (snapshot->root != NULL) {
+			rope_node_release(snapshot->root);
+		}
+		break;
+	}
+	free(snapshot->spans);
+	free(snapshot);
+}
@@ -0,0 +1,63 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "piece_table.h"
+#include "result.h"
+#include "rope.h"
+#include "text_buffer.h"
+#include "text_span.h"
+
+/*
+a read only view of a buffer's text at one version, safe to read from any
+thread while the buffer keeps being edited. taking one is O(leaves) for a rope
+and O(pieces) for a piece table since both already share their text. a split
+buffer rewrites its text in place so it has to be copied, which is fine at
+the sizes a split buffer is used for.
+
+snapshots are reference counted, the last release frees whatever kept the
+text alive.
+
+a deferred snapshot of a rope only shares the root, its spans are empty until
+text_snapshot_list walks the leaves. that walk touches every leaf, which for
+a big rope is too slow for a frame, so it's left to the thread reading it.
+*/
+typedef struct text_snapshot_t {
+	_Atomic long references;
+	text_buffer_backend_t backend;
+	unsigned long version;
+	long length;
+	text_span_t *spans;
+	long span_count;
+	// 0 for a deferred snapshot until its spans are listed
+	int listed;
+	union {
+		char *text;
+		piece_storage_t *storage;
+		rope_node_t *root;
+	};
+} text_snapshot_t;
+
+result_t text_snapshot_create(
+    text_buffer_t *buffer, text_snapshot_t **snapshot);
+// spans only listed once text_snapshot_list is called, by one thread
+result_t text_snapshot_defer(
+    text_buffer_t *buffer, text_snapshot_t **snapshot);
+result_t text_snapshot_list(text_snapshot_t *snapshot);
+text_snapshot_t *text_snapshot_retain(text_snapshot_t *snapshot);
+void text_snapshot_release(text_snapshot_t *snapshot);
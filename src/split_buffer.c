@@ -1,31 +1,197 @@
 #include "split_buffer.h"
 #define NDEBUG
 #include "logger.h"
+#include "scan.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-void split_buffer_create(split_buffer_t *split_buffer, const char *string) {
-	strncpy(split_buffer->buffer, string, MAX_BUFFER_SIZE - 1);
-	size_t length = strlen(string);
-	if (strlen(string) > MAX_BUFFER_SIZE - 1) {
-		length = MAX_BUFFER_SIZE - 1;
+static result_t split_buffer_reserve_newlines(
+    split_buffer_t *split_buffer, long count) {
+	long gap = split_buffer->newline_capacity - split_buffer->pre_newlines -
+	           split_buffer->post_newlines;
+	if (gap >= count) {
+		return NO_ERROR;
+	}
+
+	long required =
+	    split_buffer->pre_newlines + split_buffer->post_newlines + count;
+	long capacity = split_buffer->newline_capacity * 2;
+	if (capacity < 64) {
+		capacity = 64;
+	}
+	while (capacity < required) {
+		capacity *= 2;
+	}
+
+	long *newlines = realloc(split_buffer->newlines, capacity * sizeof(long));
+	if (newlines == NULL) {
+		error("failed to grow newline index!");
+		return TEXT_BUFFER_ERROR;
+	}
+	memmove(&newlines[capacity - split_buffer->post_newlines],
+	    &newlines[split_buffer->newline_capacity - split_buffer->post_newlines],
+	    split_buffer->post_newlines * sizeof(long));
+
+	split_buffer->newlines = newlines;
+	split_buffer->newline_capacity = capacity;
+
+	return NO_ERROR;
+}
+
+// offset of the nth newline in the text
+static long split_buffer_newline(const split_buffer_t *split_buffer, long n) {
+	if (n < split_buffer->pre_newlines) {
+		return split_buffer->newlines[n];
+	}
+	long index = split_buffer->newline_capacity - split_buffer->post_newlines +
+	             n - split_buffer->pre_newlines;
+	return split_buffer->current_size - split_buffer->newlines[index];
+}
+
+// records the newlines of text just placed before the gap at offset
+static result_t split_buffer_index(
+    split_buffer_t *split_buffer, long offset, long length) {
+	if (length == 0) {
+		return NO_ERROR;
+	}
+	const char *text = &split_buffer->buffer[offset];
+	result_t res = split_buffer_reserve_newlines(
+	    split_buffer, scan_count(text, '\n', length));
+	if (res != NO_ERROR) {
+		return res;
+	}
+	split_buffer->pre_newlines += scan_positions(text, '\n', length, offset,
+	    &split_buffer->newlines[split_buffer->pre_newlines]);
+	return NO_ERROR;
+}
+
+static void split_buffer_init(split_buffer_t *split_buffer) {
+	split_buffer->buffer = NULL;
+	split_buffer->capacity = 0;
+	split_buffer->pre_cursor_index = 0;
+	split_buffer->post_cursor_index = 0;
+	split_buffer->current_size = 0;
+	split_buffer->newlines = NULL;
+	split_buffer->newline_capacity = 0;
+	split_buffer->pre_newlines = 0;
+	split_buffer->post_newlines = 0;
+}
+
+result_t split_buffer_create(split_buffer_t *split_buffer, const char *string) {
+	long length = (long)strlen(string);
+	split_buffer_init(split_buffer);
+
+	result_t res = split_buffer_reserve(split_buffer, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	if (length) {
+		memcpy(split_buffer->buffer, string, length);
 	}
-	split_buffer->buffer[length] = '\0';
 
-	split_buffer->pre_cursor_index = (long)length;
-	split_buffer->post_cursor_index = MAX_BUFFER_SIZE - 1;
-	split_buffer->current_size = (long)length;
+	res = split_buffer_index(split_buffer, 0, length);
+	if (res != NO_ERROR) {
+		split_buffer_destroy(split_buffer);
+		return res;
+	}
+
+	split_buffer->pre_cursor_index = length;
+	split_buffer->current_size = length;
 	debug("pre cursor index: %ld, post cursor index: %ld, current size: %ld",
 	    split_buffer->pre_cursor_index, split_buffer->post_cursor_index,
 	    split_buffer->current_size);
+
+	return NO_ERROR;
+}
+
+// reads straight into the gap a block at a time, each block's newlines are
+// indexed while it's still in cache. a file that turns out shorter than length
+// just loads what's there.
+result_t split_buffer_load(
+    split_buffer_t *split_buffer, file_io_t *io, int fd, long length) {
+	split_buffer_init(split_buffer);
+	result_t res = split_buffer_reserve(split_buffer, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	while (split_buffer->current_size < length) {
+		long offset = split_buffer->current_size;
+		long bytes;
+		res = file_io_read(io, fd, &split_buffer->buffer[offset],
+		    length - offset, offset, &bytes);
+		if (res != NO_ERROR) {
+			error("failed to read into split buffer!");
+			split_buffer_destroy(split_buffer);
+			return TEXT_BUFFER_ERROR;
+		}
+		if (bytes == 0) {
+			break;
+		}
+		res = split_buffer_index(split_buffer, offset, bytes);
+		if (res != NO_ERROR) {
+			split_buffer_destroy(split_buffer);
+			return res;
+		}
+		split_buffer->pre_cursor_index += bytes;
+		split_buffer->current_size += bytes;
+	}
+	debug("loaded %ld bytes into split buffer", split_buffer->current_size);
+
+	return NO_ERROR;
 }
 
 void split_buffer_destroy(split_buffer_t *split_buffer) {
+	free(split_buffer->buffer);
+	split_buffer->buffer = NULL;
+	split_buffer->capacity = 0;
 	split_buffer->pre_cursor_index = 0;
-	split_buffer->post_cursor_index = MAX_BUFFER_SIZE - 1;
+	split_buffer->post_cursor_index = 0;
 	split_buffer->current_size = 0;
-	split_buffer->buffer[0] = '\0';
+
+	free(split_buffer->newlines);
+	split_buffer->newlines = NULL;
+	split_buffer->newline_capacity = 0;
+	split_buffer->pre_newlines = 0;
+	split_buffer->post_newlines = 0;
+}
+
+// make sure the gap can hold at least gap_size more bytes. the capacity grows
+// geometrically so a run of appends costs amortised O(1) per byte, and the
+// post cursor text is moved to the end of the new block so the gap stays at
+// the cursor.
+result_t split_buffer_reserve(split_buffer_t *split_buffer, long gap_size) {
+	long gap = split_buffer->post_cursor_index - split_buffer->pre_cursor_index;
+	if (gap >= gap_size) {
+		return NO_ERROR;
+	}
+
+	long required = split_buffer->current_size + gap_size;
+	long capacity = split_buffer->capacity * 2;
+	if (capacity < MIN_BUFFER_CAPACITY) {
+		capacity = MIN_BUFFER_CAPACITY;
+	}
+	while (capacity < required) {
+		capacity *= 2;
+	}
+
+	char *buffer = realloc(split_buffer->buffer, capacity);
+	if (buffer == NULL) {
+		error("failed to grow split buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+
+	long post_length = split_buffer->capacity - split_buffer->post_cursor_index;
+	memmove(&buffer[capacity - post_length],
+	    &buffer[split_buffer->post_cursor_index], post_length);
+
+	split_buffer->buffer = buffer;
+	split_buffer->post_cursor_index = capacity - post_length;
+	split_buffer->capacity = capacity;
+	debug("grew split buffer to %ld bytes", capacity);
+
+	return NO_ERROR;
 }
 
 result_t split_buffer_move(split_buffer_t *split_buffer, long distance) {
@@ -40,16 +206,38 @@ result_t split_buffer_move(split_buffer_t *split_buffer, long distance) {
 	}
 
 	if (distance > 0) {
-		memcpy(&split_buffer->buffer[split_buffer->pre_cursor_index],
+		memmove(&split_buffer->buffer[split_buffer->pre_cursor_index],
 		    &split_buffer->buffer[split_buffer->post_cursor_index], distance);
 	} else if (distance < 0) {
-		memcpy(&split_buffer->buffer[split_buffer->post_cursor_index + distance],
+		memmove(&split_buffer->buffer[split_buffer->post_cursor_index + distance],
 		    &split_buffer->buffer[split_buffer->pre_cursor_index + distance],
 		    -1 * distance);
 	}
 
 	split_buffer->pre_cursor_index += distance;
 	split_buffer->post_cursor_index += distance;
+
+	// carry the newlines the gap passed over to the other side of the index
+	long *newlines = split_buffer->newlines;
+	long post_start =
+	    split_buffer->newline_capacity - split_buffer->post_newlines;
+	if (distance > 0) {
+		while (split_buffer->post_newlines > 0 &&
+		       split_buffer->current_size - newlines[post_start] <
+		           split_buffer->pre_cursor_index) {
+			newlines[split_buffer->pre_newlines++] =
+			    split_buffer->current_size - newlines[post_start++];
+			split_buffer->post_newlines--;
+		}
+	} else {
+		while (split_buffer->pre_newlines > 0 &&
+		       newlines[split_buffer->pre_newlines - 1] >=
+		           split_buffer->pre_cursor_index) {
+			newlines[--post_start] = split_buffer->current_size -
+			                         newlines[--split_buffer->pre_newlines];
+			split_buffer->post_newlines++;
+		}
+	}
 	debug("pre cursor index: %ld, post cursor index: %ld, current size: %ld",
 	    split_buffer->pre_cursor_index, split_buffer->post_cursor_index,
 	    split_buffer->current_size);
@@ -58,36 +246,304 @@ result_t split_buffer_move(split_buffer_t *split_buffer, long distance) {
 	return NO_ERROR;
 }
 
-result_t split_buffer_ascend(split_buffer_t *split_buffer) {
-	if (split_buffer->pre_cursor_index == 0) {
+long split_buffer_line_count(const split_buffer_t *split_buffer) {
+	return split_buffer->pre_newlines + split_buffer->post_newlines + 1;
+}
+
+// offset of the first byte of a zero based line, -1 past the last line
+long split_buffer_line_start(const split_buffer_t *split_buffer, long line) {
+	if (line == 0) {
+		return 0;
+	}
+	if (line < 0 || line >= split_buffer_line_count(split_buffer)) {
+		return -1;
+	}
+	return split_buffer_newline(split_buffer, line - 1) + 1;
+}
+
+static long split_buffer_line_end(
+    const split_buffer_t *split_buffer, long line) {
+	if (line + 1 >= split_buffer_line_count(split_buffer)) {
+		return split_buffer->current_size;
+	}
+	return split_buffer_newline(split_buffer, line);
+}
+
+// zero based line containing offset, a binary search over the index
+long split_buffer_line_of(const split_buffer_t *split_buffer, long offset) {
+	long low = 0;
+	long high = split_buffer->pre_newlines + split_buffer->post_newlines;
+	while (low < high) {
+		long middle = low + (high - low) / 2;
+		if (split_buffer_newline(split_buffer, middle) < offset) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// the text either side of the gap as two contiguous ranges, clipped to
+// [start, end) in text offsets
+static void split_buffer_ranges(const split_buffer_t *split_buffer, long start,
+    long end, const char **pre, long *pre_length, const char **post,
+    long *post_length) {
+	long pre_end = end < split_buffer->pre_cursor_index
+	                   ? end
+	                   : split_buffer->pre_cursor_index;
+	*pre = &split_buffer->buffer[start];
+	*pre_length = pre_end > start ? pre_end - start : 0;
+
+	long post_start = start > split_buffer->pre_cursor_index
+	                      ? start
+	                      : split_buffer->pre_cursor_index;
+	long gap = split_buffer->post_cursor_index - split_buffer->pre_cursor_index;
+	*post = &split_buffer->buffer[post_start + gap];
+	*post_length = end > post_start ? end - post_start : 0;
+}
+
+// first offset at or after offset holding c, -1 if there is none
+long split_buffer_find_next(
+    const split_buffer_t *split_buffer, long offset, char c) {
+	const char *pre;
+	const char *post;
+	long pre_length;
+	long post_length;
+	split_buffer_ranges(split_buffer, offset, split_buffer->current_size, &pre,
+	    &pre_length, &post, &post_length);
+
+	const char *found = scan_memchr(pre, c, pre_length);
+	if (found != NULL) {
+		return offset + (found - pre);
+	}
+	found = scan_memchr(post, c, post_length);
+	if (found != NULL) {
+		return split_buffer->current_size - post_length + (found - post);
+	}
+	return -1;
+}
+
+// last offset before offset holding c, -1 if there is none
+long split_buffer_find_previous(
+    const split_buffer_t *split_buffer, long offset, char c) {
+	const char *pre;
+	const char *post;
+	long pre_length;
+	long post_length;
+	split_buffer_ranges(
+	    split_buffer, 0, offset, &pre, &pre_length, &post, &post_length);
+
+	const char *found = scan_memrchr(post, c, post_length);
+	if (found != NULL) {
+		return offset - post_length + (found - post);
+	}
+	found = scan_memrchr(pre, c, pre_length);
+	if (found != NULL) {
+		return found - pre;
+	}
+	return -1;
+}
+
+long split_buffer_find_any(const split_buffer_t *split_buffer, long offset,
+    const char *set, int set_size) {
+	const char *pre;
+	const char *post;
+	long pre_length;
+	long post_length;
+	split_buffer_ranges(split_buffer, offset, split_buffer->current_size, &pre,
+	    &pre_length, &post, &post_length);
+
+	const char *found = scan_find_any(pre, pre_length, set, set_size);
+	if (found != NULL) {
+		return offset + (found - pre);
+	}
+	found = scan_find_any(post, post_length, set, set_size);
+	if (found != NULL) {
+		return split_buffer->current_size - post_length + (found - post);
+	}
+	return -1;
+}
+
+long split_buffer_count(
+    const split_buffer_t *split_buffer, long start, long end, char c) {
+	const char *pre;
+	const char *post;
+	long pre_length;
+	long post_length;
+	split_buffer_ranges(
+	    split_buffer, start, end, &pre, &pre_length, &post, &post_length);
+	return scan_count(pre, c, pre_length) + scan_count(post, c, post_length);
+}
+
+// whether needle starts at offset, for the windows that straddle the gap
+static int split_buffer_matches_across(const split_buffer_t *split_buffer,
+    long offset, const char *needle, long length) {
+	long pre_length = split_buffer->pre_cursor_index - offset;
+	return !memcmp(&split_buffer->buffer[offset], needle, pre_length) &&
+	       !memcmp(&split_buffer->buffer[split_buffer->post_cursor_index],
+	           &needle[pre_length], length - pre_length);
+}
+
+/*
+first offset at or after offset where needle starts, -1 if there is none.
+each side of the gap is searched in place with the scan kernels, only the
+length - 1 windows that straddle the gap are checked by hand.
+*/
+long split_buffer_search_next(const split_buffer_t *split_buffer, long offset,
+    const char *needle, long length) {
+	if (length <= 0 || offset < 0 || offset > split_buffer->current_size) {
+		return -1;
+	}
+	long gap_start = split_buffer->pre_cursor_index;
+	if (offset < gap_start) {
+		const char *found = scan_find(&split_buffer->buffer[offset],
+		    gap_start - offset, needle, length);
+		if (found != NULL) {
+			return found - split_buffer->buffer;
+		}
+		long start = gap_start - length + 1 > offset ? gap_start - length + 1
+		                                             : offset;
+		for (; start < gap_start &&
+		       start + length <= split_buffer->current_size;
+		     start++) {
+			if (split_buffer->buffer[start] == needle[0] &&
+			    split_buffer_matches_across(
+			        split_buffer, start, needle, length)) {
+				return start;
+			}
+		}
+		offset = gap_start;
+	}
+
+	long gap = split_buffer->post_cursor_index - gap_start;
+	const char *post = &split_buffer->buffer[offset + gap];
+	const char *found =
+	    scan_find(post, split_buffer->current_size - offset, needle, length);
+	if (found != NULL) {
+		return offset + (found - post);
+	}
+	return -1;
+}
+
+// last offset where needle starts and ends at or before offset, -1 if there
+// is none
+long split_buffer_search_previous(const split_buffer_t *split_buffer,
+    long offset, const char *needle, long length) {
+	if (length <= 0 || offset < 0 || offset > split_buffer->current_size) {
+		return -1;
+	}
+	long gap_start = split_buffer->pre_cursor_index;
+	if (offset > gap_start) {
+		const char *post =
+		    &split_buffer->buffer[split_buffer->post_cursor_index];
+		const char *found =
+		    scan_rfind(post, offset - gap_start, needle, length);
+		if (found != NULL) {
+			return gap_start + (found - post);
+		}
+		long start =
+		    offset - length < gap_start - 1 ? offset - length : gap_start - 1;
+		for (; start >= 0 && start > gap_start - length; start--) {
+			if (split_buffer->buffer[start] == needle[0] &&
+			    split_buffer_matches_across(
+			        split_buffer, start, needle, length)) {
+				return start;
+			}
+		}
+		offset = gap_start;
+	}
+
+	const char *found =
+	    scan_rfind(split_buffer->buffer, offset, needle, length);
+	if (found != NULL) {
+		return found - split_buffer->buffer;
+	}
+	return -1;
+}
+
+// fills offsets with every match left to right, matches don't overlap.
+// returns how many there are even if that's more than capacity
+long split_buffer_search_all(const split_buffer_t *split_buffer,
+    const char *needle, long length, long *offsets, long capacity) {
+	long count = 0;
+	long offset = split_buffer_search_next(split_buffer, 0, needle, length);
+	while (offset != -1) {
+		if (count < capacity) {
+			offsets[count] = offset;
+		}
+		count++;
+		offset = split_buffer_search_next(
+		    split_buffer, offset + length, needle, length);
+	}
+	return count;
+}
+
+static result_t split_buffer_move_to(split_buffer_t *split_buffer, long offset) {
+	long distance = offset - split_buffer->pre_cursor_index;
+	if (!distance) {
+		return NO_ERROR;
+	}
+	return split_buffer_move(split_buffer, distance);
+}
+
+/*
+columns are codepoints, not bytes, so moving between lines of multibyte text
+keeps to the same character. the current line up to the cursor and every line
+above it are on the pre side, every line below it on the post side, so each
+is counted in one piece. column is the one to aim for, when it's -1 the
+cursor's own is aimed for and kept there for the next line.
+*/
+result_t split_buffer_ascend(split_buffer_t *split_buffer, long *column) {
+	// every newline before the cursor is on the pre side of the index
+	long line = split_buffer->pre_newlines;
+	if (line == 0) {
 		trace("end of buffer");
 		return NO_ERROR;
 	}
-	for (int i = split_buffer->pre_cursor_index - 1; i > 0; i--) {
-		char c = split_buffer->buffer[i];
-		if (c == '\n') {
-			split_buffer_move(split_buffer, i - split_buffer->pre_cursor_index);
-			break;
-		}
+
+	long line_start = split_buffer_line_start(split_buffer, line);
+	if (*column < 0) {
+		*column = scan_codepoints(&split_buffer->buffer[line_start],
+		    split_buffer->pre_cursor_index - line_start);
 	}
+	long start = split_buffer_line_start(split_buffer, line - 1);
+	long length = split_buffer_line_end(split_buffer, line - 1) - start;
 
-	return NO_ERROR;
+	return split_buffer_move_to(split_buffer,
+	    start + scan_codepoint_offset(
+	                &split_buffer->buffer[start], length, *column));
 }
 
-result_t split_buffer_descend(split_buffer_t *split_buffer) {
-	if (split_buffer->pre_cursor_index == split_buffer->current_size) {
+result_t split_buffer_descend(split_buffer_t *split_buffer, long *column) {
+	long line = split_buffer->pre_newlines;
+	if (line + 1 >= split_buffer_line_count(split_buffer)) {
 		trace("end of buffer");
 		return NO_ERROR;
 	}
-	for (int i = split_buffer->post_cursor_index + 1; i < MAX_BUFFER_SIZE; i++) {
-		char c = split_buffer->buffer[i];
-		if (c == '\n') {
-			split_buffer_move(split_buffer, i - split_buffer->post_cursor_index);
-			break;
-		}
+
+	long line_start = split_buffer_line_start(split_buffer, line);
+	if (*column < 0) {
+		*column = scan_codepoints(&split_buffer->buffer[line_start],
+		    split_buffer->pre_cursor_index - line_start);
 	}
+	long start = split_buffer_line_start(split_buffer, line + 1);
+	long length = split_buffer_line_end(split_buffer, line + 1) - start;
+	const char *text = &split_buffer->buffer[split_buffer->post_cursor_index +
+	                                         start -
+	                                         split_buffer->pre_cursor_index];
 
-	return NO_ERROR;
+	return split_buffer_move_to(
+	    split_buffer, start + scan_codepoint_offset(text, length, *column));
+}
+
+result_t split_buffer_goto_line(split_buffer_t *split_buffer, long line) {
+	long start = split_buffer_line_start(split_buffer, line);
+	if (start < 0) {
+		error("line must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	return split_buffer_move_to(split_buffer, start);
 }
 
 result_t split_buffer_append(split_buffer_t *split_buffer, char c) {
@@ -96,9 +552,20 @@ result_t split_buffer_append(split_buffer_t *split_buffer, char c) {
 		return TEXT_BUFFER_ERROR;
 	}
 
-	if (split_buffer->current_size == MAX_BUFFER_SIZE) {
-		error("buffer is full!");
-		return TEXT_BUFFER_ERROR;
+	if (split_buffer->pre_cursor_index == split_buffer->post_cursor_index) {
+		result_t res = split_buffer_reserve(split_buffer, 1);
+		if (res != NO_ERROR) {
+			return res;
+		}
+	}
+
+	if (c == '\n') {
+		result_t res = split_buffer_reserve_newlines(split_buffer, 1);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		split_buffer->newlines[split_buffer->pre_newlines++] =
+		    split_buffer->pre_cursor_index;
 	}
 
 	split_buffer->current_size++;
@@ -113,19 +580,369 @@ result_t split_buffer_append(split_buffer_t *split_buffer, char c) {
 }
 
 result_t split_buffer_remove(split_buffer_t *split_buffer) {
-	if (split_buffer->current_size == 0) {
-		error("buffer is empty!");
+	if (split_buffer->pre_cursor_index == 0) {
+		error("no character before the cursor!");
 		return TEXT_BUFFER_ERROR;
 	}
 
 	split_buffer->current_size--;
 	split_buffer->pre_cursor_index--;
+	if (split_buffer->buffer[split_buffer->pre_cursor_index] == '\n') {
+		split_buffer->pre_newlines--;
+	}
 	debug("pre cursor index: %ld, post cursor index: %ld, current size: %ld",
 	    split_buffer->pre_cursor_index, split_buffer->post_cursor_index,
 	    split_buffer->current_size);
 	return NO_ERROR;
 }
 
+// copies the whole block into the gap in one go, the newlines in it are found
+// with the scan kernels and pushed onto the pre side of the index
+result_t split_buffer_insert(
+    split_buffer_t *split_buffer, const char *data, long length) {
+	if (length < 0) {
+		error("length must be positive!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (!length) {
+		return NO_ERROR;
+	}
+
+	result_t res = split_buffer_reserve(split_buffer, length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	res = split_buffer_reserve_newlines(
+	    split_buffer, scan_count(data, '\n', length));
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	memcpy(&split_buffer->buffer[split_buffer->pre_cursor_index], data, length);
+	const char *newline = scan_memchr(data, '\n', length);
+	while (newline != NULL) {
+		split_buffer->newlines[split_buffer->pre_newlines++] =
+		    split_buffer->pre_cursor_index + (newline - data);
+		newline = scan_memchr(newline + 1, '\n', &data[length] - newline - 1);
+	}
+
+	split_buffer->pre_cursor_index += length;
+	split_buffer->current_size += length;
+	debug("pre cursor index: %ld, post cursor index: %ld, current size: %ld",
+	    split_buffer->pre_cursor_index, split_buffer->post_cursor_index,
+	    split_buffer->current_size);
+
+	return NO_ERROR;
+}
+
+result_t split_buffer_delete(split_buffer_t *split_buffer) {
+	if (split_buffer->pre_cursor_index == split_buffer->current_size) {
+		error("no character after the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+	return split_buffer_delete_range(split_buffer,
+	    split_buffer->pre_cursor_index, split_buffer->pre_cursor_index + 1);
+}
+
+// moves the gap to whichever end of the range is closer and widens it over
+// the range, so the only copy is the gap move. the cursor ends up at start.
+result_t split_buffer_delete_range(
+    split_buffer_t *split_buffer, long start, long end) {
+	if (start < 0 || end > split_buffer->current_size || start > end) {
+		error("range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	if (start == end) {
+		return split_buffer_move_to(split_buffer, start);
+	}
+
+	if (split_buffer->pre_cursor_index >= end) {
+		result_t res = split_buffer_move_to(split_buffer, end);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		split_buffer->pre_cursor_index = start;
+		while (split_buffer->pre_newlines > 0 &&
+		       split_buffer->newlines[split_buffer->pre_newlines - 1] >= start) {
+			split_buffer->pre_newlines--;
+		}
+	} else {
+		result_t res = split_buffer_move_to(split_buffer, start);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		split_buffer->post_cursor_index += end - start;
+		// post newlines are stored from the end, so the ones in the range are
+		// the first few on the post side
+		while (split_buffer->post_newlines > 0 &&
+		       split_buffer->current_size -
+		               split_buffer->newlines[split_buffer->newline_capacity -
+		                                      split_buffer->post_newlines] <
+		           end) {
+			split_buffer->post_newlines--;
+		}
+	}
+
+	split_buffer->current_size -= end - start;
+	debug("pre cursor index: %ld, post cursor index: %ld, current size: %ld",
+	    split_buffer->pre_cursor_index, split_buffer->post_cursor_index,
+	    split_buffer->current_size);
+
+	return NO_ERROR;
+}
+
+/*
+applies the same insert at every offset in one forward sweep of the gap.
+offsets are positions in the text before the edit and must be ascending, so
+the gap only ever moves forward and the whole batch costs O(size + count)
+instead of dragging the gap back and forth for each one. the cursor ends up
+after the last insert.
+*/
+result_t split_buffer_insert_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, const char *data, long length) {
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 || offsets[i] > split_buffer->current_size ||
+		    (i > 0 && offsets[i] < offsets[i - 1])) {
+			error("offsets must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (!count || length <= 0) {
+		return NO_ERROR;
+	}
+
+	result_t res = split_buffer_reserve(split_buffer, count * length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	res = split_buffer_reserve_newlines(
+	    split_buffer, count * scan_count(data, '\n', length));
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	for (long i = 0; i < count; i++) {
+		res = split_buffer_move_to(split_buffer, offsets[i] + i * length);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		res = split_buffer_insert(split_buffer, data, length);
+		if (res != NO_ERROR) {
+			return res;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+// deletes [offset, offset + length) at every offset in one forward sweep, the
+// ranges must be ascending and not overlap. the cursor ends up where the last
+// range was.
+result_t split_buffer_delete_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, long length) {
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 ||
+		    offsets[i] + length > split_buffer->current_size ||
+		    (i > 0 && offsets[i] < offsets[i - 1] + length)) {
+			error("ranges must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (length <= 0) {
+		return NO_ERROR;
+	}
+
+	for (long i = 0; i < count; i++) {
+		long start = offsets[i] - i * length;
+		result_t res =
+		    split_buffer_delete_range(split_buffer, start, start + length);
+		if (res != NO_ERROR) {
+			return res;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+// rebuilds the whole newline index from the text, the index must already have
+// room for every newline
+static void split_buffer_index_newlines(split_buffer_t *split_buffer) {
+	const char *pre = split_buffer->buffer;
+	long pre_length = split_buffer->pre_cursor_index;
+	split_buffer->pre_newlines = 0;
+	const char *newline = scan_memchr(pre, '\n', pre_length);
+	while (newline != NULL) {
+		split_buffer->newlines[split_buffer->pre_newlines++] = newline - pre;
+		newline =
+		    scan_memchr(newline + 1, '\n', &pre[pre_length] - newline - 1);
+	}
+
+	const char *post = &split_buffer->buffer[split_buffer->post_cursor_index];
+	long post_length = split_buffer->capacity - split_buffer->post_cursor_index;
+	split_buffer->post_newlines = scan_count(post, '\n', post_length);
+	long index = split_buffer->newline_capacity - split_buffer->post_newlines;
+	newline = scan_memchr(post, '\n', post_length);
+	while (newline != NULL) {
+		split_buffer->newlines[index++] = post_length - (newline - post);
+		newline =
+		    scan_memchr(newline + 1, '\n', &post[post_length] - newline - 1);
+	}
+}
+
+typedef struct split_buffer_writer_t {
+	char *buffer;
+	long position;
+	long gap_start;
+	long gap;
+} split_buffer_writer_t;
+
+// appends to a block whose gap is already in place, skipping over the gap
+static void split_buffer_write(
+    split_buffer_writer_t *writer, const char *data, long length) {
+	if (writer->position < writer->gap_start) {
+		long before = writer->gap_start - writer->position;
+		if (before > length) {
+			before = length;
+		}
+		memcpy(&writer->buffer[writer->position], data, before);
+		writer->position += before;
+		data += before;
+		length -= before;
+	}
+	memcpy(&writer->buffer[writer->position + writer->gap], data, length);
+	writer->position += length;
+}
+
+static void split_buffer_write_range(split_buffer_writer_t *writer,
+    const split_buffer_t *split_buffer, long start, long end) {
+	const char *pre;
+	const char *post;
+	long pre_length;
+	long post_length;
+	split_buffer_ranges(
+	    split_buffer, start, end, &pre, &pre_length, &post, &post_length);
+	split_buffer_write(writer, pre, pre_length);
+	split_buffer_write(writer, post, post_length);
+}
+
+/*
+swaps [offset, offset + removed) at every offset for the same data, the ranges
+must be ascending and not overlap. the new text is built in one pass into a
+fresh block that already has the gap where the cursor lands, so nothing is
+moved twice. the cursor keeps its place in the text around it, or lands after
+the replacement when it was inside a range.
+*/
+result_t split_buffer_replace_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, long removed, const char *data,
+    long length) {
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 ||
+		    offsets[i] + removed > split_buffer->current_size ||
+		    (i > 0 && offsets[i] < offsets[i - 1] + removed)) {
+			error("ranges must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (!count || removed < 0 || length < 0 || (!removed && !length)) {
+		return NO_ERROR;
+	}
+
+	long delta = length - removed;
+	long size = split_buffer->current_size + count * delta;
+	// at most this many newlines, the index is rebuilt with the exact count
+	long newlines = split_buffer->pre_newlines + split_buffer->post_newlines +
+	                count * scan_count(data, '\n', length);
+	long old_cursor = split_buffer->pre_cursor_index;
+	long cursor = old_cursor;
+	for (long i = 0; i < count && offsets[i] < old_cursor; i++) {
+		if (offsets[i] + removed > old_cursor) {
+			cursor = offsets[i] + i * delta + length;
+			break;
+		}
+		cursor += delta;
+	}
+
+	long capacity = MIN_BUFFER_CAPACITY;
+	while (capacity < size) {
+		capacity *= 2;
+	}
+	char *buffer = malloc(capacity);
+	result_t res = split_buffer_reserve_newlines(split_buffer,
+	    newlines - split_buffer->pre_newlines - split_buffer->post_newlines);
+	if (buffer == NULL || res != NO_ERROR) {
+		error("failed to allocate replaced text!");
+		free(buffer);
+		return TEXT_BUFFER_ERROR;
+	}
+
+	split_buffer_writer_t writer = {buffer, 0, cursor, capacity - size};
+	long copied = 0;
+	for (long i = 0; i < count; i++) {
+		split_buffer_write_range(&writer, split_buffer, copied, offsets[i]);
+		split_buffer_write(&writer, data, length);
+		copied = offsets[i] + removed;
+	}
+	split_buffer_write_range(
+	    &writer, split_buffer, copied, split_buffer->current_size);
+
+	free(split_buffer->buffer);
+	split_buffer->buffer = buffer;
+	split_buffer->capacity = capacity;
+	split_buffer->pre_cursor_index = cursor;
+	split_buffer->post_cursor_index = cursor + capacity - size;
+	split_buffer->current_size = size;
+	split_buffer_index_newlines(split_buffer);
+	debug("replaced %ld ranges, current size: %ld", count, size);
+
+	return NO_ERROR;
+}
+
+// the text before and after the gap, empty sides are left out
+int split_buffer_spans(const split_buffer_t *split_buffer, text_span_t spans[2]) {
+	int count = 0;
+	if (split_buffer->pre_cursor_index > 0) {
+		spans[count++] = (text_span_t){
+		    split_buffer->buffer, split_buffer->pre_cursor_index};
+	}
+	long post_length = split_buffer->capacity - split_buffer->post_cursor_index;
+	if (post_length > 0) {
+		spans[count++] = (text_span_t){
+		    &split_buffer->buffer[split_buffer->post_cursor_index], post_length};
+	}
+	return count;
+}
+
+// contiguous text from offset up to the gap or the end of the buffer
+long split_buffer_span_at(
+    const split_buffer_t *split_buffer, long offset, const char **text) {
+	if (offset < 0 || offset >= split_buffer->current_size) {
+		*text = NULL;
+		return 0;
+	}
+	if (offset < split_buffer->pre_cursor_index) {
+		*text = &split_buffer->buffer[offset];
+		return split_buffer->pre_cursor_index - offset;
+	}
+	long gap = split_buffer->post_cursor_index - split_buffer->pre_cursor_index;
+	*text = &split_buffer->buffer[offset + gap];
+	return split_buffer->current_size - offset;
+}
+
+// contiguous text ending at offset, back to the gap or the start of the buffer
+long split_buffer_span_before(
+    const split_buffer_t *split_buffer, long offset, const char **text) {
+	if (offset <= 0 || offset > split_buffer->current_size) {
+		*text = NULL;
+		return 0;
+	}
+	if (offset <= split_buffer->pre_cursor_index) {
+		*text = split_buffer->buffer;
+		return offset;
+	}
+	*text = &split_buffer->buffer[split_buffer->post_cursor_index];
+	return offset - split_buffer->pre_cursor_index;
+}
+
 char *split_buffer_to_string(split_buffer_t *split_buffer) {
 	if (split_buffer->current_size == 0) {
 		return NULL;
@@ -134,13 +951,13 @@ char *split_buffer_to_string(split_buffer_t *split_buffer) {
 	if (string == NULL) {
 		return NULL;
 	}
-	strncpy(string, split_buffer->buffer, split_buffer->pre_cursor_index);
-	string[split_buffer->pre_cursor_index] = '\0';
-	debug("pre cursor buffer: %s; current_size: %ld", string,
+	long post_length = split_buffer->capacity - split_buffer->post_cursor_index;
+	memcpy(string, split_buffer->buffer, split_buffer->pre_cursor_index);
+	memcpy(&string[split_buffer->pre_cursor_index],
+	    &split_buffer->buffer[split_buffer->post_cursor_index], post_length);
+	string[split_buffer->current_size] = '\0';
+	debug("split buffer to string, current_size: %ld",
 	    split_buffer->current_size);
-	strncat(string, &split_buffer->buffer[split_buffer->post_cursor_index],
-	    MAX_BUFFER_SIZE - split_buffer->post_cursor_index);
-	debug("post cursor buffer: %s", &string[split_buffer->pre_cursor_index]);
 
 	return string;
 }
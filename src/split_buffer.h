@@ -16,28 +16,93 @@
 
 #pragma once
 
+#include "file_io.h"
 #include "result.h"
+#include "text_span.h"
 
 #include <stddef.h>
 #include <stdint.h>
 
-#define MAX_BUFFER_SIZE 4096
+// initial capacity of a fresh buffer, the buffer doubles whenever it runs out
+// of gap space so there is no upper bound on its size
+#define MIN_BUFFER_CAPACITY 4096
 
+/*
+[pre cursor text][gap][post cursor text]
+0        pre_cursor_index  post_cursor_index  capacity
+
+the newline index is a gap array that follows the text's gap. newlines before
+the cursor are stored as offsets from the start, newlines after it as offsets
+from the end, so typing at the cursor never has to touch either side.
+[pre newlines][gap][post newlines]
+0         pre_newlines  newline_capacity - post_newlines  newline_capacity
+*/
 typedef struct split_buffer_t {
+  char *buffer;
+  long capacity;
   long pre_cursor_index;
   long post_cursor_index;
   long current_size;
-  char buffer[MAX_BUFFER_SIZE];
+
+  long *newlines;
+  long newline_capacity;
+  long pre_newlines;
+  long post_newlines;
 } split_buffer_t;
 
-void split_buffer_create(split_buffer_t *split_buffer, const char *string);
+result_t split_buffer_create(split_buffer_t *split_buffer, const char *string);
+// the first length bytes of fd, which may hold NUL bytes
+result_t split_buffer_load(
+    split_buffer_t *split_buffer, file_io_t *io, int fd, long length);
 void split_buffer_destroy(split_buffer_t *split_buffer);
 
+result_t split_buffer_reserve(split_buffer_t *split_buffer, long gap_size);
+
 result_t split_buffer_move(split_buffer_t *split_buffer, long distance);
-result_t split_buffer_ascend(split_buffer_t *split_buffer);
-result_t split_buffer_descend(split_buffer_t *split_buffer);
+// column is the codepoint column to land in, -1 for the cursor's own, which
+// is then stored there
+result_t split_buffer_ascend(split_buffer_t *split_buffer, long *column);
+result_t split_buffer_descend(split_buffer_t *split_buffer, long *column);
+result_t split_buffer_goto_line(split_buffer_t *split_buffer, long line);
+
+long split_buffer_line_count(const split_buffer_t *split_buffer);
+long split_buffer_line_start(const split_buffer_t *split_buffer, long line);
+long split_buffer_line_of(const split_buffer_t *split_buffer, long offset);
+
+long split_buffer_find_next(
+    const split_buffer_t *split_buffer, long offset, char c);
+long split_buffer_find_previous(
+    const split_buffer_t *split_buffer, long offset, char c);
+long split_buffer_find_any(const split_buffer_t *split_buffer, long offset,
+    const char *set, int set_size);
+long split_buffer_count(
+    const split_buffer_t *split_buffer, long start, long end, char c);
+long split_buffer_search_next(const split_buffer_t *split_buffer, long offset,
+    const char *needle, long length);
+long split_buffer_search_previous(const split_buffer_t *split_buffer,
+    long offset, const char *needle, long length);
+long split_buffer_search_all(const split_buffer_t *split_buffer,
+    const char *needle, long length, long *offsets, long capacity);
 
 result_t split_buffer_append(split_buffer_t *split_buffer, char c);
 result_t split_buffer_remove(split_buffer_t *split_buffer);
+result_t split_buffer_insert(
+    split_buffer_t *split_buffer, const char *data, long length);
+result_t split_buffer_delete(split_buffer_t *split_buffer);
+result_t split_buffer_delete_range(
+    split_buffer_t *split_buffer, long start, long end);
+result_t split_buffer_insert_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, const char *data, long length);
+result_t split_buffer_delete_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, long length);
+result_t split_buffer_replace_at_each(split_buffer_t *split_buffer,
+    const long *offsets, long count, long removed, const char *data,
+    long length);
+
+int split_buffer_spans(const split_buffer_t *split_buffer, text_span_t spans[2]);
+long split_buffer_span_at(
+    const split_buffer_t *split_buffer, long offset, const char **text);
+long split_buffer_span_before(
+    const split_buffer_t *split_buffer, long offset, const char **text);
 
 char *split_buffer_to_string(split_buffer_t *split_buffer);
@@ -0,0 +1,640 @@
+#include "text_buffer.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <string.h>
+
+result_t text_buffer_create(
+    text_buffer_t *buffer, text_buffer_backend_t backend, const char *string) {
+	buffer->backend = backend;
+	buffer->version = 0;
+	buffer->goal_column = -1;
+	memset(buffer->observers, 0, sizeof(buffer->observers));
+	// not from a file, so there's nothing to save it over in place
+	dirty_ranges_create(&buffer->dirty);
+	switch (backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_create(&buffer->split_buffer, string);
+	case PIECE_TABLE_BACKEND: {
+		result_t res = piece_table_create(&buffer->piece_table, -1);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		long length = (long)strlen(string);
+		res = piece_table_insert_at(&buffer->piece_table, 0, string, length);
+		buffer->piece_table.cursor = buffer->piece_table.current_size;
+		return res;
+	}
+	case ROPE_BACKEND: {
+		result_t res = rope_create(&buffer->rope, string, (long)strlen(string));
+		buffer->rope.cursor = rope_size(&buffer->rope);
+		return res;
+	}
+	default:
+		error("unknown text buffer backend!");
+		return TEXT_BUFFER_ERROR;
+	}
+}
+
+result_t text_buffer_load(text_buffer_t *buffer, text_buffer_backend_t backend,
+    file_io_t *io, int fd, long length) {
+	buffer->backend = backend;
+	buffer->version = 0;
+	buffer->goal_column = -1;
+	memset(buffer->observers, 0, sizeof(buffer->observers));
+	dirty_ranges_create(&buffer->dirty);
+	dirty_ranges_reset(&buffer->dirty, length);
+	switch (backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_load(&buffer->split_buffer, io, fd, length);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_create(&buffer->piece_table, fd);
+	case ROPE_BACKEND: {
+		result_t res = rope_load(&buffer->rope, io, fd, length);
+		buffer->rope.cursor = rope_size(&buffer->rope);
+		return res;
+	}
+	default:
+		error("unknown text buffer backend!");
+		return TEXT_BUFFER_ERROR;
+	}
+}
+
+void text_buffer_destroy(text_buffer_t *buffer) {
+	dirty_ranges_destroy(&buffer->dirty);
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		split_buffer_destroy(&buffer->split_buffer);
+		break;
+	case PIECE_TABLE_BACKEND:
+		piece_table_destroy(&buffer->piece_table);
+		break;
+	case ROPE_BACKEND:
+		rope_destroy(&buffer->rope);
+		break;
+	}
+}
+
+result_t text_buffer_observe(
+    text_buffer_t *buffer, text_buffer_observer_t observer) {
+	for (int i = 0; i < TEXT_BUFFER_OBSERVERS; i++) {
+		if (buffer->observers[i].edited == NULL) {
+			buffer->observers[i] = observer;
+			return NO_ERROR;
+		}
+	}
+	error("too many observers of one buffer!");
+	return TEXT_BUFFER_ERROR;
+}
+
+void text_buffer_unobserve(text_buffer_t *buffer, void *context) {
+	for (int i = 0; i < TEXT_BUFFER_OBSERVERS; i++) {
+		if (buffer->observers[i].context == context) {
+			buffer->observers[i] = (text_buffer_observer_t){NULL, NULL};
+		}
+	}
+}
+
+long text_buffer_size(const text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return buffer->split_buffer.current_size;
+	case PIECE_TABLE_BACKEND:
+		return buffer->piece_table.current_size;
+	case ROPE_BACKEND:
+		return rope_size(&buffer->rope);
+	}
+	return 0;
+}
+
+long text_buffer_cursor(const text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return buffer->split_buffer.pre_cursor_index;
+	case PIECE_TABLE_BACKEND:
+		return buffer->piece_table.cursor;
+	case ROPE_BACKEND:
+		return buffer->rope.cursor;
+	}
+	return 0;
+}
+
+long text_buffer_line_count(const text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_line_count(&buffer->split_buffer);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_line_count(&buffer->piece_table);
+	case ROPE_BACKEND:
+		return rope_line_count(&buffer->rope);
+	}
+	return 0;
+}
+
+result_t text_buffer_move(text_buffer_t *buffer, long distance) {
+	buffer->goal_column = -1;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_move(&buffer->split_buffer, distance);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_move(&buffer->piece_table, distance);
+	case ROPE_BACKEND:
+		return rope_move(&buffer->rope, distance);
+	}
+	return TEXT_BUFFER_ERROR;
+}
+
+result_t text_buffer_ascend(text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_ascend(&buffer->split_buffer, &buffer->goal_column);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_ascend(&buffer->piece_table, &buffer->goal_column);
+	case ROPE_BACKEND:
+		return rope_ascend(&buffer->rope, &buffer->goal_column);
+	}
+	return TEXT_BUFFER_ERROR;
+}
+
+result_t text_buffer_descend(text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_descend(&buffer->split_buffer, &buffer->goal_column);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_descend(&buffer->piece_table, &buffer->goal_column);
+	case ROPE_BACKEND:
+		return rope_descend(&buffer->rope, &buffer->goal_column);
+	}
+	return TEXT_BUFFER_ERROR;
+}
+
+result_t text_buffer_goto_line(text_buffer_t *buffer, long line) {
+	buffer->goal_column = -1;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_goto_line(&buffer->split_buffer, line);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_goto_line(&buffer->piece_table, line);
+	case ROPE_BACKEND:
+		return rope_goto_line(&buffer->rope, line);
+	}
+	return TEXT_BUFFER_ERROR;
+}
+
+// passes a successful edit on to whoever is watching the buffer
+static void text_buffer_edited(text_buffer_t *buffer, result_t res,
+    long offset, long removed, long inserted) {
+	if (res != NO_ERROR) {
+		return;
+	}
+	buffer->goal_column = -1;
+	dirty_ranges_edit(&buffer->dirty, offset, removed, inserted);
+	for (int i = 0; i < TEXT_BUFFER_OBSERVERS; i++) {
+		const text_buffer_observer_t *observer = &buffer->observers[i];
+		if (observer->edited != NULL) {
+			observer->edited(observer->context, offset, removed, inserted);
+		}
+	}
+}
+
+result_t text_buffer_append(text_buffer_t *buffer, char c) {
+	buffer->version++;
+	long offset = text_buffer_cursor(buffer);
+	result_t res = TEXT_BUFFER_ERROR;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		res = split_buffer_append(&buffer->split_buffer, c);
+		break;
+	case PIECE_TABLE_BACKEND:
+		res = piece_table_append(&buffer->piece_table, c);
+		break;
+	case ROPE_BACKEND:
+		res = rope_append(&buffer->rope, c);
+		break;
+	}
+	text_buffer_edited(buffer, res, offset, 0, 1);
+	return res;
+}
+
+result_t text_buffer_remove(text_buffer_t *buffer) {
+	buffer->version++;
+	long offset = text_buffer_cursor(buffer) - 1;
+	result_t res = TEXT_BUFFER_ERROR;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		res = split_buffer_remove(&buffer->split_buffer);
+		break;
+	case PIECE_TABLE_BACKEND:
+		res = piece_table_remove(&buffer->piece_table);
+		break;
+	case ROPE_BACKEND:
+		res = rope_remove(&buffer->rope);
+		break;
+	}
+	text_buffer_edited(buffer, res, offset, 1, 0);
+	return res;
+}
+
+result_t text_buffer_insert(
+    text_buffer_t *buffer, const char *data, long length) {
+	buffer->version++;
+	long offset = text_buffer_cursor(buffer);
+	result_t res = TEXT_BUFFER_ERROR;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		res = split_buffer_insert(&buffer->split_buffer, data, length);
+		break;
+	case PIECE_TABLE_BACKEND:
+		res = piece_table_insert(&buffer->piece_table, data, length);
+		break;
+	case ROPE_BACKEND:
+		res = rope_insert(&buffer->rope, data, length);
+		break;
+	}
+	text_buffer_edited(buffer, res, offset, 0, length);
+	return res;
+}
+
+result_t text_buffer_delete(text_buffer_t *buffer) {
+	buffer->version++;
+	long offset = text_buffer_cursor(buffer);
+	result_t res = TEXT_BUFFER_ERROR;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		res = split_buffer_delete(&buffer->split_buffer);
+		break;
+	case PIECE_TABLE_BACKEND:
+		res = piece_table_delete(&buffer->piece_table);
+		break;
+	case ROPE_BACKEND:
+		res = rope_delete(&buffer->rope);
+		break;
+	}
+	text_buffer_edited(buffer, res, offset, 1, 0);
+	return res;
+}
+
+result_t text_buffer_delete_range(text_buffer_t *buffer, long start, long end) {
+	buffer->version++;
+	result_t res = TEXT_BUFFER_ERROR;
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		res = split_buffer_delete_range(&buffer->split_buffer, start, end);
+		break;
+	case PIECE_TABLE_BACKEND:
+		res = piece_table_delete_range(&buffer->piece_table, start, end);
+		break;
+	case ROPE_BACKEND:
+		res = rope_delete_range(&buffer->rope, start, end);
+		break;
+	}
+	text_buffer_edited(buffer, res, start, end - start, 0);
+	return res;
+}
+
+// the split buffer sweeps its gap once, the trees find each offset on their own
+// so there is nothing to batch and they just go through them in order
+result_t text_buffer_insert_at_each(text_buffer_t *buffer, const long *offsets,
+    long count, const char *data, long length) {
+	buffer->version++;
+	if (buffer->backend == SPLIT_BUFFER_BACKEND) {
+		result_t res = split_buffer_insert_at_each(
+		    &buffer->split_buffer, offsets, count, data, length);
+		for (long i = 0; i < count && length > 0; i++) {
+			text_buffer_edited(buffer, res, offsets[i] + i * length, 0, length);
+		}
+		return res;
+	}
+
+	long size = text_buffer_size(buffer);
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 || offsets[i] > size ||
+		    (i > 0 && offsets[i] < offsets[i - 1])) {
+			error("offsets must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (!count || length <= 0) {
+		return NO_ERROR;
+	}
+
+	for (long i = 0; i < count; i++) {
+		long offset = offsets[i] + i * length;
+		result_t res;
+		if (buffer->backend == PIECE_TABLE_BACKEND) {
+			res = piece_table_insert_at(
+			    &buffer->piece_table, offset, data, length);
+		} else {
+			res = rope_insert_at(&buffer->rope, offset, data, length);
+		}
+		if (res != NO_ERROR) {
+			// the edits made so far weren't told to anyone
+			dirty_ranges_lose(&buffer->dirty);
+			return res;
+		}
+	}
+
+	long cursor = offsets[count - 1] + count * length;
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		buffer->piece_table.cursor = cursor;
+	} else {
+		buffer->rope.cursor = cursor;
+	}
+	for (long i = 0; i < count; i++) {
+		text_buffer_edited(buffer, NO_ERROR, offsets[i] + i * length, 0, length);
+	}
+
+	return NO_ERROR;
+}
+
+result_t text_buffer_delete_at_each(
+    text_buffer_t *buffer, const long *offsets, long count, long length) {
+	buffer->version++;
+	if (buffer->backend == SPLIT_BUFFER_BACKEND) {
+		result_t res = split_buffer_delete_at_each(
+		    &buffer->split_buffer, offsets, count, length);
+		for (long i = 0; i < count && length > 0; i++) {
+			text_buffer_edited(buffer, res, offsets[i] - i * length, length, 0);
+		}
+		return res;
+	}
+
+	long size = text_buffer_size(buffer);
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 || offsets[i] + length > size ||
+		    (i > 0 && offsets[i] < offsets[i - 1] + length)) {
+			error("ranges must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (!count || length <= 0) {
+		return NO_ERROR;
+	}
+
+	for (long i = 0; i < count; i++) {
+		long offset = offsets[i] - i * length;
+		result_t res;
+		if (buffer->backend == PIECE_TABLE_BACKEND) {
+			res = piece_table_delete_at(&buffer->piece_table, offset, length);
+		} else {
+			res = rope_delete_at(&buffer->rope, offset, length);
+		}
+		if (res != NO_ERROR) {
+			// the edits made so far weren't told to anyone
+			dirty_ranges_lose(&buffer->dirty);
+			return res;
+		}
+	}
+
+	long cursor = offsets[count - 1] - (count - 1) * length;
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		buffer->piece_table.cursor = cursor;
+	} else {
+		buffer->rope.cursor = cursor;
+	}
+	for (long i = 0; i < count; i++) {
+		text_buffer_edited(buffer, NO_ERROR, offsets[i] - i * length, length, 0);
+	}
+
+	return NO_ERROR;
+}
+
+// the same replacement at many ascending ranges. the split buffer rebuilds
+// itself in one pass, the trees swap each range on their own
+result_t text_buffer_replace_at_each(text_buffer_t *buffer,
+    const long *offsets, long count, long removed, const char *data,
+    long length) {
+	buffer->version++;
+	long delta = length - removed;
+	if (buffer->backend == SPLIT_BUFFER_BACKEND) {
+		result_t res = split_buffer_replace_at_each(
+		    &buffer->split_buffer, offsets, count, removed, data, length);
+		for (long i = 0; i < count && (removed > 0 || length > 0); i++) {
+			text_buffer_edited(
+			    buffer, res, offsets[i] + i * delta, removed, length);
+		}
+		return res;
+	}
+
+	long size = text_buffer_size(buffer);
+	for (long i = 0; i < count; i++) {
+		if (offsets[i] < 0 || offsets[i] + removed > size ||
+		    (i > 0 && offsets[i] < offsets[i - 1] + removed)) {
+			error("ranges must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+	}
+	if (!count || removed < 0 || length < 0 || (!removed && !length)) {
+		return NO_ERROR;
+	}
+
+	// the cursor keeps its place in the text around it, or lands after the
+	// replacement when it was inside a range
+	long old_cursor = text_buffer_cursor(buffer);
+	long cursor = old_cursor;
+	for (long i = 0; i < count && offsets[i] < old_cursor; i++) {
+		if (offsets[i] + removed > old_cursor) {
+			cursor = offsets[i] + i * delta + length;
+			break;
+		}
+		cursor += delta;
+	}
+
+	for (long i = 0; i < count; i++) {
+		long offset = offsets[i] + i * delta;
+		result_t res = NO_ERROR;
+		if (buffer->backend == PIECE_TABLE_BACKEND) {
+			if (removed > 0) {
+				res = piece_table_delete_at(&buffer->piece_table, offset, removed);
+			}
+			if (res == NO_ERROR && length > 0) {
+				res = piece_table_insert_at(
+				    &buffer->piece_table, offset, data, length);
+			}
+		} else {
+			if (removed > 0) {
+				res = rope_delete_at(&buffer->rope, offset, removed);
+			}
+			if (res == NO_ERROR && length > 0) {
+				res = rope_insert_at(&buffer->rope, offset, data, length);
+			}
+		}
+		if (res != NO_ERROR) {
+			// the edits made so far weren't told to anyone
+			dirty_ranges_lose(&buffer->dirty);
+			return res;
+		}
+	}
+
+	if (buffer->backend == PIECE_TABLE_BACKEND) {
+		buffer->piece_table.cursor = cursor;
+	} else {
+		buffer->rope.cursor = cursor;
+	}
+	for (long i = 0; i < count; i++) {
+		text_buffer_edited(
+		    buffer, NO_ERROR, offsets[i] + i * delta, removed, length);
+	}
+
+	return NO_ERROR;
+}
+
+// whether needle starts at offset, across however many spans it runs over
+static int text_buffer_matches_at(const text_buffer_t *buffer, long offset,
+    const char *needle, long length) {
+	while (length > 0) {
+		const char *text;
+		long span = text_buffer_span_at(buffer, offset, &text);
+		if (span <= 0) {
+			return 0;
+		}
+		span = span < length ? span : length;
+		if (memcmp(text, needle, span)) {
+			return 0;
+		}
+		offset += span;
+		needle += span;
+		length -= span;
+	}
+	return 1;
+}
+
+/*
+first offset at or after offset where needle starts, -1 if there is none. the
+split buffer searches either side of its gap in place, the other backends a
+span at a time with the matches that run over into the next span checked by
+hand.
+*/
+long text_buffer_search_next(const text_buffer_t *buffer, long offset,
+    const char *needle, long length) {
+	if (buffer->backend == SPLIT_BUFFER_BACKEND) {
+		return split_buffer_search_next(
+		    &buffer->split_buffer, offset, needle, length);
+	}
+	long size = text_buffer_size(buffer);
+	if (length <= 0 || offset < 0 || offset > size) {
+		return -1;
+	}
+	while (offset + length <= size) {
+		const char *text;
+		long span = text_buffer_span_at(buffer, offset, &text);
+		if (span <= 0) {
+			break;
+		}
+		const char *found = scan_find(text, span, needle, length);
+		if (found != NULL) {
+			return offset + (found - text);
+		}
+		for (long i = span - length + 1 > 0 ? span - length + 1 : 0; i < span;
+		     i++) {
+			if (!memcmp(&text[i], needle, span - i) &&
+			    text_buffer_matches_at(buffer, offset + i, needle, length)) {
+				return offset + i;
+			}
+		}
+		offset += span;
+	}
+	return -1;
+}
+
+// last offset where needle starts and ends at or before offset, -1 if there
+// is none
+long text_buffer_search_previous(const text_buffer_t *buffer, long offset,
+    const char *needle, long length) {
+	if (buffer->backend == SPLIT_BUFFER_BACKEND) {
+		return split_buffer_search_previous(
+		    &buffer->split_buffer, offset, needle, length);
+	}
+	if (length <= 0 || offset < 0 || offset > text_buffer_size(buffer)) {
+		return -1;
+	}
+	while (offset >= length) {
+		const char *text;
+		long span = text_buffer_span_before(buffer, offset, &text);
+		if (span <= 0) {
+			break;
+		}
+		const char *found = scan_rfind(text, span, needle, length);
+		if (found != NULL) {
+			return offset - span + (found - text);
+		}
+		// the ones that start in an earlier span and end in this one
+		long start = offset - span;
+		for (long i = start - 1; i >= 0 && i > start - length; i--) {
+			if (i + length <= offset &&
+			    text_buffer_matches_at(buffer, i, needle, length)) {
+				return i;
+			}
+		}
+		offset = start;
+	}
+	return -1;
+}
+
+long text_buffer_span_at(
+    const text_buffer_t *buffer, long offset, const char **text) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_span_at(&buffer->split_buffer, offset, text);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_span_at(&buffer->piece_table, offset, text);
+	case ROPE_BACKEND:
+		return rope_span_at(&buffer->rope, offset, text);
+	}
+	*text = NULL;
+	return 0;
+}
+
+long text_buffer_span_before(
+    const text_buffer_t *buffer, long offset, const char **text) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_span_before(&buffer->split_buffer, offset, text);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_span_before(&buffer->piece_table, offset, text);
+	case ROPE_BACKEND:
+		return rope_span_before(&buffer->rope, offset, text);
+	}
+	*text = NULL;
+	return 0;
+}
+
+void text_buffer_iterator_begin(const text_buffer_t *buffer,
+    text_buffer_iterator_t *iterator, long start, long end) {
+	long size = text_buffer_size(buffer);
+	iterator->buffer = buffer;
+	iterator->offset = start < 0 ? 0 : start;
+	iterator->end = end < 0 || end > size ? size : end;
+}
+
+// fills span with the next run of text, returns 0 once the range is done
+int text_buffer_iterator_next(
+    text_buffer_iterator_t *iterator, text_span_t *span) {
+	if (iterator->offset >= iterator->end) {
+		return 0;
+	}
+	long length =
+	    text_buffer_span_at(iterator->buffer, iterator->offset, &span->data);
+	if (length <= 0) {
+		return 0;
+	}
+	if (length > iterator->end - iterator->offset) {
+		length = iterator->end - iterator->offset;
+	}
+	span->length = length;
+	iterator->offset += length;
+	return 1;
+}
+
+char *text_buffer_to_string(text_buffer_t *buffer) {
+	switch (buffer->backend) {
+	case SPLIT_BUFFER_BACKEND:
+		return split_buffer_to_string(&buffer->split_buffer);
+	case PIECE_TABLE_BACKEND:
+		return piece_table_to_string(&buffer->piece_table);
+	case ROPE_BACKEND:
+		return rope_to_string(&buffer->rope);
+	}
+	return NULL;
+}
@@ -0,0 +1,143 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "dirty_ranges.h"
+#include "file_io.h"
+#include "piece_table.h"
+#include "result.h"
+#include "rope.h"
+#include "split_buffer.h"
+#include "text_span.h"
+
+typedef enum text_buffer_backend_t {
+	SPLIT_BUFFER_BACKEND = 0,
+	PIECE_TABLE_BACKEND,
+	ROPE_BACKEND,
+} text_buffer_backend_t;
+
+// told about every edit once it has been made, in offsets after any earlier
+// edit, for things kept alongside the text that can be patched in place
+typedef struct text_buffer_observer_t {
+	void (*edited)(void *context, long offset, long removed, long inserted);
+	void *context;
+} text_buffer_observer_t;
+
+// the search index and the edit log, with room to spare
+#define TEXT_BUFFER_OBSERVERS 4
+
+/*
+one interface over every storage engine, the app only ever talks to this and
+picks the backend when a file is opened
+*/
+typedef struct text_buffer_t {
+	text_buffer_backend_t backend;
+	// bumped by every edit, so anything derived from the text can tell it's
+	// out of date
+	unsigned long version;
+	// the column up and down aim for, so passing through a short line doesn't
+	// pull the cursor in. -1 until the first vertical move after any other
+	// move or edit.
+	long goal_column;
+	text_buffer_observer_t observers[TEXT_BUFFER_OBSERVERS];
+	// what changed since the file was loaded or last saved, so a save can
+	// write only that
+	dirty_ranges_t dirty;
+	union {
+		split_buffer_t split_buffer;
+		piece_table_t piece_table;
+		rope_t rope;
+	};
+} text_buffer_t;
+
+result_t text_buffer_create(
+    text_buffer_t *buffer, text_buffer_backend_t backend, const char *string);
+// the first length bytes of fd, NUL bytes and all. a piece table maps the
+// whole file instead of reading it.
+result_t text_buffer_load(text_buffer_t *buffer, text_buffer_backend_t backend,
+    file_io_t *io, int fd, long length);
+void text_buffer_destroy(text_buffer_t *buffer);
+
+// observers are told about edits in the order they were added, and are
+// removed by their context
+result_t text_buffer_observe(
+    text_buffer_t *buffer, text_buffer_observer_t observer);
+void text_buffer_unobserve(text_buffer_t *buffer, void *context);
+
+long text_buffer_size(const text_buffer_t *buffer);
+long text_buffer_cursor(const text_buffer_t *buffer);
+long text_buffer_line_count(const text_buffer_t *buffer);
+
+result_t text_buffer_move(text_buffer_t *buffer, long distance);
+result_t text_buffer_ascend(text_buffer_t *buffer);
+result_t text_buffer_descend(text_buffer_t *buffer);
+result_t text_buffer_goto_line(text_buffer_t *buffer, long line);
+
+result_t text_buffer_append(text_buffer_t *buffer, char c);
+result_t text_buffer_remove(text_buffer_t *buffer);
+
+// bulk edits for paste, replace and replay. insert leaves the cursor after the
+// new text, delete_range leaves it at start.
+result_t text_buffer_insert(
+    text_buffer_t *buffer, const char *data, long length);
+result_t text_buffer_delete(text_buffer_t *buffer);
+result_t text_buffer_delete_range(text_buffer_t *buffer, long start, long end);
+
+// the same edit at many ascending offsets, for multiple cursors. offsets are
+// positions before the edit, the cursor ends up at the last one.
+result_t text_buffer_insert_at_each(text_buffer_t *buffer, const long *offsets,
+    long count, const char *data, long length);
+result_t text_buffer_delete_at_each(
+    text_buffer_t *buffer, const long *offsets, long count, long length);
+// [offset, offset + removed) at every offset swapped for data, the ranges must
+// be ascending and not overlap. the cursor keeps its place in the text.
+result_t text_buffer_replace_at_each(text_buffer_t *buffer,
+    const long *offsets, long count, long removed, const char *data,
+    long length);
+
+// literal searches, -1 when there is no match. previous only finds matches
+// that end at or before offset.
+long text_buffer_search_next(const text_buffer_t *buffer, long offset,
+    const char *needle, long length);
+long text_buffer_search_previous(const text_buffer_t *buffer, long offset,
+    const char *needle, long length);
+
+/*
+walks the text as the backend stores it, a split buffer yields at most two
+spans and the other backends one per piece or leaf. the spans point straight
+into the buffer and stay valid until it's next edited. an end of -1 walks to
+the end of the buffer.
+*/
+typedef struct text_buffer_iterator_t {
+	const text_buffer_t *buffer;
+	long offset;
+	long end;
+} text_buffer_iterator_t;
+
+void text_buffer_iterator_begin(const text_buffer_t *buffer,
+    text_buffer_iterator_t *iterator, long start, long end);
+int text_buffer_iterator_next(
+    text_buffer_iterator_t *iterator, text_span_t *span);
+
+long text_buffer_span_at(
+    const text_buffer_t *buffer, long offset, const char **text);
+// the contiguous text that ends at offset, for walking the buffer backwards
+long text_buffer_span_before(
+    const text_buffer_t *buffer, long offset, const char **text);
+
+char *text_buffer_to_string(text_buffer_t *buffer);
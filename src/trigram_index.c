@@ -0,0 +1,510 @@
+#include "trigram_index.h"
+#define NDEBUG
+#include "logger.h"
+#include "scan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAM_BUCKETS (1L << TRIGRAM_BUCKET_BITS)
+
+static unsigned trigram_bucket(
+    unsigned char a, unsigned char b, unsigned char c) {
+	uint32_t gram = (uint32_t)a << 16 | (uint32_t)b << 8 | c;
+	return (gram * 2654435761u) >> (32 - TRIGRAM_BUCKET_BITS);
+}
+
+static int trigram_byte_at(const text_buffer_t *buffer, long offset) {
+	const char *text;
+	if (!text_buffer_span_at(buffer, offset, &text)) {
+		return -1;
+	}
+	return (unsigned char)text[0];
+}
+
+static int trigram_matches_at(const text_buffer_t *buffer, long offset,
+    const char *needle, long length) {
+	for (long i = 0; i < length; i++) {
+		if (trigram_byte_at(buffer, offset + i) != (unsigned char)needle[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// first occurrence that starts at or after from and ends by to
+static long trigram_find_range(const text_buffer_t *buffer, long from,
+    long to, const char *needle, long length) {
+	long position = from;
+	while (position + length <= to) {
+		const char *text;
+		long span = text_buffer_span_at(buffer, position, &text);
+		if (span > to - position) {
+			span = to - position;
+		}
+		const char *found = scan_find(text, span, needle, length);
+		if (found != NULL) {
+			return position + (found - text);
+		}
+		// the ones that run over into the next span
+		long straddle = span - length + 1;
+		for (long i = straddle < 0 ? 0 : straddle;
+		     i < span && position + i + length <= to; i++) {
+			if (!memcmp(&text[i], needle, span - i) &&
+			    trigram_matches_at(buffer, position + i, needle, length)) {
+				return position + i;
+			}
+		}
+		position += span;
+	}
+	return -1;
+}
+
+// reads the snapshot a byte at a time, jumping between its spans
+typedef struct trigram_reader_t {
+	const text_snapshot_t *snapshot;
+	long span;
+	long span_start;
+} trigram_reader_t;
+
+static int trigram_reader_byte(trigram_reader_t *reader, long offset) {
+	const text_snapshot_t *snapshot = reader->snapshot;
+	// the next chunk starts up to two bytes behind where the last one stopped
+	while (offset < reader->span_start) {
+		reader->span--;
+		reader->span_start -= snapshot->spans[reader->span].length;
+	}
+	while (reader->span < snapshot->span_count &&
+	       offset >= reader->span_start +
+	                     snapshot->spans[reader->span].length) {
+		reader->span_start += snapshot->spans[reader->span].length;
+		reader->span++;
+	}
+	if (reader->span >= snapshot->span_count) {
+		return -1;
+	}
+	return (unsigned char)
+	    snapshot->spans[reader->span].data[offset - reader->span_start];
+}
+
+// collects the buckets of every trigram starting inside the chunk
+static long trigram_collect(trigram_index_t *index, trigram_reader_t *reader,
+    const trigram_job_t *job) {
+	if (++index->generation == 0) {
+		memset(index->seen, 0, TRIGRAM_BUCKETS * sizeof(unsigned));
+		index->generation = 1;
+	}
+	long count = 0;
+	long end = job->offset + job->length;
+	int a = trigram_reader_byte(reader, job->offset);
+	int b = trigram_reader_byte(reader, job->offset + 1);
+	for (long offset = job->offset; offset < end && b >= 0; offset++) {
+		int c = trigram_reader_byte(reader, offset + 2);
+		if (c < 0) {
+			break;
+		}
+		unsigned bucket = trigram_bucket(a, b, c);
+		if (index->seen[bucket] != index->generation) {
+			index->seen[bucket] = index->generation;
+			index->found[count++] = bucket;
+		}
+		a = b;
+		b = c;
+	}
+	return count;
+}
+
+static int trigram_postings_add(
+    trigram_index_t *index, trigram_postings_t *postings, int chunk) {
+	if (postings->count && postings->chunks[postings->count - 1] == chunk) {
+		return 1;
+	}
+	if (postings->count == postings->capacity) {
+		int capacity = postings->capacity ? postings->capacity * 2 : 4;
+		int *chunks = realloc(postings->chunks, capacity * sizeof(int));
+		if (chunks == NULL) {
+			return 0;
+		}
+		index->memory += (capacity - postings->capacity) * sizeof(int);
+		postings->chunks = chunks;
+		postings->capacity = capacity;
+	}
+	postings->chunks[postings->count++] = chunk;
+	return 1;
+}
+
+// called and returns with the lock held. every chunk becomes a candidate
+// first, so searches in between batches never trust half cleared postings.
+static void trigram_postings_clear(trigram_index_t *index) {
+	for (long i = 0; i < index->chunk_count; i++) {
+		index->chunks[i].indexed = 0;
+	}
+	index->stale = 0;
+	index->full = 0;
+	for (long i = 0; i < TRIGRAM_BUCKETS; i++) {
+		index->memory -= index->postings[i].capacity * sizeof(int);
+		free(index->postings[i].chunks);
+		index->postings[i] = (trigram_postings_t){NULL, 0, 0};
+		if (i % TRIGRAM_BATCH == TRIGRAM_BATCH - 1) {
+			pthread_mutex_unlock(&index->lock);
+			pthread_mutex_lock(&index->lock);
+		}
+	}
+}
+
+/*
+merges one chunk into the postings a batch at a time, returns 0 once the
+limit is reached. the chunk is a candidate for every search until its last
+batch is in, so the ones before it only add to what it's already assumed to
+hold.
+*/
+static int trigram_publish(
+    trigram_index_t *index, const trigram_job_t *job, long count) {
+	int room = 1;
+	for (long i = 0; i < count && room;) {
+		long batch = count - i < TRIGRAM_BATCH ? count - i : TRIGRAM_BATCH;
+		pthread_mutex_lock(&index->lock);
+		room = index->memory + batch * (long)sizeof(int) <= index->limit;
+		for (long end = i + batch; i < end && room; i++) {
+			room = trigram_postings_add(
+			    index, &index->postings[index->found[i]], job->chunk);
+		}
+		pthread_mutex_unlock(&index->lock);
+	}
+
+	pthread_mutex_lock(&index->lock);
+	trigram_chunk_t *chunk = &index->chunks[job->chunk];
+	if (!room) {
+		index->full = 1;
+	} else {
+		if (chunk->indexed) {
+			index->stale += count;
+		}
+		// edited while it was being read, it stays a candidate
+		if (chunk->edits == job->edits) {
+			chunk->indexed = job->edits;
+		}
+	}
+	pthread_mutex_unlock(&index->lock);
+	return room;
+}
+
+static void *trigram_thread(void *argument) {
+	trigram_index_t *index = argument;
+	pthread_mutex_lock(&index->lock);
+	while (1) {
+		while (!index->stop && index->snapshot == NULL) {
+			pthread_cond_wait(&index->wake, &index->lock);
+		}
+		if (index->stop) {
+			break;
+		}
+		if (index->reset) {
+			trigram_postings_clear(index);
+			index->reset = 0;
+		}
+		pthread_mutex_unlock(&index->lock);
+
+		// a rope's leaves are listed here, it's too slow for a frame
+		int listed = text_snapshot_list(index->snapshot) == NO_ERROR;
+		trigram_reader_t reader = {index->snapshot, 0, 0};
+		for (long i = 0; listed && i < index->job_count && !index->stop; i++) {
+			long count = trigram_collect(index, &reader, &index->jobs[i]);
+			if (!trigram_publish(index, &index->jobs[i], count)) {
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&index->lock);
+		text_snapshot_release(index->snapshot);
+		index->snapshot = NULL;
+		index->job_count = 0;
+	}
+	pthread_mutex_unlock(&index->lock);
+	return NULL;
+}
+
+// runs on every keystroke, so it never waits on the thread
+static void trigram_edited(
+    void *context, long offset, long removed, long inserted) {
+	trigram_index_t *index = context;
+	long start = 0;
+	int grown = 0;
+	for (long i = 0; i < index->chunk_count; i++) {
+		trigram_chunk_t *chunk = &index->chunks[i];
+		long end = start + chunk->length;
+		if (start > offset + removed) {
+			break;
+		}
+		// trigrams starting two bytes early run into the edit
+		if (end >= offset - 2) {
+			chunk->edits++;
+		}
+		long low = start > offset ? start : offset;
+		long high = end < offset + removed ? end : offset + removed;
+		if (high > low) {
+			chunk->length -= high - low;
+		}
+		if (inserted && !grown &&
+		    (end >= offset || i == index->chunk_count - 1)) {
+			chunk->length += inserted;
+			grown = 1;
+		}
+		start = end;
+	}
+	index->pending = 1;
+}
+
+void trigram_index_destroy(trigram_index_t *index) {
+	if (index->running) {
+		pthread_mutex_lock(&index->lock);
+		index->stop = 1;
+		pthread_cond_signal(&index->wake);
+		pthread_mutex_unlock(&index->lock);
+		pthread_join(index->thread, NULL);
+		index->running = 0;
+	}
+	if (index->buffer != NULL) {
+		text_buffer_unobserve(index->buffer, index);
+	}
+	if (index->snapshot != NULL) {
+		text_snapshot_release(index->snapshot);
+	}
+	if (index->postings != NULL) {
+		for (long i = 0; i < TRIGRAM_BUCKETS; i++) {
+			free(index->postings[i].chunks);
+		}
+	}
+	free(index->postings);
+	free(index->chunks);
+	free(index->jobs);
+	free(index->seen);
+	free(index->found);
+	free(index->candidates);
+	free(index->window);
+	pthread_mutex_destroy(&index->lock);
+	pthread_cond_destroy(&index->wake);
+	memset(index, 0, sizeof(trigram_index_t));
+}
+
+result_t trigram_index_create(
+    trigram_index_t *index, text_buffer_t *buffer, long limit) {
+	memset(index, 0, sizeof(trigram_index_t));
+	pthread_mutex_init(&index->lock, NULL);
+	pthread_cond_init(&index->wake, NULL);
+	index->buffer = buffer;
+	index->limit = limit;
+
+	long size = text_buffer_size(buffer);
+	index->chunk_count = size ? (size + TRIGRAM_CHUNK_BYTES - 1) /
+	                                TRIGRAM_CHUNK_BYTES
+	                          : 1;
+	index->chunks = malloc(index->chunk_count * sizeof(trigram_chunk_t));
+	index->jobs = malloc(index->chunk_count * sizeof(trigram_job_t));
+	index->postings = calloc(TRIGRAM_BUCKETS, sizeof(trigram_postings_t));
+	index->seen = calloc(TRIGRAM_BUCKETS, sizeof(unsigned));
+	index->found = malloc(TRIGRAM_BUCKETS * sizeof(int));
+	index->candidates = malloc(index->chunk_count);
+	index->window = malloc((index->chunk_count + 1) * sizeof(long));
+	if (index->chunks == NULL || index->jobs == NULL ||
+	    index->postings == NULL || index->seen == NULL ||
+	    index->found == NULL || index->candidates == NULL ||
+	    index->window == NULL) {
+		error("failed to allocate trigram index!");
+		trigram_index_destroy(index);
+		return TEXT_BUFFER_ERROR;
+	}
+	for (long i = 0; i < index->chunk_count; i++) {
+		long length = size - i * TRIGRAM_CHUNK_BYTES;
+		index->chunks[i] = (trigram_chunk_t){
+		    length < TRIGRAM_CHUNK_BYTES ? length : TRIGRAM_CHUNK_BYTES, 1, 0};
+	}
+	index->memory = TRIGRAM_BUCKETS * sizeof(trigram_postings_t) +
+	                index->chunk_count * sizeof(trigram_chunk_t);
+	index->pending = 1;
+
+	if (pthread_create(&index->thread, NULL, trigram_thread, index)) {
+		error("failed to start trigram index thread!");
+		trigram_index_destroy(index);
+		return TEXT_BUFFER_ERROR;
+	}
+	index->running = 1;
+	result_t res = text_buffer_observe(
+	    buffer, (text_buffer_observer_t){trigram_edited, index});
+	if (res != NO_ERROR) {
+		trigram_index_destroy(index);
+		return res;
+	}
+	trigram_index_refresh(index);
+
+	return NO_ERROR;
+}
+
+void trigram_index_refresh(trigram_index_t *index) {
+	// held means the thread is busy publishing, there's nothing to hand out
+	if (!index->pending || pthread_mutex_trylock(&index->lock)) {
+		return;
+	}
+	if (index->snapshot != NULL) {
+		pthread_mutex_unlock(&index->lock);
+		return;
+	}
+	// postings from old versions of chunks are what filled it, start over
+	if (index->full && index->stale > 0) {
+		index->reset = 1;
+	} else if (index->full) {
+		pthread_mutex_unlock(&index->lock);
+		return;
+	}
+
+	text_snapshot_t *snapshot;
+	if (text_snapshot_defer(index->buffer, &snapshot) != NO_ERROR) {
+		pthread_mutex_unlock(&index->lock);
+		return;
+	}
+	long start = 0;
+	index->job_count = 0;
+	for (long i = 0; i < index->chunk_count; i++) {
+		trigram_chunk_t *chunk = &index->chunks[i];
+		if (index->reset || chunk->indexed != chunk->edits) {
+			index->jobs[index->job_count++] =
+			    (trigram_job_t){i, start, chunk->length, chunk->edits};
+		}
+		start += chunk->length;
+	}
+	index->pending = 0;
+	index->snapshot = snapshot;
+	pthread_cond_signal(&index->wake);
+	pthread_mutex_unlock(&index->lock);
+	debug("indexing %ld trigram chunks", index->job_count);
+}
+
+int trigram_index_busy(trigram_index_t *index) {
+	if (pthread_mutex_trylock(&index->lock)) {
+		return 1;
+	}
+	int busy = index->snapshot != NULL;
+	pthread_mutex_unlock(&index->lock);
+	return busy;
+}
+
+long trigram_index_memory(trigram_index_t *index) {
+	pthread_mutex_lock(&index->lock);
+	long memory = index->memory;
+	pthread_mutex_unlock(&index->lock);
+	return memory;
+}
+
+/*
+a chunk is a candidate when every trigram of the needle shows up in it or in
+the chunks after it that an occurrence starting inside it could reach. chunks
+whose postings are out of date count as having every trigram.
+*/
+static void trigram_candidates(
+    trigram_index_t *index, const char *needle, long length) {
+	long count = index->chunk_count;
+	memset(index->candidates, 1, count);
+
+	// how far an occurrence starting in each chunk can reach
+	long reach = 0;
+	long covered = 0;
+	for (long i = 0; i < count; i++) {
+		if (reach < i) {
+			reach = i;
+			covered = 0;
+		}
+		while (reach + 1 < count && covered < length - 1) {
+			covered += index->chunks[++reach].length;
+		}
+		index->window[i] = reach;
+		covered -= reach > i ? index->chunks[i + 1].length : 0;
+	}
+
+	// the rarest distinct trigrams narrow things down the most
+	unsigned grams[TRIGRAM_QUERY_GRAMS];
+	int gram_count = 0;
+	for (long i = 0; i + 2 < length; i++) {
+		unsigned bucket = trigram_bucket(needle[i], needle[i + 1], needle[i + 2]);
+		int duplicate = 0;
+		for (int j = 0; j < gram_count; j++) {
+			duplicate |= grams[j] == bucket;
+		}
+		if (duplicate) {
+			continue;
+		}
+		if (gram_count < TRIGRAM_QUERY_GRAMS) {
+			grams[gram_count++] = bucket;
+			continue;
+		}
+		int rarest = 0;
+		for (int j = 1; j < gram_count; j++) {
+			if (index->postings[grams[j]].count >
+			    index->postings[grams[rarest]].count) {
+				rarest = j;
+			}
+		}
+		if (index->postings[bucket].count <
+		    index->postings[grams[rarest]].count) {
+			grams[rarest] = bucket;
+		}
+	}
+
+	long *present = malloc((count + 1) * sizeof(long));
+	unsigned char *has = malloc(count);
+	if (present == NULL || has == NULL) {
+		free(present);
+		free(has);
+		return;
+	}
+	for (int g = 0; g < gram_count; g++) {
+		const trigram_postings_t *postings = &index->postings[grams[g]];
+		for (long i = 0; i < count; i++) {
+			has[i] = index->chunks[i].indexed != index->chunks[i].edits;
+		}
+		for (int j = 0; j < postings->count; j++) {
+			has[postings->chunks[j]] = 1;
+		}
+		present[0] = 0;
+		for (long i = 0; i < count; i++) {
+			present[i + 1] = present[i] + has[i];
+		}
+		for (long i = 0; i < count; i++) {
+			if (present[index->window[i] + 1] == present[i]) {
+				index->candidates[i] = 0;
+			}
+		}
+	}
+	free(present);
+	free(has);
+}
+
+long trigram_index_find(trigram_index_t *index, long offset,
+    const char *needle, long length) {
+	const text_buffer_t *buffer = index->buffer;
+	long size = text_buffer_size(buffer);
+	if (length < 3 || length > TRIGRAM_CHUNK_BYTES) {
+		return trigram_find_range(buffer, offset, size, needle, length);
+	}
+
+	pthread_mutex_lock(&index->lock);
+	trigram_candidates(index, needle, length);
+	long start = 0;
+	long found = -1;
+	for (long i = 0; i < index->chunk_count && found < 0; i++) {
+		long end = start + index->chunks[i].length;
+		if (index->candidates[i] && end > offset) {
+			// runs of candidates are scanned in one go
+			while (i + 1 < index->chunk_count && index->candidates[i + 1]) {
+				end += index->chunks[++i].length;
+			}
+			long from = start > offset ? start : offset;
+			long to = end + length - 1 < size ? end + length - 1 : size;
+			found = trigram_find_range(buffer, from, to, needle, length);
+		}
+		start = end;
+	}
+	pthread_mutex_unlock(&index->lock);
+
+	return found;
+}
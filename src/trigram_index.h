@@ -0,0 +1,123 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+#pragma once
+
+#include "result.h"
+#include "snapshot.h"
+#include "text_buffer.h"
+
+#include <pthread.h>
+
+// the unit the index narrows a search down to, and what an edit invalidates
+#define TRIGRAM_CHUNK_BYTES (64L * 1024L)
+// trigrams are hashed into this many posting lists
+#define TRIGRAM_BUCKET_BITS 18
+// a search only intersects the rarest few of the needle's trigrams
+#define TRIGRAM_QUERY_GRAMS 8
+// postings added or freed per hold of the lock, so the editor never waits
+// on more than a batch
+#define TRIGRAM_BATCH 1024
+
+typedef struct trigram_chunk_t {
+	// only ever touched on the editor's thread
+	long length;
+	// bumped by every edit near the chunk, the postings only describe it while
+	// indexed has caught up. the thread reads it without the lock.
+	_Atomic unsigned long edits;
+	unsigned long indexed;
+} trigram_chunk_t;
+
+// ids of the chunks a bucket's trigrams appear in
+typedef struct trigram_postings_t {
+	int *chunks;
+	int count;
+	int capacity;
+} trigram_postings_t;
+
+typedef struct trigram_job_t {
+	int chunk;
+	long offset;
+	long length;
+	unsigned long edits;
+} trigram_job_t;
+
+/*
+chunk level trigram postings over a buffer, built on a background thread
+from snapshots so the editor never waits on it. edits only bump the chunks
+they touch, which count as candidates for every search until the thread gets
+round to indexing them again. old postings of a re-indexed chunk are left
+behind since a false candidate only costs a scan of one chunk.
+
+the chunk list is fixed when the index is created, a chunk just grows or
+shrinks with the edits made inside it. edits never take the lock, they only
+touch what the thread doesn't: chunk lengths, the pending flag and the atomic
+edit counters. the postings and indexed marks are guarded by lock, which the
+thread holds for a batch at a time and the per frame calls only try for.
+*/
+typedef struct trigram_index_t {
+	text_buffer_t *buffer;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+	int running;
+	// checked by the thread between chunks so closing a file doesn't wait on
+	// a whole pass
+	_Atomic int stop;
+
+	trigram_chunk_t *chunks;
+	long chunk_count;
+	trigram_postings_t *postings;
+	// bytes held by the postings, never allowed past limit
+	long memory;
+	long limit;
+	// postings left over from chunks that have been indexed more than once
+	long stale;
+	// the limit was hit, chunks not indexed yet stay candidates
+	int full;
+	// an edit came in since the last job was handed out, editor side only
+	int pending;
+
+	// the job the thread is working on, NULL while it's idle
+	text_snapshot_t *snapshot;
+	trigram_job_t *jobs;
+	long job_count;
+	int reset;
+
+	// thread side scratch for collecting one chunk's trigrams
+	unsigned *seen;
+	int *found;
+	unsigned generation;
+	// search side scratch, one entry per chunk
+	unsigned char *candidates;
+	long *window;
+} trigram_index_t;
+
+// starts indexing buffer in the background and hooks into its edits
+result_t trigram_index_create(
+    trigram_index_t *index, text_buffer_t *buffer, long limit);
+void trigram_index_destroy(trigram_index_t *index);
+
+// hands chunks edited since the last call to the thread, cheap to call every
+// frame since it does nothing while the thread is busy
+void trigram_index_refresh(trigram_index_t *index);
+int trigram_index_busy(trigram_index_t *index);
+long trigram_index_memory(trigram_index_t *index);
+
+// next occurrence of needle at or after offset, -1 if there is none. only
+// the chunks the postings can't rule out are scanned.
+long trigram_index_find(trigram_index_t *index, long offset,
+    const char *needle, long length);
@@ -0,0 +1,599 @@
+#include "undo.h"
+#define NDEBUG
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+result_t undo_journal_create(undo_journal_t *journal, long limit) {
+	journal->records = NULL;
+	journal->record_capacity = 0;
+	journal->first = 0;
+	journal->current = 0;
+	journal->count = 0;
+	journal->arena = NULL;
+	journal->arena_capacity = 0;
+	journal->arena_start = 0;
+	journal->arena_length = 0;
+	journal->limit = limit < 0 ? 0 : limit;
+	journal->coalesce = 0;
+
+	return NO_ERROR;
+}
+
+void undo_journal_destroy(undo_journal_t *journal) {
+	free(journal->records);
+	free(journal->arena);
+	undo_journal_create(journal, journal->limit);
+}
+
+// forgets the history but keeps the memory for the next file
+void undo_journal_clear(undo_journal_t *journal) {
+	journal->first = 0;
+	journal->current = 0;
+	journal->count = 0;
+	journal->arena_start = 0;
+	journal->arena_length = 0;
+	journal->coalesce = 0;
+}
+
+long undo_journal_memory(const undo_journal_t *journal) {
+	return (journal->count - journal->first) * (long)sizeof(undo_record_t) +
+	       journal->arena_length - journal->arena_start;
+}
+
+void undo_journal_seal(undo_journal_t *journal) { journal->coalesce = 0; }
+
+static result_t undo_journal_reserve(undo_journal_t *journal, long bytes) {
+	if (journal->arena_length + bytes <= journal->arena_capacity) {
+		return NO_ERROR;
+	}
+
+	long capacity =
+	    journal->arena_capacity ? journal->arena_capacity * 2 : 4096;
+	while (capacity < journal->arena_length + bytes) {
+		capacity *= 2;
+	}
+	char *arena = realloc(journal->arena, capacity);
+	if (arena == NULL) {
+		error("failed to grow undo arena!");
+		return TEXT_BUFFER_ERROR;
+	}
+	journal->arena = arena;
+	journal->arena_capacity = capacity;
+
+	return NO_ERROR;
+}
+
+static result_t undo_journal_reserve_record(undo_journal_t *journal) {
+	if (journal->count < journal->record_capacity) {
+		return NO_ERROR;
+	}
+
+	long capacity =
+	    journal->record_capacity ? journal->record_capacity * 2 : 64;
+	undo_record_t *records =
+	    realloc(journal->records, capacity * sizeof(undo_record_t));
+	if (records == NULL) {
+		error("failed to grow undo records!");
+		return TEXT_BUFFER_ERROR;
+	}
+	journal->records = records;
+	journal->record_capacity = capacity;
+
+	return NO_ERROR;
+}
+
+// slides the live records and their bytes back to the start of their arrays
+static void undo_journal_compact(undo_journal_t *journal) {
+	for (long i = journal->first; i < journal->count; i++) {
+		journal->records[i].data -= journal->arena_start;
+	}
+	memmove(journal->records, &journal->records[journal->first],
+	    (journal->count - journal->first) * sizeof(undo_record_t));
+	memmove(journal->arena, &journal->arena[journal->arena_start],
+	    journal->arena_length - journal->arena_start);
+
+	journal->current -= journal->first;
+	journal->count -= journal->first;
+	journal->first = 0;
+	journal->arena_length -= journal->arena_start;
+	journal->arena_start = 0;
+}
+
+// drops the oldest records until the journal fits in its limit
+static void undo_journal_trim(undo_journal_t *journal) {
+	if (!journal->limit) {
+		return;
+	}
+	// a group is never left half forgotten
+	while (journal->first < journal->count &&
+	       (undo_journal_memory(journal) > journal->limit ||
+	           journal->records[journal->first].group)) {
+		journal->first++;
+		journal->arena_start = journal->first < journal->count
+		                           ? journal->records[journal->first].data
+		                           : journal->arena_length;
+	}
+	if (journal->current < journal->first) {
+		journal->current = journal->first;
+	}
+
+	// only compact once the dead space outweighs what is left, so every byte
+	// is moved at most once per byte dropped
+	if (journal->arena_start > journal->arena_length - journal->arena_start) {
+		undo_journal_compact(journal);
+	}
+}
+
+// the last record, if the next edit is allowed to be merged into it
+static undo_record_t *undo_journal_last(undo_journal_t *journal) {
+	if (!journal->coalesce || journal->current != journal->count ||
+	    journal->current == journal->first) {
+		return NULL;
+	}
+	undo_record_t *last = &journal->records[journal->current - 1];
+	if (last->removed_length + last->inserted_length >= UNDO_COALESCE_LIMIT) {
+		return NULL;
+	}
+	return last;
+}
+
+// starts a new record with room for its bytes, throwing away anything that
+// could still have been redone
+static result_t undo_journal_push(undo_journal_t *journal, long offset,
+    long removed_length, long inserted_length, undo_record_t **record) {
+	journal->count = journal->current;
+	journal->arena_length =
+	    journal->current > journal->first
+	        ? journal->records[journal->current - 1].data +
+	              journal->records[journal->current - 1].removed_length +
+	              journal->records[journal->current - 1].inserted_length
+	        : journal->arena_start;
+
+	result_t res = undo_journal_reserve_record(journal);
+	if (res != NO_ERROR) {
+		return res;
+	}
+	res = undo_journal_reserve(journal, removed_length + inserted_length);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	*record = &journal->records[journal->count++];
+	journal->current = journal->count;
+	(*record)->offset = offset;
+	(*record)->removed_length = removed_length;
+	(*record)->inserted_length = inserted_length;
+	(*record)->data = journal->arena_length;
+	(*record)->group = 0;
+	journal->arena_length += removed_length + inserted_length;
+
+	return NO_ERROR;
+}
+
+static void undo_journal_copy(
+    const text_buffer_t *buffer, long start, long end, char *out) {
+	text_buffer_iterator_t iterator;
+	text_span_t span;
+	text_buffer_iterator_begin(buffer, &iterator, start, end);
+	while (text_buffer_iterator_next(&iterator, &span)) {
+		memcpy(out, span.data, span.length);
+		out += span.length;
+	}
+}
+
+static char undo_journal_byte(const text_buffer_t *buffer, long offset) {
+	const char *text;
+	text_buffer_span_at(buffer, offset, &text);
+	return text[0];
+}
+
+// the buffer has already been edited, so a history that can't record the edit
+// is no longer true and has to go
+static result_t undo_journal_lost(undo_journal_t *journal) {
+	error("failed to record edit, undo history cleared!");
+	undo_journal_clear(journal);
+	return TEXT_BUFFER_ERROR;
+}
+
+result_t undo_journal_append(
+    undo_journal_t *journal, text_buffer_t *buffer, char c) {
+	long cursor = text_buffer_cursor(buffer);
+	result_t res = text_buffer_append(buffer, c);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	undo_record_t *last = undo_journal_last(journal);
+	if (last != NULL && last->offset + last->inserted_length == cursor) {
+		if (undo_journal_reserve(journal, 1) != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->arena[journal->arena_length++] = c;
+		last->inserted_length++;
+	} else {
+		undo_record_t *record;
+		if (undo_journal_push(journal, cursor, 0, 1, &record) != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->arena[record->data] = c;
+	}
+	journal->coalesce = 1;
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_remove(undo_journal_t *journal, text_buffer_t *buffer) {
+	long cursor = text_buffer_cursor(buffer);
+	if (cursor == 0) {
+		error("no character before the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+	char c = undo_journal_byte(buffer, cursor - 1);
+	result_t res = text_buffer_remove(buffer);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	undo_record_t *last = undo_journal_last(journal);
+	if (last != NULL && last->inserted_length > 0 &&
+	    last->offset + last->inserted_length == cursor) {
+		// backspacing over text typed in this record just takes it back out
+		journal->arena_length--;
+		last->inserted_length--;
+		if (!last->removed_length && !last->inserted_length) {
+			journal->current--;
+			journal->count--;
+		}
+	} else if (last != NULL && !last->inserted_length &&
+	           last->offset == cursor) {
+		if (undo_journal_reserve(journal, 1) != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		memmove(&journal->arena[last->data + 1], &journal->arena[last->data],
+		    last->removed_length);
+		journal->arena[last->data] = c;
+		journal->arena_length++;
+		last->offset--;
+		last->removed_length++;
+	} else {
+		undo_record_t *record;
+		if (undo_journal_push(journal, cursor - 1, 1, 0, &record) !=
+		    NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->arena[record->data] = c;
+	}
+	journal->coalesce = 1;
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_delete(undo_journal_t *journal, text_buffer_t *buffer) {
+	long cursor = text_buffer_cursor(buffer);
+	if (cursor == text_buffer_size(buffer)) {
+		error("no character after the cursor!");
+		return TEXT_BUFFER_ERROR;
+	}
+	char c = undo_journal_byte(buffer, cursor);
+	result_t res = text_buffer_delete(buffer);
+	if (res != NO_ERROR) {
+		return res;
+	}
+
+	undo_record_t *last = undo_journal_last(journal);
+	if (last != NULL && !last->inserted_length && last->offset == cursor) {
+		if (undo_journal_reserve(journal, 1) != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->arena[journal->arena_length++] = c;
+		last->removed_length++;
+	} else {
+		undo_record_t *record;
+		if (undo_journal_push(journal, cursor, 1, 0, &record) != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->arena[record->data] = c;
+	}
+	journal->coalesce = 1;
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_insert(undo_journal_t *journal, text_buffer_t *buffer,
+    const char *data, long length) {
+	long cursor = text_buffer_cursor(buffer);
+	return undo_journal_replace(journal, buffer, cursor, cursor, data, length);
+}
+
+result_t undo_journal_delete_range(
+    undo_journal_t *journal, text_buffer_t *buffer, long start, long end) {
+	return undo_journal_replace(journal, buffer, start, end, NULL, 0);
+}
+
+// swaps [start, end) for data as a single record, leaving the cursor after it
+result_t undo_journal_replace(undo_journal_t *journal, text_buffer_t *buffer,
+    long start, long end, const char *data, long length) {
+	if (start < 0 || end > text_buffer_size(buffer) || start > end ||
+	    length < 0) {
+		error("replace range must be within the buffer!");
+		return TEXT_BUFFER_ERROR;
+	}
+	journal->coalesce = 0;
+
+	long removed = end - start;
+	if (journal->limit &&
+	    removed + length + (long)sizeof(undo_record_t) > journal->limit) {
+		// it would be trimmed straight away, so don't copy it in the first place
+		warn("edit is bigger than the undo limit, undo history cleared");
+		undo_journal_clear(journal);
+	} else if (removed || length) {
+		undo_record_t *record;
+		result_t res =
+		    undo_journal_push(journal, start, removed, length, &record);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		undo_journal_copy(buffer, start, end, &journal->arena[record->data]);
+		if (length) {
+			memcpy(&journal->arena[record->data + removed], data, length);
+		}
+		undo_journal_trim(journal);
+	}
+
+	result_t res = text_buffer_delete_range(buffer, start, end);
+	if (res != NO_ERROR) {
+		return undo_journal_lost(journal);
+	}
+	res = text_buffer_insert(buffer, data, length);
+	if (res != NO_ERROR) {
+		return undo_journal_lost(journal);
+	}
+
+	return NO_ERROR;
+}
+
+// every edit gets its own record at the offset it lands on when they are
+// applied left to right, which is also the order they are redone in
+result_t undo_journal_insert_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, const char *data,
+    long length) {
+	journal->coalesce = 0;
+	long start = journal->current;
+	for (long i = 0; i < count && length > 0; i++) {
+		undo_record_t *record;
+		result_t res = undo_journal_push(
+		    journal, offsets[i] + i * length, 0, length, &record);
+		if (res != NO_ERROR) {
+			journal->current = journal->count = start;
+			return res;
+		}
+		record->group = i > 0;
+		memcpy(&journal->arena[record->data], data, length);
+	}
+
+	result_t res =
+	    text_buffer_insert_at_each(buffer, offsets, count, data, length);
+	if (res != NO_ERROR) {
+		journal->current = journal->count = start;
+		return res;
+	}
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_delete_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, long length) {
+	journal->coalesce = 0;
+	long start = journal->current;
+	long size = text_buffer_size(buffer);
+	for (long i = 0; i < count && length > 0; i++) {
+		if (offsets[i] < 0 || offsets[i] + length > size) {
+			break;
+		}
+		undo_record_t *record;
+		result_t res = undo_journal_push(
+		    journal, offsets[i] - i * length, length, 0, &record);
+		if (res != NO_ERROR) {
+			journal->current = journal->count = start;
+			return res;
+		}
+		record->group = i > 0;
+		undo_journal_copy(buffer, offsets[i], offsets[i] + length,
+		    &journal->arena[record->data]);
+	}
+
+	result_t res = text_buffer_delete_at_each(buffer, offsets, count, length);
+	if (res != NO_ERROR) {
+		journal->current = journal->count = start;
+		return res;
+	}
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+// like the other edits at each offset, every range is recorded where it lands
+// when they're made left to right. the whole replace is one group.
+result_t undo_journal_replace_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, long removed,
+    const char *data, long length) {
+	journal->coalesce = 0;
+	long size = text_buffer_size(buffer);
+	long bytes = count * (removed + length + (long)sizeof(undo_record_t));
+	if (journal->limit && bytes > journal->limit) {
+		warn("edit is bigger than the undo limit, undo history cleared");
+		undo_journal_clear(journal);
+		return text_buffer_replace_at_each(
+		    buffer, offsets, count, removed, data, length);
+	}
+
+	long start = journal->current;
+	for (long i = 0; i < count && (removed > 0 || length > 0); i++) {
+		if (offsets[i] < 0 || offsets[i] + removed > size) {
+			break;
+		}
+		undo_record_t *record;
+		result_t res = undo_journal_push(journal,
+		    offsets[i] + i * (length - removed), removed, length, &record);
+		if (res != NO_ERROR) {
+			journal->current = journal->count = start;
+			return res;
+		}
+		record->group = i > 0;
+		undo_journal_copy(buffer, offsets[i], offsets[i] + removed,
+		    &journal->arena[record->data]);
+		if (length) {
+			memcpy(&journal->arena[record->data + removed], data, length);
+		}
+	}
+
+	result_t res = text_buffer_replace_at_each(
+	    buffer, offsets, count, removed, data, length);
+	if (res != NO_ERROR) {
+		journal->current = journal->count = start;
+		return res;
+	}
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+// each change is recorded at its start, which the changes after it don't
+// move, so undoing them first to last and redoing them last to first works
+result_t undo_journal_replace_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const undo_change_t *changes, long count) {
+	long size = text_buffer_size(buffer);
+	long bytes = 0;
+	for (long i = 0; i < count; i++) {
+		if (changes[i].start < (i ? changes[i - 1].end : 0) ||
+		    changes[i].start > changes[i].end || changes[i].end > size ||
+		    changes[i].length < 0) {
+			error("replace ranges must be ascending and within the buffer!");
+			return TEXT_BUFFER_ERROR;
+		}
+		bytes += changes[i].end - changes[i].start + changes[i].length +
+		         (long)sizeof(undo_record_t);
+	}
+	journal->coalesce = 0;
+
+	// where the cursor's text ends up, text it was in the middle of has gone
+	long cursor = text_buffer_cursor(buffer);
+	long moved = cursor;
+	for (long i = 0; i < count && changes[i].start < cursor; i++) {
+		long removed = changes[i].end - changes[i].start;
+		if (changes[i].end <= cursor) {
+			moved += changes[i].length - removed;
+		} else {
+			long into = cursor - changes[i].start;
+			long kept = into < changes[i].length ? into : changes[i].length;
+			moved += kept - into;
+			break;
+		}
+	}
+
+	if (journal->limit && bytes > journal->limit) {
+		warn("edit is bigger than the undo limit, undo history cleared");
+		undo_journal_clear(journal);
+	} else {
+		long start = journal->current;
+		long recorded = 0;
+		for (long i = count - 1; i >= 0; i--) {
+			long removed = changes[i].end - changes[i].start;
+			if (!removed && !changes[i].length) {
+				continue;
+			}
+			undo_record_t *record;
+			result_t res = undo_journal_push(
+			    journal, changes[i].start, removed, changes[i].length, &record);
+			if (res != NO_ERROR) {
+				journal->current = journal->count = start;
+				return res;
+			}
+			record->group = recorded++ > 0;
+			undo_journal_copy(buffer, changes[i].start, changes[i].end,
+			    &journal->arena[record->data]);
+			if (changes[i].length) {
+				memcpy(&journal->arena[record->data + removed], changes[i].data,
+				    changes[i].length);
+			}
+		}
+	}
+
+	for (long i = count - 1; i >= 0; i--) {
+		result_t res =
+		    text_buffer_delete_range(buffer, changes[i].start, changes[i].end);
+		if (res == NO_ERROR) {
+			res = text_buffer_insert(buffer, changes[i].data, changes[i].length);
+		}
+		if (res != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+	}
+	long distance = moved - text_buffer_cursor(buffer);
+	if (distance) {
+		text_buffer_move(buffer, distance);
+	}
+	undo_journal_trim(journal);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_undo(undo_journal_t *journal, text_buffer_t *buffer) {
+	if (journal->current == journal->first) {
+		error("nothing to undo!");
+		return TEXT_BUFFER_ERROR;
+	}
+	journal->coalesce = 0;
+
+	int group;
+	do {
+		undo_record_t *record = &journal->records[journal->current - 1];
+		result_t res = text_buffer_delete_range(
+		    buffer, record->offset, record->offset + record->inserted_length);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		res = text_buffer_insert(
+		    buffer, &journal->arena[record->data], record->removed_length);
+		if (res != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		group = record->group;
+		journal->current--;
+	} while (group && journal->current > journal->first);
+
+	return NO_ERROR;
+}
+
+result_t undo_journal_redo(undo_journal_t *journal, text_buffer_t *buffer) {
+	if (journal->current == journal->count) {
+		error("nothing to redo!");
+		return TEXT_BUFFER_ERROR;
+	}
+	journal->coalesce = 0;
+
+	do {
+		undo_record_t *record = &journal->records[journal->current];
+		result_t res = text_buffer_delete_range(
+		    buffer, record->offset, record->offset + record->removed_length);
+		if (res != NO_ERROR) {
+			return res;
+		}
+		res = text_buffer_insert(buffer,
+		    &journal->arena[record->data + record->removed_length],
+		    record->inserted_length);
+		if (res != NO_ERROR) {
+			return undo_journal_lost(journal);
+		}
+		journal->current++;
+	} while (journal->current < journal->count &&
+	         journal->records[journal->current].group);
+
+	return NO_ERROR;
+}
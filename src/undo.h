@@ -0,0 +1,108 @@
+/*
+	Copyright 2023 SentientCloud24
+
+	 Licensed under the Apache License, Version 2.0 (the "License");
+	 you may not use this file except in compliance with the License.
+	 You may obtain a copy of the License at
+
+			 http://www.apache.org/licenses/LICENSE-2.0
+
+	 Unless required by applicable law or agreed to in writing, software
+	 distributed under the License is distributed on an "AS IS" BASIS,
+	 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	 See the License for the specific language governing permissions and
+	 limitations under the License.
+*/
+
+
+#pragma once
+
+#include "result.h"
+#include "text_buffer.h"
+
+// single byte edits stop being merged into a record once it holds this much
+#define UNDO_COALESCE_LIMIT 4096
+
+/*
+every edit is one record saying the text at offset lost removed_length bytes
+and gained inserted_length bytes. the bytes themselves live back to back in
+the arena, removed first, so a record is just a few numbers. a grouped record
+is undone and redone together with the one before it.
+*/
+typedef struct undo_record_t {
+	long offset;
+	long removed_length;
+	long inserted_length;
+	long data;
+	int group;
+} undo_record_t;
+
+/*
+records [first, current) can be undone, [current, count) redone. a new edit
+drops the redo side. once the journal holds more than limit bytes the oldest
+records are forgotten, a limit of 0 keeps everything.
+*/
+typedef struct undo_journal_t {
+	undo_record_t *records;
+	long record_capacity;
+	long first;
+	long current;
+	long count;
+
+	char *arena;
+	long arena_capacity;
+	long arena_start;
+	long arena_length;
+
+	long limit;
+	int coalesce;
+} undo_journal_t;
+
+result_t undo_journal_create(undo_journal_t *journal, long limit);
+void undo_journal_destroy(undo_journal_t *journal);
+void undo_journal_clear(undo_journal_t *journal);
+
+long undo_journal_memory(const undo_journal_t *journal);
+
+// these edit the buffer at its cursor and record what they did
+result_t undo_journal_append(
+    undo_journal_t *journal, text_buffer_t *buffer, char c);
+result_t undo_journal_remove(undo_journal_t *journal, text_buffer_t *buffer);
+result_t undo_journal_delete(undo_journal_t *journal, text_buffer_t *buffer);
+result_t undo_journal_insert(undo_journal_t *journal, text_buffer_t *buffer,
+    const char *data, long length);
+result_t undo_journal_delete_range(
+    undo_journal_t *journal, text_buffer_t *buffer, long start, long end);
+result_t undo_journal_replace(undo_journal_t *journal, text_buffer_t *buffer,
+    long start, long end, const char *data, long length);
+
+// one edit at every cursor, recorded as a single group
+result_t undo_journal_insert_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, const char *data,
+    long length);
+result_t undo_journal_delete_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, long length);
+// the same replacement at every range, for replacing every match of a search
+result_t undo_journal_replace_at_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const long *offsets, long count, long removed,
+    const char *data, long length);
+
+// [start, end) of the buffer as it is, swapped for length bytes of data
+typedef struct undo_change_t {
+	long start;
+	long end;
+	const char *data;
+	long length;
+} undo_change_t;
+
+// ascending changes that don't overlap, made from the last so the offsets
+// hold and recorded as a single group. the cursor stays on the text it was
+// on, for changes that came from somewhere else.
+result_t undo_journal_replace_each(undo_journal_t *journal,
+    text_buffer_t *buffer, const undo_change_t *changes, long count);
+
+// stops the next edit from being merged into the last record
+void undo_journal_seal(undo_journal_t *journal);
+
+result_t undo_journal_undo(undo_journal_t *journal, text_buffer_t *buffer);
+result_t undo_journal_redo(undo_journal_t *journal, text_buffer_t *buffer);